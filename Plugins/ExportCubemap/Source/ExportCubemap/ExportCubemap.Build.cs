@@ -1,9 +1,17 @@
 // Copyright 1998-2017 Epic Games, Inc. All Rights Reserved.
 
+using System.IO;
 using UnrealBuildTool;
 
 public class ExportCubemap : ModuleRules
 {
+	// Copy of the header-only image code of the SceneExporter plugin, so the
+	// plugin builds on its own; Tests/ checks that the copies stay identical.
+	private string SharedPath
+	{
+		get { return Path.GetFullPath(Path.Combine(ModuleDirectory, "../Shared/")); }
+	}
+
 	public ExportCubemap(ReadOnlyTargetRules Target) : base(Target)
 	{
 		PCHUsage = ModuleRules.PCHUsageMode.UseExplicitOrSharedPCHs;
@@ -19,6 +27,7 @@ public class ExportCubemap : ModuleRules
 		PrivateIncludePaths.AddRange(
 			new string[] {
 				"ExportCubemap/Private",
+				SharedPath,
 				// ... add other private include paths required here ...
 			}
 			);
@@ -13,9 +13,20 @@
 #include "Developer/DesktopPlatform/Public/DesktopPlatformModule.h"
 #include "EditorDirectories.h"
 #include "Components/ReflectionCaptureComponent.h"
+#include "Misc/Paths.h"
+#include "Misc/SecureHash.h"
+#include "HAL/FileManager.h"
+#include "HAL/IConsoleManager.h"
+#include "Async/ParallelFor.h"
 #include <fstream>
+#include "ImageWriter.h"
+#include "RgbmEncode.h"
+#include "CubeFaceRemap.h"
+#include "BlockCompress.h"
 static const FName ExportCubemapTabName("ExportCubemap");
 
+DEFINE_LOG_CATEGORY_STATIC(ExportCubemap, Log, All);
+
 #define LOCTEXT_NAMESPACE "FExportCubemapModule"
 
 
@@ -108,6 +119,7 @@ const uint32 DDSF_VOLUME = 0x00200000;
 #define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT                  0x83F1
 #define GL_COMPRESSED_RGBA_S3TC_DXT3_EXT                  0x83F2
 #define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT                  0x83F3
+#define GL_COMPRESSED_RGBA_BPTC_UNORM                     0x8E8C
 
 #define GL_RGB                            0x1907
 #define GL_RGBA                           0x1908
@@ -184,76 +196,17 @@ void flip_blocks_dxtc3(DXTColBlock *line, unsigned int numBlocks) {
 ///////////////////////////////////////////////////////////////////////////////
 // flip a DXT5 alpha block
 void flip_dxt5_alpha(DXT5AlphaBlock *block) {
-	uint8_t gBits[4][4];
-
-	const uint32_t mask = 0x00000007;          // bits = 00 00 01 11
-	uint32_t bits = 0;
-	memcpy(&bits, &block->row[0], sizeof(uint8_t) * 3);
-
-	gBits[0][0] = (uint8_t)(bits & mask);
-	bits >>= 3;
-	gBits[0][1] = (uint8_t)(bits & mask);
-	bits >>= 3;
-	gBits[0][2] = (uint8_t)(bits & mask);
-	bits >>= 3;
-	gBits[0][3] = (uint8_t)(bits & mask);
-	bits >>= 3;
-	gBits[1][0] = (uint8_t)(bits & mask);
-	bits >>= 3;
-	gBits[1][1] = (uint8_t)(bits & mask);
-	bits >>= 3;
-	gBits[1][2] = (uint8_t)(bits & mask);
-	bits >>= 3;
-	gBits[1][3] = (uint8_t)(bits & mask);
-
-	bits = 0;
-	memcpy(&bits, &block->row[3], sizeof(uint8_t) * 3);
-
-	gBits[2][0] = (uint8_t)(bits & mask);
-	bits >>= 3;
-	gBits[2][1] = (uint8_t)(bits & mask);
-	bits >>= 3;
-	gBits[2][2] = (uint8_t)(bits & mask);
-	bits >>= 3;
-	gBits[2][3] = (uint8_t)(bits & mask);
-	bits >>= 3;
-	gBits[3][0] = (uint8_t)(bits & mask);
-	bits >>= 3;
-	gBits[3][1] = (uint8_t)(bits & mask);
-	bits >>= 3;
-	gBits[3][2] = (uint8_t)(bits & mask);
-	bits >>= 3;
-	gBits[3][3] = (uint8_t)(bits & mask);
-
-	uint32_t *pBits = ((uint32_t*) &(block->row[0]));
-
-	*pBits = *pBits | (gBits[3][0] << 0);
-	*pBits = *pBits | (gBits[3][1] << 3);
-	*pBits = *pBits | (gBits[3][2] << 6);
-	*pBits = *pBits | (gBits[3][3] << 9);
-
-	*pBits = *pBits | (gBits[2][0] << 12);
-	*pBits = *pBits | (gBits[2][1] << 15);
-	*pBits = *pBits | (gBits[2][2] << 18);
-	*pBits = *pBits | (gBits[2][3] << 21);
-
-	pBits = ((uint32_t*) &(block->row[3]));
-
-#ifdef MACOS
-	*pBits &= 0x000000ff;
-#else
-	*pBits &= 0xff000000;
-#endif
-
-	*pBits = *pBits | (gBits[1][0] << 0);
-	*pBits = *pBits | (gBits[1][1] << 3);
-	*pBits = *pBits | (gBits[1][2] << 6);
-	*pBits = *pBits | (gBits[1][3] << 9);
-
-	*pBits = *pBits | (gBits[0][0] << 12);
-	*pBits = *pBits | (gBits[0][1] << 15);
-	*pBits = *pBits | (gBits[0][2] << 18);
-	*pBits = *pBits | (gBits[0][3] << 21);
+	// 16 3 bit indices, 12 bits per row of four texels, in the 48 bits
+	// after the endpoints; only those 6 bytes are read and written.
+	uint64_t bits = 0;
+	memcpy(&bits, block->row, sizeof(block->row));
+
+	uint64_t flipped = 0;
+	for (int row = 0; row < 4; row++) {
+		flipped |= ((bits >> (row * 12)) & 0xfff) << ((3 - row) * 12);
+	}
+
+	memcpy(block->row, &flipped, sizeof(block->row));
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -392,13 +345,14 @@ class CSurface {
 public:
 	CSurface();
 	CSurface(unsigned int w, unsigned int h, unsigned int d, unsigned int imgsize, const uint8 *pixels);
-	CSurface(const CSurface &copy);
-	CSurface &operator=(const CSurface &rhs);
+	CSurface(CSurface &&other);
+	CSurface &operator=(CSurface &&rhs);
 	virtual ~CSurface();
 
 	operator uint8*() const;
 
 	virtual void create(unsigned int w, unsigned int h, unsigned int d, unsigned int imgsize, const uint8 *pixels);
+	virtual void attach(unsigned int w, unsigned int h, unsigned int d, unsigned int imgsize, uint8 *pixels);
 	virtual void clear();
 
 	unsigned int get_width() const {
@@ -413,14 +367,25 @@ public:
 	unsigned int get_size() const {
 		return m_size;
 	}
+	bool owns_pixels() const {
+		return m_owner;
+	}
 
 	friend class CTexture;
+
+private:
+	CSurface(const CSurface &copy) = delete;
+	CSurface &operator=(const CSurface &rhs) = delete;
+
+	void take(CSurface &other);
+
 	unsigned int m_width;
 	unsigned int m_height;
 	unsigned int m_depth;
 	unsigned int m_size;
 
 	uint8 *m_pixels;
+	bool m_owner;
 };
 
 //////////////////////////////////////////////////////////////////////////////
@@ -430,46 +395,29 @@ public:
 ///////////////////////////////////////////////////////////////////////////////
 // default constructor
 CSurface::CSurface() :
-	m_width(0), m_height(0), m_depth(0), m_size(0), m_pixels(NULL) {
+	m_width(0), m_height(0), m_depth(0), m_size(0), m_pixels(NULL), m_owner(false) {
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-// creates an empty image
+// creates an image holding a copy of pixels
 CSurface::CSurface(unsigned int w, unsigned int h, unsigned int d, unsigned int imgsize, const uint8 *pixels) :
-	m_width(0), m_height(0), m_depth(0), m_size(0), m_pixels(NULL) {
+	m_width(0), m_height(0), m_depth(0), m_size(0), m_pixels(NULL), m_owner(false) {
 	create(w, h, d, imgsize, pixels);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-// copy constructor
-CSurface::CSurface(const CSurface &copy) :
-	m_width(0), m_height(0), m_depth(0), m_size(0), m_pixels(NULL) {
-	if (copy.get_size() != 0) {
-		m_size = copy.get_size();
-		m_width = copy.get_width();
-		m_height = copy.get_height();
-		m_depth = copy.get_depth();
-
-		m_pixels = new uint8_t[m_size];
-		memcpy(m_pixels, copy, m_size);
-	}
+// move constructor, other is left empty
+CSurface::CSurface(CSurface &&other) :
+	m_width(0), m_height(0), m_depth(0), m_size(0), m_pixels(NULL), m_owner(false) {
+	take(other);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-// assignment operator
-CSurface &CSurface::operator=(const CSurface &rhs) {
+// move assignment, rhs is left empty
+CSurface &CSurface::operator=(CSurface &&rhs) {
 	if (this != &rhs) {
-		clear();
-
-		if (rhs.get_size()) {
-			m_size = rhs.get_size();
-			m_width = rhs.get_width();
-			m_height = rhs.get_height();
-			m_depth = rhs.get_depth();
-
-			m_pixels = new uint8[m_size];
-			memcpy(m_pixels, rhs, m_size);
-		}
+		CSurface::clear();
+		take(rhs);
 	}
 
 	return *this;
@@ -478,7 +426,7 @@ CSurface &CSurface::operator=(const CSurface &rhs) {
 ///////////////////////////////////////////////////////////////////////////////
 // clean up image memory
 CSurface::~CSurface() {
-	clear();
+	CSurface::clear();
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -488,26 +436,54 @@ CSurface::operator uint8_t*() const {
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-// creates an empty image
+// copies pixels into memory owned by the surface
 void CSurface::create(unsigned int w, unsigned int h, unsigned int d, unsigned int imgsize, const uint8 *pixels) {
 
-	clear();
+	CSurface::clear();
 
 	m_width = w;
 	m_height = h;
 	m_depth = d;
 	m_size = imgsize;
 	m_pixels = new uint8_t[imgsize];
+	m_owner = true;
 	memcpy(m_pixels, pixels, imgsize);
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// refers to pixels owned by the caller, which have to outlive the surface
+void CSurface::attach(unsigned int w, unsigned int h, unsigned int d, unsigned int imgsize, uint8 *pixels) {
+
+	CSurface::clear();
+
+	m_width = w;
+	m_height = h;
+	m_depth = d;
+	m_size = imgsize;
+	m_pixels = pixels;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // free surface memory
 void CSurface::clear() {
-	if (m_pixels != NULL) {
+	if (m_owner) {
 		delete[] m_pixels;
-		m_pixels = NULL;
 	}
+	m_pixels = NULL;
+	m_owner = false;
+}
+
+void CSurface::take(CSurface &other) {
+	m_width = other.m_width;
+	m_height = other.m_height;
+	m_depth = other.m_depth;
+	m_size = other.m_size;
+	m_pixels = other.m_pixels;
+	m_owner = other.m_owner;
+
+	other.m_width = other.m_height = other.m_depth = other.m_size = 0;
+	other.m_pixels = NULL;
+	other.m_owner = false;
 }
 
 class CTexture : public CSurface {
@@ -516,11 +492,12 @@ class CTexture : public CSurface {
 public:
 	CTexture();
 	CTexture(unsigned int w, unsigned int h, unsigned int d, unsigned int imgsize, const uint8_t *pixels);
-	CTexture(const CTexture &copy);
-	CTexture &operator=(const CTexture &rhs);
+	CTexture(CTexture &&other);
+	CTexture &operator=(CTexture &&rhs);
 	~CTexture();
 
 	void create(unsigned int w, unsigned int h, unsigned int d, unsigned int imgsize, const uint8_t *pixels);
+	void attach(unsigned int w, unsigned int h, unsigned int d, unsigned int imgsize, uint8_t *pixels);
 	void clear();
 
 	const CSurface &get_mipmap(unsigned int index) const {
@@ -528,42 +505,14 @@ public:
 		return m_mipmaps[index];
 	}
 
-	void add_mipmap(const CSurface &mipmap) {
-		m_mipmaps.Push(mipmap);
+	void add_mipmap(CSurface &&mipmap) {
+		m_mipmaps.Add(MoveTemp(mipmap));
 	}
 
 	unsigned int get_num_mipmaps() const {
 		return (unsigned int)m_mipmaps.Num();
 	}
 
-	void FlipX()
-	{
-		uint32* buffer = (uint32*)m_pixels;
-		for (uint32 i(0); i < m_height; ++i)
-		{
-			for (uint32 j(0); j < (m_width >> 1); ++j)
-			{
-				uint32 temp = buffer[i * m_width + j];
-				buffer[i * m_width + j] = buffer[i * m_width + m_width - j - 1];
-				buffer[i * m_width + m_width - j - 1] = temp;
-			}
-		}
-
-		for (auto& sur : m_mipmaps)
-		{
-			buffer = (uint32*)sur.m_pixels;
-			for (uint32 i(0); i < sur.m_height; ++i)
-			{
-				for (uint32 j(0); j < (sur.m_width >> 1); ++j)
-				{
-					uint32 temp = buffer[i * sur.m_width + j];
-					buffer[i * sur.m_width + j] = buffer[i * sur.m_width + sur.m_width - j - 1];
-					buffer[i * sur.m_width + sur.m_width - j - 1] = temp;
-				}
-			}
-		}
-	}
-
 protected:
 	CSurface &get_mipmap(unsigned int index) {
 
@@ -586,7 +535,7 @@ CTexture::CTexture() :
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-// creates an empty texture
+// creates a texture holding a copy of pixels
 CTexture::CTexture(unsigned int w, unsigned int h, unsigned int d, unsigned int imgsize, const uint8 *pixels) :
 	CSurface(w, h, d, imgsize, pixels)  // initialize base class part
 {
@@ -596,22 +545,17 @@ CTexture::~CTexture() {
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-// copy constructor
-CTexture::CTexture(const CTexture &copy) :
-	CSurface(copy) {
-	for (unsigned int i = 0; i < copy.get_num_mipmaps(); i++)
-		m_mipmaps.Push(copy.get_mipmap(i));
+// move constructor
+CTexture::CTexture(CTexture &&other) :
+	CSurface(MoveTemp(other)), m_mipmaps(MoveTemp(other.m_mipmaps)) {
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-// assignment operator
-CTexture &CTexture::operator=(const CTexture &rhs) {
+// move assignment
+CTexture &CTexture::operator=(CTexture &&rhs) {
 	if (this != &rhs) {
-		CSurface::operator =(rhs);
-
-		m_mipmaps.Empty();
-		for (unsigned int i = 0; i < rhs.get_num_mipmaps(); i++)
-			m_mipmaps.Push(rhs.get_mipmap(i));
+		CSurface::operator =(MoveTemp(rhs));
+		m_mipmaps = MoveTemp(rhs.m_mipmaps);
 	}
 
 	return *this;
@@ -623,22 +567,28 @@ void CTexture::create(unsigned int w, unsigned int h, unsigned int d, unsigned i
 	m_mipmaps.Empty();
 }
 
+void CTexture::attach(unsigned int w, unsigned int h, unsigned int d, unsigned int imgsize, uint8 *pixels) {
+	CSurface::attach(w, h, d, imgsize, pixels);
+
+	m_mipmaps.Empty();
+}
+
 void CTexture::clear() {
 	CSurface::clear();
 
 	m_mipmaps.Empty();
 }
 
-
 class CDDSImage {
 public:
 	CDDSImage();
 	~CDDSImage();
 
-	void create_textureFlat(unsigned int format, unsigned int components, const CTexture &baseImage);
-	void create_texture3D(unsigned int format, unsigned int components, const CTexture &baseImage);
-	void create_textureCubemap(unsigned int format, unsigned int components, const CTexture &positiveX, const CTexture &negativeX, const CTexture &positiveY,
-		const CTexture &negativeY, const CTexture &positiveZ, const CTexture &negativeZ);
+	// the textures are moved in; surfaces attached to caller memory stay views of it
+	void create_textureFlat(unsigned int format, unsigned int components, CTexture &&baseImage);
+	void create_texture3D(unsigned int format, unsigned int components, CTexture &&baseImage);
+	void create_textureCubemap(unsigned int format, unsigned int components, CTexture &&positiveX, CTexture &&negativeX, CTexture &&positiveY,
+		CTexture &&negativeY, CTexture &&positiveZ, CTexture &&negativeZ);
 
 	void clear();
 
@@ -721,9 +671,7 @@ private:
 	}
 
 	void flip(CSurface &surface);
-	void flip_texture(CTexture &texture);
 
-	void write_texture(const CTexture &texture, std::ostream& os);
 
 	unsigned int m_format;
 	unsigned int m_components;
@@ -745,7 +693,7 @@ CDDSImage::CDDSImage() :
 CDDSImage::~CDDSImage() {
 }
 
-void CDDSImage::create_textureFlat(unsigned int format, unsigned int components, const CTexture &baseImage) {
+void CDDSImage::create_textureFlat(unsigned int format, unsigned int components, CTexture &&baseImage) {
 
 	// remove any existing images
 	clear();
@@ -754,12 +702,12 @@ void CDDSImage::create_textureFlat(unsigned int format, unsigned int components,
 	m_components = components;
 	m_type = TextureFlat;
 
-	m_images.Push(baseImage);
+	m_images.Add(MoveTemp(baseImage));
 
 	m_valid = true;
 }
 
-void CDDSImage::create_texture3D(unsigned int format, unsigned int components, const CTexture &baseImage) {
+void CDDSImage::create_texture3D(unsigned int format, unsigned int components, CTexture &&baseImage) {
 
 	// remove any existing images
 	clear();
@@ -768,7 +716,7 @@ void CDDSImage::create_texture3D(unsigned int format, unsigned int components, c
 	m_components = components;
 	m_type = Texture3D;
 
-	m_images.Push(baseImage);
+	m_images.Add(MoveTemp(baseImage));
 
 	m_valid = true;
 }
@@ -784,8 +732,8 @@ inline bool same_size(const CTexture &a, const CTexture &b) {
 	return true;
 }
 
-void CDDSImage::create_textureCubemap(unsigned int format, unsigned int components, const CTexture &positiveX, const CTexture &negativeX,
-	const CTexture &positiveY, const CTexture &negativeY, const CTexture &positiveZ, const CTexture &negativeZ) {
+void CDDSImage::create_textureCubemap(unsigned int format, unsigned int components, CTexture &&positiveX, CTexture &&negativeX,
+	CTexture &&positiveY, CTexture &&negativeY, CTexture &&positiveZ, CTexture &&negativeZ) {
 
 
 
@@ -796,12 +744,12 @@ void CDDSImage::create_textureCubemap(unsigned int format, unsigned int componen
 	m_components = components;
 	m_type = TextureCubemap;
 
-	m_images.Push(positiveX);
-	m_images.Push(negativeX);
-	m_images.Push(positiveY);
-	m_images.Push(negativeY);
-	m_images.Push(positiveZ);
-	m_images.Push(negativeZ);
+	m_images.Add(MoveTemp(positiveX));
+	m_images.Add(MoveTemp(negativeX));
+	m_images.Add(MoveTemp(positiveY));
+	m_images.Add(MoveTemp(negativeY));
+	m_images.Add(MoveTemp(positiveZ));
+	m_images.Add(MoveTemp(negativeZ));
 
 	m_valid = true;
 }
@@ -981,130 +929,59 @@ void CDDSImage::load(std::istream& is, bool flipImage) {
 
 	// swap cubemaps on y axis (since image is flipped in OGL)
 	if (m_type == TextureCubemap && flipImage) {
-		CTexture tmp;
-		tmp = m_images[3];
-		m_images[3] = m_images[2];
-		m_images[2] = tmp;
+		m_images.Swap(2, 3);
 	}
 
 	m_valid = true;
 }
 
-void CDDSImage::write_texture(const CTexture &texture, std::ostream& os) {
-
-	os.write((char*)(uint8_t*)texture, texture.get_size());
-
-	for (unsigned int i = 0; i < texture.get_num_mipmaps(); i++) {
-		const CSurface &mipmap = texture.get_mipmap(i);
-		os.write((char*)(uint8_t*)mipmap, mipmap.get_size());
-	}
-}
-
 void CDDSImage::save(const FString& filename, bool flipImage) {
-
-
-	DDS_HEADER ddsh;
-	unsigned int headerSize = sizeof(DDS_HEADER);
-	memset(&ddsh, 0, headerSize);
-	ddsh.dwSize = headerSize;
-	ddsh.dwFlags = DDSD_CAPS | DDSD_WIDTH | DDSD_HEIGHT | DDSD_PIXELFORMAT;
-	ddsh.dwHeight = get_height();
-	ddsh.dwWidth = get_width();
-
-	if (is_compressed()) {
-		ddsh.dwFlags |= DDSD_LINEARSIZE;
-		ddsh.dwLinearSize = get_size();
-	}
-	else {
-		ddsh.dwFlags |= DDSD_PITCH;
-		ddsh.dwLinearSize = get_dword_aligned_linesize(get_width(), m_components * 8);
-	}
-
 	if (m_type == Texture3D) {
-		ddsh.dwFlags |= DDSD_DEPTH;
-		ddsh.dwDepth = get_depth();
-	}
-
-	if (get_num_mipmaps() > 0) {
-		ddsh.dwFlags |= DDSD_MIPMAPCOUNT;
-		ddsh.dwMipMapCount = get_num_mipmaps() + 1;
+		UE_LOG(ExportCubemap, Warning, TEXT("Volume textures can not be saved as DDS."));
+		return;
 	}
 
-	ddsh.ddpf.dwSize = sizeof(DDS_PIXELFORMAT);
-
-	if (is_compressed()) {
-		ddsh.ddpf.dwFlags = DDPF_FOURCC;
-
-		if (m_format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT)
-			ddsh.ddpf.dwFourCC = FOURCC_DXT1;
-		if (m_format == GL_COMPRESSED_RGBA_S3TC_DXT3_EXT)
-			ddsh.ddpf.dwFourCC = FOURCC_DXT3;
-		if (m_format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)
-			ddsh.ddpf.dwFourCC = FOURCC_DXT5;
-	}
-	else {
-		ddsh.ddpf.dwFlags = (m_components == 4) ? DDSF_RGBA : DDPF_RGB;
-		ddsh.ddpf.dwRGBBitCount = m_components * 8;
-		ddsh.ddpf.dwRBitMask = 0x00ff0000;
-		ddsh.ddpf.dwGBitMask = 0x0000ff00;
-		ddsh.ddpf.dwBBitMask = 0x000000ff;
-
-		if (m_components == 4) {
-			ddsh.ddpf.dwFlags |= DDPF_ALPHAPIXELS;
-			ddsh.ddpf.dwABitMask = 0xff000000;
+	image::Format eFormat = (m_components == 4) ? image::Format::BGRA8 : image::Format::BGR8;
+	if (m_format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT)
+		eFormat = image::Format::BC1;
+	else if (m_format == GL_COMPRESSED_RGBA_S3TC_DXT3_EXT)
+		eFormat = image::Format::BC2;
+	else if (m_format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)
+		eFormat = image::Format::BC3;
+	else if (m_format == GL_COMPRESSED_RGBA_BPTC_UNORM)
+		eFormat = image::Format::BC7;
+
+	// the writer emits rows, or flipped block rows, bottom up straight from the
+	// surfaces, which are never modified; without flipImage they are taken to be
+	// in file order already, as a producer that writes bottom up leaves them
+	const uint32 uOrientation = flipImage ? image::BottomUp : image::TopDown;
+	const int32 iFaces = (m_type == TextureCubemap) ? 6 : 1;
+	const uint32 uMips = get_num_mipmaps() + 1;
+
+	TArray<image::View> aryViews;
+	aryViews.Reserve(iFaces * uMips);
+	for (int32 i = 0; i < iFaces; i++) {
+		// swap cubemaps on y axis (since image is flipped in OGL)
+		int32 iSource = i;
+		if (m_type == TextureCubemap && i == 2)
+			iSource = 3;
+		else if (m_type == TextureCubemap && i == 3)
+			iSource = 2;
+
+		const CTexture* pkFace = &m_images[iSource];
+
+		aryViews.Add(image::MakeView((const uint8_t*)*pkFace, pkFace->get_width(), pkFace->get_height(), eFormat, uOrientation));
+		for (unsigned int j = 0; j < pkFace->get_num_mipmaps(); j++) {
+			const CSurface &mipmap = pkFace->get_mipmap(j);
+			aryViews.Add(image::MakeView((const uint8_t*)mipmap, mipmap.get_width(), mipmap.get_height(), eFormat, uOrientation));
 		}
 	}
 
-	ddsh.dwCaps = DDSCAPS_TEXTURE;
-
-	if (m_type == TextureCubemap) {
-		ddsh.dwCaps |= DDSCAPS_COMPLEX;
-		ddsh.dwCaps2 = DDSF_CUBEMAP | DDSF_CUBEMAP_ALL_FACES;
-	}
-
-	if (m_type == Texture3D) {
-		ddsh.dwCaps |= DDSCAPS_COMPLEX;
-		ddsh.dwCaps2 = DDSF_VOLUME;
-	}
-
-	if (get_num_mipmaps() > 0)
-		ddsh.dwCaps |= DDSCAPS_COMPLEX | DDSCAPS_MIPMAP;
-
-	// open file
-	std::ofstream of;
-	of.exceptions(std::ios::failbit);
-	of.open(*filename, std::ios::binary);
-
-	// write file header
-	of.write("DDS ", 4);
-
-	// write dds header
-	of.write((char*)&ddsh, sizeof(DDS_HEADER));
-
-	if (m_type != TextureCubemap) {
-		CTexture tex = m_images[0];
-		if (flipImage)
-			flip_texture(tex);
-		write_texture(tex, of);
-	}
-	else {
-
-
-		for (int i = 0; i < m_images.Num(); i++) {
-			CTexture cubeFace;
-
-			if (i == 2)
-				cubeFace = m_images[3];
-			else if (i == 3)
-				cubeFace = m_images[2];
-			else
-				cubeFace = m_images[i];
-
-			if (flipImage)
-				flip_texture(cubeFace);
-			write_texture(cubeFace, of);
-		}
-	}
+	// streamed to the file as the writer produces rows; no copy of the whole file is made
+	std::ofstream of(*filename, std::ios::binary);
+	image::StreamSink sink(of);
+	if (!image::WriteDDS(sink, aryViews.GetData(), iFaces, uMips))
+		UE_LOG(ExportCubemap, Warning, TEXT("Failed to write \"%s\"."), *filename);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -1122,7 +999,8 @@ void CDDSImage::clear() {
 bool CDDSImage::is_compressed() {
 	return (m_format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT)
 		|| (m_format == GL_COMPRESSED_RGBA_S3TC_DXT3_EXT)
-		|| (m_format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT);
+		|| (m_format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)
+		|| (m_format == GL_COMPRESSED_RGBA_BPTC_UNORM);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -1228,14 +1106,6 @@ void CDDSImage::flip(CSurface &surface) {
 	}
 }
 
-void CDDSImage::flip_texture(CTexture &texture) {
-	flip(texture);
-
-	for (unsigned int i = 0; i < texture.get_num_mipmaps(); i++) {
-		flip(texture.get_mipmap(i));
-	}
-}
-
 FColor RGBMEncode(FLinearColor Color)
 {
 	FColor Encoded;
@@ -1266,56 +1136,6 @@ FColor RGBMEncode(FLinearColor Color)
 	return Encoded;
 }
 
-void CubeFace2UNITY(int32 face, FMatrix &matrix, int32 size)
-{
-	FMatrix temp1, temp2, temp3;
-	matrix.SetIdentity();
-	temp1.SetIdentity();
-	temp1.SetOrigin(FVector(-0.5f * (size - 1), -0.5f * (size - 1), 0.f));
-	temp2.SetIdentity();
-	temp3.SetIdentity();
-	temp3.SetOrigin(FVector(0.5f * (size - 1), 0.5f * (size - 1), 0.f));
-	switch (face)
-	{
-	case 0:
-	{
-		temp2.M[0][0] = 0;
-		temp2.M[0][1] = -1;
-		temp2.M[1][0] = 1;
-		temp2.M[1][1] = 0;
-		matrix = temp1*temp2*temp3;
-	}
-	break;
-	case 1:
-	{
-		temp2.M[0][0] = 0;
-		temp2.M[0][1] = 1;
-		temp2.M[1][0] = -1;
-		temp2.M[1][1] = 0;
-		matrix = temp1*temp2*temp3;
-	}
-	break;
-	case 3:
-	{
-		temp2.M[0][0] = 1;
-		//temp2.M[0][1] = 1;
-		//temp2.M[1][0] = -1;
-		temp2.M[1][1] = -1;
-		matrix = temp1*temp2*temp3;
-	}
-	break;
-	case 5:
-	{
-		temp2.M[0][0] = -1;
-		//temp2.M[0][1] = 1;
-		//temp2.M[1][0] = -1;
-		temp2.M[1][1] = -1;
-		matrix = temp1*temp2*temp3;
-	}
-	break;
-	}
-}
-
 static void EdgeWalkSetup(bool ReverseDirection, int32 Edge, int32 MipSize, int32& EdgeStart, int32& EdgeStep)
 {
 	if (ReverseDirection)
@@ -1364,33 +1184,20 @@ static void EdgeWalkSetup(bool ReverseDirection, int32 Edge, int32 MipSize, int3
 	}
 }
 
-void GetFaceData(TArray<uint8> &writeData, const uint8 *data, int32 face, int32 size)
+// Writes the rows bottom up, the order they have in a DDS file.
+void GetFaceData(uint8 *writeData, const uint8 *data, int32 face, int32 size)
 {
-	FMatrix matrix;
-	CubeFace2UNITY(face, matrix, size);
-	for (int32 y = 0; y < size; ++y)
-	{
-		for (int32 x = 0; x < size; ++x)
-		{
-			FVector v = matrix.TransformPosition(FVector(x, y, 0));
-			writeData[v.Y*size * 4 + v.X * 4] = data[y*size * 4 + x * 4];
-			writeData[v.Y*size * 4 + v.X * 4 + 1] = data[y*size * 4 + x * 4 + 1];
-			writeData[v.Y*size * 4 + v.X * 4 + 2] = data[y*size * 4 + x * 4 + 2];
-			writeData[v.Y*size * 4 + v.X * 4 + 3] = data[y*size * 4 + x * 4 + 3];
-		}
-	}
+	cubeface::Remap(cubeface::GetUnityRotation(face), data, writeData, size, true);
 }
 
-TRefCountPtr<FReflectionCaptureUncompressedData> GenerateFromDerivedDataSource(const FReflectionCaptureFullHDR& FullHDRData)
+TRefCountPtr<FReflectionCaptureUncompressedData> GenerateFromDerivedDataSource(FReflectionCaptureUncompressedData& SourceCubemapData, int32 CubemapSize)
 {
-	const int32 NumMips = FMath::CeilLogTwo(FullHDRData.CubemapSize) + 1;
-
-	TRefCountPtr<FReflectionCaptureUncompressedData> SourceCubemapData = FullHDRData.GetUncompressedData();
+	const int32 NumMips = FMath::CeilLogTwo(CubemapSize) + 1;
 
 	int32 SourceMipBaseIndex = 0;
 	int32 DestMipBaseIndex = 0;
 
-	TRefCountPtr<FReflectionCaptureUncompressedData> CapturedData = new FReflectionCaptureUncompressedData(SourceCubemapData->Size() * sizeof(FColor) / sizeof(FFloat16Color));
+	TRefCountPtr<FReflectionCaptureUncompressedData> CapturedData = new FReflectionCaptureUncompressedData(SourceCubemapData.Size() * sizeof(FColor) / sizeof(FFloat16Color));
 
 	// Note: change REFLECTIONCAPTURE_ENCODED_DERIVEDDATA_VER when modifying the encoded data layout or contents
 
@@ -1400,7 +1207,7 @@ TRefCountPtr<FReflectionCaptureUncompressedData> GenerateFromDerivedDataSource(c
 		const int32 SourceCubeFaceBytes = MipSize * MipSize * sizeof(FFloat16Color);
 		const int32 DestCubeFaceBytes = MipSize * MipSize * sizeof(FColor);
 
-		const FFloat16Color*	MipSrcData = (const FFloat16Color*)SourceCubemapData->GetData(SourceMipBaseIndex);
+		const FFloat16Color*	MipSrcData = (const FFloat16Color*)SourceCubemapData.GetData(SourceMipBaseIndex);
 		FColor*					MipDstData = (FColor*)CapturedData->GetData(DestMipBaseIndex);
 
 		// Fix cubemap seams by averaging colors across edges
@@ -1484,20 +1291,16 @@ TRefCountPtr<FReflectionCaptureUncompressedData> GenerateFromDerivedDataSource(c
 		{
 			const int32 FaceSourceIndex = SourceMipBaseIndex + CubeFace * SourceCubeFaceBytes;
 			const int32 FaceDestIndex = DestMipBaseIndex + CubeFace * DestCubeFaceBytes;
-			const FFloat16Color* FaceSourceData = (const FFloat16Color*)SourceCubemapData->GetData(FaceSourceIndex);
+			const FFloat16Color* FaceSourceData = (const FFloat16Color*)SourceCubemapData.GetData(FaceSourceIndex);
 			FColor* FaceDestData = (FColor*)CapturedData->GetData(FaceDestIndex);
 
 			// Convert each texel from linear space FP16 to RGBM FColor
 			// Note: Brightness on the capture is baked into the encoded HDR data
-			// Skip edges
+			// Skip edges; each row is one batch, with the same bytes RGBMEncode gives
 			for (int32 y = 1; y < MipSize - 1; y++)
 			{
-				for (int32 x = 1; x < MipSize - 1; x++)
-				{
-					int32 TexelIndex = x + y * MipSize;
-					const FLinearColor LinearColor = FLinearColor(FaceSourceData[TexelIndex]);
-					FaceDestData[TexelIndex] = RGBMEncode(LinearColor);
-				}
+				const int32 TexelIndex = 1 + y * MipSize;
+				rgbm::EncodeSpan((const uint16*)(FaceSourceData + TexelIndex), (uint8*)(FaceDestData + TexelIndex), MipSize - 2);
 			}
 		}
 
@@ -1509,114 +1312,186 @@ TRefCountPtr<FReflectionCaptureUncompressedData> GenerateFromDerivedDataSource(c
 
 void SaveTGA(const FString& filename, int32 width, int32 height, uint8* data)
 {
-	std::ofstream savefile;
-	savefile.exceptions(std::ios::failbit);
-	savefile.open(*filename, std::ios::binary);
-
-	const char type_header[] = { 0,0,2,0,0,0,0,0,0,0,0,0 };
-	savefile.write(&type_header[0], 12);
+	// the faces are stored bottom up and mirrored; the descriptor takes the row order and the
+	// writer mirrors each row on its way out, leaving the caller's pixels untouched
+	std::ofstream savefile(*filename, std::ios::binary);
+	image::StreamSink sink(savefile);
+	if (!image::WriteTGA(sink, image::MakeView(data, width, height, image::Format::BGRA8, image::BottomUp | image::MirrorX)))
+		UE_LOG(ExportCubemap, Warning, TEXT("Failed to write \"%s\"."), *filename);
+}
 
-	const char header[] = { width % 256, width / 256, height % 256, height / 256, 32, 8 };
 
-	unsigned int image_size = 4 * width * height;
-	uint8* invert_data = new uint8[image_size];
-	memset(invert_data, 0, image_size * sizeof(uint8));
+// Encoded probes are cached under Saved/ by a hash of their FP16 data and of
+// the encoding, so re-exporting captures that were not rebuilt only copies
+// files. Bump the version string when the DDS output changes.
+static const TCHAR* s_pcProbeCacheVersion = TEXT("ExportCubemap: dds bgra8 rgbm, seams averaged, v1");
+
+static TAutoConsoleVariable<int32> CVarExportCubemapCompression(
+	TEXT("ExportCubemap.Compression"),
+	0,
+	TEXT("Block compression of the exported probes.\n")
+	TEXT("0: uncompressed BGRA8\n")
+	TEXT("1: DXT, BC1 for probes without RGBM alpha and BC3 otherwise\n")
+	TEXT("2: BC7, in a DDS with the DX10 header"),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarExportCubemapCompressionQuality(
+	TEXT("ExportCubemap.CompressionQuality"),
+	1,
+	TEXT("Effort of the probe block compression.\n")
+	TEXT("0: bounding box endpoints\n")
+	TEXT("1: principal axis endpoints refined by least squares\n")
+	TEXT("2: as 1 with more refinement and a search around the endpoints"),
+	ECVF_Default);
+
+// Uncompressed probes keep the cache names they had before compression existed.
+FString GetProbeCacheName(FReflectionCaptureUncompressedData& kSource, int32 CubemapSize, int32 iCompression, int32 iQuality)
+{
+	FSHA1 kHash;
+	kHash.Update((const uint8*)s_pcProbeCacheVersion, FCString::Strlen(s_pcProbeCacheVersion) * sizeof(TCHAR));
+	kHash.Update((const uint8*)&CubemapSize, sizeof(CubemapSize));
+	if (iCompression != 0)
+	{
+		const int32 aiSettings[2] = { iCompression, iQuality };
+		kHash.Update((const uint8*)aiSettings, sizeof(aiSettings));
+	}
+	kHash.Update(kSource.GetData(0), kSource.Size());
+	kHash.Final();
+	uint8 abyHash[20];
+	kHash.GetHash(abyHash);
+	return FPaths::ProjectSavedDir() / TEXT("ExportCubemap/ProbeCache") / BytesToHex(abyHash, sizeof(abyHash)) + TEXT(".dds");
+}
 
-	for (unsigned int i = 0; i < image_size; i++)
+// Block compresses the faces of a probe, laid out face by face with their
+// mips and already in file order, into aryBlocks with the same layout, in
+// chunks of block rows spread over the task graph. DXT picks BC1 unless some
+// RGBM multiplier in alpha is below 255.
+bc::Format CompressProbe(const TArray<uint8>& aryFaces, int32 MipMapCount, int32 iCompression, bc::Quality eQuality, TArray<uint8>& aryBlocks)
+{
+	bc::Format eFormat = bc::Format::BC7;
+	if (iCompression == 1)
 	{
-		invert_data[i] = data[i];
+		bool bOpaque = true;
+		for (int32 i = 3; i < aryFaces.Num() && bOpaque; i += 4)
+		{
+			bOpaque = aryFaces[i] == 255;
+		}
+		eFormat = bOpaque ? bc::Format::BC1 : bc::Format::BC3;
 	}
 
-	// ֱ
-	//for (int i = 0; i < height; i++)
-	//{
-	//	for (int j = 0; j < width; j++)
-	//	{
-	//		int s = (i * width + j) * 4;
-	//		int d = ((height - 1 - i) * width + j) * 4;
-
-	//		data[s + 0] = invert_data[d + 0];
-	//		data[s + 1] = invert_data[d + 1];
-	//		data[s + 2] = invert_data[d + 2];
-	//		data[s + 3] = invert_data[d + 3];
-	//	}
-	//}
-
-	// +Ҿ
-	//for (int i = 0; i < height; i++)
-	//{
-	//	for (int j = 0; j < width; j++)
-	//	{
-	//		int s = (i * height + j) * 4;
-	//		int d = ((width - 1 - i) * height - j) * 4;
-
-	//		data[s + 0] = invert_data[d + 0];
-	//		data[s + 1] = invert_data[d + 1];
-	//		data[s + 2] = invert_data[d + 2];
-	//		data[s + 3] = invert_data[d + 3];
-	//	}
-	//}
-
-	// ˮƽ
-	for (int i = 0; i < height; i++)
+	struct BlockRows
+	{
+		const uint8* m_pbySource;
+		uint8* m_pbyDest;
+		uint32 m_uSize;
+		uint32 m_uFirst;
+		uint32 m_uEnd;
+	};
+	static const uint32 BLOCK_ROWS_PER_CHUNK = 8;
+	size_t uTotal = 0;
+	for (int32 MipIndex = 0; MipIndex < MipMapCount; MipIndex++)
+	{
+		const uint32 MipSize = 1u << (MipMapCount - MipIndex - 1);
+		uTotal += bc::GetSurfaceSize(eFormat, MipSize, MipSize) * CubeFace_MAX;
+	}
+	aryBlocks.SetNumUninitialized((int32)uTotal);
+	TArray<BlockRows> aryChunks;
+	const uint8* pbySource = aryFaces.GetData();
+	uint8* pbyDest = aryBlocks.GetData();
+	for (int32 CubeFace = 0; CubeFace < CubeFace_MAX; CubeFace++)
 	{
-		for (int j = 0; j < width; j++)
+		for (int32 MipIndex = 0; MipIndex < MipMapCount; MipIndex++)
 		{
-			int s = (i * height + j) * 4;
-			int d = (i * height + (width - j - 1)) * 4;
-
-			data[s + 0] = invert_data[d + 0];
-			data[s + 1] = invert_data[d + 1];
-			data[s + 2] = invert_data[d + 2];
-			data[s + 3] = invert_data[d + 3];
+			const uint32 MipSize = 1u << (MipMapCount - MipIndex - 1);
+			const uint32 uBlockRows = bc::GetBlockRows(MipSize);
+			for (uint32 uRow = 0; uRow < uBlockRows; uRow += BLOCK_ROWS_PER_CHUNK)
+			{
+				aryChunks.Add({ pbySource, pbyDest, MipSize, uRow, FMath::Min(uRow + BLOCK_ROWS_PER_CHUNK, uBlockRows) });
+			}
+			pbySource += MipSize * MipSize * 4;
+			pbyDest += bc::GetSurfaceSize(eFormat, MipSize, MipSize);
 		}
 	}
-
-	savefile.write(&header[0], 6);
-	savefile.write((char*)data, 4 * width * height);
-	savefile.close();
+	ParallelFor(aryChunks.Num(), [eFormat, eQuality, &aryChunks](int32 i)
+	{
+		const BlockRows& kChunk = aryChunks[i];
+		bc::CompressRows(eFormat, eQuality, kChunk.m_pbySource, kChunk.m_uSize * 4, kChunk.m_uSize, kChunk.m_uSize, kChunk.m_uFirst, kChunk.m_uEnd, kChunk.m_pbyDest);
+	});
+	return eFormat;
 }
 
-
 void ExportReflectionProbes(const TArray<ReflectionInfo> &vReflectionProbes, const FString& kPath)
 {
-	TArray<uint8> writeData;
+	const int32 iCompression = FMath::Clamp(CVarExportCubemapCompression.GetValueOnGameThread(), 0, 2);
+	const int32 iQuality = FMath::Clamp(CVarExportCubemapCompressionQuality.GetValueOnGameThread(), 0, 2);
 	for (auto& itProbe : vReflectionProbes)
 	{
-		TRefCountPtr<FReflectionCaptureUncompressedData> rpCubemapData = GenerateFromDerivedDataSource(*itProbe.m_pkData);
-		TArray<uint8>& aryData = rpCubemapData->GetArray();
 		int32 CubemapSize = itProbe.m_pkData->CubemapSize;
+		TRefCountPtr<FReflectionCaptureUncompressedData> rpSourceData = itProbe.m_pkData->GetUncompressedData();
+		FString kExportPath = kPath + "/" + itProbe.m_strName + ".dds";
+		FString kCacheName = GetProbeCacheName(*rpSourceData, CubemapSize, iCompression, iQuality);
+		if (IFileManager::Get().Copy(*kExportPath, *kCacheName) == COPY_OK)
+		{
+			continue;
+		}
+		TRefCountPtr<FReflectionCaptureUncompressedData> rpCubemapData = GenerateFromDerivedDataSource(*rpSourceData, CubemapSize);
+		rpSourceData.SafeRelease();
+		TArray<uint8>& aryData = rpCubemapData->GetArray();
 		if (aryData.Num())
 		{
-			writeData.Empty(aryData.Num());
-			writeData.AddZeroed(aryData.Num());
-			CTexture texarray[6];
-			int32 MipMapCount = FMath::Log2(CubemapSize) + 1;
-			int32 MipBaseIndex = 0;
-			int32 MipSize = 1 << (MipMapCount - 1);
-			int32 CubeFaceBytes = MipSize * MipSize * 4;
+			// The encoded data holds each mip with its six faces. Every face is
+			// rotated once into aryFaces, face by face with their mips and already
+			// bottom up, optionally block compressed from there, and the textures
+			// below are views of the result until the file is written without
+			// another flip.
+			TArray<uint8> aryFaces;
+			aryFaces.SetNumUninitialized(aryData.Num());
+			const int32 MipMapCount = FMath::Log2(CubemapSize) + 1;
+			uint8* pDest = aryFaces.GetData();
 			for (int32 CubeFace = 0; CubeFace < CubeFace_MAX; CubeFace++)
 			{
-				writeData.AddZeroed(CubeFaceBytes);
-				const int32 SourceIndex = MipBaseIndex + CubeFace * CubeFaceBytes;
-				GetFaceData(writeData, aryData.GetData() + SourceIndex, CubeFace, MipSize);
-				texarray[CubeFace].create(CubemapSize, CubemapSize, 1, CubeFaceBytes, writeData.GetData()/* EncodedData.GetData()+SourceIndex*/);
+				int32 MipBaseIndex = 0;
+				for (int32 MipIndex = 0; MipIndex < MipMapCount; MipIndex++)
+				{
+					const int32 MipSize = 1 << (MipMapCount - MipIndex - 1);
+					const int32 CubeFaceBytes = MipSize * MipSize * 4;
+					GetFaceData(pDest, aryData.GetData() + MipBaseIndex + CubeFace * CubeFaceBytes, CubeFace, MipSize);
+					pDest += CubeFaceBytes;
+					MipBaseIndex += CubeFaceBytes * CubeFace_MAX;
+				}
+			}
+			rpCubemapData.SafeRelease();
+
+			uint32 uFormat = GL_BGRA_EXT;
+			bc::Format eBlockFormat = bc::Format::BC1;
+			if (iCompression != 0)
+			{
+				TArray<uint8> aryBlocks;
+				eBlockFormat = CompressProbe(aryFaces, MipMapCount, iCompression, (bc::Quality)iQuality, aryBlocks);
+				aryFaces = MoveTemp(aryBlocks);
+				uFormat = eBlockFormat == bc::Format::BC1 ? GL_COMPRESSED_RGBA_S3TC_DXT1_EXT
+					: (eBlockFormat == bc::Format::BC3 ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGBA_BPTC_UNORM);
 			}
-			MipBaseIndex += CubeFaceBytes * CubeFace_MAX;
-		
-			for (int32 MipIndex = 1; MipIndex < MipMapCount; MipIndex++)
+			CTexture texarray[6];
+			pDest = aryFaces.GetData();
+			for (int32 CubeFace = 0; CubeFace < CubeFace_MAX; CubeFace++)
 			{
-				MipSize = 1 << (MipMapCount - MipIndex - 1);
-				CubeFaceBytes = MipSize * MipSize * 4;
-				for (int32 CubeFace = 0; CubeFace < CubeFace_MAX; CubeFace++)
+				for (int32 MipIndex = 0; MipIndex < MipMapCount; MipIndex++)
 				{
-					writeData.AddZeroed(CubeFaceBytes);
-					const int32 SourceIndex = MipBaseIndex + CubeFace * CubeFaceBytes;
-					GetFaceData(writeData, aryData.GetData() + SourceIndex, CubeFace, MipSize);
-					CSurface surface(MipSize, MipSize, 1, CubeFaceBytes, writeData.GetData()/*EncodedData.GetData() + SourceIndex*/);
-					texarray[CubeFace].add_mipmap(surface);
+					const int32 MipSize = 1 << (MipMapCount - MipIndex - 1);
+					const int32 CubeFaceBytes = (uFormat == GL_BGRA_EXT) ? MipSize * MipSize * 4 : (int32)bc::GetSurfaceSize(eBlockFormat, MipSize, MipSize);
+					if (MipIndex == 0)
+					{
+						texarray[CubeFace].attach(MipSize, MipSize, 1, CubeFaceBytes, pDest);
+					}
+					else
+					{
+						CSurface surface;
+						surface.attach(MipSize, MipSize, 1, CubeFaceBytes, pDest);
+						texarray[CubeFace].add_mipmap(MoveTemp(surface));
+					}
+					pDest += CubeFaceBytes;
 				}
-				MipBaseIndex += CubeFaceBytes * CubeFace_MAX;
 			}
 
 			//for (int i = 0; i < 6; ++i)
@@ -1625,10 +1500,15 @@ void ExportReflectionProbes(const TArray<ReflectionInfo> &vReflectionProbes, con
 			//}
 
 			CDDSImage image;
-			texarray[3].FlipX();
-			image.create_textureCubemap(GL_BGRA_EXT, 4, texarray[0], texarray[1], texarray[5], texarray[4], texarray[2], texarray[3]);
-			FString kExportPath = kPath + "/" + itProbe.m_strName + ".dds";
-			image.save(kExportPath);
+			image.create_textureCubemap(uFormat, 4, MoveTemp(texarray[0]), MoveTemp(texarray[1]), MoveTemp(texarray[5]), MoveTemp(texarray[4]), MoveTemp(texarray[2]), MoveTemp(texarray[3]));
+			image.save(kExportPath, false);
+
+			// Copied under a temporary name first, so an interrupted copy is never a cache hit.
+			IFileManager::Get().MakeDirectory(*FPaths::GetPath(kCacheName), true);
+			if (IFileManager::Get().Copy(*(kCacheName + TEXT(".tmp")), *kExportPath) == COPY_OK)
+			{
+				IFileManager::Get().Move(*kCacheName, *(kCacheName + TEXT(".tmp")));
+			}
 		}
 	}
 }
@@ -0,0 +1,966 @@
+#pragma once
+
+#include <cfloat>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	define BC_SSE2 1
+#	include <emmintrin.h>
+#else
+#	define BC_SSE2 0
+#endif
+
+// Block compression for the DDS writer. BC1 is meant for opaque colour, BC3
+// for colour with a meaningful alpha such as RGBM, BC7 (mode 6 only: one
+// subset, 7.7.7.7 endpoints with p-bits and 4 bit indices) for the best
+// quality at the size of BC3. Input is BGRA8 rows as the exporters hold them;
+// blocks over the right and bottom edges repeat the last column and row.
+//
+// Endpoints start on the principal axis of the block (a bounding box diagonal
+// for Quality::Fast), are refined by least squares for Normal and High, and
+// High then searches the neighbouring quantised endpoints. Every candidate is
+// scored by fitting all 16 pixels to the decoded palette, four pixels per SSE2
+// step. Blocks are independent, so callers spread the block rows of a surface
+// over their own threads with CompressRows. Depends only on the C++ standard
+// library.
+namespace bc {
+	enum class Format : uint32_t
+	{
+		BC1,
+		BC3,
+		BC7,
+	};
+
+	enum class Quality : uint32_t
+	{
+		Fast,
+		Normal,
+		High,
+	};
+
+	inline uint32_t GetBlockSize(Format format)
+	{
+		return format == Format::BC1 ? 8 : 16;
+	}
+
+	inline uint32_t GetBlockRows(uint32_t height)
+	{
+		return (height + 3) / 4;
+	}
+
+	/// <summary>Bytes of a width x height surface; mips below 4x4 still take one block.</summary>
+	inline size_t GetSurfaceSize(Format format, uint32_t width, uint32_t height)
+	{
+		return size_t((width + 3) / 4) * GetBlockRows(height) * GetBlockSize(format);
+	}
+
+	namespace detail {
+		/// <summary>The 16 pixels of a block channel by channel (R, G, B, A), so four pixels load at once.</summary>
+		struct alignas(16) Pixels
+		{
+			float c[4][16];
+		};
+
+		inline float Clamp(float value, float low, float high)
+		{
+			return value < low ? low : (value > high ? high : value);
+		}
+
+		inline void LoadBlock(const uint8_t* bgra, size_t pitch, uint32_t width, uint32_t height, uint32_t blockX, uint32_t blockY, Pixels& pixels)
+		{
+			for (uint32_t y = 0; y < 4; ++y)
+			{
+				const uint32_t sourceY = blockY * 4 + y < height ? blockY * 4 + y : height - 1;
+				const uint8_t* row = bgra + sourceY * pitch;
+				for (uint32_t x = 0; x < 4; ++x)
+				{
+					const uint32_t sourceX = blockX * 4 + x < width ? blockX * 4 + x : width - 1;
+					const uint8_t* pixel = row + sourceX * 4;
+					pixels.c[0][y * 4 + x] = pixel[2];
+					pixels.c[1][y * 4 + x] = pixel[1];
+					pixels.c[2][y * 4 + x] = pixel[0];
+					pixels.c[3][y * 4 + x] = pixel[3];
+				}
+			}
+		}
+
+		/// <summary>Picks the nearest of count palette entries for every pixel, comparing channels
+		/// [first, first + channels). Ties go to the lower index. Returns the summed squared error.</summary>
+		inline float FitIndices(const Pixels& pixels, const float (*palette)[4], uint32_t count, uint32_t first, uint32_t channels, uint8_t indices[16])
+		{
+#if BC_SSE2
+			__m128 total = _mm_setzero_ps();
+			for (uint32_t group = 0; group < 16; group += 4)
+			{
+				__m128 values[4];
+				for (uint32_t channel = 0; channel < channels; ++channel)
+				{
+					values[channel] = _mm_load_ps(&pixels.c[first + channel][group]);
+				}
+				__m128 best = _mm_set1_ps(FLT_MAX);
+				__m128i bestIndex = _mm_setzero_si128();
+				for (uint32_t entry = 0; entry < count; ++entry)
+				{
+					__m128 distance = _mm_setzero_ps();
+					for (uint32_t channel = 0; channel < channels; ++channel)
+					{
+						const __m128 delta = _mm_sub_ps(values[channel], _mm_set1_ps(palette[entry][first + channel]));
+						distance = _mm_add_ps(distance, _mm_mul_ps(delta, delta));
+					}
+					const __m128i closer = _mm_castps_si128(_mm_cmplt_ps(distance, best));
+					best = _mm_min_ps(best, distance);
+					bestIndex = _mm_or_si128(_mm_and_si128(closer, _mm_set1_epi32(int32_t(entry))), _mm_andnot_si128(closer, bestIndex));
+				}
+				total = _mm_add_ps(total, best);
+				alignas(16) int32_t lanes[4];
+				_mm_store_si128(reinterpret_cast<__m128i*>(lanes), bestIndex);
+				for (uint32_t lane = 0; lane < 4; ++lane)
+				{
+					indices[group + lane] = uint8_t(lanes[lane]);
+				}
+			}
+			alignas(16) float sums[4];
+			_mm_store_ps(sums, total);
+			return (sums[0] + sums[1]) + (sums[2] + sums[3]);
+#else
+			float total = 0.0f;
+			for (uint32_t pixel = 0; pixel < 16; ++pixel)
+			{
+				float best = FLT_MAX;
+				uint8_t bestIndex = 0;
+				for (uint32_t entry = 0; entry < count; ++entry)
+				{
+					float distance = 0.0f;
+					for (uint32_t channel = 0; channel < channels; ++channel)
+					{
+						const float delta = pixels.c[first + channel][pixel] - palette[entry][first + channel];
+						distance += delta * delta;
+					}
+					if (distance < best)
+					{
+						best = distance;
+						bestIndex = uint8_t(entry);
+					}
+				}
+				indices[pixel] = bestIndex;
+				total += best;
+			}
+			return total;
+#endif
+		}
+
+		/// <summary>Mean and principal axis of channels [first, first + channels), by power iteration.</summary>
+		inline void PrincipalAxis(const Pixels& pixels, uint32_t first, uint32_t channels, float mean[4], float axis[4])
+		{
+			for (uint32_t i = 0; i < channels; ++i)
+			{
+				float sum = 0.0f;
+				for (uint32_t pixel = 0; pixel < 16; ++pixel)
+				{
+					sum += pixels.c[first + i][pixel];
+				}
+				mean[i] = sum / 16.0f;
+			}
+			float covariance[4][4] = {};
+			for (uint32_t pixel = 0; pixel < 16; ++pixel)
+			{
+				for (uint32_t i = 0; i < channels; ++i)
+				{
+					const float a = pixels.c[first + i][pixel] - mean[i];
+					for (uint32_t j = i; j < channels; ++j)
+					{
+						covariance[i][j] += a * (pixels.c[first + j][pixel] - mean[j]);
+					}
+				}
+			}
+			uint32_t widest = 0;
+			for (uint32_t i = 0; i < channels; ++i)
+			{
+				for (uint32_t j = 0; j < i; ++j)
+				{
+					covariance[i][j] = covariance[j][i];
+				}
+				if (covariance[i][i] > covariance[widest][widest])
+				{
+					widest = i;
+				}
+			}
+			// the row of the widest channel already points roughly along the axis
+			float vector[4];
+			for (uint32_t i = 0; i < channels; ++i)
+			{
+				vector[i] = covariance[widest][i];
+			}
+			for (uint32_t iteration = 0; iteration < 8; ++iteration)
+			{
+				float next[4] = {};
+				float length = 0.0f;
+				for (uint32_t i = 0; i < channels; ++i)
+				{
+					for (uint32_t j = 0; j < channels; ++j)
+					{
+						next[i] += covariance[i][j] * vector[j];
+					}
+					length = std::fmax(length, std::fabs(next[i]));
+				}
+				if (length <= 0.0f)
+				{
+					break;
+				}
+				for (uint32_t i = 0; i < channels; ++i)
+				{
+					vector[i] = next[i] / length;
+				}
+			}
+			float length = 0.0f;
+			for (uint32_t i = 0; i < channels; ++i)
+			{
+				length += vector[i] * vector[i];
+			}
+			length = std::sqrt(length);
+			for (uint32_t i = 0; i < channels; ++i)
+			{
+				axis[i] = length > 0.0f ? vector[i] / length : 1.0f / std::sqrt(float(channels));
+			}
+		}
+
+		/// <summary>Endpoints at the extremes of the pixels projected on the principal axis.</summary>
+		inline void AxisEndpoints(const Pixels& pixels, uint32_t first, uint32_t channels, float start[4], float end[4])
+		{
+			float mean[4];
+			float axis[4];
+			PrincipalAxis(pixels, first, channels, mean, axis);
+			float low = FLT_MAX;
+			float high = -FLT_MAX;
+			for (uint32_t pixel = 0; pixel < 16; ++pixel)
+			{
+				float t = 0.0f;
+				for (uint32_t i = 0; i < channels; ++i)
+				{
+					t += (pixels.c[first + i][pixel] - mean[i]) * axis[i];
+				}
+				low = std::fmin(low, t);
+				high = std::fmax(high, t);
+			}
+			for (uint32_t i = 0; i < channels; ++i)
+			{
+				start[i] = Clamp(mean[i] + axis[i] * high, 0.0f, 255.0f);
+				end[i] = Clamp(mean[i] + axis[i] * low, 0.0f, 255.0f);
+			}
+		}
+
+		/// <summary>Corners of the bounding box, inset by a sixteenth, on the diagonal that follows
+		/// the sign of each channel's covariance with the widest one.</summary>
+		inline void BoxEndpoints(const Pixels& pixels, uint32_t first, uint32_t channels, float start[4], float end[4])
+		{
+			float low[4];
+			float high[4];
+			float mean[4];
+			uint32_t widest = 0;
+			for (uint32_t i = 0; i < channels; ++i)
+			{
+				low[i] = FLT_MAX;
+				high[i] = -FLT_MAX;
+				float sum = 0.0f;
+				for (uint32_t pixel = 0; pixel < 16; ++pixel)
+				{
+					low[i] = std::fmin(low[i], pixels.c[first + i][pixel]);
+					high[i] = std::fmax(high[i], pixels.c[first + i][pixel]);
+					sum += pixels.c[first + i][pixel];
+				}
+				mean[i] = sum / 16.0f;
+				const float inset = (high[i] - low[i]) / 16.0f;
+				low[i] += inset;
+				high[i] -= inset;
+				if (high[i] - low[i] > high[widest] - low[widest])
+				{
+					widest = i;
+				}
+			}
+			for (uint32_t i = 0; i < channels; ++i)
+			{
+				float covariance = 0.0f;
+				for (uint32_t pixel = 0; pixel < 16; ++pixel)
+				{
+					covariance += (pixels.c[first + i][pixel] - mean[i]) * (pixels.c[first + widest][pixel] - mean[widest]);
+				}
+				start[i] = covariance < 0.0f ? low[i] : high[i];
+				end[i] = covariance < 0.0f ? high[i] : low[i];
+			}
+		}
+
+		/// <summary>Endpoints minimising the squared error for fixed indices, where pixel i is
+		/// weights[i] * start + (1 - weights[i]) * end. False when the system is degenerate.</summary>
+		inline bool LeastSquares(const Pixels& pixels, uint32_t first, uint32_t channels, const float weights[16], float start[4], float end[4])
+		{
+			float aa = 0.0f;
+			float bb = 0.0f;
+			float ab = 0.0f;
+			float ax[4] = {};
+			float bx[4] = {};
+			for (uint32_t pixel = 0; pixel < 16; ++pixel)
+			{
+				const float a = weights[pixel];
+				const float b = 1.0f - a;
+				aa += a * a;
+				bb += b * b;
+				ab += a * b;
+				for (uint32_t i = 0; i < channels; ++i)
+				{
+					ax[i] += a * pixels.c[first + i][pixel];
+					bx[i] += b * pixels.c[first + i][pixel];
+				}
+			}
+			const float determinant = aa * bb - ab * ab;
+			if (std::fabs(determinant) < 1e-6f)
+			{
+				return false;
+			}
+			for (uint32_t i = 0; i < channels; ++i)
+			{
+				start[i] = Clamp((ax[i] * bb - bx[i] * ab) / determinant, 0.0f, 255.0f);
+				end[i] = Clamp((bx[i] * aa - ax[i] * ab) / determinant, 0.0f, 255.0f);
+			}
+			return true;
+		}
+
+		// ---- BC1 colour --------------------------------------------------
+
+		inline uint16_t To565(const float color[4])
+		{
+			const uint32_t r = uint32_t(Clamp(color[0] * (31.0f / 255.0f) + 0.5f, 0.0f, 31.0f));
+			const uint32_t g = uint32_t(Clamp(color[1] * (63.0f / 255.0f) + 0.5f, 0.0f, 63.0f));
+			const uint32_t b = uint32_t(Clamp(color[2] * (31.0f / 255.0f) + 0.5f, 0.0f, 31.0f));
+			return uint16_t((r << 11) | (g << 5) | b);
+		}
+
+		inline void From565(uint16_t value, uint8_t color[4])
+		{
+			const uint32_t r = (value >> 11) & 31;
+			const uint32_t g = (value >> 5) & 63;
+			const uint32_t b = value & 31;
+			color[0] = uint8_t((r << 3) | (r >> 2));
+			color[1] = uint8_t((g << 2) | (g >> 4));
+			color[2] = uint8_t((b << 3) | (b >> 2));
+			color[3] = 255;
+		}
+
+		/// <summary>The four colour palette as decoders build it; start must be greater than end.</summary>
+		inline void ColorPalette(uint16_t start, uint16_t end, uint8_t palette[4][4])
+		{
+			From565(start, palette[0]);
+			From565(end, palette[1]);
+			for (uint32_t i = 0; i < 4; ++i)
+			{
+				palette[2][i] = uint8_t((2 * palette[0][i] + palette[1][i]) / 3);
+				palette[3][i] = uint8_t((palette[0][i] + 2 * palette[1][i]) / 3);
+			}
+		}
+
+		struct ColorCandidate
+		{
+			uint16_t start = 0;
+			uint16_t end = 0;
+			uint8_t indices[16] = {};
+			float error = FLT_MAX;
+		};
+
+		/// <summary>Scores a pair of 565 endpoints in four colour mode; equal endpoints use index 0 only.</summary>
+		inline void ScoreColor(const Pixels& pixels, uint16_t start, uint16_t end, ColorCandidate& best)
+		{
+			if (start < end)
+			{
+				const uint16_t swap = start;
+				start = end;
+				end = swap;
+			}
+			uint8_t bytes[4][4];
+			ColorPalette(start, end, bytes);
+			float palette[4][4];
+			for (uint32_t i = 0; i < 4; ++i)
+			{
+				for (uint32_t j = 0; j < 4; ++j)
+				{
+					palette[i][j] = bytes[i][j];
+				}
+			}
+			ColorCandidate candidate;
+			candidate.start = start;
+			candidate.end = end;
+			candidate.error = FitIndices(pixels, palette, start == end ? 1 : 4, 0, 3, candidate.indices);
+			if (candidate.error < best.error)
+			{
+				best = candidate;
+			}
+		}
+
+		inline void ColorWeights(const ColorCandidate& candidate, float weights[16])
+		{
+			static const float table[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+			for (uint32_t pixel = 0; pixel < 16; ++pixel)
+			{
+				weights[pixel] = table[candidate.indices[pixel]];
+			}
+		}
+
+		/// <summary>Tries each 565 component of both endpoints one step up and down while that helps.</summary>
+		inline void SearchColor(const Pixels& pixels, ColorCandidate& best, uint32_t passes)
+		{
+			static const uint16_t steps[3] = { 1 << 11, 1 << 5, 1 };
+			static const uint16_t masks[3] = { 31 << 11, 63 << 5, 31 };
+			for (uint32_t pass = 0; pass < passes; ++pass)
+			{
+				const float before = best.error;
+				const uint16_t endpoints[2] = { best.start, best.end };
+				for (uint32_t which = 0; which < 2; ++which)
+				{
+					for (uint32_t component = 0; component < 3; ++component)
+					{
+						const uint16_t value = endpoints[which];
+						const uint16_t field = value & masks[component];
+						uint16_t moved[2] = { value, value };
+						if (field != masks[component])
+						{
+							moved[0] = uint16_t(value + steps[component]);
+						}
+						if (field != 0)
+						{
+							moved[1] = uint16_t(value - steps[component]);
+						}
+						for (uint16_t candidate : moved)
+						{
+							if (candidate != value)
+							{
+								ScoreColor(pixels, which == 0 ? candidate : endpoints[1], which == 0 ? endpoints[0] : candidate, best);
+							}
+						}
+					}
+				}
+				if (!(best.error < before))
+				{
+					break;
+				}
+			}
+		}
+
+		inline void WriteColorBlock(const ColorCandidate& candidate, uint8_t out[8])
+		{
+			uint32_t bits = 0;
+			for (uint32_t pixel = 0; pixel < 16; ++pixel)
+			{
+				bits |= uint32_t(candidate.indices[pixel]) << (pixel * 2);
+			}
+			out[0] = uint8_t(candidate.start);
+			out[1] = uint8_t(candidate.start >> 8);
+			out[2] = uint8_t(candidate.end);
+			out[3] = uint8_t(candidate.end >> 8);
+			for (uint32_t i = 0; i < 4; ++i)
+			{
+				out[4 + i] = uint8_t(bits >> (i * 8));
+			}
+		}
+
+		inline void EncodeColor(const Pixels& pixels, Quality quality, uint8_t out[8])
+		{
+			float start[4];
+			float end[4];
+			if (quality == Quality::Fast)
+			{
+				BoxEndpoints(pixels, 0, 3, start, end);
+			}
+			else
+			{
+				AxisEndpoints(pixels, 0, 3, start, end);
+			}
+			ColorCandidate best;
+			ScoreColor(pixels, To565(start), To565(end), best);
+			const uint32_t refinements = quality == Quality::Fast ? 0 : (quality == Quality::Normal ? 1 : 3);
+			for (uint32_t i = 0; i < refinements && best.start != best.end; ++i)
+			{
+				float weights[16];
+				ColorWeights(best, weights);
+				if (!LeastSquares(pixels, 0, 3, weights, start, end))
+				{
+					break;
+				}
+				ScoreColor(pixels, To565(start), To565(end), best);
+			}
+			if (quality == Quality::High)
+			{
+				SearchColor(pixels, best, 4);
+			}
+			WriteColorBlock(best, out);
+		}
+
+		// ---- BC3 alpha ---------------------------------------------------
+
+		/// <summary>Eight values when start is greater than end, otherwise six plus 0 and 255.</summary>
+		inline void AlphaPalette(uint8_t start, uint8_t end, uint8_t palette[8])
+		{
+			palette[0] = start;
+			palette[1] = end;
+			if (start > end)
+			{
+				for (uint32_t i = 1; i < 7; ++i)
+				{
+					palette[i + 1] = uint8_t(((7 - i) * start + i * end) / 7);
+				}
+			}
+			else
+			{
+				for (uint32_t i = 1; i < 5; ++i)
+				{
+					palette[i + 1] = uint8_t(((5 - i) * start + i * end) / 5);
+				}
+				palette[6] = 0;
+				palette[7] = 255;
+			}
+		}
+
+		struct AlphaCandidate
+		{
+			uint8_t start = 0;
+			uint8_t end = 0;
+			uint8_t indices[16] = {};
+			float error = FLT_MAX;
+		};
+
+		inline void ScoreAlpha(const Pixels& pixels, uint8_t start, uint8_t end, AlphaCandidate& best)
+		{
+			uint8_t bytes[8];
+			AlphaPalette(start, end, bytes);
+			float palette[8][4] = {};
+			for (uint32_t i = 0; i < 8; ++i)
+			{
+				palette[i][3] = bytes[i];
+			}
+			AlphaCandidate candidate;
+			candidate.start = start;
+			candidate.end = end;
+			candidate.error = FitIndices(pixels, palette, 8, 3, 1, candidate.indices);
+			if (candidate.error < best.error)
+			{
+				best = candidate;
+			}
+		}
+
+		inline void EncodeAlpha(const Pixels& pixels, Quality quality, uint8_t out[8])
+		{
+			float low = 255.0f;
+			float high = 0.0f;
+			float innerLow = 255.0f;
+			float innerHigh = 0.0f;
+			for (uint32_t pixel = 0; pixel < 16; ++pixel)
+			{
+				const float value = pixels.c[3][pixel];
+				low = std::fmin(low, value);
+				high = std::fmax(high, value);
+				if (value > 0.0f && value < 255.0f)
+				{
+					innerLow = std::fmin(innerLow, value);
+					innerHigh = std::fmax(innerHigh, value);
+				}
+			}
+			AlphaCandidate best;
+			if (high > low)
+			{
+				ScoreAlpha(pixels, uint8_t(high), uint8_t(low), best);
+			}
+			else
+			{
+				ScoreAlpha(pixels, uint8_t(high), uint8_t(high), best);
+			}
+			if (quality == Quality::High && high > low)
+			{
+				// least squares on the eight value ramp, then the six value mode that has 0 and 255 for free
+				float weights[16];
+				for (uint32_t pixel = 0; pixel < 16; ++pixel)
+				{
+					const uint32_t index = best.indices[pixel];
+					weights[pixel] = index == 0 ? 1.0f : (index == 1 ? 0.0f : float(8 - index) / 7.0f);
+				}
+				float start[4];
+				float end[4];
+				if (best.start > best.end && LeastSquares(pixels, 3, 1, weights, start, end))
+				{
+					const uint8_t a = uint8_t(start[0] + 0.5f);
+					const uint8_t b = uint8_t(end[0] + 0.5f);
+					if (a > b)
+					{
+						ScoreAlpha(pixels, a, b, best);
+					}
+				}
+				if (innerHigh >= innerLow)
+				{
+					ScoreAlpha(pixels, uint8_t(innerLow), uint8_t(innerHigh), best);
+				}
+			}
+			uint64_t bits = 0;
+			for (uint32_t pixel = 0; pixel < 16; ++pixel)
+			{
+				bits |= uint64_t(best.indices[pixel]) << (pixel * 3);
+			}
+			out[0] = best.start;
+			out[1] = best.end;
+			for (uint32_t i = 0; i < 6; ++i)
+			{
+				out[2 + i] = uint8_t(bits >> (i * 8));
+			}
+		}
+
+		// ---- BC7 mode 6 --------------------------------------------------
+
+		static const uint32_t Weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+		/// <summary>An endpoint as stored: seven bits per channel and the shared p-bit.</summary>
+		struct Endpoint
+		{
+			uint8_t value[4] = {};
+			uint8_t pbit = 0;
+
+			uint8_t Get(uint32_t channel) const
+			{
+				return uint8_t((value[channel] << 1) | pbit);
+			}
+		};
+
+		/// <summary>Nearest endpoint to color, trying both p-bits.</summary>
+		inline Endpoint QuantizeEndpoint(const float color[4])
+		{
+			Endpoint best;
+			float bestError = FLT_MAX;
+			for (uint8_t pbit = 0; pbit < 2; ++pbit)
+			{
+				Endpoint candidate;
+				candidate.pbit = pbit;
+				float error = 0.0f;
+				for (uint32_t i = 0; i < 4; ++i)
+				{
+					candidate.value[i] = uint8_t(Clamp((color[i] - pbit) * 0.5f + 0.5f, 0.0f, 127.0f));
+					const float delta = float(candidate.Get(i)) - color[i];
+					error += delta * delta;
+				}
+				if (error < bestError)
+				{
+					bestError = error;
+					best = candidate;
+				}
+			}
+			return best;
+		}
+
+		inline void Mode6Palette(const Endpoint& start, const Endpoint& end, uint8_t palette[16][4])
+		{
+			for (uint32_t entry = 0; entry < 16; ++entry)
+			{
+				for (uint32_t i = 0; i < 4; ++i)
+				{
+					palette[entry][i] = uint8_t(((64 - Weights4[entry]) * start.Get(i) + Weights4[entry] * end.Get(i) + 32) >> 6);
+				}
+			}
+		}
+
+		struct Mode6Candidate
+		{
+			Endpoint start;
+			Endpoint end;
+			uint8_t indices[16] = {};
+			float error = FLT_MAX;
+		};
+
+		inline void ScoreMode6(const Pixels& pixels, const Endpoint& start, const Endpoint& end, Mode6Candidate& best)
+		{
+			uint8_t bytes[16][4];
+			Mode6Palette(start, end, bytes);
+			float palette[16][4];
+			for (uint32_t i = 0; i < 16; ++i)
+			{
+				for (uint32_t j = 0; j < 4; ++j)
+				{
+					palette[i][j] = bytes[i][j];
+				}
+			}
+			Mode6Candidate candidate;
+			candidate.start = start;
+			candidate.end = end;
+			candidate.error = FitIndices(pixels, palette, 16, 0, 4, candidate.indices);
+			if (candidate.error < best.error)
+			{
+				best = candidate;
+			}
+		}
+
+		inline void SearchMode6(const Pixels& pixels, Mode6Candidate& best, uint32_t passes)
+		{
+			for (uint32_t pass = 0; pass < passes; ++pass)
+			{
+				const float before = best.error;
+				const Endpoint endpoints[2] = { best.start, best.end };
+				for (uint32_t which = 0; which < 2; ++which)
+				{
+					for (uint32_t component = 0; component < 5; ++component)
+					{
+						for (int32_t step = -1; step <= 1; step += 2)
+						{
+							Endpoint moved = endpoints[which];
+							if (component == 4)
+							{
+								if (step < 0)
+								{
+									continue;
+								}
+								moved.pbit ^= 1;
+							}
+							else
+							{
+								const int32_t value = int32_t(moved.value[component]) + step;
+								if (value < 0 || value > 127)
+								{
+									continue;
+								}
+								moved.value[component] = uint8_t(value);
+							}
+							ScoreMode6(pixels, which == 0 ? moved : endpoints[0], which == 0 ? endpoints[1] : moved, best);
+						}
+					}
+				}
+				if (!(best.error < before))
+				{
+					break;
+				}
+			}
+		}
+
+		inline void EncodeMode6(const Pixels& pixels, Quality quality, uint8_t out[16])
+		{
+			float start[4];
+			float end[4];
+			if (quality == Quality::Fast)
+			{
+				BoxEndpoints(pixels, 0, 4, start, end);
+			}
+			else
+			{
+				AxisEndpoints(pixels, 0, 4, start, end);
+			}
+			Mode6Candidate best;
+			ScoreMode6(pixels, QuantizeEndpoint(start), QuantizeEndpoint(end), best);
+			const uint32_t refinements = quality == Quality::Fast ? 0 : (quality == Quality::Normal ? 1 : 2);
+			for (uint32_t i = 0; i < refinements; ++i)
+			{
+				float weights[16];
+				for (uint32_t pixel = 0; pixel < 16; ++pixel)
+				{
+					weights[pixel] = float(64 - Weights4[best.indices[pixel]]) / 64.0f;
+				}
+				if (!LeastSquares(pixels, 0, 4, weights, start, end))
+				{
+					break;
+				}
+				ScoreMode6(pixels, QuantizeEndpoint(start), QuantizeEndpoint(end), best);
+			}
+			if (quality == Quality::High)
+			{
+				SearchMode6(pixels, best, 2);
+			}
+
+			// the anchor pixel stores three index bits, so its index has to be below 8
+			if (best.indices[0] >= 8)
+			{
+				const Endpoint swap = best.start;
+				best.start = best.end;
+				best.end = swap;
+				for (uint32_t pixel = 0; pixel < 16; ++pixel)
+				{
+					best.indices[pixel] = uint8_t(15 - best.indices[pixel]);
+				}
+			}
+			uint64_t words[2] = {};
+			uint32_t position = 0;
+			auto put = [&words, &position](uint32_t value, uint32_t count)
+			{
+				for (uint32_t bit = 0; bit < count; ++bit, ++position)
+				{
+					words[position >> 6] |= uint64_t((value >> bit) & 1) << (position & 63);
+				}
+			};
+			put(1 << 6, 7);
+			for (uint32_t i = 0; i < 4; ++i)
+			{
+				put(best.start.value[i], 7);
+				put(best.end.value[i], 7);
+			}
+			put(best.start.pbit, 1);
+			put(best.end.pbit, 1);
+			put(best.indices[0], 3);
+			for (uint32_t pixel = 1; pixel < 16; ++pixel)
+			{
+				put(best.indices[pixel], 4);
+			}
+			for (uint32_t i = 0; i < 16; ++i)
+			{
+				out[i] = uint8_t(words[i >> 3] >> ((i & 7) * 8));
+			}
+		}
+	}
+
+	/// <summary>Decodes one BC1 block to RGBA; both colour modes are handled.</summary>
+	inline void DecodeBC1(const uint8_t* block, uint8_t rgba[16][4])
+	{
+		const uint16_t start = uint16_t(block[0] | (block[1] << 8));
+		const uint16_t end = uint16_t(block[2] | (block[3] << 8));
+		uint8_t palette[4][4];
+		if (start > end)
+		{
+			detail::ColorPalette(start, end, palette);
+		}
+		else
+		{
+			detail::From565(start, palette[0]);
+			detail::From565(end, palette[1]);
+			for (uint32_t i = 0; i < 3; ++i)
+			{
+				palette[2][i] = uint8_t((palette[0][i] + palette[1][i]) / 2);
+				palette[3][i] = 0;
+			}
+			palette[2][3] = 255;
+			palette[3][3] = 0;
+		}
+		for (uint32_t pixel = 0; pixel < 16; ++pixel)
+		{
+			std::memcpy(rgba[pixel], palette[(block[4 + pixel / 4] >> ((pixel % 4) * 2)) & 3], 4);
+		}
+	}
+
+	inline void DecodeBC3(const uint8_t* block, uint8_t rgba[16][4])
+	{
+		DecodeBC1(block + 8, rgba);
+		uint8_t palette[8];
+		detail::AlphaPalette(block[0], block[1], palette);
+		uint64_t bits = 0;
+		for (uint32_t i = 0; i < 6; ++i)
+		{
+			bits |= uint64_t(block[2 + i]) << (i * 8);
+		}
+		for (uint32_t pixel = 0; pixel < 16; ++pixel)
+		{
+			rgba[pixel][3] = palette[(bits >> (pixel * 3)) & 7];
+		}
+	}
+
+	/// <summary>Decodes one BC7 block written by this encoder. Other modes are not decoded and return false.</summary>
+	inline bool DecodeBC7(const uint8_t* block, uint8_t rgba[16][4])
+	{
+		uint64_t words[2] = {};
+		for (uint32_t i = 0; i < 16; ++i)
+		{
+			words[i >> 3] |= uint64_t(block[i]) << ((i & 7) * 8);
+		}
+		uint32_t position = 0;
+		auto get = [&words, &position](uint32_t count)
+		{
+			uint32_t value = 0;
+			for (uint32_t bit = 0; bit < count; ++bit, ++position)
+			{
+				value |= uint32_t((words[position >> 6] >> (position & 63)) & 1) << bit;
+			}
+			return value;
+		};
+		if (get(7) != (1 << 6))
+		{
+			return false;
+		}
+		detail::Endpoint start;
+		detail::Endpoint end;
+		for (uint32_t i = 0; i < 4; ++i)
+		{
+			start.value[i] = uint8_t(get(7));
+			end.value[i] = uint8_t(get(7));
+		}
+		start.pbit = uint8_t(get(1));
+		end.pbit = uint8_t(get(1));
+		uint8_t palette[16][4];
+		detail::Mode6Palette(start, end, palette);
+		for (uint32_t pixel = 0; pixel < 16; ++pixel)
+		{
+			std::memcpy(rgba[pixel], palette[get(pixel == 0 ? 3 : 4)], 4);
+		}
+		return true;
+	}
+
+	/// <summary>Compresses block rows [firstRow, endRow) of a width x height BGRA8 surface into out,
+	/// which points at the first block of the surface. With measure set the blocks are decoded again
+	/// and the summed squared error over the four channels of the covered pixels is returned.</summary>
+	inline uint64_t CompressRows(Format format, Quality quality, const uint8_t* bgra, size_t pitch, uint32_t width, uint32_t height,
+		uint32_t firstRow, uint32_t endRow, uint8_t* out, bool measure = false)
+	{
+		const uint32_t blockSize = GetBlockSize(format);
+		const uint32_t columns = (width + 3) / 4;
+		uint64_t error = 0;
+		detail::Pixels pixels;
+		for (uint32_t blockY = firstRow; blockY < endRow; ++blockY)
+		{
+			for (uint32_t blockX = 0; blockX < columns; ++blockX)
+			{
+				detail::LoadBlock(bgra, pitch, width, height, blockX, blockY, pixels);
+				uint8_t* block = out + (size_t(blockY) * columns + blockX) * blockSize;
+				switch (format)
+				{
+				case Format::BC1:
+					detail::EncodeColor(pixels, quality, block);
+					break;
+				case Format::BC3:
+					detail::EncodeAlpha(pixels, quality, block);
+					detail::EncodeColor(pixels, quality, block + 8);
+					break;
+				case Format::BC7:
+					detail::EncodeMode6(pixels, quality, block);
+					break;
+				}
+				if (!measure)
+				{
+					continue;
+				}
+				uint8_t decoded[16][4];
+				if (format == Format::BC1)
+				{
+					DecodeBC1(block, decoded);
+				}
+				else if (format == Format::BC3)
+				{
+					DecodeBC3(block, decoded);
+				}
+				else
+				{
+					DecodeBC7(block, decoded);
+				}
+				for (uint32_t pixel = 0; pixel < 16; ++pixel)
+				{
+					if (blockX * 4 + pixel % 4 >= width || blockY * 4 + pixel / 4 >= height)
+					{
+						continue;
+					}
+					for (uint32_t i = 0; i < 4; ++i)
+					{
+						const int32_t delta = int32_t(decoded[pixel][i]) - int32_t(pixels.c[i][pixel]);
+						error += uint64_t(delta * delta);
+					}
+				}
+			}
+		}
+		return error;
+	}
+
+	/// <summary>Peak signal to noise ratio in dB of an 8 bit image with the given squared error over samples values.</summary>
+	inline double GetPSNR(uint64_t error, uint64_t samples)
+	{
+		if (error == 0 || samples == 0)
+		{
+			return 99.0;
+		}
+		return 10.0 * std::log10(255.0 * 255.0 * double(samples) / double(error));
+	}
+}
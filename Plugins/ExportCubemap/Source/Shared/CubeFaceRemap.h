@@ -0,0 +1,144 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Turns the faces of an engine cubemap into the orientation Unity expects.
+// Every face is a square of 32 bit texels and is only ever rotated by a
+// multiple of 90 degrees, optionally with its rows stored in reverse, so each
+// orientation is a fixed integer index mapping. The rotated faces are copied
+// in TileSize x TileSize blocks, which keeps both the rows read and the rows
+// written in cache; the others are copied row by row. Depends only on the C++
+// standard library.
+namespace cubeface {
+	/// <summary>Rotation of the image with y pointing down.</summary>
+	enum class Rotation
+	{
+		None,
+		Clockwise,
+		Half,
+		CounterClockwise,
+	};
+
+	/// <summary>Texels per side of the blocks the rotated faces are copied in; 4 KB of source and destination each.</summary>
+	constexpr uint32_t TileSize = 32;
+
+	/// <summary>Rotation that takes engine face index face (CubeFace_PosX ...) to its Unity orientation.
+	/// Face 3 was flipped twice before, once on each axis, which is the same as Half.</summary>
+	constexpr Rotation GetUnityRotation(int32_t face)
+	{
+		return face == 0 ? Rotation::CounterClockwise
+			: face == 1 ? Rotation::Clockwise
+			: (face == 3 || face == 5) ? Rotation::Half
+			: Rotation::None;
+	}
+
+	namespace detail {
+		/// <summary>Destination column and row of the texel at (x, y); last is size - 1.
+		/// StepX and StepY are how much they change when x grows by one.</summary>
+		template <Rotation R>
+		struct Kernel;
+
+		template <>
+		struct Kernel<Rotation::Clockwise>
+		{
+			static uint32_t X(uint32_t /*x*/, uint32_t y, uint32_t last) { return last - y; }
+			static uint32_t Y(uint32_t x, uint32_t /*y*/, uint32_t /*last*/) { return x; }
+			static constexpr int32_t StepX = 0;
+			static constexpr int32_t StepY = 1;
+		};
+
+		template <>
+		struct Kernel<Rotation::Half>
+		{
+			static uint32_t X(uint32_t x, uint32_t /*y*/, uint32_t last) { return last - x; }
+			static uint32_t Y(uint32_t /*x*/, uint32_t y, uint32_t last) { return last - y; }
+			static constexpr int32_t StepX = -1;
+			static constexpr int32_t StepY = 0;
+		};
+
+		template <>
+		struct Kernel<Rotation::CounterClockwise>
+		{
+			static uint32_t X(uint32_t /*x*/, uint32_t y, uint32_t /*last*/) { return y; }
+			static uint32_t Y(uint32_t x, uint32_t /*y*/, uint32_t last) { return last - x; }
+			static constexpr int32_t StepX = 0;
+			static constexpr int32_t StepY = -1;
+		};
+
+		template <Rotation R, bool BottomUp>
+		void RemapTiles(const uint8_t* source, uint8_t* dest, uint32_t size)
+		{
+			const uint32_t last = size - 1;
+			// along a source row the destination moves by a fixed number of texels
+			const ptrdiff_t step = ptrdiff_t(BottomUp ? -Kernel<R>::StepY : Kernel<R>::StepY) * size + Kernel<R>::StepX;
+			for (uint32_t tileY = 0; tileY < size; tileY += TileSize)
+			{
+				const uint32_t endY = tileY + TileSize < size ? tileY + TileSize : size;
+				for (uint32_t tileX = 0; tileX < size; tileX += TileSize)
+				{
+					const uint32_t endX = tileX + TileSize < size ? tileX + TileSize : size;
+					for (uint32_t y = tileY; y < endY; ++y)
+					{
+						const uint8_t* row = source + size_t(y) * size * 4;
+						const uint32_t destY = BottomUp ? last - Kernel<R>::Y(tileX, y, last) : Kernel<R>::Y(tileX, y, last);
+						ptrdiff_t index = ptrdiff_t(destY) * size + Kernel<R>::X(tileX, y, last);
+						for (uint32_t x = tileX; x < endX; ++x, index += step)
+						{
+							std::memcpy(dest + index * 4, row + size_t(x) * 4, 4);
+						}
+					}
+				}
+			}
+		}
+
+		template <bool BottomUp>
+		void Remap(Rotation rotation, const uint8_t* source, uint8_t* dest, uint32_t size)
+		{
+			switch (rotation)
+			{
+			case Rotation::Clockwise:
+				RemapTiles<Rotation::Clockwise, BottomUp>(source, dest, size);
+				break;
+			case Rotation::Half:
+				RemapTiles<Rotation::Half, BottomUp>(source, dest, size);
+				break;
+			case Rotation::CounterClockwise:
+				RemapTiles<Rotation::CounterClockwise, BottomUp>(source, dest, size);
+				break;
+			default:
+				if (BottomUp)
+				{
+					const size_t rowSize = size_t(size) * 4;
+					for (uint32_t y = 0; y < size; ++y)
+					{
+						std::memcpy(dest + (size - 1 - y) * rowSize, source + y * rowSize, rowSize);
+					}
+				}
+				else
+				{
+					std::memcpy(dest, source, size_t(size) * size * 4);
+				}
+				break;
+			}
+		}
+	}
+
+	/// <summary>Writes the size x size face at source to dest turned by rotation. The two must not overlap.
+	/// With bottomUp the rows of the result are stored last row first, the order a DDS file wants them in,
+	/// so the face can be written without flipping it again.</summary>
+	inline void Remap(Rotation rotation, const void* source, void* dest, uint32_t size, bool bottomUp = false)
+	{
+		const uint8_t* from = static_cast<const uint8_t*>(source);
+		uint8_t* to = static_cast<uint8_t*>(dest);
+		if (bottomUp)
+		{
+			detail::Remap<true>(rotation, from, to, size);
+		}
+		else
+		{
+			detail::Remap<false>(rotation, from, to, size);
+		}
+	}
+}
@@ -0,0 +1,777 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ostream>
+#include <vector>
+
+// Writes TGA, DDS, Radiance HDR and PVR files from a view over pixels that
+// already exist in memory. Orientation is expressed through the header of the
+// target format where it has a field for it (TGA descriptor for the row
+// order, HDR resolution string, PVR orientation metadata); DDS has none, so
+// its rows are gathered in reverse order straight from the source, and block
+// compressed rows pass through a staging buffer of one block row that also
+// mirrors the pixel rows inside every block (BC1 to BC3; BC7 blocks have to be
+// written top down). A horizontal mirror is written into the pixels of TGA
+// and DDS files, one row at a time, since many TGA readers ignore the
+// right-to-left bit of the descriptor.
+// BC7 goes out with the DX10 header extension. ASTC is written to PVR only.
+// No writer copies or modifies the whole image.
+// Depends only on the C++ standard library.
+namespace image {
+	enum class Format : uint32_t
+	{
+		R8,
+		BGR8,
+		BGRA8,
+		RGBA16F,
+		RGBA32F,
+		/// <summary>Radiance shared exponent, stored as R, G, B, E bytes.</summary>
+		RGBE8,
+		BC1,
+		BC2,
+		BC3,
+		/// <summary>BC7 UNORM, written by the DDS writer with a DX10 header.</summary>
+		BC7,
+		/// <summary>LDR ASTC with 2D footprints up to 8x8; 16 bytes per block.</summary>
+		ASTC_4x4,
+		ASTC_5x4,
+		ASTC_5x5,
+		ASTC_6x5,
+		ASTC_6x6,
+		ASTC_8x5,
+		ASTC_8x6,
+		ASTC_8x8,
+	};
+
+	/// <summary>Where the first row and column of a view are on screen. The flags combine.</summary>
+	enum Orientation : uint32_t
+	{
+		TopDown = 0,
+		BottomUp = 1,
+		MirrorX = 2,
+	};
+
+	inline bool IsASTC(Format format)
+	{
+		return format >= Format::ASTC_4x4 && format <= Format::ASTC_8x8;
+	}
+
+	inline bool IsBlockCompressed(Format format)
+	{
+		return format == Format::BC1 || format == Format::BC2 || format == Format::BC3 || format == Format::BC7 || IsASTC(format);
+	}
+
+	/// <summary>Pixels per block horizontally; 1 for formats that are not block compressed.</summary>
+	inline uint32_t GetBlockWidth(Format format)
+	{
+		static const uint8_t astc[8] = { 4, 5, 5, 6, 6, 8, 8, 8 };
+		return IsASTC(format) ? astc[uint32_t(format) - uint32_t(Format::ASTC_4x4)] : (IsBlockCompressed(format) ? 4 : 1);
+	}
+
+	/// <summary>Pixels per block vertically; 1 for formats that are not block compressed.</summary>
+	inline uint32_t GetBlockHeight(Format format)
+	{
+		static const uint8_t astc[8] = { 4, 4, 5, 5, 6, 5, 6, 8 };
+		return IsASTC(format) ? astc[uint32_t(format) - uint32_t(Format::ASTC_4x4)] : (IsBlockCompressed(format) ? 4 : 1);
+	}
+
+	/// <summary>Bytes per pixel, or per block for block compressed formats.</summary>
+	inline uint32_t GetElementSize(Format format)
+	{
+		switch (format)
+		{
+		case Format::R8: return 1;
+		case Format::BGR8: return 3;
+		case Format::BGRA8: return 4;
+		case Format::RGBA16F: return 8;
+		case Format::RGBA32F: return 16;
+		case Format::RGBE8: return 4;
+		case Format::BC1: return 8;
+		case Format::BC2: return 16;
+		case Format::BC3: return 16;
+		case Format::BC7: return 16;
+		default: return IsASTC(format) ? 16 : 0;
+		}
+	}
+
+	/// <summary>Non-owning description of one image surface.</summary>
+	struct View
+	{
+		const uint8_t* data = nullptr;
+		uint32_t width = 0;
+		uint32_t height = 0;
+		/// <summary>Distance between two rows in bytes; rows of blocks for block compressed formats.</summary>
+		size_t pitch = 0;
+		Format format = Format::BGRA8;
+		uint32_t orientation = TopDown;
+
+		/// <summary>Rows in memory; block rows for block compressed formats.</summary>
+		uint32_t GetRowCount() const
+		{
+			const uint32_t blockHeight = GetBlockHeight(format);
+			return (height + blockHeight - 1) / blockHeight;
+		}
+
+		size_t GetRowSize() const
+		{
+			const uint32_t blockWidth = GetBlockWidth(format);
+			return size_t((width + blockWidth - 1) / blockWidth) * GetElementSize(format);
+		}
+
+		const uint8_t* GetRow(uint32_t row) const
+		{
+			return data + row * pitch;
+		}
+	};
+
+	/// <summary>Tightly packed view unless a pitch is given.</summary>
+	inline View MakeView(const void* data, uint32_t width, uint32_t height, Format format, uint32_t orientation = TopDown, size_t pitch = 0)
+	{
+		View view;
+		view.data = static_cast<const uint8_t*>(data);
+		view.width = width;
+		view.height = height;
+		view.format = format;
+		view.orientation = orientation;
+		view.pitch = pitch ? pitch : view.GetRowSize();
+		return view;
+	}
+
+	/// <summary>Destination of a writer. Writers hand over rows as they are, so a sink sees many small writes.</summary>
+	class Sink
+	{
+	public:
+		virtual ~Sink() = default;
+
+		virtual bool Write(const void* data, size_t size) = 0;
+
+		/// <summary>Called once with the final size before anything is written.</summary>
+		virtual void Reserve(size_t /*size*/)
+		{
+		}
+	};
+
+	class VectorSink : public Sink
+	{
+	public:
+		explicit VectorSink(std::vector<uint8_t>& output)
+			: output(output)
+		{
+		}
+
+		bool Write(const void* data, size_t size) override
+		{
+			const uint8_t* bytes = static_cast<const uint8_t*>(data);
+			output.insert(output.end(), bytes, bytes + size);
+			return true;
+		}
+
+		void Reserve(size_t size) override
+		{
+			output.reserve(output.size() + size);
+		}
+
+	private:
+		std::vector<uint8_t>& output;
+	};
+
+	class FileSink : public Sink
+	{
+	public:
+		explicit FileSink(const char* path)
+			: file(std::fopen(path, "wb"))
+		{
+		}
+
+		~FileSink()
+		{
+			if (file)
+			{
+				std::fclose(file);
+			}
+		}
+
+		bool IsOpen() const
+		{
+			return file != nullptr;
+		}
+
+		bool Write(const void* data, size_t size) override
+		{
+			return file && std::fwrite(data, 1, size, file) == size;
+		}
+
+	private:
+		FileSink(const FileSink&) = delete;
+		FileSink& operator=(const FileSink&) = delete;
+
+		std::FILE* file;
+	};
+
+	/// <summary>Writes through a stream the caller opened, such as a std::ofstream on a wide path.</summary>
+	class StreamSink : public Sink
+	{
+	public:
+		explicit StreamSink(std::ostream& stream)
+			: stream(stream)
+		{
+		}
+
+		bool Write(const void* data, size_t size) override
+		{
+			stream.write(static_cast<const char*>(data), std::streamsize(size));
+			return bool(stream);
+		}
+
+	private:
+		std::ostream& stream;
+	};
+
+	namespace detail {
+		template <class T>
+		bool WriteValue(Sink& sink, const T& value)
+		{
+			return sink.Write(&value, sizeof(T));
+		}
+
+		/// <summary>Writes the rows of a view top to bottom or bottom to top, in one write when they are packed.</summary>
+		inline bool WriteRows(Sink& sink, const View& view, bool reverse)
+		{
+			const uint32_t rows = view.GetRowCount();
+			const size_t rowSize = view.GetRowSize();
+			if (!reverse && view.pitch == rowSize)
+			{
+				return sink.Write(view.data, rowSize * rows);
+			}
+			for (uint32_t i = 0; i < rows; ++i)
+			{
+				if (!sink.Write(view.GetRow(reverse ? rows - 1 - i : i), rowSize))
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+
+		/// <summary>As WriteRows, mirroring every row through a scratch buffer of one row.</summary>
+		inline bool WriteMirroredRows(Sink& sink, const View& view, bool reverse)
+		{
+			const uint32_t rows = view.GetRowCount();
+			const uint32_t elementSize = GetElementSize(view.format);
+			std::vector<uint8_t> scratch(view.GetRowSize());
+			for (uint32_t i = 0; i < rows; ++i)
+			{
+				const uint8_t* source = view.GetRow(reverse ? rows - 1 - i : i);
+				for (uint32_t x = 0; x < view.width; ++x)
+				{
+					std::memcpy(&scratch[size_t(x) * elementSize], source + size_t(view.width - 1 - x) * elementSize, elementSize);
+				}
+				if (!sink.Write(scratch.data(), scratch.size()))
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+
+		/// <summary>Reverses the first rows pixel rows inside each of count BC1, BC2 or BC3 blocks.</summary>
+		inline void FlipBlocks(Format format, uint8_t* blocks, size_t count, uint32_t rows)
+		{
+			const uint32_t blockSize = GetElementSize(format);
+			for (size_t i = 0; i < count; ++i)
+			{
+				uint8_t* block = blocks + i * blockSize;
+				// colour indices are one byte per row after the two endpoints
+				uint8_t* colorRows = block + (format == Format::BC1 ? 4 : 12);
+				for (uint32_t row = 0; row < rows / 2; ++row)
+				{
+					const uint8_t swap = colorRows[row];
+					colorRows[row] = colorRows[rows - 1 - row];
+					colorRows[rows - 1 - row] = swap;
+				}
+				if (format == Format::BC2)
+				{
+					// explicit alpha, two bytes per row
+					for (uint32_t row = 0; row < rows / 2; ++row)
+					{
+						for (uint32_t byte = 0; byte < 2; ++byte)
+						{
+							const uint8_t swap = block[row * 2 + byte];
+							block[row * 2 + byte] = block[(rows - 1 - row) * 2 + byte];
+							block[(rows - 1 - row) * 2 + byte] = swap;
+						}
+					}
+				}
+				else if (format == Format::BC3)
+				{
+					// 3 bit alpha indices, 12 bits per row in the 48 bits after the two endpoints
+					uint64_t bits = 0;
+					for (uint32_t byte = 0; byte < 6; ++byte)
+					{
+						bits |= uint64_t(block[2 + byte]) << (byte * 8);
+					}
+					uint64_t flipped = bits;
+					for (uint32_t row = 0; row < rows; ++row)
+					{
+						const uint32_t target = rows - 1 - row;
+						flipped &= ~(uint64_t(0xfff) << (target * 12));
+						flipped |= ((bits >> (row * 12)) & 0xfff) << (target * 12);
+					}
+					for (uint32_t byte = 0; byte < 6; ++byte)
+					{
+						block[2 + byte] = uint8_t(flipped >> (byte * 8));
+					}
+				}
+			}
+		}
+
+		/// <summary>Block rows bottom to top, each flipped in staging, which is reused between calls.</summary>
+		inline bool WriteFlippedBlockRows(Sink& sink, const View& view, std::vector<uint8_t>& staging)
+		{
+			const uint32_t rows = view.GetRowCount();
+			const size_t rowSize = view.GetRowSize();
+			// an image shorter than a block only fills the top rows of it
+			const uint32_t pixelRows = view.height < 4 ? view.height : 4;
+			staging.resize(rowSize);
+			for (uint32_t i = 0; i < rows; ++i)
+			{
+				std::memcpy(staging.data(), view.GetRow(rows - 1 - i), rowSize);
+				FlipBlocks(view.format, staging.data(), rowSize / GetElementSize(view.format), pixelRows);
+				if (!sink.Write(staging.data(), rowSize))
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+
+		inline size_t GetImageSize(const View& view)
+		{
+			return view.GetRowSize() * view.GetRowCount();
+		}
+
+		/// <summary>Half to float the way FFloat16 does it: denormals become zero and infinities stay finite.</summary>
+		inline float HalfToFloat(uint16_t half)
+		{
+			const uint32_t sign = uint32_t(half >> 15) << 31;
+			const uint32_t exponent = (half >> 10) & 0x1f;
+			const uint32_t mantissa = half & 0x3ff;
+			uint32_t bits = sign;
+			if (exponent == 31)
+			{
+				bits |= (142u << 23) | (mantissa << 13);
+			}
+			else if (exponent != 0)
+			{
+				bits |= ((exponent + 112) << 23) | (mantissa << 13);
+			}
+			float value;
+			std::memcpy(&value, &bits, sizeof(value));
+			return value;
+		}
+
+		inline float SrgbToLinear(uint8_t value)
+		{
+			const float c = value / 255.0f;
+			return c > 0.04045f ? std::pow((c + 0.055f) / 1.055f, 2.4f) : c / 12.92f;
+		}
+
+		/// <summary>Same sequence as FRandomStream::GetFraction, so dithered output matches the engine's.</summary>
+		class Random
+		{
+		public:
+			explicit Random(int32_t seed)
+				: seed(uint32_t(seed))
+			{
+			}
+
+			float GetFraction()
+			{
+				seed = seed * 196314165u + 907633515u;
+				const uint32_t bits = 0x3f800000u | (seed & 0x007fffffu);
+				float value;
+				std::memcpy(&value, &bits, sizeof(value));
+				return value - 1.0f;
+			}
+
+		private:
+			uint32_t seed;
+		};
+
+		inline void ToRGBE(const float color[3], Random* random, uint8_t out[4])
+		{
+			const float primary = std::fmax(std::fmax(color[0], color[1]), color[2]);
+			if (primary < 1e-32f)
+			{
+				out[0] = out[1] = out[2] = out[3] = 0;
+				return;
+			}
+			int exponent;
+			const float scale = std::frexp(primary, &exponent) / primary * 255.0f;
+			for (int i = 0; i < 3; ++i)
+			{
+				const int value = int(color[i] * scale + (random ? random->GetFraction() : 0.5f));
+				out[i] = uint8_t(value < 0 ? 0 : (value > 255 ? 255 : value));
+			}
+			out[3] = uint8_t((exponent < -128 ? -128 : (exponent > 127 ? 127 : exponent)) + 128);
+		}
+
+		inline void ToLinear(const View& view, const uint8_t* pixel, float color[3])
+		{
+			switch (view.format)
+			{
+			case Format::RGBA16F:
+				for (int i = 0; i < 3; ++i)
+				{
+					uint16_t half;
+					std::memcpy(&half, pixel + i * 2, sizeof(half));
+					color[i] = HalfToFloat(half);
+				}
+				break;
+			case Format::RGBA32F:
+				std::memcpy(color, pixel, sizeof(float) * 3);
+				break;
+			default:
+				color[0] = SrgbToLinear(pixel[2]);
+				color[1] = SrgbToLinear(pixel[1]);
+				color[2] = SrgbToLinear(pixel[0]);
+				break;
+			}
+		}
+
+		/// <summary>Radiance run length encoding of one channel of a scan line.</summary>
+		inline void EncodeScanLine(const uint8_t* line, size_t length, std::vector<uint8_t>& output)
+		{
+			const uint8_t* lineEnd = line + length;
+			const uint8_t* source = line;
+			while (source < lineEnd)
+			{
+				int32_t currentPos = 0;
+				int32_t nextPos = 0;
+				int32_t currentRunLength = 0;
+				while (currentRunLength <= 4 && nextPos < 128 && source + nextPos < lineEnd)
+				{
+					currentPos = nextPos;
+					currentRunLength = 0;
+					while (currentRunLength < 127 && currentPos + currentRunLength < 128 && source + nextPos < lineEnd && source[currentPos] == source[nextPos])
+					{
+						nextPos++;
+						currentRunLength++;
+					}
+				}
+
+				if (currentRunLength > 4)
+				{
+					if (currentPos > 0)
+					{
+						output.push_back(uint8_t(currentPos));
+						output.insert(output.end(), source, source + currentPos);
+					}
+					output.push_back(uint8_t(128 + currentRunLength));
+					output.push_back(source[currentPos]);
+				}
+				else
+				{
+					output.push_back(uint8_t(nextPos));
+					output.insert(output.end(), source, source + nextPos);
+				}
+				source += nextPos;
+			}
+		}
+	}
+
+	/// <summary>Uncompressed TGA from R8, BGR8 or BGRA8. The row order goes into the image descriptor,
+	/// a horizontal mirror into the pixels. With bottomLeft the file always has the bottom-left origin,
+	/// and a top-down view has its rows written last to first.</summary>
+	inline bool WriteTGA(Sink& sink, const View& view, bool bottomLeft = false)
+	{
+		uint8_t imageType;
+		switch (view.format)
+		{
+		case Format::R8: imageType = 3; break;
+		case Format::BGR8:
+		case Format::BGRA8: imageType = 2; break;
+		default: return false;
+		}
+		if (view.width > 0xffff || view.height > 0xffff)
+		{
+			return false;
+		}
+		uint8_t header[18] = {};
+		header[2] = imageType;
+		header[12] = uint8_t(view.width & 0xff);
+		header[13] = uint8_t(view.width >> 8);
+		header[14] = uint8_t(view.height & 0xff);
+		header[15] = uint8_t(view.height >> 8);
+		header[16] = uint8_t(GetElementSize(view.format) * 8);
+		header[17] = uint8_t(view.format == Format::BGRA8 ? 8 : 0);
+		const bool reverse = bottomLeft && !(view.orientation & BottomUp);
+		if (!(view.orientation & BottomUp) && !bottomLeft)
+		{
+			header[17] |= 0x20;
+		}
+		sink.Reserve(sizeof(header) + detail::GetImageSize(view));
+		return sink.Write(header, sizeof(header))
+			&& ((view.orientation & MirrorX) ? detail::WriteMirroredRows(sink, view, reverse) : detail::WriteRows(sink, view, reverse));
+	}
+
+	/// <summary>Run length encoded Radiance HDR from RGBA16F, RGBA32F, sRGB BGRA8 or already encoded RGBE8.
+	/// With dither the rounding noise is the one UE's HDR exporter uses.</summary>
+	inline bool WriteHDR(Sink& sink, const View& view, bool dither = true)
+	{
+		if (view.format != Format::RGBA16F && view.format != Format::RGBA32F && view.format != Format::BGRA8 && view.format != Format::RGBE8)
+		{
+			return false;
+		}
+		char header[128];
+		const int length = std::snprintf(header, sizeof(header), "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n%cY %u %cX %u\n",
+			(view.orientation & BottomUp) ? '+' : '-', view.height, (view.orientation & MirrorX) ? '-' : '+', view.width);
+		if (!sink.Write(header, size_t(length)))
+		{
+			return false;
+		}
+
+		const uint32_t elementSize = GetElementSize(view.format);
+		detail::Random random(0xA1A1);
+		std::vector<uint8_t> channels[4];
+		for (std::vector<uint8_t>& channel : channels)
+		{
+			channel.resize(view.width);
+		}
+		std::vector<uint8_t> output;
+		output.reserve(size_t(view.width) * 8 + 4);
+		for (uint32_t y = 0; y < view.height; ++y)
+		{
+			const uint8_t* pixel = view.GetRow(y);
+			for (uint32_t x = 0; x < view.width; ++x, pixel += elementSize)
+			{
+				uint8_t rgbe[4];
+				if (view.format == Format::RGBE8)
+				{
+					std::memcpy(rgbe, pixel, sizeof(rgbe));
+				}
+				else
+				{
+					float color[3];
+					detail::ToLinear(view, pixel, color);
+					detail::ToRGBE(color, dither ? &random : nullptr, rgbe);
+				}
+				for (int c = 0; c < 4; ++c)
+				{
+					channels[c][x] = rgbe[c];
+				}
+			}
+
+			output.clear();
+			output.push_back(2);
+			output.push_back(2);
+			output.push_back(uint8_t((view.width >> 8) & 0xff));
+			output.push_back(uint8_t(view.width & 0xff));
+			for (const std::vector<uint8_t>& channel : channels)
+			{
+				detail::EncodeScanLine(channel.data(), channel.size(), output);
+			}
+			if (!sink.Write(output.data(), output.size()))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	/// <summary>DDS from faceCount * mipCount surfaces ordered face by face, largest mip first.
+	/// faceCount is 1 or 6 and every surface has the format of the first one. BC1 to BC3 surfaces
+	/// can be BottomUp if their height is below 4 or a multiple of 4; BC7 surfaces have to be
+	/// TopDown. No block compressed surface can be mirrored.</summary>
+	inline bool WriteDDS(Sink& sink, const View* surfaces, uint32_t faceCount, uint32_t mipCount)
+	{
+		if (!surfaces || (faceCount != 1 && faceCount != 6) || mipCount == 0)
+		{
+			return false;
+		}
+		const View& top = surfaces[0];
+		const bool compressed = IsBlockCompressed(top.format) && !IsASTC(top.format);
+		if (top.format != Format::BGR8 && top.format != Format::BGRA8 && !compressed)
+		{
+			return false;
+		}
+
+		// the DX10 extension follows the 128 byte header for formats that have no fourCC
+		const bool extended = top.format == Format::BC7;
+		uint32_t header[37] = {};
+		const size_t headerSize = extended ? sizeof(header) : 128;
+		header[0] = 0x20534444; // "DDS "
+		header[1] = 124;
+		header[2] = 0x1 | 0x2 | 0x4 | 0x1000;
+		header[3] = top.height;
+		header[4] = top.width;
+		if (compressed)
+		{
+			header[2] |= 0x80000;
+			header[5] = uint32_t(detail::GetImageSize(top));
+		}
+		else
+		{
+			header[2] |= 0x8;
+			header[5] = ((top.width * GetElementSize(top.format) * 8 + 31) & ~31u) >> 3;
+		}
+		if (mipCount > 1)
+		{
+			header[2] |= 0x20000;
+			header[7] = mipCount;
+		}
+		uint32_t* pixelFormat = header + 19;
+		pixelFormat[0] = 32;
+		if (compressed)
+		{
+			pixelFormat[1] = 0x4;
+			const char* fourCC = extended ? "DX10" : (top.format == Format::BC1 ? "DXT1" : (top.format == Format::BC2 ? "DXT3" : "DXT5"));
+			std::memcpy(&pixelFormat[2], fourCC, 4);
+		}
+		else
+		{
+			pixelFormat[1] = 0x40;
+			pixelFormat[3] = GetElementSize(top.format) * 8;
+			pixelFormat[4] = 0x00ff0000;
+			pixelFormat[5] = 0x0000ff00;
+			pixelFormat[6] = 0x000000ff;
+			if (top.format == Format::BGRA8)
+			{
+				pixelFormat[1] |= 0x1;
+				pixelFormat[7] = 0xff000000;
+			}
+		}
+		header[27] = 0x1000;
+		if (faceCount == 6)
+		{
+			header[27] |= 0x8;
+			header[28] = 0x200 | 0xfc00;
+		}
+		if (mipCount > 1)
+		{
+			header[27] |= 0x8 | 0x400000;
+		}
+		if (extended)
+		{
+			header[32] = 98; // DXGI_FORMAT_BC7_UNORM
+			header[33] = 3; // D3D10_RESOURCE_DIMENSION_TEXTURE2D
+			header[34] = faceCount == 6 ? 0x4 : 0; // D3D10_RESOURCE_MISC_TEXTURECUBE
+			header[35] = 1;
+		}
+
+		const uint32_t count = faceCount * mipCount;
+		size_t total = headerSize;
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			const View& surface = surfaces[i];
+			if (surface.format != top.format || (compressed && ((surface.orientation & MirrorX)
+				|| ((surface.orientation & BottomUp) && (extended || (surface.height > 4 && surface.height % 4 != 0))))))
+			{
+				return false;
+			}
+			total += detail::GetImageSize(surfaces[i]);
+		}
+		sink.Reserve(total);
+		if (!sink.Write(header, headerSize))
+		{
+			return false;
+		}
+		std::vector<uint8_t> staging;
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			const View& surface = surfaces[i];
+			const bool reverse = (surface.orientation & BottomUp) != 0;
+			bool written;
+			if (compressed && reverse)
+			{
+				written = detail::WriteFlippedBlockRows(sink, surface, staging);
+			}
+			else
+			{
+				written = (surface.orientation & MirrorX) ? detail::WriteMirroredRows(sink, surface, reverse) : detail::WriteRows(sink, surface, reverse);
+			}
+			if (!written)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	/// <summary>PVR version 3 from faceCount * mipCount surfaces ordered as for WriteDDS.
+	/// Orientation is stored as metadata and taken from the first surface.</summary>
+	inline bool WritePVR(Sink& sink, const View* surfaces, uint32_t faceCount, uint32_t mipCount, bool srgb = false)
+	{
+		if (!surfaces || faceCount == 0 || mipCount == 0)
+		{
+			return false;
+		}
+		const View& top = surfaces[0];
+		uint64_t pixelFormat = 0;
+		uint32_t channelType = 0;
+		switch (top.format)
+		{
+		case Format::R8: pixelFormat = 'r' | (uint64_t(8) << 32); break;
+		case Format::BGR8: pixelFormat = 'b' | ('g' << 8) | ('r' << 16) | (uint64_t(0x080808) << 32); break;
+		case Format::BGRA8: pixelFormat = 'b' | ('g' << 8) | ('r' << 16) | (uint64_t('a') << 24) | (uint64_t(0x08080808) << 32); break;
+		case Format::RGBA16F: pixelFormat = 'r' | ('g' << 8) | ('b' << 16) | (uint64_t('a') << 24) | (uint64_t(0x10101010) << 32); channelType = 12; break;
+		case Format::RGBA32F: pixelFormat = 'r' | ('g' << 8) | ('b' << 16) | (uint64_t('a') << 24) | (uint64_t(0x20202020) << 32); channelType = 12; break;
+		case Format::BC1: pixelFormat = 7; break;
+		case Format::BC2: pixelFormat = 9; break;
+		case Format::BC3: pixelFormat = 11; break;
+		case Format::BC7: pixelFormat = 15; break;
+		default:
+			if (!IsASTC(top.format))
+			{
+				return false;
+			}
+			pixelFormat = 27 + (uint32_t(top.format) - uint32_t(Format::ASTC_4x4));
+			break;
+		}
+
+		const uint8_t orientation[3] = { uint8_t((top.orientation & MirrorX) ? 1 : 0), uint8_t((top.orientation & BottomUp) ? 1 : 0), 0 };
+		const bool hasMetaData = top.orientation != TopDown;
+		const uint32_t metaDataSize = hasMetaData ? 12 + sizeof(orientation) : 0;
+
+		const uint32_t header[13] = {
+			0x03525650, 0, uint32_t(pixelFormat), uint32_t(pixelFormat >> 32), srgb ? 1u : 0u, channelType,
+			top.height, top.width, 1, 1, faceCount, mipCount, metaDataSize };
+		size_t total = sizeof(header) + metaDataSize;
+		for (uint32_t i = 0; i < faceCount * mipCount; ++i)
+		{
+			if (surfaces[i].format != top.format)
+			{
+				return false;
+			}
+			total += detail::GetImageSize(surfaces[i]);
+		}
+		sink.Reserve(total);
+		if (!sink.Write(header, sizeof(header)))
+		{
+			return false;
+		}
+		if (hasMetaData)
+		{
+			const uint32_t key[3] = { 0x03525650, 3, sizeof(orientation) };
+			if (!sink.Write(key, sizeof(key)) || !sink.Write(orientation, sizeof(orientation)))
+			{
+				return false;
+			}
+		}
+		// PVR stores every face of a mip level before the next level.
+		for (uint32_t mip = 0; mip < mipCount; ++mip)
+		{
+			for (uint32_t face = 0; face < faceCount; ++face)
+			{
+				if (!detail::WriteRows(sink, surfaces[face * mipCount + mip], false))
+				{
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+}
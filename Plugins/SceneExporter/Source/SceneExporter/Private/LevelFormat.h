@@ -0,0 +1,209 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Layout of the version 3 .level file. Everything is little endian and every
+// chunk starts on a 16 byte boundary, so a loader can map the file and use
+// the arrays in place:
+//
+//   Header | ChunkEntry[chunkCount] | chunk data ...
+//
+// Names are stored once in the STRS chunk and referenced by their byte offset
+// into it; records refer to other arrays by index, -1 meaning none.
+//
+// The mesh chunks (MESH, MATL, TEXR, PARM, LMAP, SMAP) are repeated once per
+// sublevel, with the sublevel's index in ChunkEntry::section; section 0 is
+// the persistent level. Indices in a record refer to the arrays of its own
+// section, so a section can be copied from one file to the next unchanged.
+namespace level {
+	constexpr uint32_t MakeId(char a, char b, char c, char d)
+	{
+		return uint32_t(uint8_t(a)) | (uint32_t(uint8_t(b)) << 8) | (uint32_t(uint8_t(c)) << 16) | (uint32_t(uint8_t(d)) << 24);
+	}
+
+	constexpr uint32_t Magic = MakeId('V', 'L', 'V', 'L');
+	constexpr uint32_t Version = 3;
+	constexpr uint32_t Alignment = 16;
+
+	/// <summary>Chunk identifiers.</summary>
+	namespace chunk {
+		constexpr uint32_t Strings = MakeId('S', 'T', 'R', 'S');
+		constexpr uint32_t Environment = MakeId('E', 'N', 'V', 'I');
+		constexpr uint32_t Probes = MakeId('P', 'R', 'O', 'B');
+		constexpr uint32_t Meshes = MakeId('M', 'E', 'S', 'H');
+		constexpr uint32_t Materials = MakeId('M', 'A', 'T', 'L');
+		constexpr uint32_t TextureRefs = MakeId('T', 'E', 'X', 'R');
+		constexpr uint32_t Params = MakeId('P', 'A', 'R', 'M');
+		constexpr uint32_t LightMaps = MakeId('L', 'M', 'A', 'P');
+		constexpr uint32_t ShadowMaps = MakeId('S', 'M', 'A', 'P');
+		constexpr uint32_t Aliases = MakeId('A', 'L', 'I', 'S');
+	}
+
+	constexpr uint32_t AlignUp(uint32_t value, uint32_t alignment = Alignment)
+	{
+		return (value + alignment - 1) & ~(alignment - 1);
+	}
+
+	/// <summary>FNV-1a, used for chunk checksums.</summary>
+	inline uint64_t Hash64(const void* data, size_t size, uint64_t seed = 0xcbf29ce484222325ull)
+	{
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+		uint64_t hash = seed;
+		for (size_t i = 0; i < size; ++i)
+		{
+			hash ^= bytes[i];
+			hash *= 0x100000001b3ull;
+		}
+		return hash;
+	}
+
+	struct Header
+	{
+		uint32_t magic = Magic;
+		uint32_t version = Version;
+		uint32_t chunkCount = 0;
+		uint32_t flags = 0;
+		uint64_t fileSize = 0;
+		uint64_t reserved = 0;
+	};
+
+	/// <summary>Directory entry. stride is the record size of array chunks and 1 for blobs.</summary>
+	struct ChunkEntry
+	{
+		uint32_t id = 0;
+		uint32_t section = 0;
+		uint32_t stride = 0;
+		uint32_t count = 0;
+		uint64_t offset = 0;
+		uint64_t size = 0;
+		uint64_t hash = 0;
+		/// <summary>Hash of what the exporter built the chunk from, 0 if unknown. Unchanged inputs let the next export copy the chunk.</summary>
+		uint64_t inputHash = 0;
+	};
+
+	struct alignas(16) Environment
+	{
+		uint32_t hasLight = 0;
+		float lightDirection[3] = {};
+		float lightColor[3] = {};
+		uint32_t hasFog = 0;
+		float fogHeight = 0;
+		float fogDensity = 0;
+		float fogInscatteringColor[4] = {};
+		float fogHeightFalloff = 0;
+		float fogMaxOpacity = 0;
+		float fogStartDistance = 0;
+		float fogCutoffDistance = 0;
+	};
+
+	struct alignas(16) Probe
+	{
+		uint32_t name = 0;
+		float position[3] = {};
+		float offset[3] = {};
+		float brightness = 0;
+		float influenceRadius = 0;
+		float averageBrightness = 0;
+	};
+
+	struct alignas(16) Mesh
+	{
+		uint32_t name = 0;
+		uint32_t fbx = 0;
+		uint32_t firstMaterial = 0;
+		uint32_t materialCount = 0;
+		float position[3] = {};
+		int32_t lightMap = -1;
+		float rotation[3] = {};
+		int32_t shadowMap = -1;
+		float scale[3] = {};
+	};
+
+	struct alignas(16) Material
+	{
+		uint32_t name = 0;
+		uint32_t index = 0;
+		uint32_t type = 0;
+		uint32_t firstTexture = 0;
+		uint32_t textureCount = 0;
+		uint32_t firstParam = 0;
+		uint32_t paramCount = 0;
+	};
+
+	struct alignas(16) LightMap
+	{
+		uint32_t texture = 0;
+		float coordinateScale[2] = {};
+		float coordinateBias[2] = {};
+		float scale2[4] = {};
+		float add2[4] = {};
+		float scale3[4] = {};
+		float add3[4] = {};
+	};
+
+	struct alignas(16) ShadowMap
+	{
+		float invUniformPenumbraSize[4] = {};
+	};
+
+	/// <summary>A texture with the same pixels as an exported one. name is its object path, target the file name used in its place.</summary>
+	struct Alias
+	{
+		uint32_t name = 0;
+		uint32_t target = 0;
+	};
+
+	static_assert(sizeof(Header) == 32, "Header has to be 32 bytes");
+	static_assert(sizeof(ChunkEntry) == 48, "ChunkEntry has to be 48 bytes");
+	static_assert(sizeof(Environment) == 80, "Environment has to be 80 bytes");
+	static_assert(sizeof(Probe) == 48, "Probe has to be 48 bytes");
+	static_assert(sizeof(Mesh) == 64, "Mesh has to be 64 bytes");
+	static_assert(sizeof(Material) == 32, "Material has to be 32 bytes");
+	static_assert(sizeof(LightMap) == 96, "LightMap has to be 96 bytes");
+	static_assert(sizeof(ShadowMap) == 16, "ShadowMap has to be 16 bytes");
+	static_assert(sizeof(Alias) == 8, "Alias has to be 8 bytes");
+
+	/// <summary>Builds the STRS chunk. Equal strings share one entry.</summary>
+	class StringPool
+	{
+	public:
+		StringPool()
+		{
+			Add("");
+		}
+
+		uint32_t Add(const std::string& value)
+		{
+			auto found = offsets.find(value);
+			if (found != offsets.end())
+			{
+				return found->second;
+			}
+			uint32_t offset = uint32_t(data.size());
+			data.insert(data.end(), value.begin(), value.end());
+			data.push_back('\0');
+			offsets.emplace(value, offset);
+			++count;
+			return offset;
+		}
+
+		const std::vector<char>& GetData() const
+		{
+			return data;
+		}
+
+		uint32_t GetCount() const
+		{
+			return count;
+		}
+
+	private:
+		std::unordered_map<std::string, uint32_t> offsets;
+		std::vector<char> data;
+		uint32_t count = 0;
+	};
+}
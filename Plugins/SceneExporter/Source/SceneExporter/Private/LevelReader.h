@@ -0,0 +1,343 @@
+#pragma once
+
+#include "LevelFormat.h"
+
+#if defined(_WIN32) && defined(PLATFORM_WINDOWS)
+// Inside the engine windows.h comes through its wrapper, which undoes macros
+// such as TEXT, CreateDirectory, DeleteFile and MoveFile that would otherwise
+// rename IPlatformFile calls in the including file.
+#	include "Windows/AllowWindowsPlatformTypes.h"
+#	include "Windows/WindowsHWrapper.h"
+#	include "Windows/HideWindowsPlatformTypes.h"
+#elif defined(_WIN32)
+#	ifndef WIN32_LEAN_AND_MEAN
+#		define WIN32_LEAN_AND_MEAN
+#	endif
+#	ifndef NOMINMAX
+#		define NOMINMAX
+#	endif
+#	include <windows.h>
+#else
+#	include <fcntl.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
+#endif
+
+// Read side of the version 3 .level format. The file is mapped read-only and
+// every accessor returns pointers into the mapping, so nothing is parsed or
+// allocated per record. Depends only on the C++ standard library and the OS.
+namespace level {
+	/// <summary>Contiguous, non-owning range of records inside a mapped file.</summary>
+	template <class T>
+	class View
+	{
+	public:
+		View() = default;
+		View(const T* first, uint32_t count)
+			: first(first), count(count)
+		{
+		}
+
+		const T* begin() const { return first; }
+		const T* end() const { return first + count; }
+		const T* data() const { return first; }
+		uint32_t size() const { return count; }
+		bool empty() const { return count == 0; }
+
+		const T& operator[](uint32_t index) const
+		{
+			return first[index];
+		}
+
+	private:
+		const T* first = nullptr;
+		uint32_t count = 0;
+	};
+
+	class Reader
+	{
+	public:
+		Reader() = default;
+
+		~Reader()
+		{
+			Close();
+		}
+
+		/// <summary>Maps the file and validates its header and directory. The path is UTF-8.</summary>
+		bool Open(const char* path)
+		{
+			Close();
+#if defined(_WIN32)
+			wchar_t widePath[MAX_PATH * 4];
+			if (!MultiByteToWideChar(CP_UTF8, 0, path, -1, widePath, int(sizeof(widePath) / sizeof(widePath[0]))))
+			{
+				return false;
+			}
+			file = CreateFileW(widePath, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+			if (file == INVALID_HANDLE_VALUE)
+			{
+				return false;
+			}
+			LARGE_INTEGER fileSize;
+			if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+			{
+				Close();
+				return false;
+			}
+			mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			const void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+			if (!view)
+			{
+				Close();
+				return false;
+			}
+			mapped = true;
+			bytes = static_cast<const uint8_t*>(view);
+			length = size_t(fileSize.QuadPart);
+			return Bind() || (Close(), false);
+#else
+			int fd = ::open(path, O_RDONLY);
+			if (fd < 0)
+			{
+				return false;
+			}
+			struct stat info;
+			if (fstat(fd, &info) != 0 || info.st_size == 0)
+			{
+				::close(fd);
+				return false;
+			}
+			void* view = mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+			::close(fd);
+			if (view == MAP_FAILED)
+			{
+				return false;
+			}
+			mapped = true;
+			bytes = static_cast<const uint8_t*>(view);
+			length = size_t(info.st_size);
+			return Bind() || (Close(), false);
+#endif
+		}
+
+		/// <summary>Uses a file that is already in memory. The caller keeps it alive.</summary>
+		bool Attach(const void* data, size_t size)
+		{
+			Close();
+			bytes = static_cast<const uint8_t*>(data);
+			length = size;
+			return Bind();
+		}
+
+		void Close()
+		{
+#if defined(_WIN32)
+			if (mapped && bytes)
+			{
+				UnmapViewOfFile(bytes);
+			}
+			if (mapping)
+			{
+				CloseHandle(mapping);
+				mapping = nullptr;
+			}
+			if (file != INVALID_HANDLE_VALUE)
+			{
+				CloseHandle(file);
+				file = INVALID_HANDLE_VALUE;
+			}
+#else
+			if (mapped && bytes)
+			{
+				munmap(const_cast<uint8_t*>(bytes), length);
+			}
+#endif
+			mapped = false;
+			bytes = nullptr;
+			length = 0;
+			header = nullptr;
+			directory = nullptr;
+		}
+
+		bool IsValid() const
+		{
+			return header != nullptr;
+		}
+
+		const Header& GetHeader() const
+		{
+			return *header;
+		}
+
+		View<ChunkEntry> GetDirectory() const
+		{
+			return header ? View<ChunkEntry>(directory, header->chunkCount) : View<ChunkEntry>();
+		}
+
+		const ChunkEntry* FindChunk(uint32_t id, uint32_t section = 0) const
+		{
+			for (const ChunkEntry& entry : GetDirectory())
+			{
+				if (entry.id == id && entry.section == section)
+				{
+					return &entry;
+				}
+			}
+			return nullptr;
+		}
+
+		/// <summary>Records of an array chunk; empty if it is missing or its stride does not match T.</summary>
+		template <class T>
+		View<T> GetArray(uint32_t id, uint32_t section = 0) const
+		{
+			const ChunkEntry* entry = FindChunk(id, section);
+			if (!entry || entry->stride != sizeof(T))
+			{
+				return View<T>();
+			}
+			return View<T>(reinterpret_cast<const T*>(bytes + entry->offset), entry->count);
+		}
+
+		const uint8_t* GetChunkData(const ChunkEntry& entry) const
+		{
+			return bytes + entry.offset;
+		}
+
+		/// <summary>Checks a chunk's payload against the hash stored in the directory.</summary>
+		bool Verify(const ChunkEntry& entry) const
+		{
+			return Hash64(bytes + entry.offset, size_t(entry.size)) == entry.hash;
+		}
+
+		const char* GetString(uint32_t offset) const
+		{
+			const ChunkEntry* entry = FindChunk(chunk::Strings);
+			if (!entry || offset >= entry->size)
+			{
+				return "";
+			}
+			return reinterpret_cast<const char*>(bytes + entry->offset + offset);
+		}
+
+		const Environment* GetEnvironment() const
+		{
+			View<Environment> view = GetArray<Environment>(chunk::Environment);
+			return view.empty() ? nullptr : view.data();
+		}
+
+		View<Probe> GetProbes() const { return GetArray<Probe>(chunk::Probes); }
+		View<Alias> GetAliases() const { return GetArray<Alias>(chunk::Aliases); }
+
+		/// <summary>Number of mesh sections, one per sublevel. Section 0 is the persistent level.</summary>
+		uint32_t GetSectionCount() const
+		{
+			uint32_t count = 0;
+			for (const ChunkEntry& entry : GetDirectory())
+			{
+				if (entry.id == chunk::Meshes && entry.section >= count)
+				{
+					count = entry.section + 1;
+				}
+			}
+			return count;
+		}
+
+		View<Mesh> GetMeshes(uint32_t section = 0) const { return GetArray<Mesh>(chunk::Meshes, section); }
+		View<Material> GetMaterials(uint32_t section = 0) const { return GetArray<Material>(chunk::Materials, section); }
+		View<uint32_t> GetTextureRefs(uint32_t section = 0) const { return GetArray<uint32_t>(chunk::TextureRefs, section); }
+		View<float> GetParams(uint32_t section = 0) const { return GetArray<float>(chunk::Params, section); }
+		View<LightMap> GetLightMaps(uint32_t section = 0) const { return GetArray<LightMap>(chunk::LightMaps, section); }
+		View<ShadowMap> GetShadowMaps(uint32_t section = 0) const { return GetArray<ShadowMap>(chunk::ShadowMaps, section); }
+
+		View<Material> GetMaterials(const Mesh& mesh, uint32_t section = 0) const
+		{
+			View<Material> all = GetMaterials(section);
+			if (uint64_t(mesh.firstMaterial) + mesh.materialCount > all.size())
+			{
+				return View<Material>();
+			}
+			return View<Material>(all.data() + mesh.firstMaterial, mesh.materialCount);
+		}
+
+		View<uint32_t> GetTextures(const Material& material, uint32_t section = 0) const
+		{
+			View<uint32_t> all = GetTextureRefs(section);
+			if (uint64_t(material.firstTexture) + material.textureCount > all.size())
+			{
+				return View<uint32_t>();
+			}
+			return View<uint32_t>(all.data() + material.firstTexture, material.textureCount);
+		}
+
+		View<float> GetParams(const Material& material, uint32_t section = 0) const
+		{
+			View<float> all = GetParams(section);
+			if (uint64_t(material.firstParam) + material.paramCount > all.size())
+			{
+				return View<float>();
+			}
+			return View<float>(all.data() + material.firstParam, material.paramCount);
+		}
+
+		const LightMap* GetLightMap(const Mesh& mesh, uint32_t section = 0) const
+		{
+			View<LightMap> all = GetLightMaps(section);
+			return (mesh.lightMap >= 0 && uint32_t(mesh.lightMap) < all.size()) ? &all[mesh.lightMap] : nullptr;
+		}
+
+		const ShadowMap* GetShadowMap(const Mesh& mesh, uint32_t section = 0) const
+		{
+			View<ShadowMap> all = GetShadowMaps(section);
+			return (mesh.shadowMap >= 0 && uint32_t(mesh.shadowMap) < all.size()) ? &all[mesh.shadowMap] : nullptr;
+		}
+
+	private:
+		bool Bind()
+		{
+			if (length < sizeof(Header) || (reinterpret_cast<uintptr_t>(bytes) % Alignment) != 0)
+			{
+				return false;
+			}
+			const Header* candidate = reinterpret_cast<const Header*>(bytes);
+			if (candidate->magic != Magic || candidate->version != Version || candidate->fileSize > length)
+			{
+				return false;
+			}
+			if (uint64_t(candidate->chunkCount) * sizeof(ChunkEntry) > length - sizeof(Header))
+			{
+				return false;
+			}
+			const ChunkEntry* entries = reinterpret_cast<const ChunkEntry*>(bytes + sizeof(Header));
+			for (uint32_t i = 0; i < candidate->chunkCount; ++i)
+			{
+				const ChunkEntry& entry = entries[i];
+				if (entry.offset % Alignment != 0 || entry.offset > length || entry.size > length - entry.offset)
+				{
+					return false;
+				}
+				if (entry.stride != 0 && entry.stride != 1 && uint64_t(entry.stride) * entry.count > entry.size)
+				{
+					return false;
+				}
+			}
+			header = candidate;
+			directory = entries;
+			return true;
+		}
+
+		Reader(const Reader&) = delete;
+		Reader& operator=(const Reader&) = delete;
+
+		const uint8_t* bytes = nullptr;
+		size_t length = 0;
+		const Header* header = nullptr;
+		const ChunkEntry* directory = nullptr;
+		bool mapped = false;
+#if defined(_WIN32)
+		HANDLE file = INVALID_HANDLE_VALUE;
+		HANDLE mapping = nullptr;
+#endif
+	};
+}
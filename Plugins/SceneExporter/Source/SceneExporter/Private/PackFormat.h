@@ -0,0 +1,226 @@
+#pragma once
+
+#include <algorithm>
+#include "LevelFormat.h"
+
+// Layout of the .pack file that holds every exported blob when pack mode is
+// on. Blobs start on a 16 byte boundary and are followed by the table of
+// contents, so a runtime can map the file and use each asset in place:
+//
+//   Header | blob data ... | Entry[entryCount] | string pool
+//
+// Entries are sorted by the hash of their name. Blobs with the same content
+// are stored once and shared by several entries. Names are the paths the
+// loose export would use, relative to the world folder ("Textures/Foo.tga").
+//
+// A compressed blob is cut into BlockSize blocks that are deflated on their
+// own, so any block can be decoded without the others:
+//
+//   uint32_t blockEnd[blockCount] | block data ...
+//
+// blockEnd is relative to the end of the table. A block that is not shorter
+// than its uncompressed size is stored as it is.
+namespace pack {
+	constexpr uint32_t Magic = level::MakeId('V', 'P', 'A', 'K');
+	constexpr uint32_t Version = 2;
+	constexpr uint32_t Alignment = 16;
+	constexpr uint32_t BlockSize = 256 * 1024;
+
+	/// <summary>Entry flags.</summary>
+	namespace flag {
+		/// <summary>Blocks are zlib streams.</summary>
+		constexpr uint32_t Zlib = 1;
+	}
+
+	struct Header
+	{
+		/// <summary>Zero until the table of contents is written, so an interrupted export is never valid.</summary>
+		uint32_t magic = 0;
+		uint32_t version = Version;
+		uint32_t entryCount = 0;
+		uint32_t flags = 0;
+		uint64_t tocOffset = 0;
+		uint64_t stringsOffset = 0;
+		uint64_t stringsSize = 0;
+		uint64_t fileSize = 0;
+	};
+
+	struct Entry
+	{
+		/// <summary>level::Hash64 of the UTF-8 name.</summary>
+		uint64_t nameHash = 0;
+		uint32_t name = 0;
+		uint32_t flags = 0;
+		uint64_t offset = 0;
+		/// <summary>Uncompressed size.</summary>
+		uint64_t size = 0;
+		/// <summary>level::Hash64 of the uncompressed blob.</summary>
+		uint64_t hash = 0;
+		/// <summary>Bytes in the file, equal to size unless the blob is compressed.</summary>
+		uint64_t storedSize = 0;
+	};
+
+	static_assert(sizeof(Header) == 48, "Header has to be 48 bytes");
+	static_assert(sizeof(Entry) == 48, "Entry has to be 48 bytes");
+
+	inline uint64_t HashName(const char* name)
+	{
+		return level::Hash64(name, std::strlen(name));
+	}
+
+	/// <summary>Lookup over a pack that is already in memory. Nothing is copied.</summary>
+	class Index
+	{
+	public:
+		bool Bind(const void* data, size_t size)
+		{
+			bytes = static_cast<const uint8_t*>(data);
+			header = nullptr;
+			if (size < sizeof(Header))
+			{
+				return false;
+			}
+			const Header* candidate = static_cast<const Header*>(data);
+			if (candidate->magic != Magic || candidate->version != Version || candidate->fileSize > size
+				|| candidate->tocOffset > size || uint64_t(candidate->entryCount) * sizeof(Entry) > size - candidate->tocOffset
+				|| candidate->stringsOffset > size || candidate->stringsSize > size - candidate->stringsOffset)
+			{
+				return false;
+			}
+			const Entry* candidates = reinterpret_cast<const Entry*>(bytes + candidate->tocOffset);
+			for (uint32_t i = 0; i < candidate->entryCount; ++i)
+			{
+				if (candidates[i].offset > size || candidates[i].storedSize > size - candidates[i].offset || candidates[i].name >= candidate->stringsSize
+					|| !HasValidBlocks(candidates[i]))
+				{
+					return false;
+				}
+			}
+			header = candidate;
+			entries = candidates;
+			return true;
+		}
+
+		bool IsValid() const
+		{
+			return header != nullptr;
+		}
+
+		uint32_t GetCount() const
+		{
+			return header ? header->entryCount : 0;
+		}
+
+		const Entry& GetEntry(uint32_t index) const
+		{
+			return entries[index];
+		}
+
+		const char* GetName(const Entry& entry) const
+		{
+			return reinterpret_cast<const char*>(bytes + header->stringsOffset + entry.name);
+		}
+
+		const uint8_t* GetData(const Entry& entry) const
+		{
+			return bytes + entry.offset;
+		}
+
+		const Entry* Find(const char* name) const
+		{
+			if (!header)
+			{
+				return nullptr;
+			}
+			const uint64_t hash = HashName(name);
+			const Entry* last = entries + header->entryCount;
+			const Entry* found = std::lower_bound(entries, last, hash, [](const Entry& entry, uint64_t value) { return entry.nameHash < value; });
+			for (; found != last && found->nameHash == hash; ++found)
+			{
+				if (std::strcmp(GetName(*found), name) == 0)
+				{
+					return found;
+				}
+			}
+			return nullptr;
+		}
+
+		bool IsCompressed(const Entry& entry) const
+		{
+			return (entry.flags & flag::Zlib) != 0;
+		}
+
+		uint32_t GetBlockCount(const Entry& entry) const
+		{
+			return IsCompressed(entry) ? uint32_t((entry.size + BlockSize - 1) / BlockSize) : 1;
+		}
+
+		/// <summary>Uncompressed size of a block.</summary>
+		uint32_t GetBlockSize(const Entry& entry, uint32_t block) const
+		{
+			if (!IsCompressed(entry))
+			{
+				return uint32_t(entry.size);
+			}
+			const uint64_t start = uint64_t(block) * BlockSize;
+			return uint32_t(std::min<uint64_t>(BlockSize, entry.size - start));
+		}
+
+		/// <summary>Stored bytes of a block; they are compressed when storedSize is less than GetBlockSize.</summary>
+		const uint8_t* GetBlock(const Entry& entry, uint32_t block, uint32_t& storedSize) const
+		{
+			if (!IsCompressed(entry))
+			{
+				storedSize = uint32_t(entry.storedSize);
+				return bytes + entry.offset;
+			}
+			const uint32_t* ends = reinterpret_cast<const uint32_t*>(bytes + entry.offset);
+			const uint32_t start = block ? ends[block - 1] : 0;
+			storedSize = ends[block] - start;
+			return bytes + entry.offset + sizeof(uint32_t) * GetBlockCount(entry) + start;
+		}
+
+		/// <summary>Checks an uncompressed blob against the hash stored in its entry.
+		/// Compressed blobs are checked by the caller after decoding.</summary>
+		bool Verify(const Entry& entry) const
+		{
+			return !IsCompressed(entry) && level::Hash64(bytes + entry.offset, size_t(entry.size)) == entry.hash;
+		}
+
+	private:
+		/// <summary>Checks that an uncompressed blob is stored whole and that the block table of
+		/// a compressed one only points into its stored bytes, so GetBlock never reads past them.</summary>
+		bool HasValidBlocks(const Entry& entry) const
+		{
+			if (!IsCompressed(entry))
+			{
+				return entry.storedSize == entry.size;
+			}
+			if ((entry.size + BlockSize - 1) / BlockSize > UINT32_MAX)
+			{
+				return false;
+			}
+			const uint32_t count = GetBlockCount(entry);
+			if (uint64_t(count) * sizeof(uint32_t) > entry.storedSize)
+			{
+				return false;
+			}
+			const uint64_t available = entry.storedSize - uint64_t(count) * sizeof(uint32_t);
+			const uint32_t* ends = reinterpret_cast<const uint32_t*>(bytes + entry.offset);
+			uint32_t start = 0;
+			for (uint32_t block = 0; block < count; ++block)
+			{
+				if (ends[block] < start || ends[block] - start > GetBlockSize(entry, block) || ends[block] > available)
+				{
+					return false;
+				}
+				start = ends[block];
+			}
+			return true;
+		}
+
+		const uint8_t* bytes = nullptr;
+		const Header* header = nullptr;
+		const Entry* entries = nullptr;
+	};
+}
@@ -2031,13 +2031,15 @@ public:
 		StopMainTick();
 		while (m_kFGTasks.size())
 		{
-			auto func = m_kFGTasks.pop();
+			std::function<void()>* func = nullptr;
+			m_kFGTasks.try_pop(func);
 			if (func) delete func;
 		}
 
 		while (m_kBGTasks.size())
 		{
-			auto func = m_kBGTasks.pop();
+			std::function<void()>* func = nullptr;
+			m_kBGTasks.try_pop(func);
 			if (func) delete func;
 		}
 	}
@@ -2128,7 +2130,8 @@ public:
 	{
 		while (!m_bCanceling)
 		{
-			auto func = m_kBGTasks.pop();
+			std::function<void()>* func = nullptr;
+			m_kBGTasks.try_pop(func);
 			if (func)
 			{
 				(*func)();
@@ -2158,7 +2161,8 @@ public:
 		}
 		else
 		{
-			auto func = m_kFGTasks.pop();
+			std::function<void()>* func = nullptr;
+			m_kFGTasks.try_pop(func);
 			if (func)
 			{
 				(*func)();
@@ -3210,8 +3214,8 @@ private:
 	bool m_bFinished = false;
 
 	TWeakPtr<SNotificationItem> m_wpNotificationItem;
-	ring_buffer<std::function<void()>*, nullptr> m_kFGTasks;
-	ring_buffer<std::function<void()>*, nullptr> m_kBGTasks;
+	ring_buffer<std::function<void()>*> m_kFGTasks;
+	ring_buffer<std::function<void()>*> m_kBGTasks;
 
 	UExporter* m_pkMeshExporter = nullptr;
 	UExporter* m_pkTGAExporter = nullptr;
@@ -5,8 +5,17 @@
 #include "Public/ObjectTools.h"
 #include "Public/HAL/Runnable.h"
 #include "Public/HAL/RunnableThread.h"
+#include "Public/HAL/Event.h"
+#include "Public/HAL/ThreadSafeCounter64.h"
 #include "Public/HAL/PlatformFilemanager.h"
 #include "Public/Misc/SingleThreadRunnable.h"
+#include "Serialization/BufferArchive.h"
+#include "Misc/Compression.h"
+#include "Misc/FileHelper.h"
+#include "Misc/ScopeLock.h"
+#include "Misc/Paths.h"
+#include "Misc/SecureHash.h"
+#include "Public/HAL/IConsoleManager.h"
 #include "Public/SceneTypes.h"
 #include "Public/LightMap.h"
 #include "Public/ShadowMap.h"
@@ -20,8 +29,19 @@
 #include "Components/DirectionalLightComponent.h"
 #include "Components/ExponentialHeightFogComponent.h"
 #include "ring_buffer.h"
+#include "task.h"
+#include "task_pool.h"
+#include "task_graph.h"
 #include "PVR.h"
-#include <functional>
+#include "LevelFormat.h"
+#include "LevelReader.h"
+#include "PackFormat.h"
+#include "ImageWriter.h"
+#include "RgbmEncode.h"
+#include "CubeFaceRemap.h"
+#include "BlockCompress.h"
+#include "AstcEncode.h"
+#include <atomic>
 #include <fstream>
 #include "CubemapUnwrapUtils.h"
 
@@ -30,6 +50,101 @@ using namespace vtd;
 DEFINE_LOG_CATEGORY(SceneExporter);
 #define LOCTEXT_NAMESPACE "FSceneExporterModule"
 
+static TAutoConsoleVariable<int32> CVarSceneExporterWorkers(
+	TEXT("SceneExporter.Workers"),
+	0,
+	TEXT("Number of worker threads used for lightmap and reflection probe export.\n")
+	TEXT("0: one per logical core"),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarSceneExporterGameThreadBudget(
+	TEXT("SceneExporter.GameThreadBudgetMs"),
+	8.0f,
+	TEXT("Milliseconds per editor tick spent running queued game thread export tasks.\n")
+	TEXT("At least one task runs per tick regardless of the budget."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarSceneExporterLevelFormat(
+	TEXT("SceneExporter.LevelFormat"),
+	2,
+	TEXT("Version of the .level file to write.\n")
+	TEXT("1: sequential stream of inline strings and scalars\n")
+	TEXT("2: chunked, 16 byte aligned arrays with a shared string pool, see LevelFormat.h"),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarSceneExporterInFlightBudget(
+	TEXT("SceneExporter.InFlightBudgetMB"),
+	512,
+	TEXT("Megabytes of texture and reflection capture snapshots that may wait for the workers,\n")
+	TEXT("and separately of finished files that may wait for the export thread.\n")
+	TEXT("New snapshots and texture files are deferred to a later tick while the budget is used up,\n")
+	TEXT("and workers wait before queuing more files."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarSceneExporterPack(
+	TEXT("SceneExporter.Pack"),
+	0,
+	TEXT("Write textures, lightmaps and envmaps into one .pack file instead of loose files.\n")
+	TEXT("0: loose files\n")
+	TEXT("1: one pack per world, meshes stay loose"),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarSceneExporterPackCompression(
+	TEXT("SceneExporter.PackCompression"),
+	1,
+	TEXT("Compression of the blobs in a pack.\n")
+	TEXT("0: stored\n")
+	TEXT("1: zlib, in independent blocks compressed on the workers"),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarSceneExporterIncremental(
+	TEXT("SceneExporter.Incremental"),
+	1,
+	TEXT("Skip loose files whose source and export settings match the manifest of the previous export.\n")
+	TEXT("Ignored in pack mode, where the pack is written from scratch."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarSceneExporterProbeCache(
+	TEXT("SceneExporter.ProbeCache"),
+	1,
+	TEXT("Keep encoded envmaps under Saved/SceneExporter/ProbeCache, keyed by the hash of the capture data\n")
+	TEXT("and the export settings, and reuse them instead of encoding captures that were not rebuilt."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarSceneExporterProbeCompression(
+	TEXT("SceneExporter.ProbeCompression"),
+	0,
+	TEXT("Block compression of the envmaps, encoded on the workers.\n")
+	TEXT("0: uncompressed BGRA8\n")
+	TEXT("1: DXT, BC1 for probes without RGBM alpha and BC3 otherwise\n")
+	TEXT("2: BC7, in a DDS with the DX10 header"),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarSceneExporterProbeCompressionQuality(
+	TEXT("SceneExporter.ProbeCompressionQuality"),
+	1,
+	TEXT("Effort of the envmap block compression.\n")
+	TEXT("0: bounding box endpoints\n")
+	TEXT("1: principal axis endpoints refined by least squares\n")
+	TEXT("2: as 1 with more refinement and a search around the endpoints"),
+	ECVF_Default);
+
+static TAutoConsoleVariable<FString> CVarSceneExporterASTC(
+	TEXT("SceneExporter.ASTC"),
+	TEXT(""),
+	TEXT("Block footprint of ASTC .pvr copies written next to BGRA8 textures, lightmaps and envmaps,\n")
+	TEXT("one of 4x4, 5x4, 5x5, 6x5, 6x6, 8x5, 8x6 or 8x8. Empty: no ASTC copies."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarSceneExporterASTCPreset(
+	TEXT("SceneExporter.ASTCPreset"),
+	1,
+	TEXT("Effort of the ASTC encoding.\n")
+	TEXT("0: fast, one weight grid per block\n")
+	TEXT("1: medium, the 4 best grids with a least squares refinement\n")
+	TEXT("2: thorough, the 16 best grids with two refinements"),
+	ECVF_Default);
+
 UExporter* GetFBXExporter()
 {
 	TArray<UExporter*> aryExporters;
@@ -75,43 +190,40 @@ uint32 roundpos(float v, uint32 w)
 	return (uint32)(FPlatformMath::RoundToInt(v / float(w))) * w;
 }
 
-class CTextureCubeWrite
+class CArraySink : public image::Sink
 {
 public:
-	CTextureCubeWrite(const TCHAR *fileName)
+	explicit CArraySink(TArray<uint8>& aryOut)
+		: m_aryOut(aryOut)
 	{
-		m_file.open(fileName, std::ios::out | std::ios::trunc);
 	}
-	~CTextureCubeWrite()
+
+	virtual bool Write(const void* pvData, size_t stSize) override
 	{
-		if (m_file)
-			m_file.close();
+		m_aryOut.Append((const uint8*)pvData, (int32)stSize);
+		return true;
 	}
 
-	static FColor ToRGBEDithered(const FLinearColor& ColorIN, const FRandomStream& Rand)
+	virtual void Reserve(size_t stSize) override
 	{
-		const float R = ColorIN.R;
-		const float G = ColorIN.G;
-		const float B = ColorIN.B;
-		const float Primary = FMath::Max3(R, G, B);
-		FColor	ReturnColor;
-
-		if (Primary < 1E-32)
-		{
-			ReturnColor = FColor(0, 0, 0, 0);
-		}
-		else
-		{
-			int32 Exponent;
-			const float Scale = frexp(Primary, &Exponent) / Primary * 255.f;
+		m_aryOut.Reserve(m_aryOut.Num() + (int32)stSize);
+	}
 
-			ReturnColor.R = FMath::Clamp(FMath::TruncToInt((R* Scale) + Rand.GetFraction()), 0, 255);
-			ReturnColor.G = FMath::Clamp(FMath::TruncToInt((G* Scale) + Rand.GetFraction()), 0, 255);
-			ReturnColor.B = FMath::Clamp(FMath::TruncToInt((B* Scale) + Rand.GetFraction()), 0, 255);
-			ReturnColor.A = FMath::Clamp(FMath::TruncToInt(Exponent), -128, 127) + 128;
-		}
+private:
+	TArray<uint8>& m_aryOut;
+};
 
-		return ReturnColor;
+class CTextureCubeWrite
+{
+public:
+	CTextureCubeWrite(const TCHAR *fileName)
+	{
+		m_file.open(fileName, std::ios::out | std::ios::trunc | std::ios::binary);
+	}
+	~CTextureCubeWrite()
+	{
+		if (m_file)
+			m_file.close();
 	}
 
 	template< typename type>
@@ -138,127 +250,11 @@ public:
 		return true;
 	}
 
-	template<typename TSourceColorType>
-	void WriteHDRBits(TSourceColorType* SourceTexels)
-	{
-		const FRandomStream RandomStream(0xA1A1);
-		const int32 NumChannels = 4;
-		const int32 SizeX = Size.X;
-		const int32 SizeY = Size.Y;
-		TArray<uint8> ScanLine[NumChannels];
-		for (int32 Channel = 0; Channel < NumChannels; Channel++)
-		{
-			ScanLine[Channel].Reserve(SizeX);
-		}
-
-		for (int32 y = 0; y < SizeY; y++)
-		{
-			// write RLE header
-			uint8 RLEheader[4];
-			RLEheader[0] = 2;
-			RLEheader[1] = 2;
-			RLEheader[2] = SizeX >> 8;
-			RLEheader[3] = SizeX & 0xFF;
-			//Ar.Serialize(&RLEheader[0], sizeof(RLEheader));
-			m_file.write((char*)&RLEheader[0], sizeof(RLEheader));
-
-			for (int32 Channel = 0; Channel < NumChannels; Channel++)
-			{
-				ScanLine[Channel].Reset();
-			}
-
-			for (int32 x = 0; x < SizeX; x++)
-			{
-				FLinearColor LinearColor(*SourceTexels);
-				FColor RGBEColor = ToRGBEDithered(LinearColor, RandomStream);
-
-				FLinearColor lintest = RGBEColor.FromRGBE();
-				ScanLine[0].Add(RGBEColor.R);
-				ScanLine[1].Add(RGBEColor.G);
-				ScanLine[2].Add(RGBEColor.B);
-				ScanLine[3].Add(RGBEColor.A);
-				SourceTexels++;
-			}
-
-			for (int32 Channel = 0; Channel < NumChannels; Channel++)
-			{
-				WriteScanLine(ScanLine[Channel]);
-			}
-		}
-	}
-
-	void WriteScanLine(const TArray<uint8>& ScanLine)
-	{
-		const uint8* LineEnd = ScanLine.GetData() + ScanLine.Num();
-		const uint8* LineSource = ScanLine.GetData();
-		TArray<uint8> Output;
-		Output.Reserve(ScanLine.Num() * 2);
-		while (LineSource < LineEnd)
-		{
-			int32 CurrentPos = 0;
-			int32 NextPos = 0;
-			int32 CurrentRunLength = 0;
-			while (CurrentRunLength <= 4 && NextPos < 128 && LineSource + NextPos < LineEnd)
-			{
-				CurrentPos = NextPos;
-				CurrentRunLength = 0;
-				while (CurrentRunLength < 127 && CurrentPos + CurrentRunLength < 128 && LineSource + NextPos < LineEnd && LineSource[CurrentPos] == LineSource[NextPos])
-				{
-					NextPos++;
-					CurrentRunLength++;
-				}
-			}
-
-			if (CurrentRunLength > 4)
-			{
-				// write a non run: LineSource[0] to LineSource[CurrentPos]
-				if (CurrentPos > 0)
-				{
-					Output.Add(CurrentPos);
-					for (int32 i = 0; i < CurrentPos; i++)
-					{
-						Output.Add(LineSource[i]);
-					}
-				}
-				Output.Add((uint8)(128 + CurrentRunLength));
-				Output.Add(LineSource[CurrentPos]);
-			}
-			else
-			{
-				// write a non run: LineSource[0] to LineSource[NextPos]
-				Output.Add((uint8)(NextPos));
-				for (int32 i = 0; i < NextPos; i++)
-				{
-					Output.Add((uint8)(LineSource[i]));
-				}
-			}
-			LineSource += NextPos;
-		}
-		//Ar.Serialize(Output.GetData(), Output.Num());
-		m_file.write((char*)Output.GetData(), Output.Num());
-	}
-
 	void WriteHDRImage(const TArray<uint8>& RawData)
 	{
-		WriteHDRHeader();
-		if (Format == PF_FloatRGBA)
-		{
-			WriteHDRBits((FFloat16Color*)RawData.GetData());
-		}
-		else
-		{
-			WriteHDRBits((FColor*)RawData.GetData());
-		}
-	}
-
-	void WriteHDRHeader()
-	{
-		const int32 MaxHeaderSize = 256;
-		char Header[MAX_SPRINTF];
-		FCStringAnsi::Sprintf(Header, "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y %d +X %d\n", Size.Y, Size.X);
-		Header[MaxHeaderSize - 1] = 0;
-		int32 Len = FMath::Min(FCStringAnsi::Strlen(Header), MaxHeaderSize);
-		m_file.write(Header, Len);
+		const image::Format eFormat = (Format == PF_FloatRGBA) ? image::Format::RGBA16F : image::Format::BGRA8;
+		image::StreamSink kSink(m_file);
+		image::WriteHDR(kSink, image::MakeView(RawData.GetData(), Size.X, Size.Y, eFormat));
 	}
 
 	FIntPoint Size;
@@ -314,6 +310,7 @@ const uint32 DDSF_VOLUME = 0x00200000;
 #define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT                  0x83F1
 #define GL_COMPRESSED_RGBA_S3TC_DXT3_EXT                  0x83F2
 #define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT                  0x83F3
+#define GL_COMPRESSED_RGBA_BPTC_UNORM                     0x8E8C
 
 #define GL_RGB                            0x1907
 #define GL_RGBA                           0x1908
@@ -390,76 +387,17 @@ void flip_blocks_dxtc3(DXTColBlock *line, unsigned int numBlocks) {
 ///////////////////////////////////////////////////////////////////////////////
 // flip a DXT5 alpha block
 void flip_dxt5_alpha(DXT5AlphaBlock *block) {
-	uint8_t gBits[4][4];
-
-	const uint32_t mask = 0x00000007;          // bits = 00 00 01 11
-	uint32_t bits = 0;
-	memcpy(&bits, &block->row[0], sizeof(uint8_t) * 3);
-
-	gBits[0][0] = (uint8_t)(bits & mask);
-	bits >>= 3;
-	gBits[0][1] = (uint8_t)(bits & mask);
-	bits >>= 3;
-	gBits[0][2] = (uint8_t)(bits & mask);
-	bits >>= 3;
-	gBits[0][3] = (uint8_t)(bits & mask);
-	bits >>= 3;
-	gBits[1][0] = (uint8_t)(bits & mask);
-	bits >>= 3;
-	gBits[1][1] = (uint8_t)(bits & mask);
-	bits >>= 3;
-	gBits[1][2] = (uint8_t)(bits & mask);
-	bits >>= 3;
-	gBits[1][3] = (uint8_t)(bits & mask);
-
-	bits = 0;
-	memcpy(&bits, &block->row[3], sizeof(uint8_t) * 3);
-
-	gBits[2][0] = (uint8_t)(bits & mask);
-	bits >>= 3;
-	gBits[2][1] = (uint8_t)(bits & mask);
-	bits >>= 3;
-	gBits[2][2] = (uint8_t)(bits & mask);
-	bits >>= 3;
-	gBits[2][3] = (uint8_t)(bits & mask);
-	bits >>= 3;
-	gBits[3][0] = (uint8_t)(bits & mask);
-	bits >>= 3;
-	gBits[3][1] = (uint8_t)(bits & mask);
-	bits >>= 3;
-	gBits[3][2] = (uint8_t)(bits & mask);
-	bits >>= 3;
-	gBits[3][3] = (uint8_t)(bits & mask);
-
-	uint32_t *pBits = ((uint32_t*) &(block->row[0]));
-
-	*pBits = *pBits | (gBits[3][0] << 0);
-	*pBits = *pBits | (gBits[3][1] << 3);
-	*pBits = *pBits | (gBits[3][2] << 6);
-	*pBits = *pBits | (gBits[3][3] << 9);
-
-	*pBits = *pBits | (gBits[2][0] << 12);
-	*pBits = *pBits | (gBits[2][1] << 15);
-	*pBits = *pBits | (gBits[2][2] << 18);
-	*pBits = *pBits | (gBits[2][3] << 21);
-
-	pBits = ((uint32_t*) &(block->row[3]));
-
-#ifdef MACOS
-	*pBits &= 0x000000ff;
-#else
-	*pBits &= 0xff000000;
-#endif
-
-	*pBits = *pBits | (gBits[1][0] << 0);
-	*pBits = *pBits | (gBits[1][1] << 3);
-	*pBits = *pBits | (gBits[1][2] << 6);
-	*pBits = *pBits | (gBits[1][3] << 9);
-
-	*pBits = *pBits | (gBits[0][0] << 12);
-	*pBits = *pBits | (gBits[0][1] << 15);
-	*pBits = *pBits | (gBits[0][2] << 18);
-	*pBits = *pBits | (gBits[0][3] << 21);
+	// 16 3 bit indices, 12 bits per row of four texels, in the 48 bits
+	// after the endpoints; only those 6 bytes are read and written.
+	uint64_t bits = 0;
+	memcpy(&bits, block->row, sizeof(block->row));
+
+	uint64_t flipped = 0;
+	for (int row = 0; row < 4; row++) {
+		flipped |= ((bits >> (row * 12)) & 0xfff) << ((3 - row) * 12);
+	}
+
+	memcpy(block->row, &flipped, sizeof(block->row));
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -522,13 +460,14 @@ class CSurface {
 public:
 	CSurface();
 	CSurface(unsigned int w, unsigned int h, unsigned int d, unsigned int imgsize, const uint8 *pixels);
-	CSurface(const CSurface &copy);
-	CSurface &operator=(const CSurface &rhs);
+	CSurface(CSurface &&other);
+	CSurface &operator=(CSurface &&rhs);
 	virtual ~CSurface();
 
 	operator uint8*() const;
 
 	virtual void create(unsigned int w, unsigned int h, unsigned int d, unsigned int imgsize, const uint8 *pixels);
+	virtual void attach(unsigned int w, unsigned int h, unsigned int d, unsigned int imgsize, uint8 *pixels);
 	virtual void clear();
 
 	unsigned int get_width() const {
@@ -543,16 +482,25 @@ public:
 	unsigned int get_size() const {
 		return m_size;
 	}
+	bool owns_pixels() const {
+		return m_owner;
+	}
 
 	friend class CTexture;
 
 private:
+	CSurface(const CSurface &copy) = delete;
+	CSurface &operator=(const CSurface &rhs) = delete;
+
+	void take(CSurface &other);
+
 	unsigned int m_width;
 	unsigned int m_height;
 	unsigned int m_depth;
 	unsigned int m_size;
 
 	uint8 *m_pixels;
+	bool m_owner;
 };
 
 //////////////////////////////////////////////////////////////////////////////
@@ -562,46 +510,29 @@ private:
 ///////////////////////////////////////////////////////////////////////////////
 // default constructor
 CSurface::CSurface() :
-	m_width(0), m_height(0), m_depth(0), m_size(0), m_pixels(NULL) {
+	m_width(0), m_height(0), m_depth(0), m_size(0), m_pixels(NULL), m_owner(false) {
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-// creates an empty image
+// creates an image holding a copy of pixels
 CSurface::CSurface(unsigned int w, unsigned int h, unsigned int d, unsigned int imgsize, const uint8 *pixels) :
-	m_width(0), m_height(0), m_depth(0), m_size(0), m_pixels(NULL) {
+	m_width(0), m_height(0), m_depth(0), m_size(0), m_pixels(NULL), m_owner(false) {
 	create(w, h, d, imgsize, pixels);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-// copy constructor
-CSurface::CSurface(const CSurface &copy) :
-	m_width(0), m_height(0), m_depth(0), m_size(0), m_pixels(NULL) {
-	if (copy.get_size() != 0) {
-		m_size = copy.get_size();
-		m_width = copy.get_width();
-		m_height = copy.get_height();
-		m_depth = copy.get_depth();
-
-		m_pixels = new uint8_t[m_size];
-		memcpy(m_pixels, copy, m_size);
-	}
+// move constructor, other is left empty
+CSurface::CSurface(CSurface &&other) :
+	m_width(0), m_height(0), m_depth(0), m_size(0), m_pixels(NULL), m_owner(false) {
+	take(other);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-// assignment operator
-CSurface &CSurface::operator=(const CSurface &rhs) {
+// move assignment, rhs is left empty
+CSurface &CSurface::operator=(CSurface &&rhs) {
 	if (this != &rhs) {
-		clear();
-
-		if (rhs.get_size()) {
-			m_size = rhs.get_size();
-			m_width = rhs.get_width();
-			m_height = rhs.get_height();
-			m_depth = rhs.get_depth();
-
-			m_pixels = new uint8[m_size];
-			memcpy(m_pixels, rhs, m_size);
-		}
+		CSurface::clear();
+		take(rhs);
 	}
 
 	return *this;
@@ -610,7 +541,7 @@ CSurface &CSurface::operator=(const CSurface &rhs) {
 ///////////////////////////////////////////////////////////////////////////////
 // clean up image memory
 CSurface::~CSurface() {
-	clear();
+	CSurface::clear();
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -620,26 +551,54 @@ CSurface::operator uint8_t*() const {
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-// creates an empty image
+// copies pixels into memory owned by the surface
 void CSurface::create(unsigned int w, unsigned int h, unsigned int d, unsigned int imgsize, const uint8 *pixels) {
 
-	clear();
+	CSurface::clear();
 
 	m_width = w;
 	m_height = h;
 	m_depth = d;
 	m_size = imgsize;
 	m_pixels = new uint8_t[imgsize];
+	m_owner = true;
 	memcpy(m_pixels, pixels, imgsize);
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// refers to pixels owned by the caller, which have to outlive the surface
+void CSurface::attach(unsigned int w, unsigned int h, unsigned int d, unsigned int imgsize, uint8 *pixels) {
+
+	CSurface::clear();
+
+	m_width = w;
+	m_height = h;
+	m_depth = d;
+	m_size = imgsize;
+	m_pixels = pixels;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // free surface memory
 void CSurface::clear() {
-	if (m_pixels != NULL) {
+	if (m_owner) {
 		delete[] m_pixels;
-		m_pixels = NULL;
 	}
+	m_pixels = NULL;
+	m_owner = false;
+}
+
+void CSurface::take(CSurface &other) {
+	m_width = other.m_width;
+	m_height = other.m_height;
+	m_depth = other.m_depth;
+	m_size = other.m_size;
+	m_pixels = other.m_pixels;
+	m_owner = other.m_owner;
+
+	other.m_width = other.m_height = other.m_depth = other.m_size = 0;
+	other.m_pixels = NULL;
+	other.m_owner = false;
 }
 
 class CTexture : public CSurface {
@@ -648,11 +607,12 @@ class CTexture : public CSurface {
 public:
 	CTexture();
 	CTexture(unsigned int w, unsigned int h, unsigned int d, unsigned int imgsize, const uint8_t *pixels);
-	CTexture(const CTexture &copy);
-	CTexture &operator=(const CTexture &rhs);
+	CTexture(CTexture &&other);
+	CTexture &operator=(CTexture &&rhs);
 	~CTexture();
 
 	void create(unsigned int w, unsigned int h, unsigned int d, unsigned int imgsize, const uint8_t *pixels);
+	void attach(unsigned int w, unsigned int h, unsigned int d, unsigned int imgsize, uint8_t *pixels);
 	void clear();
 
 	const CSurface &get_mipmap(unsigned int index) const {
@@ -660,42 +620,14 @@ public:
 		return m_mipmaps[index];
 	}
 
-	void add_mipmap(const CSurface &mipmap) {
-		m_mipmaps.Push(mipmap);
+	void add_mipmap(CSurface &&mipmap) {
+		m_mipmaps.Add(MoveTemp(mipmap));
 	}
 
 	unsigned int get_num_mipmaps() const {
 		return (unsigned int)m_mipmaps.Num();
 	}
 
-	void FlipX()
-	{
-		uint32* buffer = (uint32*)m_pixels;
-		for (uint32 i(0); i < m_height; ++i)
-		{
-			for (uint32 j(0); j < (m_width >> 1); ++j)
-			{
-				uint32 temp = buffer[i * m_width + j];
-				buffer[i * m_width + j] = buffer[i * m_width + m_width - j - 1];
-				buffer[i * m_width + m_width - j - 1] = temp;
-			}
-		}
-
-		for (auto& sur : m_mipmaps)
-		{
-			buffer = (uint32*)sur.m_pixels;
-			for (uint32 i(0); i < sur.m_height; ++i)
-			{
-				for (uint32 j(0); j < (sur.m_width >> 1); ++j)
-				{
-					uint32 temp = buffer[i * sur.m_width + j];
-					buffer[i * sur.m_width + j] = buffer[i * sur.m_width + sur.m_width - j - 1];
-					buffer[i * sur.m_width + sur.m_width - j - 1] = temp;
-				}
-			}
-		}
-	}
-
 protected:
 	CSurface &get_mipmap(unsigned int index) {
 
@@ -718,7 +650,7 @@ CTexture::CTexture() :
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-// creates an empty texture
+// creates a texture holding a copy of pixels
 CTexture::CTexture(unsigned int w, unsigned int h, unsigned int d, unsigned int imgsize, const uint8 *pixels) :
 	CSurface(w, h, d, imgsize, pixels)  // initialize base class part
 {
@@ -728,22 +660,17 @@ CTexture::~CTexture() {
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-// copy constructor
-CTexture::CTexture(const CTexture &copy) :
-	CSurface(copy) {
-	for (unsigned int i = 0; i < copy.get_num_mipmaps(); i++)
-		m_mipmaps.Push(copy.get_mipmap(i));
+// move constructor
+CTexture::CTexture(CTexture &&other) :
+	CSurface(MoveTemp(other)), m_mipmaps(MoveTemp(other.m_mipmaps)) {
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-// assignment operator
-CTexture &CTexture::operator=(const CTexture &rhs) {
+// move assignment
+CTexture &CTexture::operator=(CTexture &&rhs) {
 	if (this != &rhs) {
-		CSurface::operator =(rhs);
-
-		m_mipmaps.Empty();
-		for (unsigned int i = 0; i < rhs.get_num_mipmaps(); i++)
-			m_mipmaps.Push(rhs.get_mipmap(i));
+		CSurface::operator =(MoveTemp(rhs));
+		m_mipmaps = MoveTemp(rhs.m_mipmaps);
 	}
 
 	return *this;
@@ -755,28 +682,35 @@ void CTexture::create(unsigned int w, unsigned int h, unsigned int d, unsigned i
 	m_mipmaps.Empty();
 }
 
+void CTexture::attach(unsigned int w, unsigned int h, unsigned int d, unsigned int imgsize, uint8 *pixels) {
+	CSurface::attach(w, h, d, imgsize, pixels);
+
+	m_mipmaps.Empty();
+}
+
 void CTexture::clear() {
 	CSurface::clear();
 
 	m_mipmaps.Empty();
 }
 
-
 class CDDSImage {
 public:
 	CDDSImage();
 	~CDDSImage();
 
-	void create_textureFlat(unsigned int format, unsigned int components, const CTexture &baseImage);
-	void create_texture3D(unsigned int format, unsigned int components, const CTexture &baseImage);
-	void create_textureCubemap(unsigned int format, unsigned int components, const CTexture &positiveX, const CTexture &negativeX, const CTexture &positiveY,
-		const CTexture &negativeY, const CTexture &positiveZ, const CTexture &negativeZ);
+	// the textures are moved in; surfaces attached to caller memory stay views of it
+	void create_textureFlat(unsigned int format, unsigned int components, CTexture &&baseImage);
+	void create_texture3D(unsigned int format, unsigned int components, CTexture &&baseImage);
+	void create_textureCubemap(unsigned int format, unsigned int components, CTexture &&positiveX, CTexture &&negativeX, CTexture &&positiveY,
+		CTexture &&negativeY, CTexture &&positiveZ, CTexture &&negativeZ);
 
 	void clear();
 
 	void load(std::istream& is, bool flipImage = true);
 	void load(const FString& filename, bool flipImage = true);
 	void save(const FString& filename, bool flipImage = true);
+	void save(TArray<uint8>& aryOut, bool flipImage = true);
 
 
 	operator uint8_t*() {
@@ -853,9 +787,7 @@ private:
 	}
 
 	void flip(CSurface &surface);
-	void flip_texture(CTexture &texture);
-
-	void write_texture(const CTexture &texture, std::ostream& os);
+	bool write(image::Sink &sink, bool flipImage);
 
 	unsigned int m_format;
 	unsigned int m_components;
@@ -877,7 +809,7 @@ CDDSImage::CDDSImage() :
 CDDSImage::~CDDSImage() {
 }
 
-void CDDSImage::create_textureFlat(unsigned int format, unsigned int components, const CTexture &baseImage) {
+void CDDSImage::create_textureFlat(unsigned int format, unsigned int components, CTexture &&baseImage) {
 
 	// remove any existing images
 	clear();
@@ -886,12 +818,12 @@ void CDDSImage::create_textureFlat(unsigned int format, unsigned int components,
 	m_components = components;
 	m_type = TextureFlat;
 
-	m_images.Push(baseImage);
+	m_images.Add(MoveTemp(baseImage));
 
 	m_valid = true;
 }
 
-void CDDSImage::create_texture3D(unsigned int format, unsigned int components, const CTexture &baseImage) {
+void CDDSImage::create_texture3D(unsigned int format, unsigned int components, CTexture &&baseImage) {
 
 	// remove any existing images
 	clear();
@@ -900,7 +832,7 @@ void CDDSImage::create_texture3D(unsigned int format, unsigned int components, c
 	m_components = components;
 	m_type = Texture3D;
 
-	m_images.Push(baseImage);
+	m_images.Add(MoveTemp(baseImage));
 
 	m_valid = true;
 }
@@ -916,8 +848,8 @@ inline bool same_size(const CTexture &a, const CTexture &b) {
 	return true;
 }
 
-void CDDSImage::create_textureCubemap(unsigned int format, unsigned int components, const CTexture &positiveX, const CTexture &negativeX,
-	const CTexture &positiveY, const CTexture &negativeY, const CTexture &positiveZ, const CTexture &negativeZ) {
+void CDDSImage::create_textureCubemap(unsigned int format, unsigned int components, CTexture &&positiveX, CTexture &&negativeX,
+	CTexture &&positiveY, CTexture &&negativeY, CTexture &&positiveZ, CTexture &&negativeZ) {
 
 
 
@@ -928,12 +860,12 @@ void CDDSImage::create_textureCubemap(unsigned int format, unsigned int componen
 	m_components = components;
 	m_type = TextureCubemap;
 
-	m_images.Push(positiveX);
-	m_images.Push(negativeX);
-	m_images.Push(positiveY);
-	m_images.Push(negativeY);
-	m_images.Push(positiveZ);
-	m_images.Push(negativeZ);
+	m_images.Add(MoveTemp(positiveX));
+	m_images.Add(MoveTemp(negativeX));
+	m_images.Add(MoveTemp(positiveY));
+	m_images.Add(MoveTemp(negativeY));
+	m_images.Add(MoveTemp(positiveZ));
+	m_images.Add(MoveTemp(negativeZ));
 
 	m_valid = true;
 }
@@ -1113,130 +1045,69 @@ void CDDSImage::load(std::istream& is, bool flipImage) {
 
 	// swap cubemaps on y axis (since image is flipped in OGL)
 	if (m_type == TextureCubemap && flipImage) {
-		CTexture tmp;
-		tmp = m_images[3];
-		m_images[3] = m_images[2];
-		m_images[2] = tmp;
+		m_images.Swap(2, 3);
 	}
 
 	m_valid = true;
 }
 
-void CDDSImage::write_texture(const CTexture &texture, std::ostream& os) {
-
-	os.write((char*)(uint8_t*)texture, texture.get_size());
-
-	for (unsigned int i = 0; i < texture.get_num_mipmaps(); i++) {
-		const CSurface &mipmap = texture.get_mipmap(i);
-		os.write((char*)(uint8_t*)mipmap, mipmap.get_size());
-	}
-}
-
+// streams to the file as the writer produces rows; no copy of the whole file is made
 void CDDSImage::save(const FString& filename, bool flipImage) {
+	std::ofstream of(*filename, std::ios::binary);
+	image::StreamSink kSink(of);
+	if (!write(kSink, flipImage))
+		UE_LOG(SceneExporter, Warning, TEXT("Failed to write \"%s\"."), *filename);
+}
 
+void CDDSImage::save(TArray<uint8>& aryOut, bool flipImage) {
+	aryOut.Reset();
+	CArraySink kSink(aryOut);
+	write(kSink, flipImage);
+}
 
-	DDS_HEADER ddsh;
-	unsigned int headerSize = sizeof(DDS_HEADER);
-	memset(&ddsh, 0, headerSize);
-	ddsh.dwSize = headerSize;
-	ddsh.dwFlags = DDSD_CAPS | DDSD_WIDTH | DDSD_HEIGHT | DDSD_PIXELFORMAT;
-	ddsh.dwHeight = get_height();
-	ddsh.dwWidth = get_width();
-
-	if (is_compressed()) {
-		ddsh.dwFlags |= DDSD_LINEARSIZE;
-		ddsh.dwLinearSize = get_size();
-	}
-	else {
-		ddsh.dwFlags |= DDSD_PITCH;
-		ddsh.dwLinearSize = get_dword_aligned_linesize(get_width(), m_components * 8);
-	}
-
+bool CDDSImage::write(image::Sink& kSink, bool flipImage) {
 	if (m_type == Texture3D) {
-		ddsh.dwFlags |= DDSD_DEPTH;
-		ddsh.dwDepth = get_depth();
-	}
-
-	if (get_num_mipmaps() > 0) {
-		ddsh.dwFlags |= DDSD_MIPMAPCOUNT;
-		ddsh.dwMipMapCount = get_num_mipmaps() + 1;
-	}
-
-	ddsh.ddpf.dwSize = sizeof(DDS_PIXELFORMAT);
-
-	if (is_compressed()) {
-		ddsh.ddpf.dwFlags = DDPF_FOURCC;
-
-		if (m_format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT)
-			ddsh.ddpf.dwFourCC = FOURCC_DXT1;
-		if (m_format == GL_COMPRESSED_RGBA_S3TC_DXT3_EXT)
-			ddsh.ddpf.dwFourCC = FOURCC_DXT3;
-		if (m_format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)
-			ddsh.ddpf.dwFourCC = FOURCC_DXT5;
+		UE_LOG(SceneExporter, Warning, TEXT("Volume textures can not be saved as DDS."));
+		return false;
 	}
-	else {
-		ddsh.ddpf.dwFlags = (m_components == 4) ? DDSF_RGBA : DDPF_RGB;
-		ddsh.ddpf.dwRGBBitCount = m_components * 8;
-		ddsh.ddpf.dwRBitMask = 0x00ff0000;
-		ddsh.ddpf.dwGBitMask = 0x0000ff00;
-		ddsh.ddpf.dwBBitMask = 0x000000ff;
 
-		if (m_components == 4) {
-			ddsh.ddpf.dwFlags |= DDPF_ALPHAPIXELS;
-			ddsh.ddpf.dwABitMask = 0xff000000;
+	image::Format eFormat = (m_components == 4) ? image::Format::BGRA8 : image::Format::BGR8;
+	if (m_format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT)
+		eFormat = image::Format::BC1;
+	else if (m_format == GL_COMPRESSED_RGBA_S3TC_DXT3_EXT)
+		eFormat = image::Format::BC2;
+	else if (m_format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)
+		eFormat = image::Format::BC3;
+	else if (m_format == GL_COMPRESSED_RGBA_BPTC_UNORM)
+		eFormat = image::Format::BC7;
+
+	// the writer emits rows, or flipped block rows, bottom up straight from the
+	// surfaces, which are never modified; without flipImage they are taken to be
+	// in file order already, as a producer that writes bottom up leaves them
+	const uint32 uOrientation = flipImage ? image::BottomUp : image::TopDown;
+	const int32 iFaces = (m_type == TextureCubemap) ? 6 : 1;
+	const uint32 uMips = get_num_mipmaps() + 1;
+
+	TArray<image::View> aryViews;
+	aryViews.Reserve(iFaces * uMips);
+	for (int32 i = 0; i < iFaces; i++) {
+		// swap cubemaps on y axis (since image is flipped in OGL)
+		int32 iSource = i;
+		if (m_type == TextureCubemap && i == 2)
+			iSource = 3;
+		else if (m_type == TextureCubemap && i == 3)
+			iSource = 2;
+
+		const CTexture* pkFace = &m_images[iSource];
+
+		aryViews.Add(image::MakeView((const uint8_t*)*pkFace, pkFace->get_width(), pkFace->get_height(), eFormat, uOrientation));
+		for (unsigned int j = 0; j < pkFace->get_num_mipmaps(); j++) {
+			const CSurface &mipmap = pkFace->get_mipmap(j);
+			aryViews.Add(image::MakeView((const uint8_t*)mipmap, mipmap.get_width(), mipmap.get_height(), eFormat, uOrientation));
 		}
 	}
 
-	ddsh.dwCaps = DDSCAPS_TEXTURE;
-
-	if (m_type == TextureCubemap) {
-		ddsh.dwCaps |= DDSCAPS_COMPLEX;
-		ddsh.dwCaps2 = DDSF_CUBEMAP | DDSF_CUBEMAP_ALL_FACES;
-	}
-
-	if (m_type == Texture3D) {
-		ddsh.dwCaps |= DDSCAPS_COMPLEX;
-		ddsh.dwCaps2 = DDSF_VOLUME;
-	}
-
-	if (get_num_mipmaps() > 0)
-		ddsh.dwCaps |= DDSCAPS_COMPLEX | DDSCAPS_MIPMAP;
-
-	// open file
-	std::ofstream of;
-	of.exceptions(std::ios::failbit);
-	of.open(*filename, std::ios::binary);
-
-	// write file header
-	of.write("DDS ", 4);
-
-	// write dds header
-	of.write((char*)&ddsh, sizeof(DDS_HEADER));
-
-	if (m_type != TextureCubemap) {
-		CTexture tex = m_images[0];
-		if (flipImage)
-			flip_texture(tex);
-		write_texture(tex, of);
-	}
-	else {
-
-
-		for (int i = 0; i < m_images.Num(); i++) {
-			CTexture cubeFace;
-
-			if (i == 2)
-				cubeFace = m_images[3];
-			else if (i == 3)
-				cubeFace = m_images[2];
-			else
-				cubeFace = m_images[i];
-
-			if (flipImage)
-				flip_texture(cubeFace);
-			write_texture(cubeFace, of);
-		}
-	}
+	return image::WriteDDS(kSink, aryViews.GetData(), iFaces, uMips);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -1254,7 +1125,8 @@ void CDDSImage::clear() {
 bool CDDSImage::is_compressed() {
 	return (m_format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT)
 		|| (m_format == GL_COMPRESSED_RGBA_S3TC_DXT3_EXT)
-		|| (m_format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT);
+		|| (m_format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)
+		|| (m_format == GL_COMPRESSED_RGBA_BPTC_UNORM);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -1360,15 +1232,6 @@ void CDDSImage::flip(CSurface &surface) {
 	}
 }
 
-void CDDSImage::flip_texture(CTexture &texture) {
-	flip(texture);
-
-	for (unsigned int i = 0; i < texture.get_num_mipmaps(); i++) {
-		flip(texture.get_mipmap(i));
-	}
-}
-
-
 class LightMap2DExt : public FLightMap2D
 {
 public:
@@ -1523,16 +1386,14 @@ static void EdgeWalkSetup(bool ReverseDirection, int32 Edge, int32 MipSize, int3
 	}
 }
 
-TRefCountPtr<FReflectionCaptureUncompressedData> GenerateFromDerivedDataSource(const FReflectionCaptureFullHDR& FullHDRData)
+TRefCountPtr<FReflectionCaptureUncompressedData> GenerateFromDerivedDataSource(FReflectionCaptureUncompressedData& SourceCubemapData, int32 CubemapSize)
 {
-	const int32 NumMips = FMath::CeilLogTwo(FullHDRData.CubemapSize) + 1;
-
-	TRefCountPtr<FReflectionCaptureUncompressedData> SourceCubemapData = FullHDRData.GetUncompressedData();
+	const int32 NumMips = FMath::CeilLogTwo(CubemapSize) + 1;
 
 	int32 SourceMipBaseIndex = 0;
 	int32 DestMipBaseIndex = 0;
 
-	TRefCountPtr<FReflectionCaptureUncompressedData> CapturedData = new FReflectionCaptureUncompressedData(SourceCubemapData->Size() * sizeof(FColor) / sizeof(FFloat16Color));
+	TRefCountPtr<FReflectionCaptureUncompressedData> CapturedData = new FReflectionCaptureUncompressedData(SourceCubemapData.Size() * sizeof(FColor) / sizeof(FFloat16Color));
 
 	// Note: change REFLECTIONCAPTURE_ENCODED_DERIVEDDATA_VER when modifying the encoded data layout or contents
 
@@ -1542,7 +1403,7 @@ TRefCountPtr<FReflectionCaptureUncompressedData> GenerateFromDerivedDataSource(c
 		const int32 SourceCubeFaceBytes = MipSize * MipSize * sizeof(FFloat16Color);
 		const int32 DestCubeFaceBytes = MipSize * MipSize * sizeof(FColor);
 
-		const FFloat16Color*	MipSrcData = (const FFloat16Color*)SourceCubemapData->GetData(SourceMipBaseIndex);
+		const FFloat16Color*	MipSrcData = (const FFloat16Color*)SourceCubemapData.GetData(SourceMipBaseIndex);
 		FColor*					MipDstData = (FColor*)CapturedData->GetData(DestMipBaseIndex);
 
 		// Fix cubemap seams by averaging colors across edges
@@ -1626,20 +1487,16 @@ TRefCountPtr<FReflectionCaptureUncompressedData> GenerateFromDerivedDataSource(c
 		{
 			const int32 FaceSourceIndex = SourceMipBaseIndex + CubeFace * SourceCubeFaceBytes;
 			const int32 FaceDestIndex = DestMipBaseIndex + CubeFace * DestCubeFaceBytes;
-			const FFloat16Color* FaceSourceData = (const FFloat16Color*)SourceCubemapData->GetData(FaceSourceIndex);
+			const FFloat16Color* FaceSourceData = (const FFloat16Color*)SourceCubemapData.GetData(FaceSourceIndex);
 			FColor* FaceDestData = (FColor*)CapturedData->GetData(FaceDestIndex);
 
 			// Convert each texel from linear space FP16 to RGBM FColor
 			// Note: Brightness on the capture is baked into the encoded HDR data
-			// Skip edges
+			// Skip edges; each row is one batch, with the same bytes RGBMEncode gives
 			for (int32 y = 1; y < MipSize - 1; y++)
 			{
-				for (int32 x = 1; x < MipSize - 1; x++)
-				{
-					int32 TexelIndex = x + y * MipSize;
-					const FLinearColor LinearColor = FLinearColor(FaceSourceData[TexelIndex]);
-					FaceDestData[TexelIndex] = RGBMEncode(LinearColor);
-				}
+				const int32 TexelIndex = 1 + y * MipSize;
+				rgbm::EncodeSpan((const uint16*)(FaceSourceData + TexelIndex), (uint8*)(FaceDestData + TexelIndex), MipSize - 2);
 			}
 		}
 
@@ -1649,118 +1506,306 @@ TRefCountPtr<FReflectionCaptureUncompressedData> GenerateFromDerivedDataSource(c
 	return CapturedData;
 }
 
-void CubeFace2UNITY(int32 face, FMatrix &matrix, int32 size)
+// Writes the rows bottom up, the order they have in a DDS file.
+void GetFaceData(uint8 *writeData, const uint8 *data, int32 face, int32 size)
 {
-	FMatrix temp1, temp2, temp3;
-	matrix.SetIdentity();
-	temp1.SetIdentity();
-	temp1.SetOrigin(FVector(-0.5f * (size - 1), -0.5f * (size - 1), 0.f));
-	temp2.SetIdentity();
-	temp3.SetIdentity();
-	temp3.SetOrigin(FVector(0.5f * (size - 1), 0.5f * (size - 1), 0.f));
-	switch (face)
-	{
-	case 0:
-	{
-		temp2.M[0][0] = 0;
-		temp2.M[0][1] = -1;
-		temp2.M[1][0] = 1;
-		temp2.M[1][1] = 0;
-		matrix = temp1*temp2*temp3;
-	}
-	break;
-	case 1:
-	{
-		temp2.M[0][0] = 0;
-		temp2.M[0][1] = 1;
-		temp2.M[1][0] = -1;
-		temp2.M[1][1] = 0;
-		matrix = temp1*temp2*temp3;
-	}
-	break;
-	case 3:
-	{
-		temp2.M[0][0] = 1;
-		//temp2.M[0][1] = 1;
-		//temp2.M[1][0] = -1;
-		temp2.M[1][1] = -1;
-		matrix = temp1*temp2*temp3;
-	}
-	break;
-	case 5:
-	{
-		temp2.M[0][0] = -1;
-		//temp2.M[0][1] = 1;
-		//temp2.M[1][0] = -1;
-		temp2.M[1][1] = -1;
-		matrix = temp1*temp2*temp3;
-	}
-	break;
-	}
+	cubeface::Remap(cubeface::GetUnityRotation(face), data, writeData, size, true);
 }
 
-void GetFaceData(TArray<uint8> &writeData, const uint8 *data, int32 face, int32 size)
+// Serialises into a growable memory buffer and hands it to the file in large
+// blocks, so writing a .level costs a few calls instead of one per scalar.
+class CLevelArchive
 {
-	FMatrix matrix;
-	CubeFace2UNITY(face, matrix, size);
-	for (int32 y = 0; y < size; ++y)
+public:
+	static const int32 FLUSH_SIZE = 1024 * 1024;
+
+	explicit CLevelArchive(IFileHandle& kFile)
+		: m_kFile(kFile)
+	{
+		m_aryBuffer.Reserve(FLUSH_SIZE);
+	}
+
+	~CLevelArchive()
 	{
-		for (int32 x = 0; x < size; ++x)
+		Flush();
+	}
+
+	void Serialize(const void* pvData, int32 iSize)
+	{
+		const int32 iOffset = m_aryBuffer.AddUninitialized(iSize);
+		FMemory::Memcpy(m_aryBuffer.GetData() + iOffset, pvData, iSize);
+		if (m_aryBuffer.Num() >= FLUSH_SIZE)
 		{
-			FVector v = matrix.TransformPosition(FVector(x, y, 0));
-			writeData[v.Y*size * 4 + v.X * 4] = data[y*size * 4 + x * 4];
-			writeData[v.Y*size * 4 + v.X * 4 + 1] = data[y*size * 4 + x * 4 + 1];
-			writeData[v.Y*size * 4 + v.X * 4 + 2] = data[y*size * 4 + x * 4 + 2];
-			writeData[v.Y*size * 4 + v.X * 4 + 3] = data[y*size * 4 + x * 4 + 3];
+			Flush();
 		}
 	}
-}
+
+	void Flush()
+	{
+		if (m_aryBuffer.Num())
+		{
+			m_kFile.Write(m_aryBuffer.GetData(), m_aryBuffer.Num());
+			m_u64Flushed += m_aryBuffer.Num();
+			m_aryBuffer.Reset();
+		}
+	}
+
+	uint64 Tell() const
+	{
+		return m_u64Flushed + m_aryBuffer.Num();
+	}
+
+private:
+	IFileHandle& m_kFile;
+	TArray<uint8> m_aryBuffer;
+	uint64 m_u64Flushed = 0;
+};
 
 template <class T>
-IFileHandle& operator << (IFileHandle& kFile, T tVal)
+CLevelArchive& operator << (CLevelArchive& kAr, T tVal)
 {
-	kFile.Write((const uint8*)&tVal, sizeof(T));
-	return kFile;
+	kAr.Serialize(&tVal, sizeof(T));
+	return kAr;
 }
 
-void Write(IFileHandle& kFile, const FString& strVal)
+void Write(CLevelArchive& kAr, const FString& strVal)
 {
+	TArray<char, TInlineAllocator<256>> aryChars;
+	aryChars.SetNumUninitialized(strVal.Len() + 1);
 	for (int32 i(0); i < strVal.Len(); ++i)
 	{
-		kFile << (char)strVal[i];
+		aryChars[i] = (char)strVal[i];
 	}
-	kFile << '\0';
+	aryChars[strVal.Len()] = '\0';
+	kAr.Serialize(aryChars.GetData(), aryChars.Num());
 }
 
-void WritePosition(IFileHandle& kFile, FVector kPos)
+void WritePosition(CLevelArchive& kAr, FVector kPos)
 {
-	kFile << kPos.X * -0.01f;
-	kFile << kPos.Z * 0.01f;
-	kFile << kPos.Y * 0.01f;
+	kAr << kPos.X * -0.01f;
+	kAr << kPos.Z * 0.01f;
+	kAr << kPos.Y * 0.01f;
 }
 
-void WriteRotation(IFileHandle& kFile, FQuat kRot)
+void WriteRotation(CLevelArchive& kAr, FQuat kRot)
 {
 	FVector kEuler = kRot.Euler();
-	kFile << kEuler.X;
-	kFile << kEuler.Y;
-	kFile << kEuler.Z;
+	kAr << kEuler.X;
+	kAr << kEuler.Y;
+	kAr << kEuler.Z;
+}
+
+void WriteScale(CLevelArchive& kAr, FVector kScale)
+{
+	kAr << kScale.X;
+	kAr << kScale.Y;
+	kAr << kScale.Z;
+}
+
+void Write(CLevelArchive& kAr, FTransform& kTransform)
+{
+	WritePosition(kAr, kTransform.GetLocation());
+	WriteRotation(kAr, kTransform.GetRotation());
+	WriteScale(kAr, kTransform.GetScale3D());
+}
+
+uint64 HashString(const FString& strVal, uint64 u64Seed)
+{
+	const FTCHARToUTF8 kUTF8(*strVal);
+	return level::Hash64(kUTF8.Get(), kUTF8.Length(), u64Seed);
 }
 
-void WriteScale(IFileHandle& kFile, FVector kScale)
+void ToLevelPosition(const FVector& kPos, float* pfOut)
+{
+	pfOut[0] = kPos.X * -0.01f;
+	pfOut[1] = kPos.Z * 0.01f;
+	pfOut[2] = kPos.Y * 0.01f;
+}
+
+void ToLevelVector(const FVector4& kVec, float* pfOut)
+{
+	pfOut[0] = kVec.X;
+	pfOut[1] = kVec.Y;
+	pfOut[2] = kVec.Z;
+	pfOut[3] = kVec.W;
+}
+
+// One chunk of a chunked .level, see LevelFormat.h.
+struct LevelChunk
+{
+	LevelChunk(uint32 uId, uint32 uStride, uint32 uCount, const void* pvData, uint64 u64Size)
+		: m_uId(uId), m_uStride(uStride), m_uCount(uCount), m_pvData(pvData), m_u64Size(u64Size)
+	{
+	}
+
+	template <class T>
+	LevelChunk(uint32 uId, const T* pkData, int32 iCount)
+		: LevelChunk(uId, sizeof(T), iCount, pkData, sizeof(T) * (uint64)iCount)
+	{
+	}
+
+	template <class T>
+	LevelChunk(uint32 uId, const TArray<T>& aryData)
+		: LevelChunk(uId, aryData.GetData(), aryData.Num())
+	{
+	}
+
+	uint32 m_uId;
+	uint32 m_uStride;
+	uint32 m_uCount;
+	const void* m_pvData;
+	uint64 m_u64Size;
+	uint32 m_uSection = 0;
+	uint64 m_u64InputHash = 0;
+};
+
+// Zeroes the padding of a .level record before constructing it, so that
+// records built from the same input hash and write to the same bytes.
+template <class T>
+T& AddLevelRecord(TArray<T>& aryRecords)
 {
-	kFile << kScale.X;
-	kFile << kScale.Y;
-	kFile << kScale.Z;
+	return *new (&aryRecords[aryRecords.AddZeroed(1)]) T;
 }
 
-void Write(IFileHandle& kFile, FTransform& kTransform)
+// Writes the header, the chunk directory and the chunk data, padding every
+// chunk to a 16 byte boundary.
+void WriteLevelChunks(CLevelArchive& kAr, const TArray<LevelChunk>& aryChunks)
 {
-	WritePosition(kFile, kTransform.GetLocation());
-	WriteRotation(kFile, kTransform.GetRotation());
-	WriteScale(kFile, kTransform.GetScale3D());
+	static const uint8 s_abyPadding[level::Alignment] = {};
+
+	TArray<level::ChunkEntry> aryDirectory;
+	uint64 u64Offset = level::AlignUp(sizeof(level::Header) + sizeof(level::ChunkEntry) * aryChunks.Num());
+	for (const LevelChunk& kChunk : aryChunks)
+	{
+		level::ChunkEntry& kEntry = aryDirectory[aryDirectory.AddDefaulted(1)];
+		kEntry.id = kChunk.m_uId;
+		kEntry.section = kChunk.m_uSection;
+		kEntry.inputHash = kChunk.m_u64InputHash;
+		kEntry.stride = kChunk.m_uStride;
+		kEntry.count = kChunk.m_uCount;
+		kEntry.offset = u64Offset;
+		kEntry.size = kChunk.m_u64Size;
+		kEntry.hash = level::Hash64(kChunk.m_pvData, kChunk.m_u64Size);
+		u64Offset = (u64Offset + kChunk.m_u64Size + level::Alignment - 1) & ~(uint64)(level::Alignment - 1);
+	}
+
+	level::Header kHeader;
+	kHeader.chunkCount = aryChunks.Num();
+	kHeader.fileSize = u64Offset;
+	kAr.Serialize(&kHeader, sizeof(kHeader));
+	kAr.Serialize(aryDirectory.GetData(), sizeof(level::ChunkEntry) * aryDirectory.Num());
+	for (int32 i(0); i < aryChunks.Num(); ++i)
+	{
+		kAr.Serialize(s_abyPadding, (int32)(aryDirectory[i].offset - kAr.Tell()));
+		kAr.Serialize(aryChunks[i].m_pvData, (int32)aryChunks[i].m_u64Size);
+	}
+	kAr.Serialize(s_abyPadding, (int32)(kHeader.fileSize - kAr.Tell()));
 }
 
+// Appends blobs to a .pack file, see PackFormat.h. Blobs with the same
+// SHA-1 digest and size are stored once. Used from the export thread only.
+class CPackWriter
+{
+public:
+	~CPackWriter()
+	{
+		delete m_pkFile;
+	}
+
+	bool Open(const FString& kFileName)
+	{
+		m_pkFile = FPlatformFileManager::Get().GetPlatformFile().OpenWrite(*kFileName);
+		if (!m_pkFile) return false;
+		// The header is rewritten by Finish(); until then its magic is zero.
+		pack::Header kHeader;
+		m_u64Offset = level::AlignUp(sizeof(kHeader), pack::Alignment);
+		return m_pkFile->Write((const uint8*)&kHeader, sizeof(kHeader));
+	}
+
+	bool IsOpen() const
+	{
+		return m_pkFile != nullptr;
+	}
+
+	// aryStored is the blob as it goes into the file; u64Size, u64Hash and
+	// kDigest describe the uncompressed data. u64Hash goes into the entry,
+	// kDigest decides which blobs are shared.
+	void Add(const FString& kName, const TArray<uint8>& aryStored, uint64 u64Size, uint64 u64Hash, const FSHAHash& kDigest, uint32 uFlags)
+	{
+		if (!m_pkFile) return;
+		pack::Entry kEntry;
+		const FTCHARToUTF8 kUTF8(*kName);
+		kEntry.nameHash = level::Hash64(kUTF8.Get(), kUTF8.Length());
+		kEntry.name = m_kStrings.Add(std::string(kUTF8.Get(), kUTF8.Length()));
+		kEntry.size = u64Size;
+		kEntry.hash = u64Hash;
+
+		const int32* piShared = m_mapBlobs.Find(kDigest);
+		if (piShared && m_aryEntries[*piShared].size == kEntry.size)
+		{
+			kEntry.offset = m_aryEntries[*piShared].offset;
+			kEntry.storedSize = m_aryEntries[*piShared].storedSize;
+			kEntry.flags = m_aryEntries[*piShared].flags;
+			m_u64SharedBytes += kEntry.storedSize;
+		}
+		else
+		{
+			kEntry.offset = m_u64Offset;
+			kEntry.storedSize = aryStored.Num();
+			kEntry.flags = uFlags;
+			if (!Append(aryStored.GetData(), aryStored.Num()))
+			{
+				UE_LOG(SceneExporter, Warning, TEXT("Failed to write \"%s\" into the pack."), *kName);
+				return;
+			}
+			m_u64Offset = (m_u64Offset + kEntry.storedSize + pack::Alignment - 1) & ~(uint64)(pack::Alignment - 1);
+			m_mapBlobs.Add(kDigest, m_aryEntries.Num());
+		}
+		m_aryEntries.Add(kEntry);
+	}
+
+	// Writes the table of contents and the string pool, then the header.
+	bool Finish()
+	{
+		if (!m_pkFile) return false;
+		m_aryEntries.Sort([](const pack::Entry& kA, const pack::Entry& kB) { return kA.nameHash < kB.nameHash; });
+
+		pack::Header kHeader;
+		kHeader.entryCount = m_aryEntries.Num();
+		kHeader.tocOffset = m_u64Offset;
+		kHeader.stringsOffset = kHeader.tocOffset + sizeof(pack::Entry) * m_aryEntries.Num();
+		kHeader.stringsSize = m_kStrings.GetData().size();
+		kHeader.fileSize = kHeader.stringsOffset + kHeader.stringsSize;
+		bool bWritten = Append(m_aryEntries.GetData(), sizeof(pack::Entry) * m_aryEntries.Num())
+			&& Append(m_kStrings.GetData().data(), kHeader.stringsSize);
+
+		kHeader.magic = pack::Magic;
+		bWritten = bWritten && m_pkFile->Seek(0) && m_pkFile->Write((const uint8*)&kHeader, sizeof(kHeader));
+		delete m_pkFile;
+		m_pkFile = nullptr;
+		UE_LOG(SceneExporter, Log, TEXT("Pack written, %d entries, %llu bytes, %llu bytes shared by identical blobs."),
+			kHeader.entryCount, kHeader.fileSize, m_u64SharedBytes);
+		return bWritten;
+	}
+
+private:
+	// Pads up to m_u64Offset, then writes the data.
+	bool Append(const void* pvData, uint64 u64Size)
+	{
+		static const uint8 s_abyPadding[pack::Alignment] = {};
+		const int64 iPadding = (int64)m_u64Offset - m_pkFile->Tell();
+		return (iPadding <= 0 || m_pkFile->Write(s_abyPadding, iPadding))
+			&& (u64Size == 0 || m_pkFile->Write((const uint8*)pvData, u64Size));
+	}
+
+	IFileHandle* m_pkFile = nullptr;
+	uint64 m_u64Offset = 0;
+	uint64 m_u64SharedBytes = 0;
+	level::StringPool m_kStrings;
+	TArray<pack::Entry> m_aryEntries;
+	TMap<FSHAHash, int32> m_mapBlobs;
+};
+
 UDirectionalLightComponent* GetDirectionalLightComponent(AActor* pkActor)
 {
 	TArray<UDirectionalLightComponent*> aryLightComponents;
@@ -1801,9 +1846,19 @@ public:
 class ExportingProcess;
 static TSharedPtr<ExportingProcess> s_spProcess;
 
-class ExportingProcess : public FRunnable, FSingleThreadRunnable
+// Hash of the source pixels of every texture seen in this editor session,
+// by source id, so unchanged textures are not decompressed again.
+static TMap<FString, FSHAHash> s_mapSourceHashes;
+
+class ExportingProcess : public FRunnable, FSingleThreadRunnable, vtd::task_executor
 {
 public:
+	enum ExportLane
+	{
+		LANE_WORKERS,
+		LANE_GAME_THREAD
+	};
+
 	enum EndState
 	{
 		ES_FAILED,
@@ -1841,6 +1896,60 @@ public:
 		TArray<MaterialInfo> m_kMaterials;
 		FLightMap2D* m_pkLightMap = nullptr;
 		FShadowMap2D* m_pkShadowMap = nullptr;
+		FString m_strLightMap;
+		FString m_strShadowMap;
+		FVector2D m_v2LightMapScale;
+		FVector2D m_v2LightMapBias;
+		FVector2D m_v2ShadowMapScale;
+		FVector2D m_v2ShadowMapBias;
+	};
+
+	// Plain copy of engine data made on the game thread. Workers only read
+	// snapshots, and the bytes count against the in-flight budget until the
+	// last reference is dropped.
+	struct Snapshot
+	{
+		Snapshot(FThreadSafeCounter64& kInFlight)
+			: m_kInFlight(kInFlight)
+		{
+		}
+
+		~Snapshot()
+		{
+			m_kInFlight.Subtract(m_iBytes);
+		}
+
+		void Account(int64 iBytes)
+		{
+			m_iBytes = iBytes;
+			m_kInFlight.Add(iBytes);
+		}
+
+		FThreadSafeCounter64& m_kInFlight;
+		int64 m_iBytes = 0;
+	};
+
+	struct MapSnapshot : public Snapshot
+	{
+		MapSnapshot(FThreadSafeCounter64& kInFlight)
+			: Snapshot(kInFlight)
+		{
+		}
+
+		int32 m_iSizeX = 0;
+		int32 m_iSizeY = 0;
+		TArray<uint8> m_aryData;
+	};
+
+	struct CubemapSnapshot : public Snapshot
+	{
+		CubemapSnapshot(FThreadSafeCounter64& kInFlight)
+			: Snapshot(kInFlight)
+		{
+		}
+
+		int32 m_iCubemapSize = 0;
+		TRefCountPtr<FReflectionCaptureUncompressedData> m_rpData;
 	};
 
 	struct ReflectionInfo
@@ -1852,46 +1961,86 @@ public:
 		float m_fInfluenceRadius;
 		float m_fAverageBrightness;
 		const FReflectionCaptureFullHDR* m_pkData = nullptr;
+		TSharedPtr<const CubemapSnapshot, ESPMode::ThreadSafe> m_spSnapshot;
 	};
 
-	struct LightMapInfo
+	// Textures are told apart by their source pixels. Every texture whose
+	// mip 0 matches one before it in path order is an alias: it is not
+	// exported and its references use the file of m_pkCanonical.
+	struct TextureInfo
 	{
-		UTexture2D* m_pkSource = nullptr;
-		TArray<uint8> m_aryData;
+		FString m_strName;
+		// Of m_strName, for the level section hashes.
+		uint64 m_u64NameHash = 0;
+		UTexture* m_pkCanonical = nullptr;
+		FSHAHash m_kHash;
+		ETextureSourceFormat m_eFormat = TSF_Invalid;
+		TSharedPtr<const MapSnapshot, ESPMode::ThreadSafe> m_spSnapshot;
 	};
 
 	struct ShadowMapInfo
 	{
 		UShadowMapTexture2D* m_pkSource = nullptr;
-		TArray<uint8> m_aryData;
+		TSharedPtr<const MapSnapshot, ESPMode::ThreadSafe> m_spSnapshot;
+		FThreadSafeCounter m_kUsers;
+	};
+
+	// Static meshes of one sublevel; levels are scanned one after another,
+	// so each owns a contiguous range of m_aryStaticMeshes. m_u64ScanHash
+	// covers what the scan gathered for them, see HashScannedMesh.
+	struct LevelSectionInfo
+	{
+		FString m_strName;
+		int32 m_iFirstMesh = 0;
+		int32 m_iMeshCount = 0;
+		uint64 m_u64ScanHash = 0;
+	};
+
+	// Records of one mesh section of a chunked .level.
+	struct MeshSection
+	{
+		TArray<level::Mesh> m_aryMeshes;
+		TArray<level::Material> m_aryMaterials;
+		TArray<uint32> m_aryTextures;
+		TArray<float> m_aryParams;
+		TArray<level::LightMap> m_aryLightMaps;
+		TArray<level::ShadowMap> m_aryShadowMaps;
+	};
+
+	struct LightMapInfo
+	{
+		UTexture2D* m_pkSource = nullptr;
+		bool m_bUpToDate = false;
+		TSharedPtr<MapSnapshot, ESPMode::ThreadSafe> m_spSnapshot;
+		TArray<const StaticMeshInfo*> m_aryMeshes;
+		TArray<ShadowMapInfo*> m_aryShadowMaps;
 	};
 
 	ExportingProcess(const FString& kPath)
 		: m_kPath(kPath)
+		, m_kWorkers(FMath::Max(CVarSceneExporterWorkers.GetValueOnGameThread(), 0))
 	{
-
+		m_pkBGEvent = FPlatformProcess::GetSynchEventFromPool(false);
 	}
 
 	~ExportingProcess()
 	{
 		StopThread();
 		StopMainTick();
-		while (m_kFGTasks.size())
-		{
-			auto func = m_kFGTasks.pop();
-			if (func) delete func;
-		}
 
-		while (m_kBGTasks.size())
-		{
-			auto func = m_kBGTasks.pop();
-			if (func) delete func;
-		}
+		// Worker tasks still queued push files and signal the export thread,
+		// so the pool is drained while the event exists; they return early
+		// once m_bCanceling is set.
+		m_bCanceling = true;
+		m_kWorkers.join();
+		FPlatformProcess::ReturnSynchEventToPool(m_pkBGEvent);
+		m_pkBGEvent = nullptr;
 	}
 
 	void Cancel()
 	{
 		m_bCanceling = true;
+		m_pkBGEvent->Trigger();
 	}
 
 	FTimespan GetDuration() const
@@ -1975,11 +2124,10 @@ public:
 	{
 		while (!m_bCanceling)
 		{
-			auto func = m_kBGTasks.pop();
-			if (func)
+			vtd::task func;
+			if (m_kBGTasks.try_pop(func))
 			{
-				(*func)();
-				delete func;
+				func();
 			}
 			else if (m_bExiting)
 			{
@@ -1987,12 +2135,271 @@ public:
 			}
 			else
 			{
-				FPlatformProcess::Sleep(0.1f);
+				m_pkBGEvent->Wait();
 			}
 		}
 		m_bIsRunning = false;
 	}
 
+	// Never waits, since the game thread pushes here too; the buffers queued
+	// count against the in-flight budget the producers check instead.
+	// Refused once the export is canceled, since the export thread stops
+	// draining the queue then.
+	bool PushBGTask(vtd::task&& kTask)
+	{
+		if (m_bCanceling) return false;
+		m_kBGTasks.push(std::move(kTask));
+		m_pkBGEvent->Trigger();
+		return true;
+	}
+
+	// Files queued for the export thread stay under the in-flight budget on
+	// their own, apart from the snapshots, so a worker holding a snapshot
+	// never waits for room that only its own snapshot takes up.
+	bool HasWriteRoom() const
+	{
+		const int64 iQueued = m_kQueuedBytes.GetValue();
+		return iQueued == 0 || iQueued < m_iInFlightBudget;
+	}
+
+	// The game thread never waits here; its nodes check HasWriteRoom() and
+	// yield instead. Workers run pool tasks while they wait, since pack
+	// compressions queued on the pool hold bytes until a worker gets to them.
+	void WaitForWriteRoom()
+	{
+		if (IsInGameThread()) return;
+		m_kWorkers.wait_until([this]() { return m_bCanceling || HasWriteRoom(); });
+	}
+
+	void ReleaseQueuedBytes(int64 iBytes)
+	{
+		m_kQueuedBytes.Subtract(iBytes);
+		m_kInFlightBytes.Subtract(iBytes);
+	}
+
+	// Hands a finished file to the export thread, which writes it with one
+	// call, or appends it to the pack, while the workers go on encoding.
+	// kName is relative to the world folder. Workers wait first while the
+	// queued files use up the in-flight budget; the buffer counts against it
+	// until it is on disk.
+	void WriteFileAsync(const FString& kName, TArray<uint8>&& aryData)
+	{
+		WaitForWriteRoom();
+		const int64 iBytes = aryData.Num();
+		m_kQueuedBytes.Add(iBytes);
+		m_kInFlightBytes.Add(iBytes);
+		if (m_bPackCompression)
+		{
+			// Compressed on the workers so the game thread does not wait for
+			// it; the pack is finished once m_kPackWrites is done.
+			m_kWorkers.submit(m_kPackWrites, vtd::task([this, kName, iBytes, aryData = MoveTemp(aryData)]()
+			{
+				if (m_bCanceling)
+				{
+					ReleaseQueuedBytes(iBytes);
+					return;
+				}
+				const uint64 u64Hash = level::Hash64(aryData.GetData(), aryData.Num());
+				FSHAHash kDigest;
+				FSHA1::HashBuffer(aryData.GetData(), aryData.Num(), kDigest.Hash);
+				bool bQueued = PushBGTask(vtd::task([this, kName, iBytes, u64Hash, kDigest, aryStored = CompressBlob(aryData)]()
+				{
+					m_kPack.Add(kName, aryStored, iBytes, u64Hash, kDigest, pack::flag::Zlib);
+					ReleaseQueuedBytes(iBytes);
+				}));
+				if (!bQueued)
+				{
+					ReleaseQueuedBytes(iBytes);
+				}
+			}));
+			return;
+		}
+
+		// Hashed by the caller so the workers share the cost.
+		uint64 u64Hash = 0;
+		FSHAHash kDigest;
+		if (m_bPack)
+		{
+			u64Hash = level::Hash64(aryData.GetData(), aryData.Num());
+			FSHA1::HashBuffer(aryData.GetData(), aryData.Num(), kDigest.Hash);
+		}
+		bool bQueued = PushBGTask(vtd::task([this, kName, iBytes, u64Hash, kDigest, aryData = MoveTemp(aryData)]()
+		{
+			if (m_bPack)
+			{
+				m_kPack.Add(kName, aryData, aryData.Num(), u64Hash, kDigest, 0);
+			}
+			else
+			{
+				const FString kFileName = m_kPath + "/" + m_kWorldName + "/" + kName;
+				IFileHandle* hFile = FPlatformFileManager::Get().GetPlatformFile().OpenWrite(*kFileName);
+				if (!(hFile && hFile->Write(aryData.GetData(), aryData.Num())))
+				{
+					UE_LOG(SceneExporter, Warning, TEXT("Failed to write \"%s\"."), *kFileName);
+				}
+				delete hFile;
+			}
+			ReleaseQueuedBytes(iBytes);
+		}));
+		if (!bQueued)
+		{
+			ReleaseQueuedBytes(iBytes);
+		}
+	}
+
+	FString GetManifestFileName() const
+	{
+		return m_kPath + "/" + m_kWorldName + "/" + m_kWorldName + ".manifest";
+	}
+
+	// Everything besides the source data that changes what ends up in the
+	// loose files. A different value invalidates the whole manifest, and the
+	// probe cache keys include it too. Uncompressed envmaps hash as before.
+	uint64 GetSettingsHash() const
+	{
+		const char* pcSettings = "manifest 1; lightmaps: tga, shadowmap alpha; envmaps: dds bgra8 with mips";
+		uint64 u64Hash = level::Hash64(pcSettings, FCStringAnsi::Strlen(pcSettings));
+		if (m_iProbeCompression != 0)
+		{
+			const int32 aiProbeSettings[2] = { m_iProbeCompression, (int32)m_eProbeQuality };
+			u64Hash = level::Hash64(aiProbeSettings, sizeof(aiProbeSettings), u64Hash);
+		}
+		if (m_upAstcEncoder)
+		{
+			const uint32 auAstcSettings[3] = { m_upAstcEncoder->GetBlockX(), m_upAstcEncoder->GetBlockY(), (uint32)m_eAstcPreset };
+			u64Hash = level::Hash64(auAstcSettings, sizeof(auAstcSettings), u64Hash);
+		}
+		return u64Hash;
+	}
+
+	// The manifest is a text file: a header line with the settings hash,
+	// then one "<hash>\t<path>" line per file, paths relative to the world.
+	void LoadManifest()
+	{
+		TArray<FString> aryLines;
+		if (!FFileHelper::LoadFileToStringArray(aryLines, *GetManifestFileName()) || aryLines.Num() == 0) return;
+		if (aryLines[0] != FString::Printf(TEXT("SceneExporterManifest %016llx"), m_u64Settings)) return;
+		for (int32 i(1); i < aryLines.Num(); ++i)
+		{
+			FString strHash, strName;
+			if (aryLines[i].Split(TEXT("\t"), &strHash, &strName))
+			{
+				m_mapPrevManifest.Add(strName, FCString::Strtoui64(*strHash, nullptr, 16));
+			}
+		}
+	}
+
+	void SaveManifest()
+	{
+		FString strManifest = FString::Printf(TEXT("SceneExporterManifest %016llx\n"), m_u64Settings);
+		{
+			FScopeLock kLock(&m_kManifestLock);
+			m_mapManifest.KeySort(TLess<FString>());
+			for (auto& itEntry : m_mapManifest)
+			{
+				strManifest += FString::Printf(TEXT("%016llx\t%s\n"), itEntry.Get<1>(), *itEntry.Get<0>());
+			}
+		}
+		FString kFileName = GetManifestFileName();
+		PushBGTask(vtd::task([kFileName, strManifest]()
+		{
+			FFileHelper::SaveStringToFile(strManifest, *kFileName);
+		}));
+	}
+
+	// Records u64Hash for the next manifest and tells whether the previous
+	// export wrote kName from the same source with the same settings.
+	bool IsUpToDate(const FString& kName, uint64 u64Hash)
+	{
+		if (!m_bIncremental) return false;
+		{
+			FScopeLock kLock(&m_kManifestLock);
+			m_mapManifest.Add(kName, u64Hash);
+		}
+		const uint64* pu64Previous = m_mapPrevManifest.Find(kName);
+		if (pu64Previous && *pu64Previous == u64Hash
+			&& FPlatformFileManager::Get().GetPlatformFile().FileExists(*(m_kPath + "/" + m_kWorldName + "/" + kName)))
+		{
+			m_kSkipped.Increment();
+			return true;
+		}
+		return false;
+	}
+
+	// Deflates aryData in pack::BlockSize blocks, in parallel on the workers,
+	// and lays the result out as described in PackFormat.h.
+	TArray<uint8> CompressBlob(const TArray<uint8>& aryData)
+	{
+		const int32 iBlocks = (aryData.Num() + pack::BlockSize - 1) / pack::BlockSize;
+		TArray<TArray<uint8>> aryBlocks;
+		aryBlocks.SetNum(iBlocks);
+		m_kWorkers.parallel_for(iBlocks, [this, &aryData, &aryBlocks](size_t i)
+		{
+			const uint64 u64Start = FPlatformTime::Cycles64();
+			const uint8* pbySource = aryData.GetData() + i * pack::BlockSize;
+			const int32 iSize = FMath::Min<int32>(pack::BlockSize, aryData.Num() - (int32)i * pack::BlockSize);
+			TArray<uint8>& aryBlock = aryBlocks[i];
+			int32 iCompressed = FCompression::CompressMemoryBound(COMPRESS_ZLIB, iSize);
+			aryBlock.SetNumUninitialized(iCompressed);
+			if (FCompression::CompressMemory(COMPRESS_ZLIB, aryBlock.GetData(), iCompressed, pbySource, iSize) && iCompressed < iSize)
+			{
+				aryBlock.SetNum(iCompressed, false);
+			}
+			else
+			{
+				aryBlock.Reset();
+				aryBlock.Append(pbySource, iSize);
+			}
+			m_kCompressCycles.Add(FPlatformTime::Cycles64() - u64Start);
+		});
+
+		TArray<uint8> aryStored;
+		int32 iTotal = 0;
+		for (const TArray<uint8>& aryBlock : aryBlocks)
+		{
+			iTotal += aryBlock.Num();
+		}
+		aryStored.SetNumUninitialized(sizeof(uint32) * iBlocks + iTotal);
+		uint32* puEnds = (uint32*)aryStored.GetData();
+		uint8* pbyOut = aryStored.GetData() + sizeof(uint32) * iBlocks;
+		uint32 uEnd = 0;
+		for (int32 i(0); i < iBlocks; ++i)
+		{
+			FMemory::Memcpy(pbyOut + uEnd, aryBlocks[i].GetData(), aryBlocks[i].Num());
+			uEnd += aryBlocks[i].Num();
+			puEnds[i] = uEnd;
+		}
+		m_kPackRawBytes.Add(aryData.Num());
+		m_kPackStoredBytes.Add(aryStored.Num());
+		return aryStored;
+	}
+
+	virtual void execute(int iLane, vtd::task&& kWork) override
+	{
+		if (iLane == LANE_GAME_THREAD)
+		{
+			m_kFGTasks.push(std::move(kWork));
+		}
+		else
+		{
+			// A canceled export skips the nodes still queued, so canceling
+			// only waits for the ones already running.
+			m_kWorkers.submit(vtd::task([this, kWork = std::move(kWork)]() mutable
+			{
+				if (!m_bCanceling)
+				{
+					kWork();
+				}
+			}));
+		}
+	}
+
+	void SetExiting()
+	{
+		m_bExiting = true;
+		m_pkBGEvent->Trigger();
+	}
+
 	bool HandleTicker(float fDeltaTime)
 	{
 		if (m_bCanceling)
@@ -2005,13 +2412,23 @@ public:
 		}
 		else
 		{
-			auto func = m_kFGTasks.pop();
-			if (func)
+			m_dFrameDeadline = FPlatformTime::Seconds() + CVarSceneExporterGameThreadBudget.GetValueOnGameThread() * 0.001;
+			// Tasks queued while draining, including ones that yielded, wait
+			// for the next tick.
+			uint64 uTasks = FMath::Max<uint64>(m_kFGTasks.size(), 1);
+			vtd::task func;
+			bool bDrained = true;
+			while (uTasks-- && m_kFGTasks.try_pop(func))
 			{
-				(*func)();
-				delete func;
+				func();
+				func.reset();
+				if (m_bCanceling || FPlatformTime::Seconds() >= m_dFrameDeadline)
+				{
+					bDrained = false;
+					break;
+				}
 			}
-			else if (m_bExiting)
+			if (bDrained && m_bExiting)
 			{
 				if (!m_bIsRunning)
 				{
@@ -2099,20 +2516,47 @@ private:
 			{
 				kPlatformFile.CreateDirectory(*kPath);
 			}
-			kPath = m_kPath + "/" + m_kWorldName + "/Textures";
-			if (!kPlatformFile.DirectoryExists(*kPath))
+			m_bPack = CVarSceneExporterPack.GetValueOnGameThread() != 0;
+			if (m_bPack && !m_kPack.Open(m_kPath + "/" + m_kWorldName + "/" + m_kWorldName + ".pack"))
 			{
-				kPlatformFile.CreateDirectory(*kPath);
+				UE_LOG(SceneExporter, Warning, TEXT("Failed to create the pack, writing loose files."));
+				m_bPack = false;
 			}
-			kPath = m_kPath + "/" + m_kWorldName + "/LightMaps";
-			if (!kPlatformFile.DirectoryExists(*kPath))
+			m_bPackCompression = m_bPack && CVarSceneExporterPackCompression.GetValueOnGameThread() != 0;
+			m_bIncremental = !m_bPack && CVarSceneExporterIncremental.GetValueOnGameThread() != 0;
+			m_iProbeCompression = FMath::Clamp(CVarSceneExporterProbeCompression.GetValueOnGameThread(), 0, 2);
+			m_eProbeQuality = (bc::Quality)FMath::Clamp(CVarSceneExporterProbeCompressionQuality.GetValueOnGameThread(), 0, 2);
+			CreateAstcEncoder();
+			m_u64Settings = GetSettingsHash();
+			m_iInFlightBudget = (int64)CVarSceneExporterInFlightBudget.GetValueOnGameThread() * 1024 * 1024;
+			m_bProbeCache = CVarSceneExporterProbeCache.GetValueOnGameThread() != 0;
+			m_kProbeCacheDir = FPaths::ProjectSavedDir() / TEXT("SceneExporter/ProbeCache");
+			if (m_bProbeCache && !kPlatformFile.CreateDirectoryTree(*m_kProbeCacheDir))
 			{
-				kPlatformFile.CreateDirectory(*kPath);
+				UE_LOG(SceneExporter, Warning, TEXT("Failed to create \"%s\", the probe cache is off."), *m_kProbeCacheDir);
+				m_bProbeCache = false;
 			}
-			kPath = m_kPath + "/" + m_kWorldName + "/EnvMaps";
-			if (!kPlatformFile.DirectoryExists(*kPath))
+			if (m_bIncremental)
 			{
-				kPlatformFile.CreateDirectory(*kPath);
+				LoadManifest();
+			}
+			if (!m_bPack)
+			{
+				kPath = m_kPath + "/" + m_kWorldName + "/Textures";
+				if (!kPlatformFile.DirectoryExists(*kPath))
+				{
+					kPlatformFile.CreateDirectory(*kPath);
+				}
+				kPath = m_kPath + "/" + m_kWorldName + "/LightMaps";
+				if (!kPlatformFile.DirectoryExists(*kPath))
+				{
+					kPlatformFile.CreateDirectory(*kPath);
+				}
+				kPath = m_kPath + "/" + m_kWorldName + "/EnvMaps";
+				if (!kPlatformFile.DirectoryExists(*kPath))
+				{
+					kPlatformFile.CreateDirectory(*kPath);
+				}
 			}
 			kPath = m_kPath + "/" + m_kWorldName + "/Materials";
 			if (!kPlatformFile.DirectoryExists(*kPath))
@@ -2121,516 +2565,1427 @@ private:
 			}
 		}
 		
+		// Gathering runs level by level on the game thread; the emit graph is
+		// built from the deduplicated result once every level has been scanned.
+		TArray<vtd::task_graph::node_id> aryScans;
 		for (auto pkLevel : pkWorld->GetLevels())
 		{
-			m_kFGTasks.push(new std::function<void()>(
-				[this, pkLevel]()
+			aryScans.Add(m_kCollect.add(vtd::task([this, pkLevel]() { ScanLevel(pkLevel); }), LANE_GAME_THREAD));
+			if (aryScans.Num() > 1)
 			{
-				for (auto pkActor : pkLevel->Actors)
-				{
-					if (pkActor->IsA(ASphereReflectionCapture::StaticClass()))
-					{
-						TArray<UReflectionCaptureComponent*> aryCaptures;
-						pkActor->GetComponents(aryCaptures);
-						if (aryCaptures.Num() > 0 && aryCaptures[0])
-						{
-							const FReflectionCaptureFullHDR* pkData = aryCaptures[0]->GetFullHDRData();
-							if (pkData)
-							{
-								ReflectionInfo& kInfo = m_aryReflectionProbes[m_aryReflectionProbes.AddDefaulted(1)];
-								kInfo.m_strName = pkActor->GetName();
-								{
-									int& iNameCount = m_mapInvolvedActorNames.FindOrAdd(kInfo.m_strName);
-									if (iNameCount > 0)
-									{
-										kInfo.m_strName = kInfo.m_strName + FString::Printf(TEXT("_%d"), iNameCount);
-									}
-									++iNameCount;
-								}
-								kInfo.m_v3Position = aryCaptures[0]->ComponentToWorld.ToMatrixWithScale().GetOrigin();
-								kInfo.m_v3Offset = aryCaptures[0]->CaptureOffset;
-								kInfo.m_fInfluenceRadius = aryCaptures[0]->GetInfluenceBoundingRadius();
-								kInfo.m_fBrightness = aryCaptures[0]->Brightness;
-								kInfo.m_fAverageBrightness = aryCaptures[0]->GetAverageBrightness();
-								kInfo.m_pkData = pkData;
-							}
-						}
-					}
-					else if (pkActor->IsA(ADirectionalLight::StaticClass()))
-					{
-						UDirectionalLightComponent* pkLightCompont = GetDirectionalLightComponent(pkActor);
-						if ((!m_pkMainLight) && pkLightCompont && pkLightCompont->Mobility == EComponentMobility::Stationary)
-						{
-							m_pkMainLight = pkLightCompont;
-						}
-					}
-					else if (pkActor->IsA(AExponentialHeightFog::StaticClass()))
-					{
-						UExponentialHeightFogComponent* pkHeightFog = GetExponentialHeightFogComponent(pkActor);
-						if ((!m_pkMainFog) && pkHeightFog)
-						{
-							m_pkMainFog = pkHeightFog;
-						}
-					}
-					else if (pkActor->IsA(AStaticMeshActor::StaticClass()))
-					{
-						UStaticMeshComponent* pkStaticMesh = CastChecked<AStaticMeshActor>(pkActor)->GetStaticMeshComponent();
-						if (!pkStaticMesh) continue;
-						UMaterialInterface* pkMaterial = pkStaticMesh->GetMaterial(0);
-						if (!pkMaterial) continue;
-						SupportedMaterialType eMatType = GetType(*pkMaterial);
-						if (eMatType >= MAT_MAX) continue;
-						StaticMeshInfo& kInfo = m_aryStaticMeshes[m_aryStaticMeshes.AddDefaulted(1)];
-						kInfo.m_strName = pkActor->GetName();
-						{
-							int& iNameCount = m_mapInvolvedActorNames.FindOrAdd(kInfo.m_strName);
-							if (iNameCount > 0)
-							{
-								kInfo.m_strName = kInfo.m_strName + FString::Printf(TEXT("_%d"), iNameCount);
-							}
-							++iNameCount;
-						}
-						kInfo.m_strFBXName = pkStaticMesh->GetStaticMesh()->GetName();
-						m_mapFBXMeshes.FindOrAdd(kInfo.m_strFBXName) = pkStaticMesh->GetStaticMesh();
-						kInfo.m_kTransform = pkActor->GetTransform();
-
-						if ("S_ZhuCheng_MB_001_02" == kInfo.m_strFBXName)
-						{
-							int a = 0;
-						}
-
-						FStaticMeshLODResources& LOD = pkStaticMesh->GetStaticMesh()->RenderData->LODResources[0];
-						int matIndex = 0;
-						while(true)
-						{
-							MaterialInfo& matInfo = kInfo.m_kMaterials[kInfo.m_kMaterials.AddDefaulted(1)];
-							matInfo.m_strName = pkMaterial->GetName();
-							matInfo.m_index = GetMaterialIndex(LOD, matIndex);
-							matInfo.m_eType = eMatType;
-							switch (matInfo.m_eType)
-							{
-							case MAT_SCENE_GRASS:
-								matInfo.m_aryRelatedTextures.SetNum(1);
-								pkMaterial->GetTextureParameterValue(TEXT("BaseTexture"), matInfo.m_aryRelatedTextures[0]);
-								matInfo.m_aryRelatedParams.SetNum(1);
-								pkMaterial->GetScalarParameterValue(TEXT("LightIntensity"), matInfo.m_aryRelatedParams[0]);
-								break;
-							case MAT_SCENE_PLAIN:
-							case MAT_SCENE_PLAIN_ALPHA:
-								matInfo.m_aryRelatedTextures.SetNum(1);
-								pkMaterial->GetTextureParameterValue(TEXT("BaseTexture"), matInfo.m_aryRelatedTextures[0]);
-								break;
-							case MAT_SCENE_PBR:
-							case MAT_SCENE_PBR_ALPHA:
-								matInfo.m_aryRelatedTextures.SetNum(3);
-								pkMaterial->GetTextureParameterValue(TEXT("BaseTexture"), matInfo.m_aryRelatedTextures[0]);
-								pkMaterial->GetTextureParameterValue(TEXT("MixTexture"), matInfo.m_aryRelatedTextures[1]);
-								pkMaterial->GetTextureParameterValue(TEXT("NormalTexture"), matInfo.m_aryRelatedTextures[2]);
-								break;
-							case MAT_SCENE_PBR_GLOW:
-								matInfo.m_aryRelatedTextures.SetNum(4);
-								pkMaterial->GetTextureParameterValue(TEXT("BaseTexture"), matInfo.m_aryRelatedTextures[0]);
-								pkMaterial->GetTextureParameterValue(TEXT("MixTexture"), matInfo.m_aryRelatedTextures[1]);
-								pkMaterial->GetTextureParameterValue(TEXT("NormalTexture"), matInfo.m_aryRelatedTextures[2]);
-								pkMaterial->GetTextureParameterValue(TEXT("GlowTexture"), matInfo.m_aryRelatedTextures[3]);
-								matInfo.m_aryRelatedParams.SetNum(1);
-								pkMaterial->GetScalarParameterValue(TEXT("GlowIntensity"), matInfo.m_aryRelatedParams[0]);
-								break;
-							case MAT_TERRAIN_PBR:
-								matInfo.m_aryRelatedTextures.SetNum(6);
-								pkMaterial->GetTextureParameterValue(TEXT("BasePBR"), matInfo.m_aryRelatedTextures[0]);
-								pkMaterial->GetTextureParameterValue(TEXT("MixPBR"), matInfo.m_aryRelatedTextures[1]);
-								pkMaterial->GetTextureParameterValue(TEXT("NormalPBR"), matInfo.m_aryRelatedTextures[2]);
-								pkMaterial->GetTextureParameterValue(TEXT("BaseLayer0"), matInfo.m_aryRelatedTextures[3]);
-								pkMaterial->GetTextureParameterValue(TEXT("BaseLayer1"), matInfo.m_aryRelatedTextures[4]);
-								pkMaterial->GetTextureParameterValue(TEXT("Blend"), matInfo.m_aryRelatedTextures[5]);
-								matInfo.m_aryRelatedParams.SetNum(3);
-								pkMaterial->GetScalarParameterValue(TEXT("TilingPBR"), matInfo.m_aryRelatedParams[0]);
-								pkMaterial->GetScalarParameterValue(TEXT("Tiling0"), matInfo.m_aryRelatedParams[1]);
-								pkMaterial->GetScalarParameterValue(TEXT("Tiling1"), matInfo.m_aryRelatedParams[2]);
-								break;
-							case MAT_WATER:
-								matInfo.m_aryRelatedTextures.SetNum(0);
-								break;
-							default:
-								break;
-							}
-							pkMaterial = pkStaticMesh->GetMaterial(++matIndex);
-							if (!pkMaterial) break;
-							eMatType = GetType(*pkMaterial);
-							if (eMatType >= MAT_MAX) break;
-						}						
-
-						if (pkStaticMesh->LODData.Num() > 0)
-						{
-							const FMeshMapBuildData* pkMeshMapBuildData = pkStaticMesh->GetMeshMapBuildData(pkStaticMesh->LODData[0]);
-							if (pkMeshMapBuildData)
-							{
-								if (pkMeshMapBuildData->LightMap != nullptr)
-								{
-									kInfo.m_pkLightMap = pkMeshMapBuildData->LightMap->GetLightMap2D();
-									UTexture2D* pkLightMapTex = kInfo.m_pkLightMap->GetTexture(1);
-									m_mapLightMaps.FindOrAdd(pkLightMapTex->GetName()).m_pkSource = pkLightMapTex;
-
-									if (pkMeshMapBuildData->ShadowMap != nullptr)
-									{
-										kInfo.m_pkShadowMap = pkMeshMapBuildData->ShadowMap->GetShadowMap2D();
-										UShadowMapTexture2D* pkShadowMapTex = kInfo.m_pkShadowMap->GetTexture();
-										m_mapShadowMaps.FindOrAdd(pkShadowMapTex->GetName()).m_pkSource = pkShadowMapTex;
-									}
-								}
-							}
-						}
-					}
-				}
-
-				ExportMeshes();
-				ExportTextures();
-				ExportSceneStructure();
-
-				m_kBGTasks.push(new std::function<void()>([this]()
-				{
-					ExportLightMaps();
-					ExportReflectionProbes();
-					m_bExiting = true;
-				}));
-			}));
+				m_kCollect.depend(aryScans.Last(), aryScans.Last(1));
+			}
 		}
 
+		m_dStartTime = FPlatformTime::Seconds();
+		m_kCollect.launch(*this, vtd::task([this]()
+		{
+			UE_LOG(SceneExporter, Log, TEXT("%d levels scanned in %.1f ms."),
+				(int32)m_kCollect.size(), (FPlatformTime::Seconds() - m_dStartTime) * 1000.0);
+			LaunchEmit();
+		}));
+
 		return true;
 	}
 
-	void ExportLightMaps()
+	// One node per asset, so every file is written exactly once and the
+	// game-thread and worker nodes overlap.
+	void LaunchEmit()
 	{
-		for (auto& itTex : m_mapLightMaps)
+		for (auto& itMesh : m_mapFBXMeshes)
 		{
-			LightMapInfo& kInfo = itTex.Get<1>();
-			kInfo.m_pkSource->Source.GetMipData(kInfo.m_aryData, 0);
-			int32 i(3);
-			while (i < kInfo.m_aryData.Num())
+			const FString* pkName = &itMesh.Get<0>();
+			UStaticMesh* pkMesh = itMesh.Get<1>();
+			if (pkMesh->RenderData && IsUpToDate("Meshes/" + *pkName + ".fbx", HashString(pkMesh->RenderData->DerivedDataKey, m_u64Settings)))
 			{
-				kInfo.m_aryData[i] = 0;
-				i += 4;
+				continue;
 			}
+			m_kEmit.add(vtd::task([this, pkName, pkMesh]() { ExportMesh(*pkName, pkMesh); }), LANE_GAME_THREAD);
 		}
 
-		for (auto& itTex : m_mapShadowMaps)
+		// Source pixels are hashed once per source id and editor session;
+		// texture files and the level wait until every hash is known.
+		vtd::task_graph::node_id uResolve = m_kEmit.add(vtd::task([this]() { ResolveTextures(); }), LANE_GAME_THREAD);
+		for (auto& itTex : m_mapTextures)
+		{
+			UTexture* pkTex = itTex.Get<0>();
+			TextureInfo* pkInfo = &itTex.Get<1>();
+			const FSHAHash* pkHash = s_mapSourceHashes.Find(pkTex->Source.GetIdString());
+			if (pkHash)
+			{
+				pkInfo->m_kHash = *pkHash;
+			}
+			else
+			{
+				vtd::task_graph::node_id uSnapshot = m_kEmit.add(vtd::task([this, pkTex, pkInfo]() { SnapshotTextureSource(*pkTex, *pkInfo); }), LANE_GAME_THREAD);
+				vtd::task_graph::node_id uHash = m_kEmit.add(vtd::task([pkInfo]() { HashTextureSource(*pkInfo); }), LANE_WORKERS);
+				m_kEmit.depend(uHash, uSnapshot);
+				m_kEmit.depend(uResolve, uHash);
+			}
+			vtd::task_graph::node_id uExport = m_kEmit.add(vtd::task([this, pkTex, pkInfo]() { ExportTexture(pkTex, *pkInfo); }), LANE_GAME_THREAD);
+			m_kEmit.depend(uExport, uResolve);
+			if (m_upAstcEncoder)
+			{
+				vtd::task_graph::node_id uAstc = m_kEmit.add(vtd::task([this, pkInfo]() { ExportTextureASTC(*pkInfo); }), LANE_WORKERS);
+				m_kEmit.depend(uAstc, uExport);
+			}
+		}
+
+		vtd::task_graph::node_id uLevel = m_kEmit.add(vtd::task([this]() { ExportSceneStructure(); }), LANE_GAME_THREAD);
+		m_kEmit.depend(uLevel, uResolve);
+
+		// Engine data is copied on the game thread by snapshot nodes; the
+		// worker nodes that depend on them only see the copies.
+		for (auto& itProbe : m_aryReflectionProbes)
 		{
-			ShadowMapInfo& kInfo = itTex.Get<1>();
-			kInfo.m_pkSource->Source.GetMipData(kInfo.m_aryData, 0);
+			ReflectionInfo* pkProbe = &itProbe;
+			vtd::task_graph::node_id uSnapshot = m_kEmit.add(vtd::task([this, pkProbe]() { SnapshotReflectionProbe(*pkProbe); }), LANE_GAME_THREAD);
+			vtd::task_graph::node_id uExport = m_kEmit.add(vtd::task([this, pkProbe]() { ExportReflectionProbe(*pkProbe); }), LANE_WORKERS);
+			m_kEmit.depend(uExport, uSnapshot);
 		}
 
 		for (auto& itMesh : m_aryStaticMeshes)
 		{
 			if (!itMesh.m_pkLightMap) continue;
-			LightMapInfo* pkLMInfo = m_mapLightMaps.Find(itMesh.m_pkLightMap->GetTexture(1)->GetName());
+			LightMapInfo* pkLMInfo = m_mapLightMaps.Find(itMesh.m_strLightMap);
 			if (!pkLMInfo) continue;
 			if (!itMesh.m_pkShadowMap) continue;
-			ShadowMapInfo* pkSMInfo = m_mapShadowMaps.Find(itMesh.m_pkShadowMap->GetTexture()->GetName());
+			ShadowMapInfo* pkSMInfo = m_mapShadowMaps.Find(itMesh.m_strShadowMap);
 			if (!pkSMInfo) continue;
-
-			FVector2D v2SrcScale = itMesh.m_pkShadowMap->GetCoordinateScale();
-			FVector2D v2SrcBias = itMesh.m_pkShadowMap->GetCoordinateBias();
-			FVector2D v2DstScale = itMesh.m_pkLightMap->GetCoordinateScale();
-			FVector2D v2DstBias = itMesh.m_pkLightMap->GetCoordinateBias();
-
-			uint32 stw = itMesh.m_pkShadowMap->GetTexture()->GetSizeX();
-			uint32 sth = itMesh.m_pkShadowMap->GetTexture()->GetSizeY();
-			uint32 dtw = itMesh.m_pkLightMap->GetTexture(1)->GetSizeX();
-			uint32 dth = itMesh.m_pkLightMap->GetTexture(1)->GetSizeY();
-
-			uint32 sw = po2((uint32)(float(stw) * v2SrcScale.X));
-			uint32 sh = po2((uint32)(float(sth) * v2SrcScale.Y));
-			uint32 dw = po2((uint32)(float(dtw) * v2DstScale.X));
-			uint32 dh = po2((uint32)(float(dth >> 1) * v2DstScale.Y));
-			if (sw != dw || sh != dh) continue;
-
-			uint32 sx = roundpos(float(stw) * v2SrcBias.X, sw);
-			uint32 sy = roundpos(float(sth) * v2SrcBias.Y, sh);
-			uint32 dx = roundpos(float(dtw) * v2DstBias.X, dw);
-			uint32 dy = roundpos(float(dth >> 1) * v2DstBias.Y, dh);
-
-			for (uint32 i(0); i < sw; ++i)
+			pkLMInfo->m_aryMeshes.Add(&itMesh);
+			if (!pkLMInfo->m_aryShadowMaps.Contains(pkSMInfo))
 			{
-				for (uint32 j(0); j < sh; ++j)
-				{
-					pkLMInfo->m_aryData[((j + dy) * dtw + (i + dx)) * 4 + 3] = pkSMInfo->m_aryData[(j + sy) * stw + (i + sx)];
-				}
+				pkLMInfo->m_aryShadowMaps.Add(pkSMInfo);
+				pkSMInfo->m_kUsers.Increment();
 			}
 		}
 
+		// A lightmap is up to date when its own source, the sources of the
+		// shadowmaps merged into it and the merge rectangles are unchanged.
 		for (auto& itTex : m_mapLightMaps)
 		{
-			LightMapInfo& kInfo = itTex.Get<1>();
-			FString kFileName = m_kPath + "/" + m_kWorldName + "/LightMaps/" + itTex.Get<0>() + ".tga";
-			IFileHandle* hFile = FPlatformFileManager::Get().GetPlatformFile().OpenWrite(*kFileName);
-			if (hFile)
-			{
-				uint8 acHeader[12] = { 0,0,2,0,0,0,0,0,0,0,0,0 };
-				hFile->Write(acHeader, 12);
-				((uint16*)acHeader)[0] = kInfo.m_pkSource->GetSizeX();
-				((uint16*)acHeader)[1] = kInfo.m_pkSource->GetSizeY();
-				acHeader[4] = 32;
-				acHeader[5] = 8;
-				hFile->Write(acHeader, 6);
-				uint8* pbyBuffer = kInfo.m_aryData.GetData();
-				uint32 u32Pitch = kInfo.m_pkSource->GetSizeX() * 4;
-				for (int32 i(0); i < kInfo.m_pkSource->GetSizeY(); ++i)
+			LightMapInfo* pkInfo = &itTex.Get<1>();
+			uint64 u64Hash = HashString(pkInfo->m_pkSource->Source.GetIdString(), m_u64Settings);
+			for (const StaticMeshInfo* pkMesh : pkInfo->m_aryMeshes)
+			{
+				const ShadowMapInfo& kSMInfo = m_mapShadowMaps.FindChecked(pkMesh->m_strShadowMap);
+				u64Hash = HashString(kSMInfo.m_pkSource->Source.GetIdString(), u64Hash);
+				const FVector2D av2Rects[4] = { pkMesh->m_v2ShadowMapScale, pkMesh->m_v2ShadowMapBias, pkMesh->m_v2LightMapScale, pkMesh->m_v2LightMapBias };
+				u64Hash = level::Hash64(av2Rects, sizeof(av2Rects), u64Hash);
+			}
+			// both are asked, so both stay in the manifest
+			const bool bTGAUpToDate = IsUpToDate("LightMaps/" + itTex.Get<0>() + ".tga", u64Hash);
+			const bool bPVRUpToDate = !m_upAstcEncoder || IsUpToDate("LightMaps/" + itTex.Get<0>() + ".pvr", u64Hash);
+			if (bTGAUpToDate && bPVRUpToDate)
+			{
+				pkInfo->m_bUpToDate = true;
+				for (ShadowMapInfo* pkSMInfo : pkInfo->m_aryShadowMaps)
 				{
-					hFile->Write(pbyBuffer + (kInfo.m_pkSource->GetSizeY() - i - 1) * u32Pitch, u32Pitch);
+					pkSMInfo->m_kUsers.Decrement();
 				}
-				/*pvr::Header kHeader;
-				kHeader.pixelFormat = pvr::PixelFormat::BGRA_8888;
-				kHeader.colorSpace = pvr::ColorSpace::lRGB;
-				kHeader.channelType = pvr::VariableType::UnsignedByteNorm;
-				kHeader.height = kInfo.m_pkSource->GetSizeY();
-				kHeader.width = kInfo.m_pkSource->GetSizeX();
-				kHeader.depth = 1;
-				kHeader.numberOfSurfaces = 1;
-				kHeader.numberOfFaces = 1;
-				kHeader.mipMapCount = 1;
-				kHeader.metaDataSize = 0;
-				hFile->Write((const uint8*)&kHeader, sizeof(pvr::Header));
-				hFile->Write(kInfo.m_aryData.GetData(), kInfo.m_aryData.Num());*/
-				delete hFile;
-				UE_LOG(SceneExporter, Log, TEXT("LightMap \"%s\" exported."), *kFileName);
-				
 			}
 		}
-	}
 
-	void ExportMeshes()
-	{
-		for (auto& itMesh : m_mapFBXMeshes)
+		TMap<const ShadowMapInfo*, vtd::task_graph::node_id> mapShadowSnapshots;
+		for (auto& itTex : m_mapShadowMaps)
 		{
-			UExporter::FExportToFileParams kParams;
-			kParams.Object = itMesh.Get<1>();
-			kParams.Exporter = m_pkMeshExporter;
-			FString kExportPath = m_kPath + "/" + m_kWorldName + "/Meshes/" + itMesh.Get<0>() + ".fbx";
-			kParams.Filename = *kExportPath;
-			kParams.InSelectedOnly = false;
-			kParams.NoReplaceIdentical = false;
-			kParams.Prompt = false;
-			kParams.bUseFileArchive = false;
-			kParams.WriteEmptyFiles = false;
-			UExporter::ExportToFileEx(kParams);
-			UE_LOG(SceneExporter, Log, TEXT("Mesh \"%s\" exported."), *kExportPath);
+			ShadowMapInfo* pkInfo = &itTex.Get<1>();
+			if (pkInfo->m_kUsers.GetValue() == 0) continue;
+			mapShadowSnapshots.Add(pkInfo, m_kEmit.add(vtd::task([this, pkInfo]() { SnapshotShadowMap(*pkInfo); }), LANE_GAME_THREAD));
 		}
-	}
 
-	void ExportTextures()
-	{
-		TSet<FString> kTexNames;
-		for (auto& itMesh : m_aryStaticMeshes)
+		// The alpha merge needs the lightmap and every shadowmap it takes
+		// alpha from; meshes sharing a lightmap are merged by the same node.
+		for (auto& itTex : m_mapLightMaps)
 		{
-			for (auto& itMaterial : itMesh.m_kMaterials)
+			const FString* pkName = &itTex.Get<0>();
+			LightMapInfo* pkInfo = &itTex.Get<1>();
+			if (pkInfo->m_bUpToDate) continue;
+			vtd::task_graph::node_id uSnapshot = m_kEmit.add(vtd::task([this, pkInfo]() { SnapshotLightMap(*pkInfo); }), LANE_GAME_THREAD);
+			vtd::task_graph::node_id uMerge = m_kEmit.add(vtd::task([this, pkName, pkInfo]() { ExportLightMap(*pkName, *pkInfo); }), LANE_WORKERS);
+			m_kEmit.depend(uMerge, uSnapshot);
+			for (ShadowMapInfo* pkSMInfo : pkInfo->m_aryShadowMaps)
 			{
-				for (auto& itTex : itMaterial.m_aryRelatedTextures)
+				m_kEmit.depend(uMerge, mapShadowSnapshots.FindChecked(pkSMInfo));
+			}
+		}
+
+		const double dEmitStart = FPlatformTime::Seconds();
+		m_kEmit.launch(*this, vtd::task([this, dEmitStart]()
+		{
+			UE_LOG(SceneExporter, Log, TEXT("%d meshes, %d textures, %d lightmaps and %d envmaps exported in %.1f ms with %d workers."),
+				m_mapFBXMeshes.Num(), m_mapTextures.Num(), m_mapLightMaps.Num(), m_aryReflectionProbes.Num(),
+				(FPlatformTime::Seconds() - dEmitStart) * 1000.0, (int32)m_kWorkers.worker_count());
+			if (m_bProbeCache)
+			{
+				UE_LOG(SceneExporter, Log, TEXT("%d envmaps were taken from the probe cache."), m_kProbeCacheHits.GetValue());
+			}
+			if (m_kProbeRawBytes.GetValue() > 0)
+			{
+				const double dRawMB = m_kProbeRawBytes.GetValue() / (1024.0 * 1024.0);
+				const double dEncodeSeconds = FPlatformTime::ToSeconds64(m_kProbeEncodeCycles.GetValue());
+				UE_LOG(SceneExporter, Log, TEXT("Envmap block compression (%s, quality %d): %.1f MB at %.1f MB/s per worker, PSNR %.2f dB."),
+					m_iProbeCompression == 1 ? TEXT("BC1/BC3") : TEXT("BC7"), (int32)m_eProbeQuality, dRawMB,
+					dEncodeSeconds > 0.0 ? dRawMB / dEncodeSeconds : 0.0,
+					bc::GetPSNR(m_kProbeError.GetValue(), m_kProbeRawBytes.GetValue()));
+			}
+			if (m_kAstcRawBytes.GetValue() > 0)
+			{
+				static const TCHAR* s_apcPresets[] = { TEXT("fast"), TEXT("medium"), TEXT("thorough") };
+				const double dRawMB = m_kAstcRawBytes.GetValue() / (1024.0 * 1024.0);
+				const double dEncodeSeconds = FPlatformTime::ToSeconds64(m_kAstcCycles.GetValue());
+				UE_LOG(SceneExporter, Log, TEXT("ASTC %ux%u %s: %.1f MB at %.2f MB/s per worker."),
+					m_upAstcEncoder->GetBlockX(), m_upAstcEncoder->GetBlockY(), s_apcPresets[(int32)m_eAstcPreset], dRawMB,
+					dEncodeSeconds > 0.0 ? dRawMB / dEncodeSeconds : 0.0);
+			}
+			if (m_bPack)
+			{
+				// Waits for blobs still being compressed, then queues the table
+				// of contents behind every blob.
+				m_kWorkers.submit(vtd::task([this, dEmitStart]()
 				{
-					if (!kTexNames.Find(itTex->GetName()))
+					m_kWorkers.wait(m_kPackWrites);
+					if (m_bPackCompression)
 					{
-						kTexNames.Add(itTex->GetName());
-						UExporter::FExportToFileParams kParams;
-						kParams.Object = itTex;
-						kParams.Exporter = m_pkTGAExporter;
-						FString kExportPath = m_kPath + "/" + m_kWorldName + "/Textures/" + itTex->GetName() + ".tga";
-						kParams.Filename = *kExportPath;
-						kParams.InSelectedOnly = false;
-						kParams.NoReplaceIdentical = false;
-						kParams.Prompt = false;
-						kParams.bUseFileArchive = false;
-						kParams.WriteEmptyFiles = false;
-						UExporter::ExportToFileEx(kParams);
-						UE_LOG(SceneExporter, Log, TEXT("Texture \"%s\" exported."), *kExportPath);
+						const double dRawMB = m_kPackRawBytes.GetValue() / (1024.0 * 1024.0);
+						const double dStoredMB = m_kPackStoredBytes.GetValue() / (1024.0 * 1024.0);
+						const double dCompressSeconds = FPlatformTime::ToSeconds64(m_kCompressCycles.GetValue());
+						UE_LOG(SceneExporter, Log, TEXT("Pack compression: %.1f MB to %.1f MB (%.1f%%), %.1f MB/s per worker, %.1f MB/s overall."),
+							dRawMB, dStoredMB, dRawMB > 0.0 ? dStoredMB * 100.0 / dRawMB : 100.0,
+							dCompressSeconds > 0.0 ? dRawMB / dCompressSeconds : 0.0,
+							dRawMB / FMath::Max(FPlatformTime::Seconds() - dEmitStart, 0.001));
 					}
-				}
+					PushBGTask(vtd::task([this]() { m_kPack.Finish(); }));
+					SetExiting();
+				}));
+				return;
 			}
-		}
+			if (m_bIncremental)
+			{
+				UE_LOG(SceneExporter, Log, TEXT("%d of %d files were up to date and skipped."), m_kSkipped.GetValue(), m_mapManifest.Num());
+				SaveManifest();
+			}
+			SetExiting();
+		}));
 	}
 
-	void ExportReflectionProbes()
+	// Resumes at m_iScanCursor and yields back to the game thread queue once
+	// the frame budget set by HandleTicker is used up, so large levels are
+	// scanned over several frames without losing what was gathered.
+	void ScanLevel(ULevel* pkLevel)
 	{
-		TArray<uint8> writeData;
-		for (auto& itProbe : m_aryReflectionProbes)
+		const int32 iCheckInterval = 32;
+		if (m_iScanCursor == 0)
+		{
+			LevelSectionInfo& kSection = m_aryLevelSections[m_aryLevelSections.AddDefaulted(1)];
+			kSection.m_strName = pkLevel->GetOutermost()->GetName();
+			kSection.m_iFirstMesh = m_aryStaticMeshes.Num();
+		}
+		while (m_iScanCursor < pkLevel->Actors.Num())
 		{
-			TRefCountPtr<FReflectionCaptureUncompressedData> rpCubemapData = GenerateFromDerivedDataSource(*itProbe.m_pkData);
-			TArray<uint8>& aryData = rpCubemapData->GetArray();
-			int32 CubemapSize = itProbe.m_pkData->CubemapSize;
-			if (aryData.Num())
+			AActor* pkActor = pkLevel->Actors[m_iScanCursor++];
+			if (pkActor)
 			{
-				writeData.Empty(aryData.Num());
-				writeData.AddZeroed(aryData.Num());
-				CTexture texarray[6];
-				int32 MipMapCount = FMath::Log2(CubemapSize) + 1;
-				int32 MipBaseIndex = 0;
-				int32 MipSize = 1 << (MipMapCount - 1);
-				int32 CubeFaceBytes = MipSize * MipSize * 4;
-				for (int32 CubeFace = 0; CubeFace < CubeFace_MAX; CubeFace++)
+				ScanActor(pkActor);
+			}
+			if ((m_iScanCursor % iCheckInterval) == 0 && FPlatformTime::Seconds() >= m_dFrameDeadline)
+			{
+				vtd::task_graph::yield();
+				return;
+			}
+		}
+		m_aryLevelSections.Last().m_iMeshCount = m_aryStaticMeshes.Num() - m_aryLevelSections.Last().m_iFirstMesh;
+		m_iScanCursor = 0;
+	}
+
+	void ScanActor(AActor* pkActor)
+	{
+		if (pkActor->IsA(ASphereReflectionCapture::StaticClass()))
+		{
+			TArray<UReflectionCaptureComponent*> aryCaptures;
+			pkActor->GetComponents(aryCaptures);
+			if (aryCaptures.Num() > 0 && aryCaptures[0])
+			{
+				const FReflectionCaptureFullHDR* pkData = aryCaptures[0]->GetFullHDRData();
+				if (pkData)
 				{
-					writeData.AddZeroed(CubeFaceBytes);
-					const int32 SourceIndex = MipBaseIndex + CubeFace * CubeFaceBytes;
-					GetFaceData(writeData, aryData.GetData() + SourceIndex, CubeFace, MipSize);
-					texarray[CubeFace].create(CubemapSize, CubemapSize, 1, CubeFaceBytes, writeData.GetData()/* EncodedData.GetData()+SourceIndex*/);
+					ReflectionInfo& kInfo = m_aryReflectionProbes[m_aryReflectionProbes.AddDefaulted(1)];
+					kInfo.m_strName = pkActor->GetName();
+					{
+						int& iNameCount = m_mapInvolvedActorNames.FindOrAdd(kInfo.m_strName);
+						if (iNameCount > 0)
+						{
+							kInfo.m_strName = kInfo.m_strName + FString::Printf(TEXT("_%d"), iNameCount);
+						}
+						++iNameCount;
+					}
+					kInfo.m_v3Position = aryCaptures[0]->ComponentToWorld.ToMatrixWithScale().GetOrigin();
+					kInfo.m_v3Offset = aryCaptures[0]->CaptureOffset;
+					kInfo.m_fInfluenceRadius = aryCaptures[0]->GetInfluenceBoundingRadius();
+					kInfo.m_fBrightness = aryCaptures[0]->Brightness;
+					kInfo.m_fAverageBrightness = aryCaptures[0]->GetAverageBrightness();
+					kInfo.m_pkData = pkData;
 				}
-				MipBaseIndex += CubeFaceBytes * CubeFace_MAX;
+			}
+		}
+		else if (pkActor->IsA(ADirectionalLight::StaticClass()))
+		{
+			UDirectionalLightComponent* pkLightCompont = GetDirectionalLightComponent(pkActor);
+			if ((!m_pkMainLight) && pkLightCompont && pkLightCompont->Mobility == EComponentMobility::Stationary)
+			{
+				m_pkMainLight = pkLightCompont;
+			}
+		}
+		else if (pkActor->IsA(AExponentialHeightFog::StaticClass()))
+		{
+			UExponentialHeightFogComponent* pkHeightFog = GetExponentialHeightFogComponent(pkActor);
+			if ((!m_pkMainFog) && pkHeightFog)
+			{
+				m_pkMainFog = pkHeightFog;
+			}
+		}
+		else if (pkActor->IsA(AStaticMeshActor::StaticClass()))
+		{
+			UStaticMeshComponent* pkStaticMesh = CastChecked<AStaticMeshActor>(pkActor)->GetStaticMeshComponent();
+			if (!pkStaticMesh) return;
+			UMaterialInterface* pkMaterial = pkStaticMesh->GetMaterial(0);
+			if (!pkMaterial) return;
+			SupportedMaterialType eMatType = GetType(*pkMaterial);
+			if (eMatType >= MAT_MAX) return;
+			StaticMeshInfo& kInfo = m_aryStaticMeshes[m_aryStaticMeshes.AddDefaulted(1)];
+			kInfo.m_strName = pkActor->GetName();
+			{
+				int& iNameCount = m_mapInvolvedActorNames.FindOrAdd(kInfo.m_strName);
+				if (iNameCount > 0)
+				{
+					kInfo.m_strName = kInfo.m_strName + FString::Printf(TEXT("_%d"), iNameCount);
+				}
+				++iNameCount;
+			}
+			kInfo.m_strFBXName = pkStaticMesh->GetStaticMesh()->GetName();
+			m_mapFBXMeshes.FindOrAdd(kInfo.m_strFBXName) = pkStaticMesh->GetStaticMesh();
+			kInfo.m_kTransform = pkActor->GetTransform();
+
+			if ("S_ZhuCheng_MB_001_02" == kInfo.m_strFBXName)
+			{
+				int a = 0;
+			}
 
-				for (int32 MipIndex = 1; MipIndex < MipMapCount; MipIndex++)
+			FStaticMeshLODResources& LOD = pkStaticMesh->GetStaticMesh()->RenderData->LODResources[0];
+			int matIndex = 0;
+			while(true)
+			{
+				MaterialInfo& matInfo = kInfo.m_kMaterials[kInfo.m_kMaterials.AddDefaulted(1)];
+				matInfo.m_strName = pkMaterial->GetName();
+				matInfo.m_index = GetMaterialIndex(LOD, matIndex);
+				matInfo.m_eType = eMatType;
+				switch (matInfo.m_eType)
 				{
-					MipSize = 1 << (MipMapCount - MipIndex - 1);
-					CubeFaceBytes = MipSize * MipSize * 4;
-					for (int32 CubeFace = 0; CubeFace < CubeFace_MAX; CubeFace++)
+				case MAT_SCENE_GRASS:
+					matInfo.m_aryRelatedTextures.SetNum(1);
+					pkMaterial->GetTextureParameterValue(TEXT("BaseTexture"), matInfo.m_aryRelatedTextures[0]);
+					matInfo.m_aryRelatedParams.SetNum(1);
+					pkMaterial->GetScalarParameterValue(TEXT("LightIntensity"), matInfo.m_aryRelatedParams[0]);
+					break;
+				case MAT_SCENE_PLAIN:
+				case MAT_SCENE_PLAIN_ALPHA:
+					matInfo.m_aryRelatedTextures.SetNum(1);
+					pkMaterial->GetTextureParameterValue(TEXT("BaseTexture"), matInfo.m_aryRelatedTextures[0]);
+					break;
+				case MAT_SCENE_PBR:
+				case MAT_SCENE_PBR_ALPHA:
+					matInfo.m_aryRelatedTextures.SetNum(3);
+					pkMaterial->GetTextureParameterValue(TEXT("BaseTexture"), matInfo.m_aryRelatedTextures[0]);
+					pkMaterial->GetTextureParameterValue(TEXT("MixTexture"), matInfo.m_aryRelatedTextures[1]);
+					pkMaterial->GetTextureParameterValue(TEXT("NormalTexture"), matInfo.m_aryRelatedTextures[2]);
+					break;
+				case MAT_SCENE_PBR_GLOW:
+					matInfo.m_aryRelatedTextures.SetNum(4);
+					pkMaterial->GetTextureParameterValue(TEXT("BaseTexture"), matInfo.m_aryRelatedTextures[0]);
+					pkMaterial->GetTextureParameterValue(TEXT("MixTexture"), matInfo.m_aryRelatedTextures[1]);
+					pkMaterial->GetTextureParameterValue(TEXT("NormalTexture"), matInfo.m_aryRelatedTextures[2]);
+					pkMaterial->GetTextureParameterValue(TEXT("GlowTexture"), matInfo.m_aryRelatedTextures[3]);
+					matInfo.m_aryRelatedParams.SetNum(1);
+					pkMaterial->GetScalarParameterValue(TEXT("GlowIntensity"), matInfo.m_aryRelatedParams[0]);
+					break;
+				case MAT_TERRAIN_PBR:
+					matInfo.m_aryRelatedTextures.SetNum(6);
+					pkMaterial->GetTextureParameterValue(TEXT("BasePBR"), matInfo.m_aryRelatedTextures[0]);
+					pkMaterial->GetTextureParameterValue(TEXT("MixPBR"), matInfo.m_aryRelatedTextures[1]);
+					pkMaterial->GetTextureParameterValue(TEXT("NormalPBR"), matInfo.m_aryRelatedTextures[2]);
+					pkMaterial->GetTextureParameterValue(TEXT("BaseLayer0"), matInfo.m_aryRelatedTextures[3]);
+					pkMaterial->GetTextureParameterValue(TEXT("BaseLayer1"), matInfo.m_aryRelatedTextures[4]);
+					pkMaterial->GetTextureParameterValue(TEXT("Blend"), matInfo.m_aryRelatedTextures[5]);
+					matInfo.m_aryRelatedParams.SetNum(3);
+					pkMaterial->GetScalarParameterValue(TEXT("TilingPBR"), matInfo.m_aryRelatedParams[0]);
+					pkMaterial->GetScalarParameterValue(TEXT("Tiling0"), matInfo.m_aryRelatedParams[1]);
+					pkMaterial->GetScalarParameterValue(TEXT("Tiling1"), matInfo.m_aryRelatedParams[2]);
+					break;
+				case MAT_WATER:
+					matInfo.m_aryRelatedTextures.SetNum(0);
+					break;
+				default:
+					break;
+				}
+				for (auto pkTex : matInfo.m_aryRelatedTextures)
+				{
+					if (pkTex)
 					{
-						writeData.AddZeroed(CubeFaceBytes);
-						const int32 SourceIndex = MipBaseIndex + CubeFace * CubeFaceBytes;
-						GetFaceData(writeData, aryData.GetData() + SourceIndex, CubeFace, MipSize);
-						CSurface surface(MipSize, MipSize, 1, CubeFaceBytes, writeData.GetData()/*EncodedData.GetData() + SourceIndex*/);
-						texarray[CubeFace].add_mipmap(surface);
+						m_mapTextures.FindOrAdd(pkTex);
+					}
+				}
+				pkMaterial = pkStaticMesh->GetMaterial(++matIndex);
+				if (!pkMaterial) break;
+				eMatType = GetType(*pkMaterial);
+				if (eMatType >= MAT_MAX) break;
+			}						
+
+			if (pkStaticMesh->LODData.Num() > 0)
+			{
+				const FMeshMapBuildData* pkMeshMapBuildData = pkStaticMesh->GetMeshMapBuildData(pkStaticMesh->LODData[0]);
+				if (pkMeshMapBuildData)
+				{
+					if (pkMeshMapBuildData->LightMap != nullptr)
+					{
+						kInfo.m_pkLightMap = pkMeshMapBuildData->LightMap->GetLightMap2D();
+						UTexture2D* pkLightMapTex = kInfo.m_pkLightMap->GetTexture(1);
+						kInfo.m_strLightMap = pkLightMapTex->GetName();
+						kInfo.m_v2LightMapScale = kInfo.m_pkLightMap->GetCoordinateScale();
+						kInfo.m_v2LightMapBias = kInfo.m_pkLightMap->GetCoordinateBias();
+						m_mapLightMaps.FindOrAdd(kInfo.m_strLightMap).m_pkSource = pkLightMapTex;
+
+						if (pkMeshMapBuildData->ShadowMap != nullptr)
+						{
+							kInfo.m_pkShadowMap = pkMeshMapBuildData->ShadowMap->GetShadowMap2D();
+							UShadowMapTexture2D* pkShadowMapTex = kInfo.m_pkShadowMap->GetTexture();
+							kInfo.m_strShadowMap = pkShadowMapTex->GetName();
+							kInfo.m_v2ShadowMapScale = kInfo.m_pkShadowMap->GetCoordinateScale();
+							kInfo.m_v2ShadowMapBias = kInfo.m_pkShadowMap->GetCoordinateBias();
+							m_mapShadowMaps.FindOrAdd(kInfo.m_strShadowMap).m_pkSource = pkShadowMapTex;
+						}
 					}
-					MipBaseIndex += CubeFaceBytes * CubeFace_MAX;
 				}
-				CDDSImage image;
-				texarray[3].FlipX();
-				image.create_textureCubemap(GL_BGRA_EXT, 4, texarray[0], texarray[1], texarray[5], texarray[4], texarray[2], texarray[3]);
-				FString kExportPath = m_kPath + "/" + m_kWorldName + "/EnvMaps/" + itProbe.m_strName + ".dds";
-				image.save(kExportPath);
-				UE_LOG(SceneExporter, Log, TEXT("EnvMap \"%s\" exported."), *kExportPath);
 			}
+			LevelSectionInfo& kSection = m_aryLevelSections.Last();
+			kSection.m_u64ScanHash = HashScannedMesh(kInfo, kSection.m_u64ScanHash);
 		}
 	}
 
-	void ExportSceneStructure()
+	// Everything BuildMeshSection reads for one mesh, hashed while the scan
+	// has it at hand, except the texture names, which are only known once
+	// ResolveTextures has run.
+	static uint64 HashScannedMesh(const StaticMeshInfo& kMesh, uint64 u64Hash)
 	{
-		FString kFileName = m_kPath + "/" + m_kWorldName + "/" + m_kWorldName + ".level";
-		IFileHandle* hFile = FPlatformFileManager::Get().GetPlatformFile().OpenWrite(*kFileName);
-		if (hFile)
+		u64Hash = HashString(kMesh.m_strName, u64Hash);
+		u64Hash = HashString(kMesh.m_strFBXName, u64Hash);
+		const FVector kLocation = kMesh.m_kTransform.GetLocation();
+		const FQuat kRotation = kMesh.m_kTransform.GetRotation();
+		const FVector kScale = kMesh.m_kTransform.GetScale3D();
+		const float afTransform[] = { kLocation.X, kLocation.Y, kLocation.Z, kRotation.X, kRotation.Y, kRotation.Z, kRotation.W, kScale.X, kScale.Y, kScale.Z };
+		u64Hash = level::Hash64(afTransform, sizeof(afTransform), u64Hash);
+		for (auto& itMat : kMesh.m_kMaterials)
+		{
+			u64Hash = HashString(itMat.m_strName, u64Hash);
+			const int32 aiMaterial[] = { itMat.m_index, (int32)itMat.m_eType, itMat.m_aryRelatedTextures.Num(), itMat.m_aryRelatedParams.Num() };
+			u64Hash = level::Hash64(aiMaterial, sizeof(aiMaterial), u64Hash);
+			u64Hash = level::Hash64(itMat.m_aryRelatedParams.GetData(), itMat.m_aryRelatedParams.Num() * sizeof(float), u64Hash);
+		}
+		if (kMesh.m_pkLightMap)
+		{
+			LightMap2DExt* pkLightMap = (LightMap2DExt*)kMesh.m_pkLightMap;
+			u64Hash = HashString(kMesh.m_strLightMap, u64Hash);
+			const FVector4 akVectors[] = { pkLightMap->GetScaleVector(2), pkLightMap->GetAddVector(2), pkLightMap->GetScaleVector(3), pkLightMap->GetAddVector(3) };
+			const FVector2D akCoordinates[] = { kMesh.m_v2LightMapScale, kMesh.m_v2LightMapBias };
+			u64Hash = level::Hash64(akVectors, sizeof(akVectors), u64Hash);
+			u64Hash = level::Hash64(akCoordinates, sizeof(akCoordinates), u64Hash);
+		}
+		if (kMesh.m_pkShadowMap)
+		{
+			const FVector4 kPenumbra = ((ShadowMap2DExt*)kMesh.m_pkShadowMap)->GetInvUniformPenumbraSize();
+			u64Hash = level::Hash64(&kPenumbra, sizeof(kPenumbra), u64Hash);
+		}
+		const uint8 abyMaps[] = { kMesh.m_pkLightMap != nullptr, kMesh.m_pkShadowMap != nullptr };
+		return level::Hash64(abyMaps, sizeof(abyMaps), u64Hash);
+	}
+
+	static void MergeShadowMap(const StaticMeshInfo& kMesh, MapSnapshot& kLightMap, const MapSnapshot& kShadowMap)
+	{
+		FVector2D v2SrcScale = kMesh.m_v2ShadowMapScale;
+		FVector2D v2SrcBias = kMesh.m_v2ShadowMapBias;
+		FVector2D v2DstScale = kMesh.m_v2LightMapScale;
+		FVector2D v2DstBias = kMesh.m_v2LightMapBias;
+
+		uint32 stw = kShadowMap.m_iSizeX;
+		uint32 sth = kShadowMap.m_iSizeY;
+		uint32 dtw = kLightMap.m_iSizeX;
+		uint32 dth = kLightMap.m_iSizeY;
+
+		uint32 sw = po2((uint32)(float(stw) * v2SrcScale.X));
+		uint32 sh = po2((uint32)(float(sth) * v2SrcScale.Y));
+		uint32 dw = po2((uint32)(float(dtw) * v2DstScale.X));
+		uint32 dh = po2((uint32)(float(dth >> 1) * v2DstScale.Y));
+		if (sw != dw || sh != dh) return;
+
+		uint32 sx = roundpos(float(stw) * v2SrcBias.X, sw);
+		uint32 sy = roundpos(float(sth) * v2SrcBias.Y, sh);
+		uint32 dx = roundpos(float(dtw) * v2DstBias.X, dw);
+		uint32 dy = roundpos(float(dth >> 1) * v2DstBias.Y, dh);
+
+		for (uint32 i(0); i < sw; ++i)
 		{
-			if (m_pkMainLight)
+			for (uint32 j(0); j < sh; ++j)
 			{
-				(*hFile) << (uint32)(1);
-				FVector DirectionalLightDirection = -m_pkMainLight->GetDirection();
-				(*hFile) << -DirectionalLightDirection.X;
-				(*hFile) << DirectionalLightDirection.Z;
-				(*hFile) << DirectionalLightDirection.Y;
+				kLightMap.m_aryData[((j + dy) * dtw + (i + dx)) * 4 + 3] = kShadowMap.m_aryData[(j + sy) * stw + (i + sx)];
+			}
+		}
+	}
 
-				FLinearColor DirectionalLightColor = FLinearColor(m_pkMainLight->LightColor) * m_pkMainLight->ComputeLightBrightness();
-				if (m_pkMainLight->bUseTemperature)
-				{
-					DirectionalLightColor *= FLinearColor::MakeFromColorTemperature(m_pkMainLight->Temperature);
-				}
-				DirectionalLightColor /= PI;
-				(*hFile) << DirectionalLightColor.R;
-				(*hFile) << DirectionalLightColor.G;
-				(*hFile) << DirectionalLightColor.B;
+	void WriteLightMap(const FString& kName, const MapSnapshot& kInfo)
+	{
+		FString kFileName = "LightMaps/" + kName + ".tga";
+		TArray<uint8> aryFile;
+		CArraySink kSink(aryFile);
+		// Bottom up with the bottom-left origin, byte for byte the files
+		// lightmaps were written as before the image writer.
+		const image::View kView = image::MakeView(kInfo.m_aryData.GetData(), kInfo.m_iSizeX, kInfo.m_iSizeY, image::Format::BGRA8);
+		image::WriteTGA(kSink, kView, true);
+		WriteFileAsync(kFileName, MoveTemp(aryFile));
+		UE_LOG(SceneExporter, Log, TEXT("LightMap \"%s\" exported."), *kFileName);
+		if (m_upAstcEncoder)
+		{
+			WriteASTC("LightMaps/" + kName + ".pvr", TArray<image::View>{ kView }, 1, 1);
+		}
+	}
+
+	void CreateAstcEncoder()
+	{
+		m_upAstcEncoder.Reset();
+		const FString strFootprint = CVarSceneExporterASTC.GetValueOnGameThread();
+		if (strFootprint.IsEmpty()) return;
+		uint32 uBlockX = 0;
+		uint32 uBlockY = 0;
+		if (!astc::ParseFootprint(TCHAR_TO_ANSI(*strFootprint), uBlockX, uBlockY))
+		{
+			UE_LOG(SceneExporter, Warning, TEXT("\"%s\" is not an ASTC footprint from 4x4 to 8x8, no ASTC copies are written."), *strFootprint);
+			return;
+		}
+		m_eAstcPreset = (astc::Preset)FMath::Clamp(CVarSceneExporterASTCPreset.GetValueOnGameThread(), 0, 2);
+		m_upAstcEncoder = MakeUnique<astc::Encoder>(uBlockX, uBlockY, m_eAstcPreset);
+		check(m_upAstcEncoder->IsValid());
+		for (uint32 u = (uint32)image::Format::ASTC_4x4; u <= (uint32)image::Format::ASTC_8x8; ++u)
+		{
+			if (image::GetBlockWidth((image::Format)u) == uBlockX && image::GetBlockHeight((image::Format)u) == uBlockY)
+			{
+				m_eAstcFormat = (image::Format)u;
 			}
-			else
+		}
+	}
+
+	// Encodes BGRA8 surfaces to ASTC, one after another into aryBlocks, in
+	// chunks of block rows on the workers; returns views of the blocks with
+	// the orientation of their sources.
+	TArray<image::View> EncodeASTC(const TArray<image::View>& arySurfaces, TArray<uint8>& aryBlocks)
+	{
+		const astc::Encoder& kEncoder = *m_upAstcEncoder;
+		struct BlockRows
+		{
+			const image::View* m_pkSurface;
+			uint8* m_pbyDest;
+			uint32 m_uFirst;
+			uint32 m_uEnd;
+		};
+		// ASTC is slow enough per block that small chunks still pay off
+		static const uint32 BLOCK_ROWS_PER_CHUNK = 2;
+		size_t uTotal = 0;
+		for (const image::View& kSurface : arySurfaces)
+		{
+			uTotal += astc::GetSurfaceSize(kEncoder.GetBlockX(), kEncoder.GetBlockY(), kSurface.width, kSurface.height);
+		}
+		aryBlocks.SetNumUninitialized((int32)uTotal);
+		TArray<image::View> aryViews;
+		TArray<BlockRows> aryChunks;
+		uint8* pbyDest = aryBlocks.GetData();
+		int64 iRawBytes = 0;
+		for (const image::View& kSurface : arySurfaces)
+		{
+			const uint32 uBlockRows = astc::GetBlockRows(kSurface.height, kEncoder.GetBlockY());
+			for (uint32 uRow = 0; uRow < uBlockRows; uRow += BLOCK_ROWS_PER_CHUNK)
 			{
-				(*hFile) << (uint32)(0);
+				aryChunks.Add({ &kSurface, pbyDest, uRow, FMath::Min(uRow + BLOCK_ROWS_PER_CHUNK, uBlockRows) });
 			}
+			aryViews.Add(image::MakeView(pbyDest, kSurface.width, kSurface.height, m_eAstcFormat, kSurface.orientation));
+			pbyDest += astc::GetSurfaceSize(kEncoder.GetBlockX(), kEncoder.GetBlockY(), kSurface.width, kSurface.height);
+			iRawBytes += (int64)kSurface.width * kSurface.height * 4;
+		}
+		m_kWorkers.parallel_for(aryChunks.Num(), [this, &kEncoder, &aryChunks](size_t i)
+		{
+			const uint64 u64Start = FPlatformTime::Cycles64();
+			const BlockRows& kChunk = aryChunks[i];
+			const image::View& kSurface = *kChunk.m_pkSurface;
+			kEncoder.CompressRows(kSurface.data, kSurface.pitch, kSurface.width, kSurface.height, kChunk.m_uFirst, kChunk.m_uEnd, kChunk.m_pbyDest);
+			m_kAstcCycles.Add(FPlatformTime::Cycles64() - u64Start);
+		});
+		m_kAstcRawBytes.Add(iRawBytes);
+		return aryViews;
+	}
+
+	// faceCount * mipCount BGRA8 surfaces, ordered as for image::WritePVR.
+	void WriteASTC(const FString& kName, const TArray<image::View>& arySurfaces, uint32 uFaceCount, uint32 uMipCount)
+	{
+		TArray<uint8> aryBlocks;
+		const TArray<image::View> aryViews = EncodeASTC(arySurfaces, aryBlocks);
+		TArray<uint8> aryFile;
+		CArraySink kSink(aryFile);
+		image::WritePVR(kSink, aryViews.GetData(), uFaceCount, uMipCount);
+		WriteFileAsync(kName, MoveTemp(aryFile));
+		UE_LOG(SceneExporter, Log, TEXT("ASTC \"%s\" exported."), *kName);
+	}
 
-			if (m_pkMainFog)
+	bool HasInFlightRoom() const
+	{
+		const int64 iInFlight = m_kInFlightBytes.GetValue();
+		return iInFlight == 0 || iInFlight < m_iInFlightBudget;
+	}
+
+	TSharedPtr<MapSnapshot, ESPMode::ThreadSafe> SnapshotTexture(UTexture2D& kTexture)
+	{
+		TSharedPtr<MapSnapshot, ESPMode::ThreadSafe> spSnapshot(new MapSnapshot(m_kInFlightBytes));
+		spSnapshot->m_iSizeX = kTexture.GetSizeX();
+		spSnapshot->m_iSizeY = kTexture.GetSizeY();
+		kTexture.Source.GetMipData(spSnapshot->m_aryData, 0);
+		spSnapshot->Account(spSnapshot->m_aryData.Num());
+		return spSnapshot;
+	}
+
+	void SnapshotTextureSource(UTexture& kTexture, TextureInfo& kInfo)
+	{
+		if (!HasInFlightRoom())
+		{
+			vtd::task_graph::yield();
+			return;
+		}
+		TSharedPtr<MapSnapshot, ESPMode::ThreadSafe> spSnapshot(new MapSnapshot(m_kInFlightBytes));
+		spSnapshot->m_iSizeX = kTexture.Source.GetSizeX();
+		spSnapshot->m_iSizeY = kTexture.Source.GetSizeY();
+		kTexture.Source.GetMipData(spSnapshot->m_aryData, 0);
+		spSnapshot->Account(spSnapshot->m_aryData.Num());
+		kInfo.m_eFormat = kTexture.Source.GetFormat();
+		kInfo.m_spSnapshot = spSnapshot;
+	}
+
+	// A cryptographic hash, so two textures are only merged when their
+	// pixels really are the same.
+	static void HashTextureSource(TextureInfo& kInfo)
+	{
+		const MapSnapshot& kSnapshot = *kInfo.m_spSnapshot;
+		const int32 aiShape[3] = { kSnapshot.m_iSizeX, kSnapshot.m_iSizeY, (int32)kInfo.m_eFormat };
+		FSHA1 kHash;
+		kHash.Update((const uint8*)aiShape, sizeof(aiShape));
+		kHash.Update(kSnapshot.m_aryData.GetData(), kSnapshot.m_aryData.Num());
+		kHash.Final();
+		kHash.GetHash(kInfo.m_kHash.Hash);
+		kInfo.m_spSnapshot.Reset();
+	}
+
+	// Picks the texture that is exported for each distinct hash and names
+	// the files. Textures are visited in path order, so the choice and the
+	// names are the same on every export of an unchanged world.
+	void ResolveTextures()
+	{
+		TArray<UTexture*> aryTextures;
+		m_mapTextures.GenerateKeyArray(aryTextures);
+		aryTextures.Sort([](const UTexture& kA, const UTexture& kB) { return kA.GetPathName() < kB.GetPathName(); });
+
+		TMap<FSHAHash, UTexture*> mapCanonical;
+		TMap<FString, int> mapNames;
+		int32 iAliases = 0;
+		int64 iSavedBytes = 0;
+		for (UTexture* pkTex : aryTextures)
+		{
+			TextureInfo& kInfo = m_mapTextures.FindChecked(pkTex);
+			s_mapSourceHashes.Add(pkTex->Source.GetIdString(), kInfo.m_kHash);
+			UTexture** ppkCanonical = mapCanonical.Find(kInfo.m_kHash);
+			if (ppkCanonical)
+			{
+				kInfo.m_pkCanonical = *ppkCanonical;
+				kInfo.m_strName = m_mapTextures.FindChecked(*ppkCanonical).m_strName;
+				kInfo.m_u64NameHash = m_mapTextures.FindChecked(*ppkCanonical).m_u64NameHash;
+				++iAliases;
+				iSavedBytes += (int64)pkTex->Source.GetSizeX() * pkTex->Source.GetSizeY() * pkTex->Source.GetBytesPerPixel();
+				UE_LOG(SceneExporter, Log, TEXT("Texture \"%s\" has the same pixels as \"%s\" and is not exported."), *pkTex->GetPathName(), *(*ppkCanonical)->GetPathName());
+				continue;
+			}
+			mapCanonical.Add(kInfo.m_kHash, pkTex);
+			kInfo.m_pkCanonical = pkTex;
+			kInfo.m_strName = pkTex->GetName();
+			int& iNameCount = mapNames.FindOrAdd(kInfo.m_strName);
+			if (iNameCount > 0)
 			{
-				(*hFile) << (uint32)(1);
-				(*hFile) << m_pkMainFog->GetComponentLocation().Z;
-				(*hFile) << m_pkMainFog->FogDensity;
-				(*hFile) << m_pkMainFog->FogInscatteringColor.R;
-				(*hFile) << m_pkMainFog->FogInscatteringColor.G;
-				(*hFile) << m_pkMainFog->FogInscatteringColor.B;
-				(*hFile) << m_pkMainFog->FogInscatteringColor.A;
-				(*hFile) << m_pkMainFog->FogHeightFalloff;
-				(*hFile) << m_pkMainFog->FogMaxOpacity;
-				(*hFile) << m_pkMainFog->StartDistance;
-				(*hFile) << m_pkMainFog->FogCutoffDistance;
+				kInfo.m_strName = kInfo.m_strName + FString::Printf(TEXT("_%d"), iNameCount);
+			}
+			++iNameCount;
+			kInfo.m_u64NameHash = HashString(kInfo.m_strName, 0);
+		}
+		UE_LOG(SceneExporter, Log, TEXT("%d of %d textures are duplicates, %.1f MB of source pixels not exported."),
+			iAliases, aryTextures.Num(), iSavedBytes / (1024.0 * 1024.0));
+	}
+
+	// File name of a texture after deduplication, without extension.
+	const FString& GetTextureName(UTexture* pkTex) const
+	{
+		static const FString s_strNone;
+		const TextureInfo* pkInfo = m_mapTextures.Find(pkTex);
+		return pkInfo ? pkInfo->m_strName : s_strNone;
+	}
+
+	void SnapshotLightMap(LightMapInfo& kInfo)
+	{
+		if (!HasInFlightRoom())
+		{
+			vtd::task_graph::yield();
+			return;
+		}
+		kInfo.m_spSnapshot = SnapshotTexture(*kInfo.m_pkSource);
+	}
+
+	void SnapshotShadowMap(ShadowMapInfo& kInfo)
+	{
+		if (!HasInFlightRoom())
+		{
+			vtd::task_graph::yield();
+			return;
+		}
+		kInfo.m_spSnapshot = SnapshotTexture(*kInfo.m_pkSource);
+	}
+
+	void SnapshotReflectionProbe(ReflectionInfo& kInfo)
+	{
+		if (!HasInFlightRoom())
+		{
+			vtd::task_graph::yield();
+			return;
+		}
+		TSharedPtr<CubemapSnapshot, ESPMode::ThreadSafe> spSnapshot(new CubemapSnapshot(m_kInFlightBytes));
+		spSnapshot->m_iCubemapSize = kInfo.m_pkData->CubemapSize;
+		spSnapshot->m_rpData = kInfo.m_pkData->GetUncompressedData();
+		spSnapshot->Account(spSnapshot->m_rpData->Size());
+		kInfo.m_spSnapshot = spSnapshot;
+	}
+
+	// Owns the lightmap snapshot exclusively; shadowmap snapshots are shared
+	// and dropped by whichever lightmap finishes with them last.
+	void ExportLightMap(const FString& kName, LightMapInfo& kInfo)
+	{
+		MapSnapshot& kLightMap = *kInfo.m_spSnapshot;
+		int32 i(3);
+		while (i < kLightMap.m_aryData.Num())
+		{
+			kLightMap.m_aryData[i] = 0;
+			i += 4;
+		}
+		for (const StaticMeshInfo* pkMesh : kInfo.m_aryMeshes)
+		{
+			const ShadowMapInfo& kSMInfo = m_mapShadowMaps.FindChecked(pkMesh->m_strShadowMap);
+			MergeShadowMap(*pkMesh, kLightMap, *kSMInfo.m_spSnapshot);
+		}
+		WriteLightMap(kName, kLightMap);
+		kInfo.m_spSnapshot.Reset();
+		for (ShadowMapInfo* pkSMInfo : kInfo.m_aryShadowMaps)
+		{
+			if (pkSMInfo->m_kUsers.Decrement() == 0)
+			{
+				pkSMInfo->m_spSnapshot.Reset();
+			}
+		}
+	}
+
+	// The FBX exporter writes its file itself rather than into an archive, so
+	// meshes are the one output still written on the game thread.
+	void ExportMesh(const FString& kName, UStaticMesh* pkMesh)
+	{
+		UExporter::FExportToFileParams kParams;
+		kParams.Object = pkMesh;
+		kParams.Exporter = m_pkMeshExporter;
+		FString kExportPath = m_kPath + "/" + m_kWorldName + "/Meshes/" + kName + ".fbx";
+		kParams.Filename = *kExportPath;
+		kParams.InSelectedOnly = false;
+		kParams.NoReplaceIdentical = false;
+		kParams.Prompt = false;
+		kParams.bUseFileArchive = false;
+		kParams.WriteEmptyFiles = false;
+		UExporter::ExportToFileEx(kParams);
+		UE_LOG(SceneExporter, Log, TEXT("Mesh \"%s\" exported."), *kExportPath);
+	}
+
+	void ExportTexture(UTexture* pkTex, TextureInfo& kInfo)
+	{
+		if (kInfo.m_pkCanonical != pkTex)
+		{
+			return;
+		}
+		const uint64 u64Hash = HashString(pkTex->Source.GetIdString(), m_u64Settings);
+		const bool bTGAUpToDate = IsUpToDate("Textures/" + kInfo.m_strName + ".tga", u64Hash);
+		const bool bAstc = m_upAstcEncoder && !IsUpToDate("Textures/" + kInfo.m_strName + ".pvr", u64Hash);
+		if (bTGAUpToDate && !bAstc)
+		{
+			return;
+		}
+		// Encoded to memory here and written by the export thread, loose or
+		// into the pack. The ASTC copy is encoded from a snapshot by
+		// ExportTextureASTC on the workers.
+		if (!HasWriteRoom() || (bAstc && !HasInFlightRoom()))
+		{
+			vtd::task_graph::yield();
+			return;
+		}
+		if (bAstc)
+		{
+			// other source formats would need a conversion first
+			if (pkTex->Source.GetFormat() == TSF_BGRA8)
+			{
+				TSharedPtr<MapSnapshot, ESPMode::ThreadSafe> spSnapshot(new MapSnapshot(m_kInFlightBytes));
+				spSnapshot->m_iSizeX = pkTex->Source.GetSizeX();
+				spSnapshot->m_iSizeY = pkTex->Source.GetSizeY();
+				pkTex->Source.GetMipData(spSnapshot->m_aryData, 0);
+				spSnapshot->Account(spSnapshot->m_aryData.Num());
+				kInfo.m_spSnapshot = spSnapshot;
 			}
 			else
 			{
-				(*hFile) << (uint32)(0);
+				UE_LOG(SceneExporter, Log, TEXT("Texture \"%s\" has no BGRA8 source and gets no ASTC copy."), *pkTex->GetPathName());
 			}
+		}
+		if (bTGAUpToDate)
+		{
+			return;
+		}
+		FString kName = "Textures/" + kInfo.m_strName + ".tga";
+		FBufferArchive kAr;
+		if (m_pkTGAExporter->ExportBinary(pkTex, TEXT("TGA"), kAr, GWarn))
+		{
+			WriteFileAsync(kName, MoveTemp(kAr));
+			UE_LOG(SceneExporter, Log, TEXT("Texture \"%s\" exported."), *kName);
+		}
+		else
+		{
+			UE_LOG(SceneExporter, Warning, TEXT("Failed to export texture \"%s\"."), *kName);
+		}
+	}
+
+	void ExportTextureASTC(TextureInfo& kInfo)
+	{
+		if (!kInfo.m_spSnapshot) return;
+		const MapSnapshot& kSnapshot = *kInfo.m_spSnapshot;
+		WriteASTC("Textures/" + kInfo.m_strName + ".pvr",
+			TArray<image::View>{ image::MakeView(kSnapshot.m_aryData.GetData(), kSnapshot.m_iSizeX, kSnapshot.m_iSizeY, image::Format::BGRA8) }, 1, 1);
+		kInfo.m_spSnapshot.Reset();
+	}
 
-			(*hFile) << (uint32)m_aryReflectionProbes.Num();
-			for (auto& itRef : m_aryReflectionProbes)
+	// Block compresses the faces of a probe, laid out face by face with their
+	// mips and already in file order, into aryBlocks with the same layout.
+	// Chunks of block rows are spread over the workers. DXT picks BC1 unless
+	// some RGBM multiplier in alpha is below 255.
+	bc::Format CompressProbe(const TArray<uint8>& aryFaces, int32 MipMapCount, TArray<uint8>& aryBlocks)
+	{
+		bc::Format eFormat = bc::Format::BC7;
+		if (m_iProbeCompression == 1)
+		{
+			bool bOpaque = true;
+			for (int32 i = 3; i < aryFaces.Num() && bOpaque; i += 4)
 			{
-				Write(*hFile, itRef.m_strName);
-				WritePosition(*hFile, itRef.m_v3Position);
-				WritePosition(*hFile, itRef.m_v3Offset);
-				(*hFile) << itRef.m_fBrightness;
-				(*hFile) << itRef.m_fInfluenceRadius * 0.01f;
-				(*hFile) << itRef.m_fAverageBrightness;
+				bOpaque = aryFaces[i] == 255;
 			}
+			eFormat = bOpaque ? bc::Format::BC1 : bc::Format::BC3;
+		}
 
-			(*hFile) << (uint32)m_aryStaticMeshes.Num();
-			for (auto& itMesh : m_aryStaticMeshes)
+		struct BlockRows
+		{
+			const uint8* m_pbySource;
+			uint8* m_pbyDest;
+			uint32 m_uSize;
+			uint32 m_uFirst;
+			uint32 m_uEnd;
+		};
+		static const uint32 BLOCK_ROWS_PER_CHUNK = 8;
+		size_t uTotal = 0;
+		for (int32 MipIndex = 0; MipIndex < MipMapCount; MipIndex++)
+		{
+			const uint32 MipSize = 1u << (MipMapCount - MipIndex - 1);
+			uTotal += bc::GetSurfaceSize(eFormat, MipSize, MipSize) * CubeFace_MAX;
+		}
+		aryBlocks.SetNumUninitialized((int32)uTotal);
+		TArray<BlockRows> aryChunks;
+		const uint8* pbySource = aryFaces.GetData();
+		uint8* pbyDest = aryBlocks.GetData();
+		for (int32 CubeFace = 0; CubeFace < CubeFace_MAX; CubeFace++)
+		{
+			for (int32 MipIndex = 0; MipIndex < MipMapCount; MipIndex++)
 			{
-				Write(*hFile, itMesh.m_strName);
-				Write(*hFile, itMesh.m_strFBXName);
-				Write(*hFile, itMesh.m_kTransform);
-				(*hFile) << (uint32)itMesh.m_kMaterials.Num();
+				const uint32 MipSize = 1u << (MipMapCount - MipIndex - 1);
+				const uint32 uBlockRows = bc::GetBlockRows(MipSize);
+				for (uint32 uRow = 0; uRow < uBlockRows; uRow += BLOCK_ROWS_PER_CHUNK)
+				{
+					aryChunks.Add({ pbySource, pbyDest, MipSize, uRow, FMath::Min(uRow + BLOCK_ROWS_PER_CHUNK, uBlockRows) });
+				}
+				pbySource += MipSize * MipSize * 4;
+				pbyDest += bc::GetSurfaceSize(eFormat, MipSize, MipSize);
+			}
+		}
+		m_kWorkers.parallel_for(aryChunks.Num(), [this, eFormat, &aryChunks](size_t i)
+		{
+			const uint64 u64Start = FPlatformTime::Cycles64();
+			const BlockRows& kChunk = aryChunks[i];
+			const uint64 u64Error = bc::CompressRows(eFormat, m_eProbeQuality, kChunk.m_pbySource, kChunk.m_uSize * 4, kChunk.m_uSize, kChunk.m_uSize,
+				kChunk.m_uFirst, kChunk.m_uEnd, kChunk.m_pbyDest, true);
+			m_kProbeError.Add((int64)u64Error);
+			m_kProbeEncodeCycles.Add(FPlatformTime::Cycles64() - u64Start);
+		});
+		m_kProbeRawBytes.Add(aryFaces.Num());
+		return eFormat;
+	}
 
-				for (auto& itMat : itMesh.m_kMaterials)
+	void ExportReflectionProbe(ReflectionInfo& itProbe)
+	{
+		const CubemapSnapshot& kSnapshot = *itProbe.m_spSnapshot;
+		// The capture has no id that follows its data, so the data is hashed.
+		const TArray<uint8>& arySource = kSnapshot.m_rpData->GetArray();
+		const uint64 u64Hash = level::Hash64(arySource.GetData(), arySource.Num(), m_u64Settings ^ kSnapshot.m_iCubemapSize);
+		FString kExportPath = "EnvMaps/" + itProbe.m_strName + ".dds";
+		const bool bUpToDate = IsUpToDate(kExportPath, u64Hash);
+		const bool bAstc = m_upAstcEncoder && !IsUpToDate("EnvMaps/" + itProbe.m_strName + ".pvr", u64Hash);
+		if (bUpToDate && !bAstc)
+		{
+			itProbe.m_spSnapshot.Reset();
+			return;
+		}
+		const FString kCacheName = m_bProbeCache ? FString::Printf(TEXT("%s/%016llx.dds"), *m_kProbeCacheDir, u64Hash) : FString();
+		TArray<uint8> aryCached;
+		// the cache only holds the DDS, so an ASTC copy needs the faces again
+		if (m_bProbeCache && !bAstc && FFileHelper::LoadFileToArray(aryCached, *kCacheName, FILEREAD_Silent))
+		{
+			itProbe.m_spSnapshot.Reset();
+			m_kProbeCacheHits.Increment();
+			WriteFileAsync(kExportPath, MoveTemp(aryCached));
+			return;
+		}
+		const int32 CubemapSize = kSnapshot.m_iCubemapSize;
+		TRefCountPtr<FReflectionCaptureUncompressedData> rpCubemapData = GenerateFromDerivedDataSource(*kSnapshot.m_rpData, CubemapSize);
+		itProbe.m_spSnapshot.Reset();
+		TArray<uint8>& aryData = rpCubemapData->GetArray();
+		if (aryData.Num())
+		{
+			// The encoded data holds each mip with its six faces. Every face is
+			// rotated once into aryFaces, face by face with their mips and already
+			// bottom up, optionally block compressed from there, and the textures
+			// below are views of the result until the file is written without
+			// another flip.
+			TArray<uint8> aryFaces;
+			aryFaces.SetNumUninitialized(aryData.Num());
+			const int32 MipMapCount = FMath::Log2(CubemapSize) + 1;
+			uint8* pDest = aryFaces.GetData();
+			for (int32 CubeFace = 0; CubeFace < CubeFace_MAX; CubeFace++)
+			{
+				int32 MipBaseIndex = 0;
+				for (int32 MipIndex = 0; MipIndex < MipMapCount; MipIndex++)
+				{
+					const int32 MipSize = 1 << (MipMapCount - MipIndex - 1);
+					const int32 CubeFaceBytes = MipSize * MipSize * 4;
+					GetFaceData(pDest, aryData.GetData() + MipBaseIndex + CubeFace * CubeFaceBytes, CubeFace, MipSize);
+					pDest += CubeFaceBytes;
+					MipBaseIndex += CubeFaceBytes * CubeFace_MAX;
+				}
+			}
+			rpCubemapData.SafeRelease();
+			if (bAstc)
+			{
+				// the faces and rows exactly as the DDS holds them, with its swap of the y faces
+				static const int32 s_aiFileFaces[6] = { 0, 1, 5, 4, 2, 3 };
+				TArray<image::View> arySurfaces;
+				for (int32 iFace : s_aiFileFaces)
+				{
+					const uint8* pbyFace = aryFaces.GetData() + iFace * (aryFaces.Num() / CubeFace_MAX);
+					for (int32 MipIndex = 0; MipIndex < MipMapCount; MipIndex++)
+					{
+						const int32 MipSize = 1 << (MipMapCount - MipIndex - 1);
+						arySurfaces.Add(image::MakeView(pbyFace, MipSize, MipSize, image::Format::BGRA8));
+						pbyFace += MipSize * MipSize * 4;
+					}
+				}
+				WriteASTC("EnvMaps/" + itProbe.m_strName + ".pvr", arySurfaces, CubeFace_MAX, MipMapCount);
+				if (bUpToDate)
+				{
+					return;
+				}
+			}
+
+			uint32 uFormat = GL_BGRA_EXT;
+			bc::Format eBlockFormat = bc::Format::BC1;
+			if (m_iProbeCompression != 0)
+			{
+				TArray<uint8> aryBlocks;
+				eBlockFormat = CompressProbe(aryFaces, MipMapCount, aryBlocks);
+				aryFaces = MoveTemp(aryBlocks);
+				uFormat = eBlockFormat == bc::Format::BC1 ? GL_COMPRESSED_RGBA_S3TC_DXT1_EXT
+					: (eBlockFormat == bc::Format::BC3 ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGBA_BPTC_UNORM);
+			}
+			CTexture texarray[6];
+			pDest = aryFaces.GetData();
+			for (int32 CubeFace = 0; CubeFace < CubeFace_MAX; CubeFace++)
+			{
+				for (int32 MipIndex = 0; MipIndex < MipMapCount; MipIndex++)
 				{
-					Write(*hFile, itMat.m_strName);
-					(*hFile) << (uint32)itMat.m_index;
-					(*hFile) << (uint32)itMat.m_eType;
-					(*hFile) << (uint32)itMat.m_aryRelatedTextures.Num();
-					for (auto& itTex : itMat.m_aryRelatedTextures)
+					const int32 MipSize = 1 << (MipMapCount - MipIndex - 1);
+					const int32 CubeFaceBytes = (uFormat == GL_BGRA_EXT) ? MipSize * MipSize * 4 : (int32)bc::GetSurfaceSize(eBlockFormat, MipSize, MipSize);
+					if (MipIndex == 0)
 					{
-						Write(*hFile, itTex->GetName());
+						texarray[CubeFace].attach(MipSize, MipSize, 1, CubeFaceBytes, pDest);
 					}
-					(*hFile) << (uint32)itMat.m_aryRelatedParams.Num();
-					for (float fParam : itMat.m_aryRelatedParams)
+					else
 					{
-						(*hFile) << fParam;
+						CSurface surface;
+						surface.attach(MipSize, MipSize, 1, CubeFaceBytes, pDest);
+						texarray[CubeFace].add_mipmap(MoveTemp(surface));
 					}
+					pDest += CubeFaceBytes;
 				}
-				if (itMesh.m_pkLightMap)
+			}
+			CDDSImage image;
+			image.create_textureCubemap(uFormat, 4, MoveTemp(texarray[0]), MoveTemp(texarray[1]), MoveTemp(texarray[5]), MoveTemp(texarray[4]), MoveTemp(texarray[2]), MoveTemp(texarray[3]));
+			TArray<uint8> aryFile;
+			image.save(aryFile, false);
+			if (m_bProbeCache)
+			{
+				// Written under a temporary name first, so an interrupted write is never a cache hit.
+				PushBGTask(vtd::task([kCacheName, aryCache = aryFile]()
+				{
+					IPlatformFile& kPlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+					const FString kTempName = kCacheName + ".tmp";
+					if (FFileHelper::SaveArrayToFile(aryCache, *kTempName))
+					{
+						kPlatformFile.DeleteFile(*kCacheName);
+						kPlatformFile.MoveFile(*kCacheName, *kTempName);
+					}
+				}));
+			}
+			WriteFileAsync(kExportPath, MoveTemp(aryFile));
+			UE_LOG(SceneExporter, Log, TEXT("EnvMap \"%s\" exported."), *kExportPath);
+		}
+	}
+
+	void WriteLevelV1(CLevelArchive& kAr)
+	{
+		if (m_pkMainLight)
+		{
+			kAr << (uint32)(1);
+			FVector DirectionalLightDirection = -m_pkMainLight->GetDirection();
+			kAr << -DirectionalLightDirection.X;
+			kAr << DirectionalLightDirection.Z;
+			kAr << DirectionalLightDirection.Y;
+
+			FLinearColor DirectionalLightColor = FLinearColor(m_pkMainLight->LightColor) * m_pkMainLight->ComputeLightBrightness();
+			if (m_pkMainLight->bUseTemperature)
+			{
+				DirectionalLightColor *= FLinearColor::MakeFromColorTemperature(m_pkMainLight->Temperature);
+			}
+			DirectionalLightColor /= PI;
+			kAr << DirectionalLightColor.R;
+			kAr << DirectionalLightColor.G;
+			kAr << DirectionalLightColor.B;
+		}
+		else
+		{
+			kAr << (uint32)(0);
+		}
+
+		if (m_pkMainFog)
+		{
+			kAr << (uint32)(1);
+			kAr << m_pkMainFog->GetComponentLocation().Z;
+			kAr << m_pkMainFog->FogDensity;
+			kAr << m_pkMainFog->FogInscatteringColor.R;
+			kAr << m_pkMainFog->FogInscatteringColor.G;
+			kAr << m_pkMainFog->FogInscatteringColor.B;
+			kAr << m_pkMainFog->FogInscatteringColor.A;
+			kAr << m_pkMainFog->FogHeightFalloff;
+			kAr << m_pkMainFog->FogMaxOpacity;
+			kAr << m_pkMainFog->StartDistance;
+			kAr << m_pkMainFog->FogCutoffDistance;
+		}
+		else
+		{
+			kAr << (uint32)(0);
+		}
+
+		kAr << (uint32)m_aryReflectionProbes.Num();
+		for (auto& itRef : m_aryReflectionProbes)
+		{
+			Write(kAr, itRef.m_strName);
+			WritePosition(kAr, itRef.m_v3Position);
+			WritePosition(kAr, itRef.m_v3Offset);
+			kAr << itRef.m_fBrightness;
+			kAr << itRef.m_fInfluenceRadius * 0.01f;
+			kAr << itRef.m_fAverageBrightness;
+		}
+
+		kAr << (uint32)m_aryStaticMeshes.Num();
+		for (auto& itMesh : m_aryStaticMeshes)
+		{
+			Write(kAr, itMesh.m_strName);
+			Write(kAr, itMesh.m_strFBXName);
+			Write(kAr, itMesh.m_kTransform);
+			kAr << (uint32)itMesh.m_kMaterials.Num();
+
+			for (auto& itMat : itMesh.m_kMaterials)
+			{
+				Write(kAr, itMat.m_strName);
+				kAr << (uint32)itMat.m_index;
+				kAr << (uint32)itMat.m_eType;
+				kAr << (uint32)itMat.m_aryRelatedTextures.Num();
+				for (auto& itTex : itMat.m_aryRelatedTextures)
 				{
-					(*hFile) << (uint32)1;
-					Write(*hFile, ((LightMap2DExt*)itMesh.m_pkLightMap)->GetTexture(1)->GetName());
-					(*hFile) << itMesh.m_pkLightMap->GetCoordinateScale().X;
-					(*hFile) << itMesh.m_pkLightMap->GetCoordinateScale().Y;
-					(*hFile) << itMesh.m_pkLightMap->GetCoordinateBias().X;
-					(*hFile) << itMesh.m_pkLightMap->GetCoordinateBias().Y;
-
-					(*hFile) << ((LightMap2DExt*)itMesh.m_pkLightMap)->GetScaleVector(2).X;
-					(*hFile) << ((LightMap2DExt*)itMesh.m_pkLightMap)->GetScaleVector(2).Y;
-					(*hFile) << ((LightMap2DExt*)itMesh.m_pkLightMap)->GetScaleVector(2).Z;
-					(*hFile) << ((LightMap2DExt*)itMesh.m_pkLightMap)->GetScaleVector(2).W;
-
-					(*hFile) << ((LightMap2DExt*)itMesh.m_pkLightMap)->GetAddVector(2).X;
-					(*hFile) << ((LightMap2DExt*)itMesh.m_pkLightMap)->GetAddVector(2).Y;
-					(*hFile) << ((LightMap2DExt*)itMesh.m_pkLightMap)->GetAddVector(2).Z;
-					(*hFile) << ((LightMap2DExt*)itMesh.m_pkLightMap)->GetAddVector(2).W;
-
-					(*hFile) << ((LightMap2DExt*)itMesh.m_pkLightMap)->GetScaleVector(3).X;
-					(*hFile) << ((LightMap2DExt*)itMesh.m_pkLightMap)->GetScaleVector(3).Y;
-					(*hFile) << ((LightMap2DExt*)itMesh.m_pkLightMap)->GetScaleVector(3).Z;
-					(*hFile) << ((LightMap2DExt*)itMesh.m_pkLightMap)->GetScaleVector(3).W;
-
-					(*hFile) << ((LightMap2DExt*)itMesh.m_pkLightMap)->GetAddVector(3).X;
-					(*hFile) << ((LightMap2DExt*)itMesh.m_pkLightMap)->GetAddVector(3).Y;
-					(*hFile) << ((LightMap2DExt*)itMesh.m_pkLightMap)->GetAddVector(3).Z;
-					(*hFile) << ((LightMap2DExt*)itMesh.m_pkLightMap)->GetAddVector(3).W;
+					Write(kAr, GetTextureName(itTex));
 				}
-				else
+				kAr << (uint32)itMat.m_aryRelatedParams.Num();
+				for (float fParam : itMat.m_aryRelatedParams)
 				{
-					(*hFile) << (uint32)0;
+					kAr << fParam;
 				}
-				if (itMesh.m_pkShadowMap)
+			}
+			if (itMesh.m_pkLightMap)
+			{
+				kAr << (uint32)1;
+				Write(kAr, ((LightMap2DExt*)itMesh.m_pkLightMap)->GetTexture(1)->GetName());
+				kAr << itMesh.m_pkLightMap->GetCoordinateScale().X;
+				kAr << itMesh.m_pkLightMap->GetCoordinateScale().Y;
+				kAr << itMesh.m_pkLightMap->GetCoordinateBias().X;
+				kAr << itMesh.m_pkLightMap->GetCoordinateBias().Y;
+
+				kAr << ((LightMap2DExt*)itMesh.m_pkLightMap)->GetScaleVector(2).X;
+				kAr << ((LightMap2DExt*)itMesh.m_pkLightMap)->GetScaleVector(2).Y;
+				kAr << ((LightMap2DExt*)itMesh.m_pkLightMap)->GetScaleVector(2).Z;
+				kAr << ((LightMap2DExt*)itMesh.m_pkLightMap)->GetScaleVector(2).W;
+
+				kAr << ((LightMap2DExt*)itMesh.m_pkLightMap)->GetAddVector(2).X;
+				kAr << ((LightMap2DExt*)itMesh.m_pkLightMap)->GetAddVector(2).Y;
+				kAr << ((LightMap2DExt*)itMesh.m_pkLightMap)->GetAddVector(2).Z;
+				kAr << ((LightMap2DExt*)itMesh.m_pkLightMap)->GetAddVector(2).W;
+
+				kAr << ((LightMap2DExt*)itMesh.m_pkLightMap)->GetScaleVector(3).X;
+				kAr << ((LightMap2DExt*)itMesh.m_pkLightMap)->GetScaleVector(3).Y;
+				kAr << ((LightMap2DExt*)itMesh.m_pkLightMap)->GetScaleVector(3).Z;
+				kAr << ((LightMap2DExt*)itMesh.m_pkLightMap)->GetScaleVector(3).W;
+
+				kAr << ((LightMap2DExt*)itMesh.m_pkLightMap)->GetAddVector(3).X;
+				kAr << ((LightMap2DExt*)itMesh.m_pkLightMap)->GetAddVector(3).Y;
+				kAr << ((LightMap2DExt*)itMesh.m_pkLightMap)->GetAddVector(3).Z;
+				kAr << ((LightMap2DExt*)itMesh.m_pkLightMap)->GetAddVector(3).W;
+			}
+			else
+			{
+				kAr << (uint32)0;
+			}
+			if (itMesh.m_pkShadowMap)
+			{
+				kAr << (uint32)1;
+				FVector4 kPenumbraSize = ((ShadowMap2DExt*)itMesh.m_pkShadowMap)->GetInvUniformPenumbraSize();
+				kAr << kPenumbraSize.X;
+				kAr << kPenumbraSize.Y;
+				kAr << kPenumbraSize.Z;
+				kAr << kPenumbraSize.W;
+			}
+			else
+			{
+				kAr << (uint32)0;
+			}
+		}
+	}
+
+	// Builds the records of one sublevel. AddString maps a name to its offset
+	// in the string pool.
+	template <class TAddString>
+	void BuildMeshSection(const LevelSectionInfo& kSection, MeshSection& kOut, TAddString&& AddString)
+	{
+		for (int32 i(kSection.m_iFirstMesh); i < kSection.m_iFirstMesh + kSection.m_iMeshCount; ++i)
+		{
+			const StaticMeshInfo& itMesh = m_aryStaticMeshes[i];
+			level::Mesh& kMesh = AddLevelRecord(kOut.m_aryMeshes);
+			kMesh.name = AddString(itMesh.m_strName);
+			kMesh.fbx = AddString(itMesh.m_strFBXName);
+			ToLevelPosition(itMesh.m_kTransform.GetLocation(), kMesh.position);
+			FVector kEuler = itMesh.m_kTransform.GetRotation().Euler();
+			kMesh.rotation[0] = kEuler.X;
+			kMesh.rotation[1] = kEuler.Y;
+			kMesh.rotation[2] = kEuler.Z;
+			FVector kScale = itMesh.m_kTransform.GetScale3D();
+			kMesh.scale[0] = kScale.X;
+			kMesh.scale[1] = kScale.Y;
+			kMesh.scale[2] = kScale.Z;
+
+			kMesh.firstMaterial = kOut.m_aryMaterials.Num();
+			kMesh.materialCount = itMesh.m_kMaterials.Num();
+			for (auto& itMat : itMesh.m_kMaterials)
+			{
+				level::Material& kMaterial = AddLevelRecord(kOut.m_aryMaterials);
+				kMaterial.name = AddString(itMat.m_strName);
+				kMaterial.index = (uint32)itMat.m_index;
+				kMaterial.type = (uint32)itMat.m_eType;
+				kMaterial.firstTexture = kOut.m_aryTextures.Num();
+				kMaterial.textureCount = itMat.m_aryRelatedTextures.Num();
+				for (auto& itTex : itMat.m_aryRelatedTextures)
 				{
-					(*hFile) << (uint32)1;
-					FVector4 kPenumbraSize = ((ShadowMap2DExt*)itMesh.m_pkShadowMap)->GetInvUniformPenumbraSize();
-					(*hFile) << kPenumbraSize.X;
-					(*hFile) << kPenumbraSize.Y;
-					(*hFile) << kPenumbraSize.Z;
-					(*hFile) << kPenumbraSize.W;
+					kOut.m_aryTextures.Add(AddString(GetTextureName(itTex)));
 				}
-				else
+				kMaterial.firstParam = kOut.m_aryParams.Num();
+				kMaterial.paramCount = itMat.m_aryRelatedParams.Num();
+				kOut.m_aryParams.Append(itMat.m_aryRelatedParams);
+			}
+
+			if (itMesh.m_pkLightMap)
+			{
+				LightMap2DExt* pkLightMap = (LightMap2DExt*)itMesh.m_pkLightMap;
+				kMesh.lightMap = kOut.m_aryLightMaps.Num();
+				level::LightMap& kLightMap = AddLevelRecord(kOut.m_aryLightMaps);
+				kLightMap.texture = AddString(pkLightMap->GetTexture(1)->GetName());
+				kLightMap.coordinateScale[0] = pkLightMap->GetCoordinateScale().X;
+				kLightMap.coordinateScale[1] = pkLightMap->GetCoordinateScale().Y;
+				kLightMap.coordinateBias[0] = pkLightMap->GetCoordinateBias().X;
+				kLightMap.coordinateBias[1] = pkLightMap->GetCoordinateBias().Y;
+				ToLevelVector(pkLightMap->GetScaleVector(2), kLightMap.scale2);
+				ToLevelVector(pkLightMap->GetAddVector(2), kLightMap.add2);
+				ToLevelVector(pkLightMap->GetScaleVector(3), kLightMap.scale3);
+				ToLevelVector(pkLightMap->GetAddVector(3), kLightMap.add3);
+			}
+			if (itMesh.m_pkShadowMap)
+			{
+				kMesh.shadowMap = kOut.m_aryShadowMaps.Num();
+				level::ShadowMap& kShadowMap = AddLevelRecord(kOut.m_aryShadowMaps);
+				ToLevelVector(((ShadowMap2DExt*)itMesh.m_pkShadowMap)->GetInvUniformPenumbraSize(), kShadowMap.invUniformPenumbraSize);
+			}
+		}
+	}
+
+	// Copies an unchanged mesh section from the previous .level. Its names
+	// are added to the new string pool and the offsets rewritten, so the
+	// pool only holds strings that the written sections refer to.
+	static void CopyMeshSection(const level::Reader& kPrevious, uint32 uSection, MeshSection& kOut, level::StringPool& kStrings)
+	{
+		auto Remap = [&kPrevious, &kStrings](uint32 uOffset)
+		{
+			return kStrings.Add(kPrevious.GetString(uOffset));
+		};
+		for (const level::Mesh& kSource : kPrevious.GetMeshes(uSection))
+		{
+			level::Mesh& kMesh = kOut.m_aryMeshes[kOut.m_aryMeshes.Add(kSource)];
+			kMesh.name = Remap(kSource.name);
+			kMesh.fbx = Remap(kSource.fbx);
+		}
+		for (const level::Material& kSource : kPrevious.GetMaterials(uSection))
+		{
+			kOut.m_aryMaterials[kOut.m_aryMaterials.Add(kSource)].name = Remap(kSource.name);
+		}
+		for (uint32 uTexture : kPrevious.GetTextureRefs(uSection))
+		{
+			kOut.m_aryTextures.Add(Remap(uTexture));
+		}
+		const level::View<float> kParams = kPrevious.GetParams(uSection);
+		kOut.m_aryParams.Append(kParams.data(), kParams.size());
+		for (const level::LightMap& kSource : kPrevious.GetLightMaps(uSection))
+		{
+			kOut.m_aryLightMaps[kOut.m_aryLightMaps.Add(kSource)].texture = Remap(kSource.texture);
+		}
+		const level::View<level::ShadowMap> kShadowMaps = kPrevious.GetShadowMaps(uSection);
+		kOut.m_aryShadowMaps.Append(kShadowMaps.data(), kShadowMaps.size());
+	}
+
+	// Hash of everything a mesh section is built from, without building it:
+	// the scan hash of its meshes and the resolved names of the textures they
+	// refer to, which deduplication may change without any mesh changing.
+	uint64 HashMeshSection(const LevelSectionInfo& kSection, uint32 uSection) const
+	{
+		uint64 u64Hash = HashString(kSection.m_strName, level::Hash64(&uSection, sizeof(uSection)));
+		u64Hash = level::Hash64(&kSection.m_u64ScanHash, sizeof(kSection.m_u64ScanHash), u64Hash);
+		for (int32 i(kSection.m_iFirstMesh); i < kSection.m_iFirstMesh + kSection.m_iMeshCount; ++i)
+		{
+			for (auto& itMat : m_aryStaticMeshes[i].m_kMaterials)
+			{
+				for (UTexture* pkTex : itMat.m_aryRelatedTextures)
 				{
-					(*hFile) << (uint32)0;
+					const TextureInfo* pkInfo = m_mapTextures.Find(pkTex);
+					const uint64 u64Name = pkInfo ? pkInfo->m_u64NameHash : 0;
+					u64Hash = level::Hash64(&u64Name, sizeof(u64Name), u64Hash);
 				}
 			}
+		}
+		return u64Hash;
+	}
+
+	// pkPrevious is the .level written by the last export, if any. Mesh
+	// sections whose input hash is unchanged are copied from it instead of
+	// being built again.
+	void WriteLevelV2(CLevelArchive& kAr, const level::Reader* pkPrevious)
+	{
+		static const uint32 s_auSectionChunks[] = { level::chunk::Meshes, level::chunk::Materials, level::chunk::TextureRefs,
+			level::chunk::Params, level::chunk::LightMaps, level::chunk::ShadowMaps };
+
+		TArray<uint64> aryInputHashes;
+		TArray<bool> aryReused;
+		int32 iReused = 0;
+		for (int32 i(0); i < m_aryLevelSections.Num(); ++i)
+		{
+			aryInputHashes.Add(HashMeshSection(m_aryLevelSections[i], (uint32)i));
+			bool bReused = pkPrevious != nullptr;
+			for (uint32 uId : s_auSectionChunks)
+			{
+				const level::ChunkEntry* pkEntry = bReused ? pkPrevious->FindChunk(uId, (uint32)i) : nullptr;
+				bReused = pkEntry && pkEntry->inputHash == aryInputHashes[i];
+			}
+			aryReused.Add(bReused);
+			iReused += bReused ? 1 : 0;
+		}
+
+		level::StringPool kStrings;
+		auto AddString = [&kStrings](const FString& strVal)
+		{
+			return kStrings.Add(std::string(TCHAR_TO_UTF8(*strVal)));
+		};
+
+		level::Environment kEnvironment;
+		FMemory::Memzero(kEnvironment);
+		new (&kEnvironment) level::Environment;
+		if (m_pkMainLight)
+		{
+			kEnvironment.hasLight = 1;
+			FVector DirectionalLightDirection = -m_pkMainLight->GetDirection();
+			kEnvironment.lightDirection[0] = -DirectionalLightDirection.X;
+			kEnvironment.lightDirection[1] = DirectionalLightDirection.Z;
+			kEnvironment.lightDirection[2] = DirectionalLightDirection.Y;
+
+			FLinearColor DirectionalLightColor = FLinearColor(m_pkMainLight->LightColor) * m_pkMainLight->ComputeLightBrightness();
+			if (m_pkMainLight->bUseTemperature)
+			{
+				DirectionalLightColor *= FLinearColor::MakeFromColorTemperature(m_pkMainLight->Temperature);
+			}
+			DirectionalLightColor /= PI;
+			kEnvironment.lightColor[0] = DirectionalLightColor.R;
+			kEnvironment.lightColor[1] = DirectionalLightColor.G;
+			kEnvironment.lightColor[2] = DirectionalLightColor.B;
+		}
+		if (m_pkMainFog)
+		{
+			kEnvironment.hasFog = 1;
+			kEnvironment.fogHeight = m_pkMainFog->GetComponentLocation().Z;
+			kEnvironment.fogDensity = m_pkMainFog->FogDensity;
+			kEnvironment.fogInscatteringColor[0] = m_pkMainFog->FogInscatteringColor.R;
+			kEnvironment.fogInscatteringColor[1] = m_pkMainFog->FogInscatteringColor.G;
+			kEnvironment.fogInscatteringColor[2] = m_pkMainFog->FogInscatteringColor.B;
+			kEnvironment.fogInscatteringColor[3] = m_pkMainFog->FogInscatteringColor.A;
+			kEnvironment.fogHeightFalloff = m_pkMainFog->FogHeightFalloff;
+			kEnvironment.fogMaxOpacity = m_pkMainFog->FogMaxOpacity;
+			kEnvironment.fogStartDistance = m_pkMainFog->StartDistance;
+			kEnvironment.fogCutoffDistance = m_pkMainFog->FogCutoffDistance;
+		}
+
+		TArray<level::Probe> aryProbes;
+		for (auto& itRef : m_aryReflectionProbes)
+		{
+			level::Probe& kProbe = AddLevelRecord(aryProbes);
+			kProbe.name = AddString(itRef.m_strName);
+			ToLevelPosition(itRef.m_v3Position, kProbe.position);
+			ToLevelPosition(itRef.m_v3Offset, kProbe.offset);
+			kProbe.brightness = itRef.m_fBrightness;
+			kProbe.influenceRadius = itRef.m_fInfluenceRadius * 0.01f;
+			kProbe.averageBrightness = itRef.m_fAverageBrightness;
+		}
+
+		TArray<level::Alias> aryAliases;
+		for (auto& itTex : m_mapTextures)
+		{
+			if (itTex.Get<1>().m_pkCanonical != itTex.Get<0>())
+			{
+				level::Alias& kAlias = AddLevelRecord(aryAliases);
+				kAlias.name = AddString(itTex.Get<0>()->GetPathName());
+				kAlias.target = AddString(itTex.Get<1>().m_strName);
+			}
+		}
+
+		TArray<MeshSection> arySections;
+		arySections.SetNum(m_aryLevelSections.Num());
+		for (int32 i(0); i < m_aryLevelSections.Num(); ++i)
+		{
+			if (aryReused[i])
+			{
+				CopyMeshSection(*pkPrevious, (uint32)i, arySections[i], kStrings);
+			}
+			else
+			{
+				BuildMeshSection(m_aryLevelSections[i], arySections[i], AddString);
+			}
+		}
+
+		TArray<LevelChunk> aryChunks;
+		aryChunks.Add(LevelChunk(level::chunk::Strings, 1, kStrings.GetCount(), kStrings.GetData().data(), kStrings.GetData().size()));
+		aryChunks.Add(LevelChunk(level::chunk::Environment, &kEnvironment, 1));
+		aryChunks.Add(LevelChunk(level::chunk::Probes, aryProbes));
+		aryChunks.Add(LevelChunk(level::chunk::Aliases, aryAliases));
+		for (int32 i(0); i < arySections.Num(); ++i)
+		{
+			const int32 iFirst = aryChunks.Num();
+			const MeshSection& kSection = arySections[i];
+			aryChunks.Add(LevelChunk(level::chunk::Meshes, kSection.m_aryMeshes));
+			aryChunks.Add(LevelChunk(level::chunk::Materials, kSection.m_aryMaterials));
+			aryChunks.Add(LevelChunk(level::chunk::TextureRefs, kSection.m_aryTextures));
+			aryChunks.Add(LevelChunk(level::chunk::Params, kSection.m_aryParams));
+			aryChunks.Add(LevelChunk(level::chunk::LightMaps, kSection.m_aryLightMaps));
+			aryChunks.Add(LevelChunk(level::chunk::ShadowMaps, kSection.m_aryShadowMaps));
+			for (int32 j(iFirst); j < aryChunks.Num(); ++j)
+			{
+				aryChunks[j].m_uSection = (uint32)i;
+				aryChunks[j].m_u64InputHash = aryInputHashes[i];
+			}
+		}
+		WriteLevelChunks(kAr, aryChunks);
+		if (pkPrevious)
+		{
+			UE_LOG(SceneExporter, Log, TEXT("%d of %d level sections were unchanged and copied."), iReused, m_aryLevelSections.Num());
+		}
+	}
 
+	void ExportSceneStructure()
+	{
+		IPlatformFile& kPlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+		FString kFileName = m_kPath + "/" + m_kWorldName + "/" + m_kWorldName + ".level";
+		const bool bV2 = CVarSceneExporterLevelFormat.GetValueOnGameThread() >= 2;
+
+		// Unchanged sections are copied from the previous file, mapped rather
+		// than read so only the copied sections are paged in. The new file is
+		// written next to it and replaces it once complete.
+		level::Reader kPrevious;
+		const bool bPrevious = bV2 && m_bIncremental && kPrevious.Open(TCHAR_TO_UTF8(*FPaths::ConvertRelativePathToFull(kFileName)));
+		FString kTempName = kFileName + ".tmp";
+		IFileHandle* hFile = kPlatformFile.OpenWrite(*kTempName);
+		if (hFile)
+		{
+			const double dStart = FPlatformTime::Seconds();
+			CLevelArchive kAr(*hFile);
+			if (bV2)
+			{
+				WriteLevelV2(kAr, bPrevious ? &kPrevious : nullptr);
+			}
+			else
+			{
+				WriteLevelV1(kAr);
+			}
+			kAr.Flush();
 			delete hFile;
-			UE_LOG(SceneExporter, Log, TEXT("Level \"%s\" exported."), *kFileName);
+			// A mapped file cannot be deleted on Windows.
+			kPrevious.Close();
+			kPlatformFile.DeleteFile(*kFileName);
+			if (!kPlatformFile.MoveFile(*kFileName, *kTempName))
+			{
+				UE_LOG(SceneExporter, Error, TEXT("Failed to replace \"%s\"."), *kFileName);
+				return;
+			}
+			UE_LOG(SceneExporter, Log, TEXT("Level \"%s\" exported, %llu bytes in %.2f ms."), *kFileName, kAr.Tell(), (FPlatformTime::Seconds() - dStart) * 1000.0);
 		}
 	}
 
@@ -2698,21 +4053,69 @@ private:
 	FDateTime m_tStartTime = 0;
 	FDateTime m_kEndTime = 0;
 	float m_fSleepInterval = 0.0f;
-	bool m_bIsRunning = false;
-	bool m_bCanceling = false;
-	bool m_bExiting = false;
+	// Shared by the game thread, the export thread and the workers.
+	std::atomic<bool> m_bIsRunning{ false };
+	std::atomic<bool> m_bCanceling{ false };
+	std::atomic<bool> m_bExiting{ false };
 	bool m_bFinished = false;
+	FEvent* m_pkBGEvent = nullptr;
 
 	TWeakPtr<SNotificationItem> m_wpNotificationItem;
-	ring_buffer<std::function<void()>*, nullptr> m_kFGTasks;
-	ring_buffer<std::function<void()>*, nullptr> m_kBGTasks;
+	segmented_buffer<vtd::task> m_kFGTasks;
+	// Files waiting for the export thread. Unbounded, since the game thread
+	// pushes here and must not wait; WriteFileAsync bounds the bytes queued.
+	segmented_buffer<vtd::task> m_kBGTasks;
 
 	UExporter* m_pkMeshExporter = nullptr;
 	UExporter* m_pkTGAExporter = nullptr;
 
+	// Set before the export thread starts; the pack is only touched by it.
+	bool m_bPack = false;
+	bool m_bPackCompression = false;
+	CPackWriter m_kPack;
+	FThreadSafeCounter64 m_kPackRawBytes;
+	FThreadSafeCounter64 m_kPackStoredBytes;
+	FThreadSafeCounter64 m_kCompressCycles;
+
+	// Previous and current manifest; the previous one is read-only after
+	// Assigning(), the current one is filled by game thread and workers.
+	bool m_bIncremental = false;
+	uint64 m_u64Settings = 0;
+	TMap<FString, uint64> m_mapPrevManifest;
+	TMap<FString, uint64> m_mapManifest;
+	FCriticalSection m_kManifestLock;
+	FThreadSafeCounter m_kSkipped;
+
+	bool m_bProbeCache = false;
+	FString m_kProbeCacheDir;
+	FThreadSafeCounter m_kProbeCacheHits;
+
+	// Envmap block compression; the error is summed over all bytes encoded
+	// and measured on the workers by decoding every block again.
+	int32 m_iProbeCompression = 0;
+	bc::Quality m_eProbeQuality = bc::Quality::Normal;
+	FThreadSafeCounter64 m_kProbeRawBytes;
+	FThreadSafeCounter64 m_kProbeEncodeCycles;
+	FThreadSafeCounter64 m_kProbeError;
+
+	// ASTC copies, see SceneExporter.ASTC; no encoder when they are off.
+	TUniquePtr<astc::Encoder> m_upAstcEncoder;
+	astc::Preset m_eAstcPreset = astc::Preset::Medium;
+	image::Format m_eAstcFormat = image::Format::ASTC_6x6;
+	FThreadSafeCounter64 m_kAstcRawBytes;
+	FThreadSafeCounter64 m_kAstcCycles;
+
+	// Outlives the containers below, whose snapshots release bytes from it.
+	FThreadSafeCounter64 m_kInFlightBytes;
+	// The part of m_kInFlightBytes that is files queued for the export thread.
+	FThreadSafeCounter64 m_kQueuedBytes;
+	int64 m_iInFlightBudget = 0;
+
 	TMap<FString, int> m_mapInvolvedActorNames;
 	TMap<FString, UStaticMesh*> m_mapFBXMeshes;
+	TMap<UTexture*, TextureInfo> m_mapTextures;
 	TArray<StaticMeshInfo> m_aryStaticMeshes;
+	TArray<LevelSectionInfo> m_aryLevelSections;
 	TArray<ReflectionInfo> m_aryReflectionProbes;
 	UDirectionalLightComponent* m_pkMainLight = nullptr;
 	UExponentialHeightFogComponent* m_pkMainFog = nullptr;
@@ -2720,6 +4123,16 @@ private:
 	TMap<FString, LightMapInfo> m_mapLightMaps;
 	TMap<FString, ShadowMapInfo> m_mapShadowMaps;
 
+	double m_dStartTime = 0.0;
+	double m_dFrameDeadline = 0.0;
+	int32 m_iScanCursor = 0;
+
+	// Declared last so the pool joins its workers before the data they use is gone.
+	vtd::task_graph m_kCollect;
+	vtd::task_graph m_kEmit;
+	vtd::task_group m_kPackWrites;
+	vtd::task_pool m_kWorkers;
+
 };
 
 void ExportTo(const FString& kPath)
@@ -1,16 +1,49 @@
 #pragma once
 
 #include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <thread>
 
 #ifndef VTD_QUEUE_MASK
 #	define VTD_QUEUE_MASK (0x7FF)
 #endif
 
+#ifndef VTD_CACHE_LINE
+#	define VTD_CACHE_LINE (64)
+#endif
+
 namespace vtd
 {
-	template <class _Ty, _Ty _Default, size_t _Mask = VTD_QUEUE_MASK>
+	// Spins briefly, then yields the time slice.
+	class backoff
+	{
+	public:
+		void pause() noexcept
+		{
+			if (_Count < 16)
+			{
+				++_Count;
+			}
+			else
+			{
+				std::this_thread::yield();
+			}
+		}
+
+	private:
+		unsigned int _Count = 0;
+	};
+
+	// Bounded multi-producer/multi-consumer queue. Every slot carries a sequence
+	// number that tells producers when it is free and consumers when it has been
+	// written, so a slot is never read before its value is stored and never
+	// reused before it has been consumed.
+	template <class _Ty, size_t _Mask = VTD_QUEUE_MASK>
 	class ring_buffer
 	{
+		static_assert(((_Mask + 1) & _Mask) == 0, "ring_buffer capacity must be a power of two");
+
 	public:
 		typedef _Ty value_type;
 		typedef value_type* pointer;
@@ -18,68 +51,249 @@ namespace vtd
 
 		ring_buffer() noexcept
 		{
-#if defined(DEBUG) | defined(_DEBUG)
-			_Size.store(0);
-#endif
-			_Cursor.store(0);
-			_Head.store(0);
-			_Tail.store(0);
+			for (size_type i(0); i < _Max; ++i)
+			{
+				_Cells[i]._Sequence.store(i, std::memory_order_relaxed);
+			}
+			_Enqueue.store(0, std::memory_order_relaxed);
+			_Dequeue.store(0, std::memory_order_relaxed);
 		}
 
 		~ring_buffer() noexcept = default;
 
+		// Returns false without modifying _Val when the queue is full.
+		bool try_push(value_type& _Val) noexcept
+		{
+			_Cell* cell;
+			size_type pos = _Enqueue.load(std::memory_order_relaxed);
+			while (true)
+			{
+				cell = &_Cells[pos & _Mask];
+				size_type seq = cell->_Sequence.load(std::memory_order_acquire);
+				int64_t dif = (int64_t)seq - (int64_t)pos;
+				if (dif == 0)
+				{
+					if (_Enqueue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+				}
+				else if (dif < 0)
+				{
+					return false;
+				}
+				else
+				{
+					pos = _Enqueue.load(std::memory_order_relaxed);
+				}
+			}
+			cell->_Value = std::move(_Val);
+			cell->_Sequence.store(pos + 1, std::memory_order_release);
+			return true;
+		}
+
+		// Waits for a consumer to free a slot when the queue is full.
+		void push_blocking(value_type _Val) noexcept
+		{
+			backoff wait;
+			while (!try_push(_Val))
+			{
+				wait.pause();
+			}
+		}
+
 		void push(value_type _Val) noexcept
 		{
-#if defined(DEBUG) | defined(_DEBUG)
-			assert(_Size.fetch_add(1, std::memory_order_acquire) < _Max);
-#endif
-			size_type cur = _Cursor.fetch_add(1, std::memory_order_acquire);
-			buffer[cur & _Mask] = std::move(_Val);
-			_Head.fetch_add(1, std::memory_order_release);
+			push_blocking(std::move(_Val));
 		}
 
-		value_type pop() noexcept
+		bool try_pop(value_type& _Val) noexcept
 		{
-			size_type h, t;
-			do
+			_Cell* cell;
+			size_type pos = _Dequeue.load(std::memory_order_relaxed);
+			while (true)
 			{
-				h = _Head.load(std::memory_order_relaxed);
-				t = _Tail.load(std::memory_order_relaxed);
-				if (t >= h)
+				cell = &_Cells[pos & _Mask];
+				size_type seq = cell->_Sequence.load(std::memory_order_acquire);
+				int64_t dif = (int64_t)seq - (int64_t)(pos + 1);
+				if (dif == 0)
 				{
-					return _Default;
+					if (_Dequeue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
 				}
-			} while (!_Tail.compare_exchange_weak(t, t + 1, std::memory_order_relaxed));
-#if defined(DEBUG) | defined(_DEBUG)
-			auto res = std::move(buffer[t & _Mask]);
-			assert(_Size.fetch_sub(1, std::memory_order_release) > 0);
-			return std::move(res);
-#else
-			return std::move(buffer[t & _Mask]);
-#endif
+				else if (dif < 0)
+				{
+					return false;
+				}
+				else
+				{
+					pos = _Dequeue.load(std::memory_order_relaxed);
+				}
+			}
+			_Val = std::move(cell->_Value);
+			cell->_Sequence.store(pos + _Max, std::memory_order_release);
+			return true;
+		}
+
+		// Approximate while producers or consumers are active.
+		size_type size() const noexcept
+		{
+			size_type e = _Enqueue.load(std::memory_order_relaxed);
+			size_type d = _Dequeue.load(std::memory_order_relaxed);
+			return e > d ? e - d : 0;
 		}
 
-		size_type size() noexcept
+		static constexpr size_type capacity() noexcept
 		{
-			size_type h = _Head.load(std::memory_order_relaxed);
-			size_type t = _Tail.load(std::memory_order_relaxed);
-			return h - t;
+			return _Max;
 		}
 
 	private:
 		static constexpr size_type _Max = _Mask + 1;
 
+		struct _Cell
+		{
+			std::atomic<size_type> _Sequence;
+			value_type _Value;
+		};
+
 		ring_buffer(const ring_buffer&) = delete;
 		ring_buffer(ring_buffer&&) = delete;
 		ring_buffer& operator = (const ring_buffer&) = delete;
 
-#if defined(DEBUG) | defined(_DEBUG)
-		std::atomic<size_type> _Size;
-#endif
-		std::atomic<size_type> _Cursor;
-		std::atomic<size_type> _Head;
-		std::atomic<size_type> _Tail;
-		value_type buffer[_Max];
+		// Padded rather than aligned, since the queue may come from operator
+		// new, which does not honour alignas above alignof(std::max_align_t)
+		// before C++17.
+		char _Pad0[VTD_CACHE_LINE];
+		std::atomic<size_type> _Enqueue;
+		char _Pad1[VTD_CACHE_LINE];
+		std::atomic<size_type> _Dequeue;
+		char _Pad2[VTD_CACHE_LINE];
+		_Cell _Cells[_Max];
+
+	};
+
+	// Unbounded multi-producer/multi-consumer queue built from a chain of
+	// fixed-size segments. Producers share a lock on the tail segment and
+	// consumers one on the head segment; the two ends only meet through the
+	// count of written cells of a segment. A segment is released once every
+	// cell has been consumed and the producers have moved on, and the last
+	// one released is kept as a spare, so memory follows how many values are
+	// queued rather than how many were ever pushed.
+	template <class _Ty, size_t _Mask = VTD_QUEUE_MASK>
+	class segmented_buffer
+	{
+		static_assert(((_Mask + 1) & _Mask) == 0, "segmented_buffer segment size must be a power of two");
+
+	public:
+		typedef _Ty value_type;
+		typedef value_type* pointer;
+		typedef uint64_t size_type;
+
+		segmented_buffer()
+		{
+			_Head = new _Segment();
+			_Tail = _Head;
+			_Spare.store(nullptr, std::memory_order_relaxed);
+			_Count.store(0, std::memory_order_relaxed);
+		}
+
+		~segmented_buffer() noexcept
+		{
+			_Segment* seg = _Head;
+			while (seg)
+			{
+				_Segment* next = seg->_Next.load(std::memory_order_relaxed);
+				delete seg;
+				seg = next;
+			}
+			delete _Spare.load(std::memory_order_relaxed);
+		}
+
+		void push(value_type _Val)
+		{
+			std::lock_guard<std::mutex> lock(_TailLock);
+			size_type idx = _Tail->_Written.load(std::memory_order_relaxed);
+			if (idx == _Max)
+			{
+				_Segment* next = _Spare.exchange(nullptr, std::memory_order_acquire);
+				if (!next)
+				{
+					next = new _Segment();
+				}
+				// The tail segment is not touched again once it has a successor.
+				_Tail->_Next.store(next, std::memory_order_release);
+				_Tail = next;
+				idx = 0;
+			}
+			_Tail->_Cells[idx] = std::move(_Val);
+			_Tail->_Written.store(idx + 1, std::memory_order_release);
+			_Count.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		bool try_push(value_type& _Val)
+		{
+			push(std::move(_Val));
+			return true;
+		}
+
+		void push_blocking(value_type _Val)
+		{
+			push(std::move(_Val));
+		}
+
+		bool try_pop(value_type& _Val)
+		{
+			std::lock_guard<std::mutex> lock(_HeadLock);
+			if (_Read == _Max)
+			{
+				_Segment* next = _Head->_Next.load(std::memory_order_acquire);
+				if (!next) return false;
+				_Recycle(_Head);
+				_Head = next;
+				_Read = 0;
+			}
+			if (_Read == _Head->_Written.load(std::memory_order_acquire)) return false;
+			_Val = std::move(_Head->_Cells[_Read]);
+			++_Read;
+			_Count.fetch_sub(1, std::memory_order_relaxed);
+			return true;
+		}
+
+		size_type size() const noexcept
+		{
+			return _Count.load(std::memory_order_relaxed);
+		}
+
+	private:
+		static constexpr size_type _Max = _Mask + 1;
+
+		struct _Segment
+		{
+			std::atomic<size_type> _Written{ 0 };
+			std::atomic<_Segment*> _Next{ nullptr };
+			value_type _Cells[_Max];
+		};
+
+		segmented_buffer(const segmented_buffer&) = delete;
+		segmented_buffer& operator = (const segmented_buffer&) = delete;
+
+		// Called by a consumer that owns _Seg alone: every cell was consumed
+		// and producers write to its successor.
+		void _Recycle(_Segment* _Seg) noexcept
+		{
+			_Seg->_Written.store(0, std::memory_order_relaxed);
+			_Seg->_Next.store(nullptr, std::memory_order_relaxed);
+			delete _Spare.exchange(_Seg, std::memory_order_release);
+		}
+
+		// Consumer side.
+		std::mutex _HeadLock;
+		_Segment* _Head;
+		size_type _Read = 0;
+		char _Pad0[VTD_CACHE_LINE];
+		// Producer side.
+		std::mutex _TailLock;
+		_Segment* _Tail;
+		char _Pad1[VTD_CACHE_LINE];
+		std::atomic<_Segment*> _Spare;
+		std::atomic<size_type> _Count;
 
 	};
 
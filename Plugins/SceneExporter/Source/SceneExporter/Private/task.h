@@ -0,0 +1,248 @@
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#ifndef VTD_TASK_INLINE_SIZE
+#	define VTD_TASK_INLINE_SIZE (48)
+#endif
+
+#ifndef VTD_TASK_BLOCK_SIZE
+#	define VTD_TASK_BLOCK_SIZE (256)
+#endif
+
+namespace vtd
+{
+	// Process wide free list of fixed-size blocks for callables that do not
+	// fit into a task's inline storage. Blocks are carved from slabs that are
+	// kept for the lifetime of the process.
+	class task_allocator
+	{
+	public:
+		static constexpr size_t block_size = VTD_TASK_BLOCK_SIZE;
+
+		static void* acquire()
+		{
+			task_allocator& inst = _Instance();
+			std::lock_guard<std::mutex> lock(inst._Lock);
+			if (!inst._Free)
+			{
+				inst._Refill();
+			}
+			_Block* block = inst._Free;
+			inst._Free = block->_Next;
+			return block;
+		}
+
+		static void release(void* _Ptr) noexcept
+		{
+			task_allocator& inst = _Instance();
+			std::lock_guard<std::mutex> lock(inst._Lock);
+			_Block* block = static_cast<_Block*>(_Ptr);
+			block->_Next = inst._Free;
+			inst._Free = block;
+		}
+
+	private:
+		union _Block
+		{
+			_Block* _Next;
+			alignas(std::max_align_t) unsigned char _Data[block_size];
+		};
+
+		static constexpr size_t _SlabBlocks = 64;
+
+		task_allocator() = default;
+		task_allocator(const task_allocator&) = delete;
+		task_allocator& operator = (const task_allocator&) = delete;
+
+		static task_allocator& _Instance()
+		{
+			static task_allocator inst;
+			return inst;
+		}
+
+		void _Refill()
+		{
+			_Block* slab = static_cast<_Block*>(::operator new(sizeof(_Block) * _SlabBlocks));
+			for (size_t i(0); i < _SlabBlocks; ++i)
+			{
+				slab[i]._Next = _Free;
+				_Free = slab + i;
+			}
+		}
+
+		std::mutex _Lock;
+		_Block* _Free = nullptr;
+	};
+
+	// Move-only void() callable. Small callables are stored inline, larger
+	// ones in a task_allocator block, so creating, queuing and running a task
+	// never goes through the general heap.
+	class task
+	{
+	public:
+		static constexpr size_t inline_size = VTD_TASK_INLINE_SIZE;
+
+		task() noexcept
+			: _Ops(nullptr)
+		{
+		}
+
+		template <class _Fn, class = typename std::enable_if<!std::is_same<typename std::decay<_Fn>::type, task>::value>::type>
+		task(_Fn&& _Func)
+			: _Ops(nullptr)
+		{
+			typedef typename std::decay<_Fn>::type _Callable;
+			static_assert(sizeof(_Callable) <= task_allocator::block_size, "task capture is larger than a task_allocator block");
+			_Init<_Callable>(std::forward<_Fn>(_Func), std::integral_constant<bool, _Fits<_Callable>::value>());
+		}
+
+		task(task&& _Right) noexcept
+			: _Ops(_Right._Ops)
+		{
+			if (_Ops)
+			{
+				_Ops->_Move(_Storage, _Right._Storage);
+				_Right._Ops = nullptr;
+			}
+		}
+
+		task& operator = (task&& _Right) noexcept
+		{
+			if (this != &_Right)
+			{
+				reset();
+				if (_Right._Ops)
+				{
+					_Ops = _Right._Ops;
+					_Ops->_Move(_Storage, _Right._Storage);
+					_Right._Ops = nullptr;
+				}
+			}
+			return *this;
+		}
+
+		~task() noexcept
+		{
+			reset();
+		}
+
+		void operator () ()
+		{
+			_Ops->_Invoke(_Storage);
+		}
+
+		explicit operator bool() const noexcept
+		{
+			return _Ops != nullptr;
+		}
+
+		void reset() noexcept
+		{
+			if (_Ops)
+			{
+				_Ops->_Destroy(_Storage);
+				_Ops = nullptr;
+			}
+		}
+
+	private:
+		struct _Table
+		{
+			void(*_Invoke)(void*);
+			void(*_Move)(void*, void*);
+			void(*_Destroy)(void*);
+		};
+
+		template <class _Callable>
+		struct _Fits : std::integral_constant<bool, sizeof(_Callable) <= inline_size
+			&& alignof(_Callable) <= alignof(std::max_align_t)
+			&& std::is_nothrow_move_constructible<_Callable>::value>
+		{
+		};
+
+		template <class _Callable>
+		struct _Inline
+		{
+			static void _Invoke(void* _Ptr)
+			{
+				(*static_cast<_Callable*>(_Ptr))();
+			}
+
+			static void _Move(void* _Dst, void* _Src)
+			{
+				_Callable* src = static_cast<_Callable*>(_Src);
+				new (_Dst) _Callable(std::move(*src));
+				src->~_Callable();
+			}
+
+			static void _Destroy(void* _Ptr)
+			{
+				static_cast<_Callable*>(_Ptr)->~_Callable();
+			}
+
+			static const _Table table;
+		};
+
+		template <class _Callable>
+		struct _Pooled
+		{
+			static _Callable*& _Get(void* _Ptr)
+			{
+				return *static_cast<_Callable**>(_Ptr);
+			}
+
+			static void _Invoke(void* _Ptr)
+			{
+				(*_Get(_Ptr))();
+			}
+
+			static void _Move(void* _Dst, void* _Src)
+			{
+				new (_Dst) _Callable*(_Get(_Src));
+			}
+
+			static void _Destroy(void* _Ptr)
+			{
+				_Callable* func = _Get(_Ptr);
+				func->~_Callable();
+				task_allocator::release(func);
+			}
+
+			static const _Table table;
+		};
+
+		template <class _Callable, class _Fn>
+		void _Init(_Fn&& _Func, std::true_type)
+		{
+			new (_Storage) _Callable(std::forward<_Fn>(_Func));
+			_Ops = &_Inline<_Callable>::table;
+		}
+
+		template <class _Callable, class _Fn>
+		void _Init(_Fn&& _Func, std::false_type)
+		{
+			void* block = task_allocator::acquire();
+			new (_Storage) _Callable*(new (block) _Callable(std::forward<_Fn>(_Func)));
+			_Ops = &_Pooled<_Callable>::table;
+		}
+
+		task(const task&) = delete;
+		task& operator = (const task&) = delete;
+
+		alignas(std::max_align_t) unsigned char _Storage[inline_size];
+		const _Table* _Ops;
+
+	};
+
+	template <class _Callable>
+	const task::_Table task::_Inline<_Callable>::table = { &_Invoke, &_Move, &_Destroy };
+
+	template <class _Callable>
+	const task::_Table task::_Pooled<_Callable>::table = { &_Invoke, &_Move, &_Destroy };
+
+}
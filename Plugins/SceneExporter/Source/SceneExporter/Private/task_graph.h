@@ -0,0 +1,166 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "task.h"
+
+namespace vtd
+{
+	// Receives the nodes of a task_graph once their prerequisites are done.
+	// The lane tells the executor where the node has to run.
+	class task_executor
+	{
+	public:
+		virtual ~task_executor() = default;
+
+		virtual void execute(int _Lane, task&& _Work) = 0;
+	};
+
+	// Directed acyclic graph of tasks. Nodes are added and wired up on one
+	// thread, then launch() hands every node without prerequisites to the
+	// executor; each finished node releases its successors. A node that calls
+	// yield() is handed back to the executor instead of finishing, so long
+	// running work can be split into slices that keep their own cursor.
+	class task_graph
+	{
+	public:
+		typedef size_t node_id;
+
+		task_graph() noexcept
+		{
+			_Outstanding.store(0);
+		}
+
+		node_id add(task _Work, int _Lane = 0)
+		{
+			_Nodes.emplace_back(new _Node(std::move(_Work), _Lane));
+			return _Nodes.size() - 1;
+		}
+
+		// _Node does not start before _Prerequisite has finished.
+		void depend(node_id _Node, node_id _Prerequisite)
+		{
+			_Nodes[_Prerequisite]->_Successors.push_back(_Node);
+			_Nodes[_Node]->_Remaining.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		void launch(task_executor& _Exec, task _OnComplete)
+		{
+			_Executor = &_Exec;
+			_Done = std::move(_OnComplete);
+			_Outstanding.store(_Nodes.size(), std::memory_order_release);
+			if (_Nodes.empty())
+			{
+				_Finish();
+				return;
+			}
+			std::vector<node_id> roots;
+			for (node_id i(0); i < _Nodes.size(); ++i)
+			{
+				if (_Nodes[i]->_Remaining.load(std::memory_order_relaxed) == 0)
+				{
+					roots.push_back(i);
+				}
+			}
+			for (node_id i : roots)
+			{
+				_Dispatch(i);
+			}
+		}
+
+		size_t size() const noexcept
+		{
+			return _Nodes.size();
+		}
+
+		bool done() const noexcept
+		{
+			return _Outstanding.load(std::memory_order_acquire) == 0;
+		}
+
+		// Called from inside a node: run the node again later instead of
+		// completing it when it returns.
+		static void yield() noexcept
+		{
+			_Yielded() = true;
+		}
+
+	private:
+		struct _Node
+		{
+			_Node(task&& _Task, int _Where)
+				: _Work(std::move(_Task)), _Lane(_Where)
+			{
+				_Remaining.store(0);
+			}
+
+			task _Work;
+			int _Lane;
+			std::atomic<size_t> _Remaining;
+			std::vector<node_id> _Successors;
+		};
+
+		task_graph(const task_graph&) = delete;
+		task_graph& operator = (const task_graph&) = delete;
+
+		void _Dispatch(node_id _Id)
+		{
+			_Executor->execute(_Nodes[_Id]->_Lane, task([this, _Id]()
+			{
+				_Run(_Id);
+			}));
+		}
+
+		static bool& _Yielded() noexcept
+		{
+			static thread_local bool yielded = false;
+			return yielded;
+		}
+
+		void _Run(node_id _Id)
+		{
+			_Node& node = *_Nodes[_Id];
+			// A node that waits on the pool can run other nodes on this thread
+			// before it returns, so the flag of the node around it is kept.
+			const bool outer = _Yielded();
+			_Yielded() = false;
+			node._Work();
+			const bool yielded = _Yielded();
+			_Yielded() = outer;
+			if (yielded)
+			{
+				_Dispatch(_Id);
+				return;
+			}
+			node._Work.reset();
+			for (node_id next : node._Successors)
+			{
+				if (_Nodes[next]->_Remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+				{
+					_Dispatch(next);
+				}
+			}
+			if (_Outstanding.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			{
+				_Finish();
+			}
+		}
+
+		void _Finish()
+		{
+			if (_Done)
+			{
+				_Done();
+				_Done.reset();
+			}
+		}
+
+		std::vector<std::unique_ptr<_Node>> _Nodes;
+		std::atomic<size_t> _Outstanding;
+		task_executor* _Executor = nullptr;
+		task _Done;
+
+	};
+
+}
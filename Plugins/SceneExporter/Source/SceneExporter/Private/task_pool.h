@@ -0,0 +1,330 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "task.h"
+
+#ifndef VTD_CACHE_LINE
+#	define VTD_CACHE_LINE (64)
+#endif
+
+#ifndef VTD_WORKER_QUEUE_SIZE
+#	define VTD_WORKER_QUEUE_SIZE (1024)
+#endif
+
+namespace vtd
+{
+	// Counts the tasks submitted through it so a caller can wait for a batch
+	// without waiting for the whole pool.
+	class task_group
+	{
+	public:
+		task_group() noexcept
+		{
+			_Count.store(0);
+		}
+
+		bool done() const noexcept
+		{
+			return _Count.load(std::memory_order_acquire) == 0;
+		}
+
+	private:
+		friend class task_pool;
+
+		task_group(const task_group&) = delete;
+		task_group& operator = (const task_group&) = delete;
+
+		std::atomic<size_t> _Count;
+	};
+
+	// Fixed set of worker threads, each owning a deque. A worker pops its own
+	// deque from the back and steals from the front of the others when idle.
+	// The deques are fixed-size rings allocated with the pool; when every ring
+	// is full the submitting thread runs the task itself.
+	class task_pool
+	{
+	public:
+		typedef task task_type;
+
+		explicit task_pool(size_t _Workers = 0)
+			: _Queues(_Resolve(_Workers))
+		{
+			_Pending.store(0);
+			_Next.store(0);
+			_Stop = false;
+			_Threads.reserve(_Queues.size());
+			for (size_t i(0); i < _Queues.size(); ++i)
+			{
+				_Threads.emplace_back([this, i]() { _Run(i); });
+			}
+		}
+
+		~task_pool() noexcept
+		{
+			join();
+		}
+
+		// Runs every queued task, including ones they submit, then stops and
+		// joins the workers. Nothing may be submitted from outside the pool
+		// afterwards.
+		void join() noexcept
+		{
+			{
+				std::lock_guard<std::mutex> lock(_SleepLock);
+				_Stop = true;
+			}
+			_Wake.notify_all();
+			for (auto& thread : _Threads)
+			{
+				if (thread.joinable())
+				{
+					thread.join();
+				}
+			}
+		}
+
+		size_t worker_count() const noexcept
+		{
+			return _Threads.size();
+		}
+
+		void submit(task_group& _Group, task_type _Task)
+		{
+			_Group._Count.fetch_add(1, std::memory_order_relaxed);
+			_Push(_Item(std::move(_Task), &_Group));
+		}
+
+		void submit(task_type _Task)
+		{
+			_Push(_Item(std::move(_Task), nullptr));
+		}
+
+		// Blocks until every task of the group has finished. The calling thread
+		// runs queued tasks while it waits, so this is safe to call from inside
+		// a task.
+		void wait(task_group& _Group)
+		{
+			wait_until([&_Group]() { return _Group.done(); });
+		}
+
+		// Blocks until _Ready returns true, running queued tasks meanwhile as
+		// wait() does, for conditions that queued tasks may be needed to meet.
+		template <class _Pred>
+		void wait_until(_Pred _Ready)
+		{
+			while (!_Ready())
+			{
+				if (!_Help())
+				{
+					std::this_thread::yield();
+				}
+			}
+		}
+
+		template <class _Fn>
+		void parallel_for(size_t _Count, _Fn _Func)
+		{
+			task_group group;
+			for (size_t i(0); i < _Count; ++i)
+			{
+				submit(group, [&_Func, i]() { _Func(i); });
+			}
+			wait(group);
+		}
+
+	private:
+		struct _Item
+		{
+			task_type _Func;
+			task_group* _Group = nullptr;
+
+			_Item() = default;
+			_Item(task_type&& _Task, task_group* _Owner) noexcept
+				: _Func(std::move(_Task)), _Group(_Owner)
+			{
+			}
+			_Item(_Item&&) = default;
+			_Item& operator = (_Item&&) = default;
+		};
+
+		// Padded rather than aligned: std::allocator does not honour alignas
+		// above alignof(std::max_align_t) before C++17, so the trailing line
+		// is what keeps neighbouring queues in the vector off each other's
+		// cache lines.
+		struct _Queue
+		{
+			std::mutex _Lock;
+			std::vector<_Item> _Items;
+			size_t _Front = 0;
+			size_t _Count = 0;
+			char _Pad[VTD_CACHE_LINE];
+
+			_Queue()
+				: _Items(VTD_WORKER_QUEUE_SIZE)
+			{
+			}
+
+			bool push_back(_Item& _Val) noexcept
+			{
+				if (_Count == _Items.size()) return false;
+				_Items[(_Front + _Count) % _Items.size()] = std::move(_Val);
+				++_Count;
+				return true;
+			}
+
+			bool pop_back(_Item& _Val) noexcept
+			{
+				if (_Count == 0) return false;
+				--_Count;
+				_Val = std::move(_Items[(_Front + _Count) % _Items.size()]);
+				return true;
+			}
+
+			bool pop_front(_Item& _Val) noexcept
+			{
+				if (_Count == 0) return false;
+				_Val = std::move(_Items[_Front]);
+				_Front = (_Front + 1) % _Items.size();
+				--_Count;
+				return true;
+			}
+		};
+
+		task_pool(const task_pool&) = delete;
+		task_pool& operator = (const task_pool&) = delete;
+
+		static size_t _Resolve(size_t _Workers) noexcept
+		{
+			if (_Workers == 0)
+			{
+				_Workers = std::thread::hardware_concurrency();
+			}
+			return _Workers ? _Workers : 1;
+		}
+
+		static task_pool*& _CurrentPool() noexcept
+		{
+			static thread_local task_pool* pool = nullptr;
+			return pool;
+		}
+
+		static size_t& _CurrentIndex() noexcept
+		{
+			static thread_local size_t index = 0;
+			return index;
+		}
+
+		void _Push(_Item&& _Val)
+		{
+			size_t home = (_CurrentPool() == this) ? _CurrentIndex()
+				: _Next.fetch_add(1, std::memory_order_relaxed) % _Queues.size();
+			bool queued = false;
+			for (size_t i(0); i < _Queues.size() && (!queued); ++i)
+			{
+				_Queue& queue = _Queues[(home + i) % _Queues.size()];
+				std::lock_guard<std::mutex> lock(queue._Lock);
+				queued = queue.push_back(_Val);
+			}
+			if (!queued)
+			{
+				_Pending.fetch_add(1, std::memory_order_relaxed);
+				_Execute(_Val);
+				return;
+			}
+			_Pending.fetch_add(1, std::memory_order_release);
+			{
+				std::lock_guard<std::mutex> lock(_SleepLock);
+			}
+			_Wake.notify_one();
+		}
+
+		bool _PopBack(size_t _Index, _Item& _Val)
+		{
+			_Queue& queue = _Queues[_Index];
+			std::lock_guard<std::mutex> lock(queue._Lock);
+			return queue.pop_back(_Val);
+		}
+
+		bool _StealFront(size_t _Index, _Item& _Val)
+		{
+			_Queue& queue = _Queues[_Index];
+			std::unique_lock<std::mutex> lock(queue._Lock, std::try_to_lock);
+			if (!lock.owns_lock()) return false;
+			return queue.pop_front(_Val);
+		}
+
+		bool _Take(size_t _Home, bool _Own, _Item& _Val)
+		{
+			if (_Pending.load(std::memory_order_acquire) == 0) return false;
+			if (_Own && _PopBack(_Home, _Val)) return true;
+			size_t count = _Queues.size();
+			for (size_t i(_Own ? 1 : 0); i < count; ++i)
+			{
+				if (_StealFront((_Home + i) % count, _Val)) return true;
+			}
+			return false;
+		}
+
+		void _Execute(_Item& _Val)
+		{
+			_Pending.fetch_sub(1, std::memory_order_relaxed);
+			_Val._Func();
+			_Val._Func.reset();
+			if (_Val._Group)
+			{
+				_Val._Group->_Count.fetch_sub(1, std::memory_order_release);
+			}
+		}
+
+		bool _Help()
+		{
+			_Item item;
+			bool own = (_CurrentPool() == this);
+			size_t home = own ? _CurrentIndex()
+				: _Next.load(std::memory_order_relaxed) % _Queues.size();
+			if (!_Take(home, own, item)) return false;
+			_Execute(item);
+			return true;
+		}
+
+		void _Run(size_t _Index)
+		{
+			_CurrentPool() = this;
+			_CurrentIndex() = _Index;
+			while (true)
+			{
+				_Item item;
+				if (_Take(_Index, true, item))
+				{
+					_Execute(item);
+					continue;
+				}
+				std::unique_lock<std::mutex> lock(_SleepLock);
+				if (_Pending.load(std::memory_order_acquire) == 0)
+				{
+					if (_Stop) break;
+					_Wake.wait(lock);
+				}
+			}
+		}
+
+		// The pool itself may come from operator new, so the shared counters
+		// are kept apart by padding as well.
+		std::vector<_Queue> _Queues;
+		std::vector<std::thread> _Threads;
+		char _Pad0[VTD_CACHE_LINE];
+		std::atomic<size_t> _Pending;
+		char _Pad1[VTD_CACHE_LINE];
+		std::atomic<size_t> _Next;
+		char _Pad2[VTD_CACHE_LINE];
+		std::mutex _SleepLock;
+		std::condition_variable _Wake;
+		bool _Stop;
+
+	};
+
+}
@@ -14,6 +14,12 @@ public class SceneExporter : ModuleRules
         get { return Path.GetFullPath(Path.Combine(ModulePath, "../ThirdParty/")); }
     }
 
+    // Header-only image code shared with the ExportCubemap plugin.
+    private string SharedPath
+    {
+        get { return Path.GetFullPath(Path.Combine(ModulePath, "../Shared/")); }
+    }
+
     public SceneExporter(ReadOnlyTargetRules Target) : base(Target)
 	{
 		PCHUsage = ModuleRules.PCHUsageMode.UseExplicitOrSharedPCHs;
@@ -33,7 +39,8 @@ public class SceneExporter : ModuleRules
                 "EditorStyle",
                 "Slate",
                 "Slate/Public/Framework",
-                "UnrealEd"
+                "UnrealEd",
+                SharedPath
             }
 			);
 
@@ -0,0 +1,948 @@
+#pragma once
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// LDR ASTC encoding of BGRA8 images for the PVR writer, written from the
+// format specification: the vendored astcenc ships its headers and a Windows
+// library but not the codec sources. Footprints are the 2D ones from 4x4 to
+// 8x8. Every block has one partition and one weight plane, with direct RGB
+// endpoints (CEM 8) when the block is opaque and direct RGBA (CEM 12)
+// otherwise; blocks of one colour are written as void extent blocks. Only
+// weight grids whose weights and endpoints both fall on ranges of plain bits
+// are used, so no trit or quint packing is needed; the encoder finds them for
+// its footprint when it is constructed.
+//
+// Endpoints start on the principal axis of the block, texel weights are
+// projected on them and averaged down to the weight grid through the bilinear
+// infill the decoder applies, and every candidate is scored by decoding it.
+// Grids are ordered by a rough cost of their weight precision, decimation and
+// endpoint precision; Preset::Fast fits the first grid of the footprint, Medium
+// the first 4 with one least squares refinement and Thorough the first 16 with
+// two. An encoder does not change after construction, so threads share one
+// and each compress a range of block rows, like bc::CompressRows. Depends only
+// on the C++ standard library.
+namespace astc {
+	enum class Preset : uint32_t
+	{
+		Fast,
+		Medium,
+		Thorough,
+	};
+
+	inline bool IsSupportedFootprint(uint32_t blockX, uint32_t blockY)
+	{
+		return (blockX == 4 && blockY == 4) || (blockX == 5 && (blockY == 4 || blockY == 5)) || (blockX == 6 && (blockY == 5 || blockY == 6))
+			|| (blockX == 8 && (blockY == 5 || blockY == 6 || blockY == 8));
+	}
+
+	/// <summary>Reads a footprint written as "6x6".</summary>
+	inline bool ParseFootprint(const char* text, uint32_t& blockX, uint32_t& blockY)
+	{
+		if (!text || text[0] < '0' || text[0] > '9' || (text[1] != 'x' && text[1] != 'X') || text[2] < '0' || text[2] > '9' || text[3] != 0)
+		{
+			return false;
+		}
+		blockX = uint32_t(text[0] - '0');
+		blockY = uint32_t(text[2] - '0');
+		return IsSupportedFootprint(blockX, blockY);
+	}
+
+	inline uint32_t GetBlockRows(uint32_t height, uint32_t blockY)
+	{
+		return (height + blockY - 1) / blockY;
+	}
+
+	/// <summary>Bytes of a width x height surface, 16 per block.</summary>
+	inline size_t GetSurfaceSize(uint32_t blockX, uint32_t blockY, uint32_t width, uint32_t height)
+	{
+		return size_t((width + blockX - 1) / blockX) * GetBlockRows(height, blockY) * 16;
+	}
+
+	namespace detail {
+		/// <summary>One of the 21 ranges of the integer sequence encoding: 2^bits levels, times 3 with a trit or 5 with a quint.</summary>
+		struct Range
+		{
+			uint32_t levels;
+			uint32_t bits;
+			uint32_t trits;
+			uint32_t quints;
+		};
+
+		inline const Range& GetRange(uint32_t index)
+		{
+			static const Range ranges[21] = {
+				{ 2, 1, 0, 0 }, { 3, 0, 1, 0 }, { 4, 2, 0, 0 }, { 5, 0, 0, 1 }, { 6, 1, 1, 0 }, { 8, 3, 0, 0 }, { 10, 1, 0, 1 },
+				{ 12, 2, 1, 0 }, { 16, 4, 0, 0 }, { 20, 2, 0, 1 }, { 24, 3, 1, 0 }, { 32, 5, 0, 0 }, { 40, 3, 0, 1 }, { 48, 4, 1, 0 },
+				{ 64, 6, 0, 0 }, { 80, 4, 0, 1 }, { 96, 5, 1, 0 }, { 128, 7, 0, 0 }, { 160, 5, 0, 1 }, { 192, 6, 1, 0 }, { 256, 8, 0, 0 },
+			};
+			return ranges[index];
+		}
+
+		/// <summary>Bits taken by count values of a range in the integer sequence encoding.</summary>
+		inline uint32_t GetSequenceBits(uint32_t range, uint32_t count)
+		{
+			const Range& r = GetRange(range);
+			return count * r.bits + (r.trits ? (8 * count + 4) / 5 : 0) + (r.quints ? (7 * count + 2) / 3 : 0);
+		}
+
+		/// <summary>The largest range whose count values fit in bits, which is how the decoder
+		/// sizes the endpoints; -1 when none fits.</summary>
+		inline int32_t GetColorRange(uint32_t count, int32_t bits)
+		{
+			for (int32_t range = 20; range >= 0 && bits > 0; --range)
+			{
+				if (GetSequenceBits(uint32_t(range), count) <= uint32_t(bits))
+				{
+					return range;
+				}
+			}
+			return -1;
+		}
+
+		struct BlockMode
+		{
+			uint32_t gridX = 0;
+			uint32_t gridY = 0;
+			uint32_t weightRange = 0;
+			bool dualPlane = false;
+		};
+
+		/// <summary>Weight grid, weight range and plane count of an 11 bit 2D block mode. Reserved
+		/// modes, the void extent and grids the format does not allow return false.</summary>
+		inline bool DecodeBlockMode(uint32_t mode, BlockMode& out)
+		{
+			if ((mode & 0x1ff) == 0x1fc)
+			{
+				return false;
+			}
+			uint32_t range = (mode >> 4) & 1;
+			uint32_t high = (mode >> 9) & 1;
+			uint32_t dual = (mode >> 10) & 1;
+			const uint32_t a = (mode >> 5) & 3;
+			uint32_t x;
+			uint32_t y;
+			if (mode & 3)
+			{
+				range |= (mode & 3) << 1;
+				uint32_t b = (mode >> 7) & 3;
+				switch ((mode >> 2) & 3)
+				{
+				case 0: x = b + 4; y = a + 2; break;
+				case 1: x = b + 8; y = a + 2; break;
+				case 2: x = a + 2; y = b + 8; break;
+				default:
+					b &= 1;
+					if (mode & 0x100)
+					{
+						x = b + 2;
+						y = a + 2;
+					}
+					else
+					{
+						x = a + 2;
+						y = b + 6;
+					}
+					break;
+				}
+			}
+			else
+			{
+				range |= ((mode >> 2) & 3) << 1;
+				const uint32_t b = (mode >> 9) & 3;
+				switch ((mode >> 7) & 3)
+				{
+				case 0: x = 12; y = a + 2; break;
+				case 1: x = a + 2; y = 12; break;
+				case 2: x = a + 6; y = b + 6; high = 0; dual = 0; break;
+				default:
+					if (a > 1)
+					{
+						return false;
+					}
+					x = a == 0 ? 6 : 10;
+					y = a == 0 ? 10 : 6;
+					break;
+				}
+			}
+			if (range < 2)
+			{
+				return false;
+			}
+			out.gridX = x;
+			out.gridY = y;
+			out.weightRange = range - 2 + 6 * high;
+			out.dualPlane = dual != 0;
+			const uint32_t count = x * y * (dual + 1);
+			const uint32_t bits = GetSequenceBits(out.weightRange, count);
+			return count <= 64 && bits >= 24 && bits <= 96;
+		}
+
+		/// <summary>Endpoint value of a plain bit range widened to 8 bits by bit replication.</summary>
+		inline uint32_t UnquantizeColor(uint32_t value, uint32_t bits)
+		{
+			uint32_t result = value << (8 - bits);
+			for (uint32_t shift = bits; shift < 8; shift *= 2)
+			{
+				result |= result >> shift;
+			}
+			return result;
+		}
+
+		/// <summary>Weight of a plain bit range on the 0 to 64 scale: replicated to 6 bits, then
+		/// one more above 32 so that the scale is symmetric.</summary>
+		inline uint32_t UnquantizeWeight(uint32_t value, uint32_t bits)
+		{
+			uint32_t result = value << (6 - bits);
+			for (uint32_t shift = bits; shift < 6; shift *= 2)
+			{
+				result |= result >> shift;
+			}
+			return result > 32 ? result + 1 : result;
+		}
+
+		/// <summary>The four grid weights under each texel and their factors in sixteenths, from
+		/// the bilinear infill of the format. Factors of neighbours past the grid are zero.</summary>
+		struct Infill
+		{
+			uint8_t index[64][4];
+			uint8_t factor[64][4];
+		};
+
+		inline void MakeInfill(uint32_t blockX, uint32_t blockY, uint32_t gridX, uint32_t gridY, Infill& infill)
+		{
+			const uint32_t scaleX = (1024 + blockX / 2) / (blockX - 1);
+			const uint32_t scaleY = (1024 + blockY / 2) / (blockY - 1);
+			const uint32_t count = gridX * gridY;
+			for (uint32_t y = 0; y < blockY; ++y)
+			{
+				for (uint32_t x = 0; x < blockX; ++x)
+				{
+					const uint32_t texel = y * blockX + x;
+					const uint32_t gx = (scaleX * x * (gridX - 1) + 32) >> 6;
+					const uint32_t gy = (scaleY * y * (gridY - 1) + 32) >> 6;
+					const uint32_t fx = gx & 15;
+					const uint32_t fy = gy & 15;
+					const uint32_t base = (gy >> 4) * gridX + (gx >> 4);
+					const uint32_t both = (fx * fy + 8) >> 4;
+					const uint32_t index[4] = { base, base + 1, base + gridX, base + gridX + 1 };
+					const uint32_t factor[4] = { 16 - fx - fy + both, fx - both, fy - both, both };
+					for (uint32_t i = 0; i < 4; ++i)
+					{
+						infill.index[texel][i] = uint8_t(index[i] < count ? index[i] : 0);
+						infill.factor[texel][i] = uint8_t(index[i] < count ? factor[i] : 0);
+					}
+				}
+			}
+		}
+
+		/// <summary>RGBA endpoints of CEM 8 (alpha 255) or CEM 12 from the unquantised values in the
+		/// order of the format, R0 R1 G0 G1 B0 B1 A0 A1, with the blue contraction of the format.</summary>
+		inline void DecodeEndpoints(uint32_t cem, const uint32_t values[8], uint32_t start[4], uint32_t end[4])
+		{
+			const uint32_t alpha0 = cem == 12 ? values[6] : 255;
+			const uint32_t alpha1 = cem == 12 ? values[7] : 255;
+			if (values[1] + values[3] + values[5] >= values[0] + values[2] + values[4])
+			{
+				const uint32_t low[4] = { values[0], values[2], values[4], alpha0 };
+				const uint32_t high[4] = { values[1], values[3], values[5], alpha1 };
+				std::memcpy(start, low, sizeof(low));
+				std::memcpy(end, high, sizeof(high));
+			}
+			else
+			{
+				const uint32_t low[4] = { (values[1] + values[5]) >> 1, (values[3] + values[5]) >> 1, values[5], alpha1 };
+				const uint32_t high[4] = { (values[0] + values[4]) >> 1, (values[2] + values[4]) >> 1, values[4], alpha0 };
+				std::memcpy(start, low, sizeof(low));
+				std::memcpy(end, high, sizeof(high));
+			}
+		}
+
+		/// <summary>8 bit result of the LDR interpolation: both endpoints widened to 16 bits, weighted
+		/// on the 0 to 64 scale, and the top 8 bits kept.</summary>
+		inline uint32_t Interpolate(uint32_t start, uint32_t end, uint32_t weight)
+		{
+			return ((start * 257 * (64 - weight) + end * 257 * weight + 32) >> 6) >> 8;
+		}
+
+		/// <summary>A weight grid the encoder may use, with the ranges the decoder derives from it.</summary>
+		struct Config
+		{
+			uint32_t mode = 0;
+			uint32_t gridX = 0;
+			uint32_t gridY = 0;
+			uint32_t weightBits = 0;
+			uint32_t colorBits = 0;
+			uint32_t cem = 0;
+			Infill infill;
+		};
+
+		/// <summary>Rough squared error a grid adds, for trying the likely best grids first: a weight
+		/// step over a span of 8 levels, the texels between two grid weights in each direction, and an
+		/// endpoint step. Fitted to the per grid results on probe content.</summary>
+		inline float GetCost(const Config& config, uint32_t blockX, uint32_t blockY)
+		{
+			const float weightStep = 8.0f / float((1u << config.weightBits) - 1);
+			const float spanX = float(blockX - 1) / float(config.gridX - 1);
+			const float spanY = float(blockY - 1) / float(config.gridY - 1);
+			const float colorStep = 255.0f / float((1u << config.colorBits) - 1);
+			return weightStep * weightStep + spanX * spanX + spanY * spanY + colorStep * colorStep;
+		}
+
+		/// <summary>The texels of a block channel by channel (R, G, B, A), row by row.</summary>
+		struct Texels
+		{
+			float c[4][64];
+			uint32_t count;
+		};
+
+		inline void LoadBlock(const uint8_t* bgra, size_t pitch, uint32_t width, uint32_t height, uint32_t blockX, uint32_t blockY,
+			uint32_t column, uint32_t row, Texels& texels)
+		{
+			texels.count = blockX * blockY;
+			for (uint32_t y = 0; y < blockY; ++y)
+			{
+				const uint32_t sourceY = row * blockY + y < height ? row * blockY + y : height - 1;
+				const uint8_t* line = bgra + sourceY * pitch;
+				for (uint32_t x = 0; x < blockX; ++x)
+				{
+					const uint32_t sourceX = column * blockX + x < width ? column * blockX + x : width - 1;
+					const uint8_t* pixel = line + sourceX * 4;
+					const uint32_t texel = y * blockX + x;
+					texels.c[0][texel] = pixel[2];
+					texels.c[1][texel] = pixel[1];
+					texels.c[2][texel] = pixel[0];
+					texels.c[3][texel] = pixel[3];
+				}
+			}
+		}
+
+		inline float Clamp(float value, float low, float high)
+		{
+			return value < low ? low : (value > high ? high : value);
+		}
+
+		/// <summary>Endpoints at the extremes of the texels projected on their principal axis.</summary>
+		inline void AxisEndpoints(const Texels& texels, uint32_t channels, float start[4], float end[4])
+		{
+			float mean[4] = {};
+			for (uint32_t i = 0; i < channels; ++i)
+			{
+				for (uint32_t texel = 0; texel < texels.count; ++texel)
+				{
+					mean[i] += texels.c[i][texel];
+				}
+				mean[i] /= float(texels.count);
+			}
+			float covariance[4][4] = {};
+			for (uint32_t texel = 0; texel < texels.count; ++texel)
+			{
+				for (uint32_t i = 0; i < channels; ++i)
+				{
+					const float di = texels.c[i][texel] - mean[i];
+					for (uint32_t j = i; j < channels; ++j)
+					{
+						covariance[i][j] += di * (texels.c[j][texel] - mean[j]);
+					}
+				}
+			}
+			float axis[4] = { 1.0f, 1.0f, 1.0f, channels == 4 ? 1.0f : 0.0f };
+			for (uint32_t iteration = 0; iteration < 8; ++iteration)
+			{
+				float next[4] = {};
+				for (uint32_t i = 0; i < channels; ++i)
+				{
+					for (uint32_t j = 0; j < channels; ++j)
+					{
+						next[i] += (i <= j ? covariance[i][j] : covariance[j][i]) * axis[j];
+					}
+				}
+				float length = 0.0f;
+				for (uint32_t i = 0; i < channels; ++i)
+				{
+					length += next[i] * next[i];
+				}
+				if (length < FLT_MIN)
+				{
+					break;
+				}
+				length = 1.0f / std::sqrt(length);
+				for (uint32_t i = 0; i < channels; ++i)
+				{
+					axis[i] = next[i] * length;
+				}
+			}
+			float low = FLT_MAX;
+			float high = -FLT_MAX;
+			for (uint32_t texel = 0; texel < texels.count; ++texel)
+			{
+				float projection = 0.0f;
+				for (uint32_t i = 0; i < channels; ++i)
+				{
+					projection += (texels.c[i][texel] - mean[i]) * axis[i];
+				}
+				low = projection < low ? projection : low;
+				high = projection > high ? projection : high;
+			}
+			for (uint32_t i = 0; i < 4; ++i)
+			{
+				start[i] = i < channels ? Clamp(mean[i] + axis[i] * low, 0.0f, 255.0f) : 255.0f;
+				end[i] = i < channels ? Clamp(mean[i] + axis[i] * high, 0.0f, 255.0f) : 255.0f;
+			}
+		}
+
+		/// <summary>Endpoints that best fit the texels for the given texel weights on the 0 to 64
+		/// scale; false when the weights do not tell the endpoints apart.</summary>
+		inline bool LeastSquares(const Texels& texels, uint32_t channels, const uint8_t weights[64], float start[4], float end[4])
+		{
+			float aa = 0.0f;
+			float ab = 0.0f;
+			float bb = 0.0f;
+			float ax[4] = {};
+			float bx[4] = {};
+			for (uint32_t texel = 0; texel < texels.count; ++texel)
+			{
+				const float b = float(weights[texel]) / 64.0f;
+				const float a = 1.0f - b;
+				aa += a * a;
+				ab += a * b;
+				bb += b * b;
+				for (uint32_t i = 0; i < channels; ++i)
+				{
+					ax[i] += a * texels.c[i][texel];
+					bx[i] += b * texels.c[i][texel];
+				}
+			}
+			const float determinant = aa * bb - ab * ab;
+			if (std::fabs(determinant) < 1e-6f)
+			{
+				return false;
+			}
+			const float inverse = 1.0f / determinant;
+			for (uint32_t i = 0; i < channels; ++i)
+			{
+				start[i] = Clamp((ax[i] * bb - bx[i] * ab) * inverse, 0.0f, 255.0f);
+				end[i] = Clamp((bx[i] * aa - ax[i] * ab) * inverse, 0.0f, 255.0f);
+			}
+			return true;
+		}
+
+		inline uint32_t QuantizeColor(float value, uint32_t bits)
+		{
+			const uint32_t top = (1u << bits) - 1;
+			const float clamped = Clamp(value, 0.0f, 255.0f);
+			const uint32_t guess = uint32_t(clamped * float(top) / 255.0f + 0.5f);
+			uint32_t best = guess;
+			float bestDistance = FLT_MAX;
+			for (uint32_t candidate = guess > 0 ? guess - 1 : 0; candidate <= guess + 1 && candidate <= top; ++candidate)
+			{
+				const float distance = std::fabs(float(UnquantizeColor(candidate, bits)) - clamped);
+				if (distance < bestDistance)
+				{
+					best = candidate;
+					bestDistance = distance;
+				}
+			}
+			return best;
+		}
+
+		inline uint32_t QuantizeWeight(float weight, uint32_t bits)
+		{
+			const uint32_t top = (1u << bits) - 1;
+			const float scaled = Clamp(weight, 0.0f, 1.0f) * 64.0f;
+			const uint32_t guess = uint32_t(Clamp(weight, 0.0f, 1.0f) * float(top) + 0.5f);
+			uint32_t best = guess;
+			float bestDistance = FLT_MAX;
+			for (uint32_t candidate = guess > 0 ? guess - 1 : 0; candidate <= guess + 1 && candidate <= top; ++candidate)
+			{
+				const float distance = std::fabs(float(UnquantizeWeight(candidate, bits)) - scaled);
+				if (distance < bestDistance)
+				{
+					best = candidate;
+					bestDistance = distance;
+				}
+			}
+			return best;
+		}
+
+		/// <summary>Texel weights on the 0 to 64 scale from quantised grid weights.</summary>
+		inline void InfillWeights(const Config& config, uint32_t texelCount, const uint8_t* weights, uint8_t texelWeights[64])
+		{
+			uint32_t unquantized[64];
+			for (uint32_t i = 0; i < config.gridX * config.gridY; ++i)
+			{
+				unquantized[i] = UnquantizeWeight(weights[i], config.weightBits);
+			}
+			for (uint32_t texel = 0; texel < texelCount; ++texel)
+			{
+				const uint8_t* index = config.infill.index[texel];
+				const uint8_t* factor = config.infill.factor[texel];
+				texelWeights[texel] = uint8_t((unquantized[index[0]] * factor[0] + unquantized[index[1]] * factor[1]
+					+ unquantized[index[2]] * factor[2] + unquantized[index[3]] * factor[3] + 8) >> 4);
+			}
+		}
+
+		struct Candidate
+		{
+			uint32_t error = UINT32_MAX;
+			const Config* config = nullptr;
+			uint8_t colors[8] = {};
+			uint8_t weights[64] = {};
+			uint8_t texelWeights[64] = {};
+		};
+
+		/// <summary>Decodes the quantised endpoints and grid weights against the texels and keeps them in best when they do better.</summary>
+		inline void Score(const Texels& texels, const Config& config, const uint8_t colors[8], const uint8_t* weights, Candidate& best)
+		{
+			uint32_t values[8] = {};
+			const uint32_t valueCount = config.cem == 12 ? 8 : 6;
+			for (uint32_t i = 0; i < valueCount; ++i)
+			{
+				values[i] = UnquantizeColor(colors[i], config.colorBits);
+			}
+			uint32_t start[4];
+			uint32_t end[4];
+			DecodeEndpoints(config.cem, values, start, end);
+			uint8_t texelWeights[64];
+			InfillWeights(config, texels.count, weights, texelWeights);
+			uint32_t error = 0;
+			for (uint32_t texel = 0; texel < texels.count && error < best.error; ++texel)
+			{
+				for (uint32_t i = 0; i < 4; ++i)
+				{
+					const int32_t delta = int32_t(Interpolate(start[i], end[i], texelWeights[texel])) - int32_t(texels.c[i][texel]);
+					error += uint32_t(delta * delta);
+				}
+			}
+			if (error < best.error)
+			{
+				best.error = error;
+				best.config = &config;
+				std::memcpy(best.colors, colors, valueCount);
+				std::memcpy(best.weights, weights, config.gridX * config.gridY);
+				std::memcpy(best.texelWeights, texelWeights, texels.count);
+			}
+		}
+
+		/// <summary>Quantises the endpoints for the config, fits the grid weights to them and scores the result.</summary>
+		inline void Fit(const Texels& texels, const Config& config, const float start[4], const float end[4], Candidate& best)
+		{
+			const uint32_t channels = config.cem == 12 ? 4 : 3;
+			uint8_t colors[8] = {};
+			float low[4] = { 255.0f, 255.0f, 255.0f, 255.0f };
+			float high[4] = { 255.0f, 255.0f, 255.0f, 255.0f };
+			uint32_t lowSum = 0;
+			uint32_t highSum = 0;
+			for (uint32_t i = 0; i < channels; ++i)
+			{
+				colors[2 * i] = uint8_t(QuantizeColor(start[i], config.colorBits));
+				colors[2 * i + 1] = uint8_t(QuantizeColor(end[i], config.colorBits));
+				low[i] = float(UnquantizeColor(colors[2 * i], config.colorBits));
+				high[i] = float(UnquantizeColor(colors[2 * i + 1], config.colorBits));
+				lowSum += i < 3 ? uint32_t(low[i]) : 0;
+				highSum += i < 3 ? uint32_t(high[i]) : 0;
+			}
+			// keep the endpoints direct: a smaller second endpoint would make the decoder blue contract them
+			if (highSum < lowSum)
+			{
+				for (uint32_t i = 0; i < channels; ++i)
+				{
+					const uint8_t color = colors[2 * i];
+					colors[2 * i] = colors[2 * i + 1];
+					colors[2 * i + 1] = color;
+					const float value = low[i];
+					low[i] = high[i];
+					high[i] = value;
+				}
+			}
+
+			float ideal[64];
+			float direction[4] = {};
+			float length = 0.0f;
+			for (uint32_t i = 0; i < channels; ++i)
+			{
+				direction[i] = high[i] - low[i];
+				length += direction[i] * direction[i];
+			}
+			const float scale = length > 0.0f ? 1.0f / length : 0.0f;
+			for (uint32_t texel = 0; texel < texels.count; ++texel)
+			{
+				float projection = 0.0f;
+				for (uint32_t i = 0; i < channels; ++i)
+				{
+					projection += (texels.c[i][texel] - low[i]) * direction[i];
+				}
+				ideal[texel] = Clamp(projection * scale, 0.0f, 1.0f);
+			}
+
+			const uint32_t gridCount = config.gridX * config.gridY;
+			uint8_t weights[64];
+			if (gridCount == texels.count)
+			{
+				for (uint32_t texel = 0; texel < texels.count; ++texel)
+				{
+					weights[texel] = uint8_t(QuantizeWeight(ideal[texel], config.weightBits));
+				}
+			}
+			else
+			{
+				// average the ideal weights down through the infill factors, then take two steps
+				// towards the grid whose infill reproduces them
+				float grid[64] = {};
+				float total[64] = {};
+				for (uint32_t texel = 0; texel < texels.count; ++texel)
+				{
+					for (uint32_t i = 0; i < 4; ++i)
+					{
+						const float factor = config.infill.factor[texel][i];
+						grid[config.infill.index[texel][i]] += factor * ideal[texel];
+						total[config.infill.index[texel][i]] += factor;
+					}
+				}
+				for (uint32_t i = 0; i < gridCount; ++i)
+				{
+					grid[i] = total[i] > 0.0f ? grid[i] / total[i] : 0.0f;
+				}
+				for (uint32_t step = 0; step < 2; ++step)
+				{
+					float change[64] = {};
+					for (uint32_t texel = 0; texel < texels.count; ++texel)
+					{
+						const uint8_t* index = config.infill.index[texel];
+						const uint8_t* factor = config.infill.factor[texel];
+						const float infilled = (grid[index[0]] * factor[0] + grid[index[1]] * factor[1] + grid[index[2]] * factor[2] + grid[index[3]] * factor[3]) / 16.0f;
+						const float residual = ideal[texel] - infilled;
+						for (uint32_t i = 0; i < 4; ++i)
+						{
+							change[index[i]] += factor[i] * residual;
+						}
+					}
+					for (uint32_t i = 0; i < gridCount; ++i)
+					{
+						grid[i] += total[i] > 0.0f ? change[i] / total[i] : 0.0f;
+					}
+				}
+				for (uint32_t i = 0; i < gridCount; ++i)
+				{
+					weights[i] = uint8_t(QuantizeWeight(grid[i], config.weightBits));
+				}
+			}
+			Score(texels, config, colors, weights, best);
+		}
+
+		/// <summary>Constant colour block: the void extent with no extent, and the colour as UNORM16.</summary>
+		inline void WriteVoidExtent(const Texels& texels, uint8_t out[16])
+		{
+			uint64_t words[2] = { 0xfffffffffffffdfcull, 0 };
+			for (uint32_t i = 0; i < 4; ++i)
+			{
+				words[1] |= uint64_t(uint32_t(texels.c[i][0]) * 257) << (16 * i);
+			}
+			for (uint32_t i = 0; i < 16; ++i)
+			{
+				out[i] = uint8_t(words[i >> 3] >> ((i & 7) * 8));
+			}
+		}
+
+		/// <summary>Block mode, one partition, the endpoint mode and the endpoint values from bit 0 up;
+		/// the weights from bit 127 down, each value with its bits reversed.</summary>
+		inline void WriteBlock(const Candidate& candidate, uint8_t out[16])
+		{
+			const Config& config = *candidate.config;
+			uint64_t words[2] = {};
+			uint32_t position = 0;
+			auto put = [&words, &position](uint32_t value, uint32_t count)
+			{
+				for (uint32_t bit = 0; bit < count; ++bit, ++position)
+				{
+					words[position >> 6] |= uint64_t((value >> bit) & 1) << (position & 63);
+				}
+			};
+			put(config.mode, 11);
+			put(0, 2);
+			put(config.cem, 4);
+			for (uint32_t i = 0; i < (config.cem == 12 ? 8u : 6u); ++i)
+			{
+				put(candidate.colors[i], config.colorBits);
+			}
+			position = 0;
+			for (uint32_t i = 0; i < config.gridX * config.gridY; ++i)
+			{
+				for (uint32_t bit = 0; bit < config.weightBits; ++bit, ++position)
+				{
+					const uint32_t target = 127 - position;
+					words[target >> 6] |= uint64_t((candidate.weights[i] >> bit) & 1) << (target & 63);
+				}
+			}
+			for (uint32_t i = 0; i < 16; ++i)
+			{
+				out[i] = uint8_t(words[i >> 3] >> ((i & 7) * 8));
+			}
+		}
+	}
+
+	/// <summary>Decodes one block written by an encoder of this footprint to RGBA, row by row: void
+	/// extent blocks and blocks of one partition and one plane with CEM 8 or 12 on plain bit ranges.
+	/// Any other block returns false.</summary>
+	inline bool DecodeBlock(const uint8_t* block, uint32_t blockX, uint32_t blockY, uint8_t (*rgba)[4])
+	{
+		uint64_t words[2] = {};
+		for (uint32_t i = 0; i < 16; ++i)
+		{
+			words[i >> 3] |= uint64_t(block[i]) << ((i & 7) * 8);
+		}
+		const uint32_t texelCount = blockX * blockY;
+		if ((words[0] & 0x3ff) == 0x1fc)
+		{
+			for (uint32_t texel = 0; texel < texelCount; ++texel)
+			{
+				for (uint32_t i = 0; i < 4; ++i)
+				{
+					rgba[texel][i] = uint8_t(((words[1] >> (16 * i)) & 0xffff) >> 8);
+				}
+			}
+			return true;
+		}
+		detail::BlockMode mode;
+		if (!detail::DecodeBlockMode(uint32_t(words[0] & 0x7ff), mode) || mode.dualPlane || mode.gridX > blockX || mode.gridY > blockY
+			|| ((words[0] >> 11) & 3) != 0)
+		{
+			return false;
+		}
+		detail::Config config;
+		config.cem = uint32_t((words[0] >> 13) & 15);
+		const detail::Range& weightRange = detail::GetRange(mode.weightRange);
+		const uint32_t gridCount = mode.gridX * mode.gridY;
+		const uint32_t valueCount = config.cem == 12 ? 8 : 6;
+		const int32_t colorRange = detail::GetColorRange(valueCount, 111 - int32_t(detail::GetSequenceBits(mode.weightRange, gridCount)));
+		if ((config.cem != 8 && config.cem != 12) || weightRange.trits || weightRange.quints || colorRange < 0
+			|| detail::GetRange(uint32_t(colorRange)).trits || detail::GetRange(uint32_t(colorRange)).quints)
+		{
+			return false;
+		}
+		config.gridX = mode.gridX;
+		config.gridY = mode.gridY;
+		config.weightBits = weightRange.bits;
+		config.colorBits = detail::GetRange(uint32_t(colorRange)).bits;
+		detail::MakeInfill(blockX, blockY, config.gridX, config.gridY, config.infill);
+
+		uint32_t position = 17;
+		auto get = [&words, &position](uint32_t count)
+		{
+			uint32_t value = 0;
+			for (uint32_t bit = 0; bit < count; ++bit, ++position)
+			{
+				value |= uint32_t((words[position >> 6] >> (position & 63)) & 1) << bit;
+			}
+			return value;
+		};
+		uint32_t values[8] = {};
+		for (uint32_t i = 0; i < valueCount; ++i)
+		{
+			values[i] = detail::UnquantizeColor(get(config.colorBits), config.colorBits);
+		}
+		uint8_t weights[64];
+		position = 0;
+		for (uint32_t i = 0; i < gridCount; ++i)
+		{
+			uint32_t value = 0;
+			for (uint32_t bit = 0; bit < config.weightBits; ++bit, ++position)
+			{
+				const uint32_t source = 127 - position;
+				value |= uint32_t((words[source >> 6] >> (source & 63)) & 1) << bit;
+			}
+			weights[i] = uint8_t(value);
+		}
+		uint32_t start[4];
+		uint32_t end[4];
+		detail::DecodeEndpoints(config.cem, values, start, end);
+		uint8_t texelWeights[64];
+		detail::InfillWeights(config, texelCount, weights, texelWeights);
+		for (uint32_t texel = 0; texel < texelCount; ++texel)
+		{
+			for (uint32_t i = 0; i < 4; ++i)
+			{
+				rgba[texel][i] = uint8_t(detail::Interpolate(start[i], end[i], texelWeights[texel]));
+			}
+		}
+		return true;
+	}
+
+	class Encoder
+	{
+	public:
+		/// <summary>Finds the weight grids of the footprint; invalid when the footprint is not supported.</summary>
+		Encoder(uint32_t blockX, uint32_t blockY, Preset preset)
+			: blockX(blockX)
+			, blockY(blockY)
+			, preset(preset)
+		{
+			if (!IsSupportedFootprint(blockX, blockY))
+			{
+				return;
+			}
+			for (uint32_t cem : { 8u, 12u })
+			{
+				std::vector<detail::Config>& configs = cem == 8 ? opaque : translucent;
+				for (uint32_t mode = 0; mode < 2048; ++mode)
+				{
+					detail::BlockMode blockMode;
+					if (!detail::DecodeBlockMode(mode, blockMode) || blockMode.dualPlane || blockMode.gridX > blockX || blockMode.gridY > blockY)
+					{
+						continue;
+					}
+					const detail::Range& weightRange = detail::GetRange(blockMode.weightRange);
+					const uint32_t gridCount = blockMode.gridX * blockMode.gridY;
+					const int32_t colorRange = detail::GetColorRange(cem == 12 ? 8 : 6, 111 - int32_t(detail::GetSequenceBits(blockMode.weightRange, gridCount)));
+					if (weightRange.trits || weightRange.quints || colorRange < 0
+						|| detail::GetRange(uint32_t(colorRange)).trits || detail::GetRange(uint32_t(colorRange)).quints)
+					{
+						continue;
+					}
+					bool known = false;
+					for (const detail::Config& config : configs)
+					{
+						known |= config.gridX == blockMode.gridX && config.gridY == blockMode.gridY && config.weightBits == weightRange.bits;
+					}
+					if (known)
+					{
+						continue;
+					}
+					configs.emplace_back();
+					detail::Config& config = configs.back();
+					config.mode = mode;
+					config.gridX = blockMode.gridX;
+					config.gridY = blockMode.gridY;
+					config.weightBits = weightRange.bits;
+					config.colorBits = detail::GetRange(uint32_t(colorRange)).bits;
+					config.cem = cem;
+					detail::MakeInfill(blockX, blockY, config.gridX, config.gridY, config.infill);
+				}
+				std::stable_sort(configs.begin(), configs.end(), [blockX, blockY](const detail::Config& a, const detail::Config& b)
+				{
+					return detail::GetCost(a, blockX, blockY) < detail::GetCost(b, blockX, blockY);
+				});
+			}
+		}
+
+		bool IsValid() const
+		{
+			return !opaque.empty() && !translucent.empty();
+		}
+
+		uint32_t GetBlockX() const
+		{
+			return blockX;
+		}
+
+		uint32_t GetBlockY() const
+		{
+			return blockY;
+		}
+
+		/// <summary>Compresses block rows [firstRow, endRow) of a width x height BGRA8 surface into out,
+		/// which points at the first block of the surface. Blocks over the right and bottom edges repeat
+		/// the last column and row. With measure set the blocks are decoded again and the summed squared
+		/// error over the four channels of the covered pixels is returned.</summary>
+		uint64_t CompressRows(const uint8_t* bgra, size_t pitch, uint32_t width, uint32_t height, uint32_t firstRow, uint32_t endRow,
+			uint8_t* out, bool measure = false) const
+		{
+			const uint32_t columns = (width + blockX - 1) / blockX;
+			uint64_t error = 0;
+			detail::Texels texels;
+			for (uint32_t row = firstRow; row < endRow; ++row)
+			{
+				for (uint32_t column = 0; column < columns; ++column)
+				{
+					detail::LoadBlock(bgra, pitch, width, height, blockX, blockY, column, row, texels);
+					uint8_t* block = out + (size_t(row) * columns + column) * 16;
+					EncodeBlock(texels, block);
+					if (!measure)
+					{
+						continue;
+					}
+					uint8_t decoded[64][4];
+					DecodeBlock(block, blockX, blockY, decoded);
+					for (uint32_t texel = 0; texel < texels.count; ++texel)
+					{
+						if (column * blockX + texel % blockX >= width || row * blockY + texel / blockX >= height)
+						{
+							continue;
+						}
+						for (uint32_t i = 0; i < 4; ++i)
+						{
+							const int32_t delta = int32_t(decoded[texel][i]) - int32_t(texels.c[i][texel]);
+							error += uint64_t(delta * delta);
+						}
+					}
+				}
+			}
+			return error;
+		}
+
+	private:
+		void EncodeBlock(const detail::Texels& texels, uint8_t out[16]) const
+		{
+			bool solid = true;
+			bool opaqueBlock = true;
+			for (uint32_t texel = 0; texel < texels.count; ++texel)
+			{
+				for (uint32_t i = 0; i < 4; ++i)
+				{
+					solid &= texels.c[i][texel] == texels.c[i][0];
+				}
+				opaqueBlock &= texels.c[3][texel] == 255.0f;
+			}
+			if (solid)
+			{
+				detail::WriteVoidExtent(texels, out);
+				return;
+			}
+			const std::vector<detail::Config>& configs = opaqueBlock ? opaque : translucent;
+			const uint32_t channels = opaqueBlock ? 3 : 4;
+			float start[4];
+			float end[4];
+			detail::AxisEndpoints(texels, channels, start, end);
+
+			const size_t tries = preset == Preset::Fast ? 1 : (preset == Preset::Medium ? 4 : 16);
+			const uint32_t refinements = preset == Preset::Fast ? 0 : (preset == Preset::Medium ? 1 : 2);
+			detail::Candidate best;
+			for (size_t i = 0; i < tries && i < configs.size(); ++i)
+			{
+				detail::Candidate fit;
+				detail::Fit(texels, configs[i], start, end, fit);
+				for (uint32_t refinement = 0; refinement < refinements; ++refinement)
+				{
+					float refinedStart[4] = { 255.0f, 255.0f, 255.0f, 255.0f };
+					float refinedEnd[4] = { 255.0f, 255.0f, 255.0f, 255.0f };
+					const uint32_t before = fit.error;
+					if (!detail::LeastSquares(texels, channels, fit.texelWeights, refinedStart, refinedEnd))
+					{
+						break;
+					}
+					detail::Fit(texels, configs[i], refinedStart, refinedEnd, fit);
+					if (!(fit.error < before))
+					{
+						break;
+					}
+				}
+				if (fit.error < best.error)
+				{
+					best = fit;
+				}
+			}
+			detail::WriteBlock(best, out);
+		}
+
+		uint32_t blockX;
+		uint32_t blockY;
+		Preset preset;
+		std::vector<detail::Config> opaque;
+		std::vector<detail::Config> translucent;
+	};
+}
@@ -0,0 +1,319 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#	define RGBM_X86 1
+#	include <immintrin.h>
+#	if defined(_MSC_VER)
+#		include <intrin.h>
+#	else
+#		include <cpuid.h>
+#	endif
+#else
+#	define RGBM_X86 0
+#endif
+
+#if RGBM_X86 && (defined(__GNUC__) || defined(__clang__))
+#	define RGBM_TARGET(features) __attribute__((target(features)))
+#else
+#	define RGBM_TARGET(features)
+#endif
+
+// Batch version of the engine's RGBMEncode for reflection captures: FP16 RGBA
+// texels in, FColor (B, G, R, A bytes) out. Every path gives the same bytes
+// as the scalar one, which follows RGBMEncode operation by operation: half to
+// float like FFloat16 (denormals to zero, infinity and NaN to finite values),
+// float square roots and divisions, the tonemap curve in double, ceil for
+// alpha and floor(x + 0.5) for colour. The vector paths convert halves with
+// F16C and run 4 texels per step with SSE4.1 or 8 with AVX2; the widest one
+// the CPU supports is picked once. Depends only on the C++ standard library.
+namespace rgbm {
+	namespace detail {
+		/// <summary>Truncation like cvttss2si: NaN and out of range values give INT32_MIN.</summary>
+		inline int32_t TruncateToInt(float value)
+		{
+			return (value >= -2147483648.0f && value < 2147483648.0f) ? int32_t(value) : INT32_MIN;
+		}
+
+		/// <summary>Same result as FFloat16::GetFloat.</summary>
+		inline float HalfToFloat(uint16_t half)
+		{
+			const uint32_t sign = uint32_t(half >> 15) << 31;
+			const uint32_t exponent = (half >> 10) & 0x1f;
+			const uint32_t mantissa = half & 0x3ff;
+			uint32_t bits = sign;
+			if (exponent == 31)
+			{
+				bits |= (142u << 23) | (mantissa << 13);
+			}
+			else if (exponent != 0)
+			{
+				bits |= ((exponent + 112) << 23) | (mantissa << 13);
+			}
+			float value;
+			std::memcpy(&value, &bits, sizeof(value));
+			return value;
+		}
+	}
+
+	/// <summary>Encodes one linear colour; out receives B, G, R, A.</summary>
+	inline void EncodeTexel(float r, float g, float b, uint8_t* out)
+	{
+		r = std::sqrt(r) / 16.0f;
+		g = std::sqrt(g) / 16.0f;
+		b = std::sqrt(b) / 16.0f;
+
+		// FMath::Max(A, B) is A >= B ? A : B, which keeps NaN operands in the same places as maxps.
+		const float rg = r >= g ? r : g;
+		const float bd = b >= 0.00001f ? b : 0.00001f;
+		float maxValue = rg >= bd ? rg : bd;
+		if (maxValue > 0.75f)
+		{
+			const float tonemapped = float((maxValue - 0.75 * 0.75) / (maxValue - 0.5));
+			const float scale = tonemapped / maxValue;
+			r *= scale;
+			g *= scale;
+			b *= scale;
+			maxValue = tonemapped;
+		}
+
+		const int32_t alpha = detail::TruncateToInt(std::ceil(maxValue * 255.0f));
+		const uint8_t a = uint8_t(alpha < 255 ? alpha : 255);
+		out[0] = uint8_t(detail::TruncateToInt(std::floor((b * 255.0f / a) * 255.0f + 0.5f)));
+		out[1] = uint8_t(detail::TruncateToInt(std::floor((g * 255.0f / a) * 255.0f + 0.5f)));
+		out[2] = uint8_t(detail::TruncateToInt(std::floor((r * 255.0f / a) * 255.0f + 0.5f)));
+		out[3] = a;
+	}
+
+	/// <summary>Scalar path for count texels of 4 halves each.</summary>
+	inline void EncodeSpanScalar(const uint16_t* halves, uint8_t* out, size_t count)
+	{
+		for (size_t i = 0; i < count; ++i, halves += 4, out += 4)
+		{
+			EncodeTexel(detail::HalfToFloat(halves[0]), detail::HalfToFloat(halves[1]), detail::HalfToFloat(halves[2]), out);
+		}
+	}
+
+#if RGBM_X86
+	namespace detail {
+		/// <summary>Rewrites halves F16C would not convert like FFloat16: denormals to signed zero, exponent 31 to exponent 30.</summary>
+		RGBM_TARGET("sse4.1")
+		inline __m128i SanitizeHalves(__m128i halves)
+		{
+			const __m128i exponentMask = _mm_set1_epi16(0x7c00);
+			const __m128i exponent = _mm_and_si128(halves, exponentMask);
+			const __m128i isZero = _mm_cmpeq_epi16(exponent, _mm_setzero_si128());
+			const __m128i isSpecial = _mm_cmpeq_epi16(exponent, exponentMask);
+			halves = _mm_andnot_si128(_mm_and_si128(isZero, _mm_set1_epi16(0x7fff)), halves);
+			return _mm_xor_si128(halves, _mm_and_si128(isSpecial, _mm_set1_epi16(0x0400)));
+		}
+
+		/// <summary>Packs the low byte of each lane into B, G, R, A texels, like assigning an int32 to a uint8.</summary>
+		RGBM_TARGET("sse4.1")
+		inline __m128i PackTexels(__m128i b, __m128i g, __m128i r, __m128i a)
+		{
+			const __m128i byteMask = _mm_set1_epi32(0xff);
+			__m128i texels = _mm_and_si128(b, byteMask);
+			texels = _mm_or_si128(texels, _mm_slli_epi32(_mm_and_si128(g, byteMask), 8));
+			texels = _mm_or_si128(texels, _mm_slli_epi32(_mm_and_si128(r, byteMask), 16));
+			return _mm_or_si128(texels, _mm_slli_epi32(a, 24));
+		}
+
+		RGBM_TARGET("sse4.1")
+		inline __m128 Tonemap(__m128 maxValue)
+		{
+			const __m128d low = _mm_cvtps_pd(maxValue);
+			const __m128d high = _mm_cvtps_pd(_mm_movehl_ps(maxValue, maxValue));
+			const __m128d knee = _mm_set1_pd(0.75 * 0.75);
+			const __m128d half = _mm_set1_pd(0.5);
+			const __m128 tonemappedLow = _mm_cvtpd_ps(_mm_div_pd(_mm_sub_pd(low, knee), _mm_sub_pd(low, half)));
+			const __m128 tonemappedHigh = _mm_cvtpd_ps(_mm_div_pd(_mm_sub_pd(high, knee), _mm_sub_pd(high, half)));
+			return _mm_movelh_ps(tonemappedLow, tonemappedHigh);
+		}
+	}
+
+	/// <summary>F16C and SSE4.1 path, 4 texels per step.</summary>
+	RGBM_TARGET("sse4.1,f16c")
+	inline void EncodeSpanSSE4(const uint16_t* halves, uint8_t* out, size_t count)
+	{
+		const __m128 sixteenth = _mm_set1_ps(1.0f / 16.0f);
+		const __m128 delta = _mm_set1_ps(0.00001f);
+		const __m128 threshold = _mm_set1_ps(0.75f);
+		const __m128 scale255 = _mm_set1_ps(255.0f);
+		const __m128 roundingHalf = _mm_set1_ps(0.5f);
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4, halves += 16, out += 16)
+		{
+			const __m128i halves01 = detail::SanitizeHalves(_mm_loadu_si128(reinterpret_cast<const __m128i*>(halves)));
+			const __m128i halves23 = detail::SanitizeHalves(_mm_loadu_si128(reinterpret_cast<const __m128i*>(halves + 8)));
+			// One texel per register until the transpose turns them into channels.
+			__m128 r = _mm_cvtph_ps(halves01);
+			__m128 g = _mm_cvtph_ps(_mm_unpackhi_epi64(halves01, halves01));
+			__m128 b = _mm_cvtph_ps(halves23);
+			__m128 a = _mm_cvtph_ps(_mm_unpackhi_epi64(halves23, halves23));
+			_MM_TRANSPOSE4_PS(r, g, b, a);
+
+			// Multiplying by 1/16 is exact, as dividing by 16 is.
+			r = _mm_mul_ps(_mm_sqrt_ps(r), sixteenth);
+			g = _mm_mul_ps(_mm_sqrt_ps(g), sixteenth);
+			b = _mm_mul_ps(_mm_sqrt_ps(b), sixteenth);
+
+			// maxps(x, y) is x > y ? x : y; it differs from FMath::Max only for
+			// equal operands, which cannot change the result.
+			__m128 maxValue = _mm_max_ps(_mm_max_ps(r, g), _mm_max_ps(b, delta));
+			const __m128 isBright = _mm_cmpgt_ps(maxValue, threshold);
+			const __m128 tonemapped = detail::Tonemap(maxValue);
+			const __m128 scale = _mm_div_ps(tonemapped, maxValue);
+			r = _mm_blendv_ps(r, _mm_mul_ps(r, scale), isBright);
+			g = _mm_blendv_ps(g, _mm_mul_ps(g, scale), isBright);
+			b = _mm_blendv_ps(b, _mm_mul_ps(b, scale), isBright);
+			maxValue = _mm_blendv_ps(maxValue, tonemapped, isBright);
+
+			const __m128i alpha = _mm_min_epi32(_mm_cvttps_epi32(_mm_ceil_ps(_mm_mul_ps(maxValue, scale255))), _mm_set1_epi32(255));
+			const __m128 alphaFloat = _mm_cvtepi32_ps(alpha);
+			const __m128i rByte = _mm_cvttps_epi32(_mm_floor_ps(_mm_add_ps(_mm_mul_ps(_mm_div_ps(_mm_mul_ps(r, scale255), alphaFloat), scale255), roundingHalf)));
+			const __m128i gByte = _mm_cvttps_epi32(_mm_floor_ps(_mm_add_ps(_mm_mul_ps(_mm_div_ps(_mm_mul_ps(g, scale255), alphaFloat), scale255), roundingHalf)));
+			const __m128i bByte = _mm_cvttps_epi32(_mm_floor_ps(_mm_add_ps(_mm_mul_ps(_mm_div_ps(_mm_mul_ps(b, scale255), alphaFloat), scale255), roundingHalf)));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out), detail::PackTexels(bByte, gByte, rByte, alpha));
+		}
+		EncodeSpanScalar(halves, out, count - i);
+	}
+
+	/// <summary>F16C and AVX2 path, 8 texels per step.</summary>
+	RGBM_TARGET("avx2,f16c")
+	inline void EncodeSpanAVX2(const uint16_t* halves, uint8_t* out, size_t count)
+	{
+		const __m256 sixteenth = _mm256_set1_ps(1.0f / 16.0f);
+		const __m256 delta = _mm256_set1_ps(0.00001f);
+		const __m256 threshold = _mm256_set1_ps(0.75f);
+		const __m256 scale255 = _mm256_set1_ps(255.0f);
+		const __m256 roundingHalf = _mm256_set1_ps(0.5f);
+		const __m256d knee = _mm256_set1_pd(0.75 * 0.75);
+		const __m256d half = _mm256_set1_pd(0.5);
+		const __m256i byteMask = _mm256_set1_epi32(0xff);
+		// The in-lane transpose leaves texels in the order 0 2 4 6 1 3 5 7.
+		const __m256i texelOrder = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8, halves += 32, out += 32)
+		{
+			// Each register holds texels 2k and 2k + 1, one per 128 bit lane.
+			__m256 t0 = _mm256_cvtph_ps(detail::SanitizeHalves(_mm_loadu_si128(reinterpret_cast<const __m128i*>(halves))));
+			__m256 t1 = _mm256_cvtph_ps(detail::SanitizeHalves(_mm_loadu_si128(reinterpret_cast<const __m128i*>(halves + 8))));
+			__m256 t2 = _mm256_cvtph_ps(detail::SanitizeHalves(_mm_loadu_si128(reinterpret_cast<const __m128i*>(halves + 16))));
+			__m256 t3 = _mm256_cvtph_ps(detail::SanitizeHalves(_mm_loadu_si128(reinterpret_cast<const __m128i*>(halves + 24))));
+			const __m256 rg01 = _mm256_unpacklo_ps(t0, t1);
+			const __m256 ba01 = _mm256_unpackhi_ps(t0, t1);
+			const __m256 rg23 = _mm256_unpacklo_ps(t2, t3);
+			const __m256 ba23 = _mm256_unpackhi_ps(t2, t3);
+			__m256 r = _mm256_castpd_ps(_mm256_unpacklo_pd(_mm256_castps_pd(rg01), _mm256_castps_pd(rg23)));
+			__m256 g = _mm256_castpd_ps(_mm256_unpackhi_pd(_mm256_castps_pd(rg01), _mm256_castps_pd(rg23)));
+			__m256 b = _mm256_castpd_ps(_mm256_unpacklo_pd(_mm256_castps_pd(ba01), _mm256_castps_pd(ba23)));
+
+			r = _mm256_mul_ps(_mm256_sqrt_ps(r), sixteenth);
+			g = _mm256_mul_ps(_mm256_sqrt_ps(g), sixteenth);
+			b = _mm256_mul_ps(_mm256_sqrt_ps(b), sixteenth);
+
+			__m256 maxValue = _mm256_max_ps(_mm256_max_ps(r, g), _mm256_max_ps(b, delta));
+			const __m256 isBright = _mm256_cmp_ps(maxValue, threshold, _CMP_GT_OQ);
+			const __m256d low = _mm256_cvtps_pd(_mm256_castps256_ps128(maxValue));
+			const __m256d high = _mm256_cvtps_pd(_mm256_extractf128_ps(maxValue, 1));
+			const __m256 tonemapped = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm256_cvtpd_ps(_mm256_div_pd(_mm256_sub_pd(low, knee), _mm256_sub_pd(low, half)))),
+				_mm256_cvtpd_ps(_mm256_div_pd(_mm256_sub_pd(high, knee), _mm256_sub_pd(high, half))), 1);
+			const __m256 scale = _mm256_div_ps(tonemapped, maxValue);
+			r = _mm256_blendv_ps(r, _mm256_mul_ps(r, scale), isBright);
+			g = _mm256_blendv_ps(g, _mm256_mul_ps(g, scale), isBright);
+			b = _mm256_blendv_ps(b, _mm256_mul_ps(b, scale), isBright);
+			maxValue = _mm256_blendv_ps(maxValue, tonemapped, isBright);
+
+			const __m256i alpha = _mm256_min_epi32(_mm256_cvttps_epi32(_mm256_ceil_ps(_mm256_mul_ps(maxValue, scale255))), _mm256_set1_epi32(255));
+			const __m256 alphaFloat = _mm256_cvtepi32_ps(alpha);
+			const __m256i rByte = _mm256_cvttps_epi32(_mm256_floor_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_div_ps(_mm256_mul_ps(r, scale255), alphaFloat), scale255), roundingHalf)));
+			const __m256i gByte = _mm256_cvttps_epi32(_mm256_floor_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_div_ps(_mm256_mul_ps(g, scale255), alphaFloat), scale255), roundingHalf)));
+			const __m256i bByte = _mm256_cvttps_epi32(_mm256_floor_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_div_ps(_mm256_mul_ps(b, scale255), alphaFloat), scale255), roundingHalf)));
+			__m256i texels = _mm256_and_si256(bByte, byteMask);
+			texels = _mm256_or_si256(texels, _mm256_slli_epi32(_mm256_and_si256(gByte, byteMask), 8));
+			texels = _mm256_or_si256(texels, _mm256_slli_epi32(_mm256_and_si256(rByte, byteMask), 16));
+			texels = _mm256_or_si256(texels, _mm256_slli_epi32(alpha, 24));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(out), _mm256_permutevar8x32_epi32(texels, texelOrder));
+		}
+		EncodeSpanSSE4(halves, out, count - i);
+	}
+#endif
+
+	enum class Path
+	{
+		Scalar,
+		SSE4,
+		AVX2,
+	};
+
+	/// <summary>Widest path this CPU and OS support, checked once.</summary>
+	inline Path GetBestPath()
+	{
+#if RGBM_X86
+		static const Path best = []()
+		{
+			uint32_t regs[4] = {};
+			uint32_t regs7[4] = {};
+#if defined(_MSC_VER)
+			int info[4];
+			__cpuid(info, 1);
+			std::memcpy(regs, info, sizeof(regs));
+			__cpuidex(info, 7, 0);
+			std::memcpy(regs7, info, sizeof(regs7));
+#else
+			__get_cpuid(1, &regs[0], &regs[1], &regs[2], &regs[3]);
+			__get_cpuid_count(7, 0, &regs7[0], &regs7[1], &regs7[2], &regs7[3]);
+#endif
+			const bool sse41 = (regs[2] & (1u << 19)) != 0;
+			const bool f16c = (regs[2] & (1u << 29)) != 0;
+			const bool osxsave = (regs[2] & (1u << 27)) != 0;
+			const bool avx = (regs[2] & (1u << 28)) != 0;
+			bool ymmState = false;
+			if (osxsave)
+			{
+#if defined(_MSC_VER)
+				ymmState = (_xgetbv(0) & 6) == 6;
+#else
+				uint32_t eax, edx;
+				__asm__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+				ymmState = (eax & 6) == 6;
+#endif
+			}
+			// F16C instructions use the VEX encoding, so both vector paths need the OS to save YMM state.
+			if (!(sse41 && f16c && avx && ymmState))
+			{
+				return Path::Scalar;
+			}
+			const bool avx2 = (regs7[1] & (1u << 5)) != 0;
+			return avx2 ? Path::AVX2 : Path::SSE4;
+		}();
+		return best;
+#else
+		return Path::Scalar;
+#endif
+	}
+
+	/// <summary>Encodes count texels of 4 halves (R, G, B, A; A is ignored) into B, G, R, A bytes.</summary>
+	inline void EncodeSpan(const uint16_t* halves, uint8_t* out, size_t count, Path path = GetBestPath())
+	{
+		switch (path)
+		{
+#if RGBM_X86
+		case Path::AVX2:
+			EncodeSpanAVX2(halves, out, count);
+			return;
+		case Path::SSE4:
+			EncodeSpanSSE4(halves, out, count);
+			return;
+#endif
+		default:
+			EncodeSpanScalar(halves, out, count);
+			return;
+		}
+	}
+}
@@ -0,0 +1,202 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+#include "check.h"
+#include "astc_reference.h"
+#include "block_compress_reference.h"
+#include "AstcEncode.h"
+#include "BlockCompress.h"
+
+namespace {
+	const uint32_t Footprints[8][2] = { { 4, 4 }, { 5, 4 }, { 5, 5 }, { 6, 5 }, { 6, 6 }, { 8, 5 }, { 8, 6 }, { 8, 8 } };
+	const char* const PresetNames[] = { "Fast", "Medium", "Thorough" };
+
+	// Lowest PSNR in dB each footprint and preset may give on the probe image
+	// with its alpha; a few tenths under what the encoder reaches today.
+	const double MinPSNR[8][3] = {
+		{ 39.2, 39.4, 39.5 },
+		{ 38.7, 38.9, 39.0 },
+		{ 37.9, 38.1, 38.2 },
+		{ 37.5, 37.6, 37.7 },
+		{ 36.8, 37.0, 37.0 },
+		{ 37.0, 37.1, 37.2 },
+		{ 36.2, 36.3, 36.4 },
+		{ 34.2, 35.0, 35.1 },
+	};
+
+	// Every 2D block mode reads the same as from the layout table of the specification.
+	void TestBlockModes()
+	{
+		for (uint32_t mode = 0; mode < 2048; ++mode)
+		{
+			astc::detail::BlockMode decoded;
+			uint32_t gridX = 0;
+			uint32_t gridY = 0;
+			uint32_t weightRange = 0;
+			bool dualPlane = false;
+			const bool valid = test::DecodeAstcModeReference(mode, gridX, gridY, weightRange, dualPlane);
+			CHECK(astc::detail::DecodeBlockMode(mode, decoded) == valid);
+			if (valid)
+			{
+				CHECK(decoded.gridX == gridX && decoded.gridY == gridY && decoded.weightRange == weightRange && decoded.dualPlane == dualPlane);
+			}
+		}
+	}
+
+	// Squared error of a compressed surface against its source, decoded with the reference decoder.
+	uint64_t MeasureError(uint32_t blockX, uint32_t blockY, const std::vector<uint8_t>& bgra, uint32_t width, uint32_t height, const std::vector<uint8_t>& blocks)
+	{
+		const uint32_t columns = (width + blockX - 1) / blockX;
+		uint64_t error = 0;
+		for (uint32_t y = 0; y < height; ++y)
+		{
+			for (uint32_t x = 0; x < width; ++x)
+			{
+				uint8_t rgba[64][4];
+				CHECK(test::DecodeAstcReference(&blocks[(size_t(y / blockY) * columns + x / blockX) * 16], blockX, blockY, rgba));
+				const uint8_t* decoded = rgba[(y % blockY) * blockX + x % blockX];
+				const uint8_t* source = &bgra[(size_t(y) * width + x) * 4];
+				const int deltas[4] = { decoded[0] - source[2], decoded[1] - source[1], decoded[2] - source[0], decoded[3] - source[3] };
+				for (int delta : deltas)
+				{
+					error += uint64_t(delta * delta);
+				}
+			}
+		}
+		return error;
+	}
+
+	// Quality against the reference decoder, the error CompressRows reports,
+	// and the same blocks when the rows are split between two calls as the
+	// exporter splits them between workers.
+	double TestImage(const astc::Encoder& encoder, const std::vector<uint8_t>& bgra, uint32_t width, uint32_t height)
+	{
+		const uint32_t blockX = encoder.GetBlockX();
+		const uint32_t blockY = encoder.GetBlockY();
+		const size_t size = astc::GetSurfaceSize(blockX, blockY, width, height);
+		const uint32_t rows = astc::GetBlockRows(height, blockY);
+		std::vector<uint8_t> blocks(size + 16, 0xcd);
+		const uint64_t reported = encoder.CompressRows(bgra.data(), width * 4, width, height, 0, rows, blocks.data(), true);
+		for (size_t i = size; i < blocks.size(); ++i)
+		{
+			CHECK(blocks[i] == 0xcd);
+		}
+		blocks.resize(size);
+
+		const uint64_t error = MeasureError(blockX, blockY, bgra, width, height, blocks);
+		CHECK(reported == error);
+
+		std::vector<uint8_t> split(size);
+		encoder.CompressRows(bgra.data(), width * 4, width, height, 0, rows / 2, split.data());
+		encoder.CompressRows(bgra.data(), width * 4, width, height, rows / 2, rows, split.data());
+		CHECK(split == blocks);
+		return bc::GetPSNR(error, uint64_t(width) * height * 4);
+	}
+
+	// Blocks over the right and bottom edges repeat the last column and row,
+	// so they match the blocks of the same image padded that way.
+	void TestEdges(const astc::Encoder& encoder, const std::vector<uint8_t>& bgra, uint32_t width, uint32_t height)
+	{
+		const uint32_t blockX = encoder.GetBlockX();
+		const uint32_t blockY = encoder.GetBlockY();
+		const uint32_t paddedWidth = (width + blockX - 1) / blockX * blockX;
+		const uint32_t paddedHeight = (height + blockY - 1) / blockY * blockY;
+		std::vector<uint8_t> padded(size_t(paddedWidth) * paddedHeight * 4);
+		for (uint32_t y = 0; y < paddedHeight; ++y)
+		{
+			for (uint32_t x = 0; x < paddedWidth; ++x)
+			{
+				const uint32_t sourceX = std::min(x, width - 1);
+				const uint32_t sourceY = std::min(y, height - 1);
+				std::memcpy(&padded[(size_t(y) * paddedWidth + x) * 4], &bgra[(size_t(sourceY) * width + sourceX) * 4], 4);
+			}
+		}
+		std::vector<uint8_t> blocks(astc::GetSurfaceSize(blockX, blockY, width, height));
+		std::vector<uint8_t> paddedBlocks(astc::GetSurfaceSize(blockX, blockY, paddedWidth, paddedHeight));
+		CHECK(blocks.size() == paddedBlocks.size());
+		encoder.CompressRows(bgra.data(), width * 4, width, height, 0, astc::GetBlockRows(height, blockY), blocks.data());
+		encoder.CompressRows(padded.data(), paddedWidth * 4, paddedWidth, paddedHeight, 0, astc::GetBlockRows(paddedHeight, blockY), paddedBlocks.data());
+		CHECK(blocks == paddedBlocks);
+	}
+
+	// A block of one colour is a void extent block and decodes exactly.
+	void TestSolid(const astc::Encoder& encoder)
+	{
+		const uint32_t blockX = encoder.GetBlockX();
+		const uint32_t blockY = encoder.GetBlockY();
+		std::mt19937 random(2);
+		for (int i = 0; i < 500; ++i)
+		{
+			const uint32_t bgra = uint32_t(random()) | (i % 2 ? 0xff000000u : 0);
+			std::vector<uint8_t> pixels(blockX * blockY * 4);
+			for (uint32_t texel = 0; texel < blockX * blockY; ++texel)
+			{
+				std::memcpy(&pixels[texel * 4], &bgra, 4);
+			}
+			uint8_t block[16];
+			encoder.CompressRows(pixels.data(), blockX * 4, blockX, blockY, 0, 1, block);
+			uint8_t rgba[64][4];
+			CHECK(test::DecodeAstcReference(block, blockX, blockY, rgba));
+			for (uint32_t texel = 0; texel < blockX * blockY; ++texel)
+			{
+				CHECK(rgba[texel][0] == pixels[2] && rgba[texel][1] == pixels[1] && rgba[texel][2] == pixels[0] && rgba[texel][3] == pixels[3]);
+			}
+		}
+	}
+
+	// Opaque blocks keep an alpha of exactly 255.
+	void TestOpaque(const astc::Encoder& encoder, std::vector<uint8_t> bgra, uint32_t width, uint32_t height)
+	{
+		for (size_t i = 3; i < bgra.size(); i += 4)
+		{
+			bgra[i] = 255;
+		}
+		const uint32_t blockX = encoder.GetBlockX();
+		const uint32_t blockY = encoder.GetBlockY();
+		std::vector<uint8_t> blocks(astc::GetSurfaceSize(blockX, blockY, width, height));
+		encoder.CompressRows(bgra.data(), width * 4, width, height, 0, astc::GetBlockRows(height, blockY), blocks.data());
+		for (size_t i = 0; i < blocks.size(); i += 16)
+		{
+			uint8_t rgba[64][4];
+			CHECK(test::DecodeAstcReference(&blocks[i], blockX, blockY, rgba));
+			for (uint32_t texel = 0; texel < blockX * blockY; ++texel)
+			{
+				CHECK(rgba[texel][3] == 255);
+			}
+		}
+	}
+}
+
+int main()
+{
+	TestBlockModes();
+	uint32_t blockX = 0;
+	uint32_t blockY = 0;
+	CHECK(astc::ParseFootprint("6x6", blockX, blockY) && blockX == 6 && blockY == 6);
+	CHECK(!astc::ParseFootprint("7x7", blockX, blockY) && !astc::ParseFootprint("10x10", blockX, blockY) && !astc::ParseFootprint("", blockX, blockY));
+	CHECK(!astc::Encoder(7, 7, astc::Preset::Fast).IsValid());
+
+	const std::vector<uint8_t> probe = test::MakeProbeImage(128, 128, 1);
+	const std::vector<uint8_t> small = test::MakeProbeImage(13, 7, 2);
+	for (uint32_t footprint = 0; footprint < 8; ++footprint)
+	{
+		for (astc::Preset preset : { astc::Preset::Fast, astc::Preset::Medium, astc::Preset::Thorough })
+		{
+			const astc::Encoder encoder(Footprints[footprint][0], Footprints[footprint][1], preset);
+			CHECK(encoder.IsValid());
+			const double psnr = TestImage(encoder, probe, 128, 128);
+			std::printf("%ux%u %-8s: %.2f dB\n", encoder.GetBlockX(), encoder.GetBlockY(), PresetNames[int(preset)], psnr);
+			CHECK(psnr >= MinPSNR[footprint][int(preset)]);
+			TestImage(encoder, small, 13, 7);
+			TestImage(encoder, small, 1, 1);
+			TestEdges(encoder, small, 13, 7);
+			TestEdges(encoder, small, 2, 3);
+			TestSolid(encoder);
+			TestOpaque(encoder, probe, 128, 128);
+		}
+	}
+	std::printf("astc_encode_test passed\n");
+	return 0;
+}
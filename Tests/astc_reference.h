@@ -0,0 +1,275 @@
+#pragma once
+
+#include <cstdint>
+
+// ASTC decoding written from the format description rather than from
+// AstcEncode.h: block modes follow the 2D layout table of the specification,
+// bits are read one at a time, and the weight infill is worked out texel by
+// texel. It covers what an LDR single partition encoder may write with plain
+// bit ranges (void extent blocks, CEM 8 and 12); blocks that need trits,
+// quints, more partitions or a second plane are refused.
+namespace test {
+	inline uint32_t ReadAstcBit(const uint8_t* block, uint32_t bit)
+	{
+		return (block[bit / 8] >> (bit % 8)) & 1;
+	}
+
+	/// <summary>Grid size, weight range (0 to 11 for 2 to 32 levels) and plane count of a 2D block mode.</summary>
+	inline bool DecodeAstcModeReference(uint32_t mode, uint32_t& gridX, uint32_t& gridY, uint32_t& weightRange, bool& dualPlane)
+	{
+		auto bits = [mode](uint32_t high, uint32_t low) { return (mode >> low) & ((2u << (high - low)) - 1); };
+		uint32_t precision = bits(9, 9);
+		dualPlane = bits(10, 10) != 0;
+		uint32_t r;
+		if (bits(1, 0) != 0)
+		{
+			// R2 R1 in bits 1:0, R0 in bit 4
+			r = (bits(1, 0) << 1) | bits(4, 4);
+			const uint32_t a = bits(6, 5);
+			switch (bits(3, 2))
+			{
+			case 0: gridX = bits(8, 7) + 4; gridY = a + 2; break;
+			case 1: gridX = bits(8, 7) + 8; gridY = a + 2; break;
+			case 2: gridX = a + 2; gridY = bits(8, 7) + 8; break;
+			default:
+				if (bits(8, 8) == 0)
+				{
+					gridX = a + 2;
+					gridY = bits(7, 7) + 6;
+				}
+				else
+				{
+					gridX = bits(7, 7) + 2;
+					gridY = a + 2;
+				}
+				break;
+			}
+		}
+		else
+		{
+			// R2 R1 in bits 3:2, R0 in bit 4; 0000 in bits 3:0 is reserved
+			r = (bits(3, 2) << 1) | bits(4, 4);
+			if (bits(3, 2) == 0)
+			{
+				return false;
+			}
+			const uint32_t a = bits(6, 5);
+			switch (bits(8, 7))
+			{
+			case 0: gridX = 12; gridY = a + 2; break;
+			case 1: gridX = a + 2; gridY = 12; break;
+			case 2:
+				gridX = a + 6;
+				gridY = bits(10, 9) + 6;
+				precision = 0;
+				dualPlane = false;
+				break;
+			default:
+				if (a == 0)
+				{
+					gridX = 6;
+					gridY = 10;
+				}
+				else if (a == 1)
+				{
+					gridX = 10;
+					gridY = 6;
+				}
+				else
+				{
+					return false;
+				}
+				break;
+			}
+		}
+		if (r < 2)
+		{
+			return false;
+		}
+		weightRange = precision * 6 + r - 2;
+		static const uint32_t WeightLevels[12] = { 2, 3, 4, 5, 6, 8, 10, 12, 16, 20, 24, 32 };
+		const uint32_t weights = gridX * gridY * (dualPlane ? 2 : 1);
+		const uint32_t levels = WeightLevels[weightRange];
+		// a trit packs five values into 8 bits and a quint three into 7, next to the plain bits
+		const uint32_t plain = levels % 3 == 0 ? levels / 3 : (levels % 5 == 0 ? levels / 5 : levels);
+		uint32_t log = 0;
+		while ((1u << log) < plain)
+		{
+			++log;
+		}
+		const uint32_t weightBits = weights * log + (levels % 3 == 0 ? (weights * 8 + 4) / 5 : 0) + (levels % 5 == 0 ? (weights * 7 + 2) / 3 : 0);
+		return weights <= 64 && weightBits >= 24 && weightBits <= 96;
+	}
+
+	/// <summary>RGBA of the blockX x blockY texels, row by row.</summary>
+	inline bool DecodeAstcReference(const uint8_t* block, uint32_t blockX, uint32_t blockY, uint8_t (*rgba)[4])
+	{
+		auto read = [block](uint32_t first, uint32_t count)
+		{
+			uint32_t value = 0;
+			for (uint32_t i = 0; i < count; ++i)
+			{
+				value |= ReadAstcBit(block, first + i) << i;
+			}
+			return value;
+		};
+		if (read(0, 9) == 0x1fc)
+		{
+			// void extent: HDR flag in bit 9, extent coordinates up to bit 63, then RGBA as UNORM16
+			if (read(9, 1) != 0)
+			{
+				return false;
+			}
+			for (uint32_t texel = 0; texel < blockX * blockY; ++texel)
+			{
+				for (uint32_t i = 0; i < 4; ++i)
+				{
+					rgba[texel][i] = uint8_t(read(64 + 16 * i, 16) >> 8);
+				}
+			}
+			return true;
+		}
+		uint32_t gridX;
+		uint32_t gridY;
+		uint32_t weightRange;
+		bool dualPlane;
+		if (!DecodeAstcModeReference(read(0, 11), gridX, gridY, weightRange, dualPlane) || dualPlane || gridX > blockX || gridY > blockY
+			|| read(11, 2) != 0)
+		{
+			return false;
+		}
+		const uint32_t cem = read(13, 4);
+		if (cem != 8 && cem != 12)
+		{
+			return false;
+		}
+		static const uint32_t WeightLevels[12] = { 2, 3, 4, 5, 6, 8, 10, 12, 16, 20, 24, 32 };
+		const uint32_t weightLevels = WeightLevels[weightRange];
+		if ((weightLevels & (weightLevels - 1)) != 0)
+		{
+			return false;
+		}
+		uint32_t weightBits = 0;
+		while ((1u << weightBits) < weightLevels)
+		{
+			++weightBits;
+		}
+		const uint32_t weightCount = gridX * gridY;
+
+		// the endpoints take the largest range of the 21 whose encoding fits between bit 17 and the weights
+		static const uint32_t ColorLevels[21] = { 2, 3, 4, 5, 6, 8, 10, 12, 16, 20, 24, 32, 40, 48, 64, 80, 96, 128, 160, 192, 256 };
+		const uint32_t valueCount = cem == 12 ? 8 : 6;
+		const int32_t available = 128 - 17 - int32_t(weightCount * weightBits);
+		uint32_t colorLevels = 0;
+		for (uint32_t levels : ColorLevels)
+		{
+			uint32_t plain = levels % 3 == 0 ? levels / 3 : (levels % 5 == 0 ? levels / 5 : levels);
+			uint32_t log = 0;
+			while ((1u << log) < plain)
+			{
+				++log;
+			}
+			const int32_t needed = int32_t(valueCount * log + (levels % 3 == 0 ? (valueCount * 8 + 4) / 5 : 0) + (levels % 5 == 0 ? (valueCount * 7 + 2) / 3 : 0));
+			if (needed <= available)
+			{
+				colorLevels = levels;
+			}
+		}
+		if (colorLevels == 0 || (colorLevels & (colorLevels - 1)) != 0)
+		{
+			return false;
+		}
+		uint32_t colorBits = 0;
+		while ((1u << colorBits) < colorLevels)
+		{
+			++colorBits;
+		}
+
+		int values[8] = {};
+		for (uint32_t i = 0; i < valueCount; ++i)
+		{
+			// bit replication up to 8 bits
+			const uint32_t value = read(17 + i * colorBits, colorBits);
+			int widened = 0;
+			for (int bit = 7, source = int(colorBits) - 1; bit >= 0; --bit, source = source == 0 ? int(colorBits) - 1 : source - 1)
+			{
+				widened |= int((value >> source) & 1) << bit;
+			}
+			values[i] = widened;
+		}
+		int endpoints[2][4];
+		const int alpha0 = cem == 12 ? values[6] : 255;
+		const int alpha1 = cem == 12 ? values[7] : 255;
+		if (values[1] + values[3] + values[5] >= values[0] + values[2] + values[4])
+		{
+			const int e0[4] = { values[0], values[2], values[4], alpha0 };
+			const int e1[4] = { values[1], values[3], values[5], alpha1 };
+			for (int i = 0; i < 4; ++i)
+			{
+				endpoints[0][i] = e0[i];
+				endpoints[1][i] = e1[i];
+			}
+		}
+		else
+		{
+			// blue contraction, with the endpoints swapped
+			const int e0[4] = { (values[1] + values[5]) >> 1, (values[3] + values[5]) >> 1, values[5], alpha1 };
+			const int e1[4] = { (values[0] + values[4]) >> 1, (values[2] + values[4]) >> 1, values[4], alpha0 };
+			for (int i = 0; i < 4; ++i)
+			{
+				endpoints[0][i] = e0[i];
+				endpoints[1][i] = e1[i];
+			}
+		}
+
+		// weights are stored from bit 127 down
+		int weights[64];
+		for (uint32_t i = 0; i < weightCount; ++i)
+		{
+			uint32_t value = 0;
+			for (uint32_t bit = 0; bit < weightBits; ++bit)
+			{
+				value |= ReadAstcBit(block, 127 - (i * weightBits + bit)) << bit;
+			}
+			int widened = 0;
+			for (int bit = 5, source = int(weightBits) - 1; bit >= 0; --bit, source = source == 0 ? int(weightBits) - 1 : source - 1)
+			{
+				widened |= int((value >> source) & 1) << bit;
+			}
+			weights[i] = widened > 32 ? widened + 1 : widened;
+		}
+
+		const int ds = int((1024 + blockX / 2) / (blockX - 1));
+		const int dt = int((1024 + blockY / 2) / (blockY - 1));
+		auto weightAt = [&](int x, int y) { return x < int(gridX) && y < int(gridY) ? weights[y * int(gridX) + x] : 0; };
+		for (uint32_t t = 0; t < blockY; ++t)
+		{
+			for (uint32_t s = 0; s < blockX; ++s)
+			{
+				const int gs = (ds * int(s) * (int(gridX) - 1) + 32) >> 6;
+				const int gt = (dt * int(t) * (int(gridY) - 1) + 32) >> 6;
+				const int js = gs >> 4;
+				const int fs = gs & 15;
+				const int jt = gt >> 4;
+				const int ft = gt & 15;
+				const int w11 = (fs * ft + 8) >> 4;
+				const int w10 = ft - w11;
+				const int w01 = fs - w11;
+				const int w00 = 16 - fs - ft + w11;
+				const int p00 = weightAt(js, jt);
+				const int p01 = fs ? weightAt(js + 1, jt) : 0;
+				const int p10 = ft ? weightAt(js, jt + 1) : 0;
+				const int p11 = fs && ft ? weightAt(js + 1, jt + 1) : 0;
+				const int weight = (p00 * w00 + p01 * w01 + p10 * w10 + p11 * w11 + 8) >> 4;
+				for (int i = 0; i < 4; ++i)
+				{
+					// both endpoints widened to 16 bits, the top 8 bits of the result kept
+					const int c0 = endpoints[0][i] * 257;
+					const int c1 = endpoints[1][i] * 257;
+					rgba[t * blockX + s][i] = uint8_t(((c0 * (64 - weight) + c1 * weight + 32) >> 6) >> 8);
+				}
+			}
+		}
+		return true;
+	}
+}
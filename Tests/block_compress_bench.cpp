@@ -0,0 +1,27 @@
+#include <vector>
+#include "check.h"
+#include "block_compress_reference.h"
+#include "BlockCompress.h"
+
+// Megabytes of BGRA8 source compressed per second on one thread, for every
+// format and quality, on a 256 face of probe-like content.
+int main()
+{
+	const uint32_t size = 256;
+	const std::vector<uint8_t> bgra = test::MakeProbeImage(size, size, 1);
+	const char* const formatNames[] = { "BC1", "BC3", "BC7" };
+	const char* const qualityNames[] = { "Fast", "Normal", "High" };
+	for (bc::Format format : { bc::Format::BC1, bc::Format::BC3, bc::Format::BC7 })
+	{
+		std::vector<uint8_t> blocks(bc::GetSurfaceSize(format, size, size));
+		for (bc::Quality quality : { bc::Quality::Fast, bc::Quality::Normal, bc::Quality::High })
+		{
+			const double seconds = test::BestOf(5, [&]()
+			{
+				bc::CompressRows(format, quality, bgra.data(), size * 4, size, size, 0, bc::GetBlockRows(size), blocks.data());
+			});
+			std::printf("%s %-16s %8.1f MB/s\n", formatNames[int(format)], qualityNames[int(quality)], bgra.size() / seconds / 1e6);
+		}
+	}
+	return 0;
+}
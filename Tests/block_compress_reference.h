@@ -0,0 +1,170 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+// Block decoders written from the format descriptions rather than from
+// BlockCompress.h, reading the bits in block order, and the probe-like
+// content the test and the benchmark compress. 565 endpoints widen by bit
+// replication and interpolated BC1 and BC3 entries round down, as the DXT
+// specification has them.
+namespace test {
+	inline void Expand565(uint32_t value, int color[3])
+	{
+		const int r = (value >> 11) & 0x1f;
+		const int g = (value >> 5) & 0x3f;
+		const int b = value & 0x1f;
+		color[0] = r * 8 + r / 4;
+		color[1] = g * 4 + g / 16;
+		color[2] = b * 8 + b / 4;
+	}
+
+	/// <summary>RGBA of the 16 pixels, row by row.</summary>
+	inline void DecodeBC1Reference(const uint8_t* block, uint8_t rgba[16][4])
+	{
+		const uint32_t color0 = block[0] + block[1] * 256u;
+		const uint32_t color1 = block[2] + block[3] * 256u;
+		int palette[4][4];
+		Expand565(color0, palette[0]);
+		Expand565(color1, palette[1]);
+		palette[0][3] = palette[1][3] = 255;
+		for (int i = 0; i < 3; ++i)
+		{
+			if (color0 > color1)
+			{
+				palette[2][i] = (2 * palette[0][i] + palette[1][i]) / 3;
+				palette[3][i] = (palette[0][i] + 2 * palette[1][i]) / 3;
+			}
+			else
+			{
+				palette[2][i] = (palette[0][i] + palette[1][i]) / 2;
+				palette[3][i] = 0;
+			}
+		}
+		palette[2][3] = 255;
+		palette[3][3] = color0 > color1 ? 255 : 0;
+		for (int pixel = 0; pixel < 16; ++pixel)
+		{
+			const int index = (block[4 + pixel / 4] >> (2 * (pixel % 4))) & 3;
+			for (int i = 0; i < 4; ++i)
+			{
+				rgba[pixel][i] = uint8_t(palette[index][i]);
+			}
+		}
+	}
+
+	inline void DecodeBC3Reference(const uint8_t* block, uint8_t rgba[16][4])
+	{
+		DecodeBC1Reference(block + 8, rgba);
+		const int alpha0 = block[0];
+		const int alpha1 = block[1];
+		int palette[8] = { alpha0, alpha1 };
+		if (alpha0 > alpha1)
+		{
+			for (int i = 2; i < 8; ++i)
+			{
+				palette[i] = ((8 - i) * alpha0 + (i - 1) * alpha1) / 7;
+			}
+		}
+		else
+		{
+			for (int i = 2; i < 6; ++i)
+			{
+				palette[i] = ((6 - i) * alpha0 + (i - 1) * alpha1) / 5;
+			}
+			palette[6] = 0;
+			palette[7] = 255;
+		}
+		for (int pixel = 0; pixel < 16; ++pixel)
+		{
+			const int bit = 16 + pixel * 3;
+			const int index = ((block[bit / 8] | (bit / 8 + 1 < 8 ? block[bit / 8 + 1] << 8 : 0)) >> (bit % 8)) & 7;
+			rgba[pixel][3] = uint8_t(palette[index]);
+		}
+	}
+
+	/// <summary>Explicit alpha: four bits per pixel, row by row, low nibble first.</summary>
+	inline void DecodeBC2Reference(const uint8_t* block, uint8_t rgba[16][4])
+	{
+		DecodeBC1Reference(block + 8, rgba);
+		for (int pixel = 0; pixel < 16; ++pixel)
+		{
+			const int alpha = (block[pixel / 2] >> (4 * (pixel % 2))) & 0xf;
+			rgba[pixel][3] = uint8_t(alpha * 17);
+		}
+	}
+
+	/// <summary>Mode 6 only; returns false for any other mode.</summary>
+	inline bool DecodeBC7Reference(const uint8_t* block, uint8_t rgba[16][4])
+	{
+		int bit = 0;
+		auto read = [block, &bit](int count)
+		{
+			int value = 0;
+			for (int i = 0; i < count; ++i, ++bit)
+			{
+				value |= ((block[bit / 8] >> (bit % 8)) & 1) << i;
+			}
+			return value;
+		};
+		int mode = 0;
+		while (mode < 8 && read(1) == 0)
+		{
+			++mode;
+		}
+		if (mode != 6)
+		{
+			return false;
+		}
+		int endpoints[2][4];
+		for (int channel = 0; channel < 4; ++channel)
+		{
+			endpoints[0][channel] = read(7);
+			endpoints[1][channel] = read(7);
+		}
+		for (int endpoint = 0; endpoint < 2; ++endpoint)
+		{
+			const int pbit = read(1);
+			for (int channel = 0; channel < 4; ++channel)
+			{
+				endpoints[endpoint][channel] = endpoints[endpoint][channel] * 2 + pbit;
+			}
+		}
+		static const int Weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+		for (int pixel = 0; pixel < 16; ++pixel)
+		{
+			const int weight = Weights[read(pixel == 0 ? 3 : 4)];
+			for (int channel = 0; channel < 4; ++channel)
+			{
+				rgba[pixel][channel] = uint8_t(((64 - weight) * endpoints[0][channel] + weight * endpoints[1][channel] + 32) >> 6);
+			}
+		}
+		return true;
+	}
+
+	/// <summary>BGRA8 rows of smooth gradients with a little noise and an RGBM-like alpha.</summary>
+	inline std::vector<uint8_t> MakeProbeImage(uint32_t width, uint32_t height, uint32_t seed)
+	{
+		std::vector<uint8_t> bgra(size_t(width) * height * 4);
+		std::mt19937 random(seed);
+		auto clamp = [](float value) { return uint8_t(std::min(255.0f, std::max(0.0f, value))); };
+		for (uint32_t y = 0; y < height; ++y)
+		{
+			for (uint32_t x = 0; x < width; ++x)
+			{
+				uint8_t* pixel = &bgra[(size_t(y) * width + x) * 4];
+				const float u = x / float(width);
+				const float v = y / float(height);
+				const float noise = float(int(random() % 9) - 4);
+				pixel[2] = clamp(200 * u + 30 * std::sin(v * 20) + noise);
+				pixel[1] = clamp(180 * v + 40 * std::cos(u * 13) + 25 + noise);
+				pixel[0] = clamp(120 * u * v + 60 + noise);
+				pixel[3] = uint8_t(40 + 150 * std::fabs(std::sin(u * 7 + v * 5)));
+			}
+		}
+		return bgra;
+	}
+}
@@ -0,0 +1,203 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+#include "check.h"
+#include "block_compress_reference.h"
+#include "BlockCompress.h"
+
+namespace {
+	const char* const FormatNames[] = { "BC1", "BC3", "BC7" };
+	const char* const QualityNames[] = { "Fast", "Normal", "High" };
+
+	// Lowest PSNR in dB each format and quality may give on the probe image;
+	// a few tenths under what the encoder reaches today.
+	const double MinPSNR[3][3] = {
+		{ 38.4, 39.2, 39.2 },
+		{ 39.4, 40.2, 40.2 },
+		{ 38.5, 39.7, 39.7 },
+	};
+
+	void Decode(bc::Format format, const uint8_t* block, uint8_t rgba[16][4])
+	{
+		switch (format)
+		{
+		case bc::Format::BC1:
+			test::DecodeBC1Reference(block, rgba);
+			break;
+		case bc::Format::BC3:
+			test::DecodeBC3Reference(block, rgba);
+			break;
+		case bc::Format::BC7:
+			CHECK(test::DecodeBC7Reference(block, rgba));
+			break;
+		}
+	}
+
+	// Squared error of a compressed surface against its source, decoded with
+	// the reference decoders; BC1 leaves alpha out as the encoder does not keep it.
+	uint64_t MeasureError(bc::Format format, const std::vector<uint8_t>& bgra, uint32_t width, uint32_t height, const std::vector<uint8_t>& blocks)
+	{
+		const uint32_t columns = (width + 3) / 4;
+		uint64_t error = 0;
+		for (uint32_t y = 0; y < height; ++y)
+		{
+			for (uint32_t x = 0; x < width; ++x)
+			{
+				uint8_t rgba[16][4];
+				Decode(format, &blocks[(size_t(y / 4) * columns + x / 4) * bc::GetBlockSize(format)], rgba);
+				const uint8_t* decoded = rgba[(y % 4) * 4 + x % 4];
+				const uint8_t* source = &bgra[(size_t(y) * width + x) * 4];
+				const int deltas[4] = { decoded[0] - source[2], decoded[1] - source[1], decoded[2] - source[0], decoded[3] - source[3] };
+				for (int i = 0; i < (format == bc::Format::BC1 ? 3 : 4); ++i)
+				{
+					error += uint64_t(deltas[i] * deltas[i]);
+				}
+			}
+		}
+		return error;
+	}
+
+	// The decoders CompressRows measures with must read any block as the
+	// reference ones do, in both BC1 colour modes and both BC3 alpha modes.
+	void TestDecoders()
+	{
+		std::mt19937 random(1);
+		for (int i = 0; i < 100000; ++i)
+		{
+			uint8_t block[16];
+			for (uint8_t& value : block)
+			{
+				value = uint8_t(random());
+			}
+			uint8_t expected[16][4];
+			uint8_t decoded[16][4];
+			test::DecodeBC1Reference(block, expected);
+			bc::DecodeBC1(block, decoded);
+			CHECK(std::memcmp(decoded, expected, sizeof(expected)) == 0);
+
+			test::DecodeBC3Reference(block, expected);
+			bc::DecodeBC3(block, decoded);
+			CHECK(std::memcmp(decoded, expected, sizeof(expected)) == 0);
+
+			CHECK(bc::DecodeBC7(block, decoded) == test::DecodeBC7Reference(block, expected));
+			block[0] = uint8_t((block[0] & 0x80) | 0x40);
+			CHECK(bc::DecodeBC7(block, decoded) && test::DecodeBC7Reference(block, expected));
+			CHECK(std::memcmp(decoded, expected, sizeof(expected)) == 0);
+		}
+	}
+
+	// Quality against the reference decoders, the error CompressRows reports,
+	// and the same blocks when the rows are split between two calls as the
+	// exporters split them between workers.
+	void TestImage(bc::Format format, bc::Quality quality, const std::vector<uint8_t>& bgra, uint32_t width, uint32_t height)
+	{
+		const size_t size = bc::GetSurfaceSize(format, width, height);
+		const uint32_t rows = bc::GetBlockRows(height);
+		std::vector<uint8_t> blocks(size + 16, 0xcd);
+		const uint64_t reported = bc::CompressRows(format, quality, bgra.data(), width * 4, width, height, 0, rows, blocks.data(), true);
+		for (size_t i = size; i < blocks.size(); ++i)
+		{
+			CHECK(blocks[i] == 0xcd);
+		}
+		blocks.resize(size);
+
+		const uint64_t error = MeasureError(format, bgra, width, height, blocks);
+		if (format != bc::Format::BC1)
+		{
+			CHECK(reported == error);
+		}
+
+		std::vector<uint8_t> split(size);
+		bc::CompressRows(format, quality, bgra.data(), width * 4, width, height, 0, rows / 2, split.data());
+		bc::CompressRows(format, quality, bgra.data(), width * 4, width, height, rows / 2, rows, split.data());
+		CHECK(split == blocks);
+
+		if (width >= 64)
+		{
+			const double psnr = bc::GetPSNR(error, uint64_t(width) * height * (format == bc::Format::BC1 ? 3 : 4));
+			std::printf("%s %-6s %ux%u: %.2f dB\n", FormatNames[int(format)], QualityNames[int(quality)], width, height, psnr);
+			CHECK(psnr >= MinPSNR[int(format)][int(quality)]);
+		}
+	}
+
+	// Blocks over the right and bottom edges repeat the last column and row,
+	// so they match the blocks of the same image padded that way.
+	void TestEdges(bc::Format format, bc::Quality quality, const std::vector<uint8_t>& bgra, uint32_t width, uint32_t height)
+	{
+		const uint32_t paddedWidth = (width + 3) / 4 * 4;
+		const uint32_t paddedHeight = (height + 3) / 4 * 4;
+		std::vector<uint8_t> padded(size_t(paddedWidth) * paddedHeight * 4);
+		for (uint32_t y = 0; y < paddedHeight; ++y)
+		{
+			for (uint32_t x = 0; x < paddedWidth; ++x)
+			{
+				const uint32_t sourceX = std::min(x, width - 1);
+				const uint32_t sourceY = std::min(y, height - 1);
+				std::memcpy(&padded[(size_t(y) * paddedWidth + x) * 4], &bgra[(size_t(sourceY) * width + sourceX) * 4], 4);
+			}
+		}
+		std::vector<uint8_t> blocks(bc::GetSurfaceSize(format, width, height));
+		std::vector<uint8_t> paddedBlocks(bc::GetSurfaceSize(format, paddedWidth, paddedHeight));
+		CHECK(blocks.size() == paddedBlocks.size());
+		bc::CompressRows(format, quality, bgra.data(), width * 4, width, height, 0, bc::GetBlockRows(height), blocks.data());
+		bc::CompressRows(format, quality, padded.data(), paddedWidth * 4, paddedWidth, paddedHeight, 0, bc::GetBlockRows(paddedHeight), paddedBlocks.data());
+		CHECK(blocks == paddedBlocks);
+	}
+
+	// A block of one colour: BC7 keeps every channel within one step, BC3 keeps
+	// the alpha exactly and BC1 and BC3 colour stay within their 565 rounding.
+	void TestSolid(bc::Format format, bc::Quality quality)
+	{
+		std::mt19937 random(2);
+		for (int i = 0; i < 2000; ++i)
+		{
+			const uint32_t bgra = uint32_t(random());
+			std::vector<uint8_t> pixels(16 * 4);
+			for (int pixel = 0; pixel < 16; ++pixel)
+			{
+				std::memcpy(&pixels[pixel * 4], &bgra, 4);
+			}
+			uint8_t block[16];
+			bc::CompressRows(format, quality, pixels.data(), 16, 4, 4, 0, 1, block);
+			uint8_t rgba[16][4];
+			Decode(format, block, rgba);
+			const uint8_t* source = pixels.data();
+			const int limits[4] = {
+				format == bc::Format::BC7 ? 1 : 4,
+				format == bc::Format::BC7 ? 1 : 2,
+				format == bc::Format::BC7 ? 1 : 4,
+				format == bc::Format::BC7 ? 1 : (format == bc::Format::BC3 ? 0 : 255),
+			};
+			for (int pixel = 0; pixel < 16; ++pixel)
+			{
+				CHECK(std::abs(rgba[pixel][0] - source[2]) <= limits[0]);
+				CHECK(std::abs(rgba[pixel][1] - source[1]) <= limits[1]);
+				CHECK(std::abs(rgba[pixel][2] - source[0]) <= limits[2]);
+				CHECK(std::abs(rgba[pixel][3] - source[3]) <= limits[3]);
+			}
+		}
+	}
+}
+
+int main()
+{
+	TestDecoders();
+	const std::vector<uint8_t> probe = test::MakeProbeImage(128, 128, 1);
+	const std::vector<uint8_t> small = test::MakeProbeImage(13, 7, 2);
+	for (bc::Format format : { bc::Format::BC1, bc::Format::BC3, bc::Format::BC7 })
+	{
+		for (bc::Quality quality : { bc::Quality::Fast, bc::Quality::Normal, bc::Quality::High })
+		{
+			TestImage(format, quality, probe, 128, 128);
+			TestImage(format, quality, small, 13, 7);
+			TestImage(format, quality, small, 1, 1);
+			TestEdges(format, quality, small, 13, 7);
+			TestEdges(format, quality, small, 2, 3);
+			TestSolid(format, quality);
+		}
+	}
+	std::printf("block_compress_test passed\n");
+	return 0;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+// Test programs stop at the first failed check and return non-zero, which is
+// all ctest looks at.
+#define CHECK(expr) \
+	do \
+	{ \
+		if (!(expr)) \
+		{ \
+			std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #expr); \
+			std::exit(1); \
+		} \
+	} while (0)
+
+namespace test {
+	/// <summary>Best wall time in seconds of runs calls of func, for the benchmarks.</summary>
+	template <class Func>
+	double BestOf(int runs, Func&& func)
+	{
+		double best = 1e30;
+		for (int i = 0; i < runs; ++i)
+		{
+			const auto start = std::chrono::steady_clock::now();
+			func();
+			const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+			best = elapsed.count() < best ? elapsed.count() : best;
+		}
+		return best;
+	}
+}
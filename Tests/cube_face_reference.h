@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+// How GetFaceData turned a face before CubeFaceRemap.h: a float matrix
+// built from a translation to the centre, a rotation or mirror and the
+// translation back, applied to every texel as a row vector, and face 3
+// mirrored once more along x afterwards (FlipX).
+namespace test {
+	struct Matrix
+	{
+		float m[4][4];
+
+		static Matrix Identity()
+		{
+			Matrix result = {};
+			for (int i = 0; i < 4; ++i)
+			{
+				result.m[i][i] = 1.0f;
+			}
+			return result;
+		}
+
+		Matrix operator * (const Matrix& right) const
+		{
+			Matrix result = {};
+			for (int i = 0; i < 4; ++i)
+			{
+				for (int j = 0; j < 4; ++j)
+				{
+					float sum = 0.0f;
+					for (int k = 0; k < 4; ++k)
+					{
+						sum += m[i][k] * right.m[k][j];
+					}
+					result.m[i][j] = sum;
+				}
+			}
+			return result;
+		}
+	};
+
+	inline void RotateFaceWithMatrix(const uint8_t* source, uint8_t* dest, int face, int size)
+	{
+		Matrix toCentre = Matrix::Identity();
+		Matrix turn = Matrix::Identity();
+		Matrix back = Matrix::Identity();
+		toCentre.m[3][0] = toCentre.m[3][1] = -0.5f * (size - 1);
+		back.m[3][0] = back.m[3][1] = 0.5f * (size - 1);
+		switch (face)
+		{
+		case 0:
+			turn.m[0][0] = 0.0f;
+			turn.m[0][1] = -1.0f;
+			turn.m[1][0] = 1.0f;
+			turn.m[1][1] = 0.0f;
+			break;
+		case 1:
+			turn.m[0][0] = 0.0f;
+			turn.m[0][1] = 1.0f;
+			turn.m[1][0] = -1.0f;
+			turn.m[1][1] = 0.0f;
+			break;
+		case 3:
+			turn.m[1][1] = -1.0f;
+			break;
+		case 5:
+			turn.m[0][0] = -1.0f;
+			turn.m[1][1] = -1.0f;
+			break;
+		}
+		const Matrix transform = toCentre * turn * back;
+		for (int y = 0; y < size; ++y)
+		{
+			for (int x = 0; x < size; ++x)
+			{
+				const float destX = x * transform.m[0][0] + y * transform.m[1][0] + transform.m[3][0];
+				const float destY = x * transform.m[0][1] + y * transform.m[1][1] + transform.m[3][1];
+				std::memcpy(dest + int(destY * size * 4 + destX * 4), source + (y * size + x) * 4, 4);
+			}
+		}
+		if (face == 3)
+		{
+			uint32_t* texels = reinterpret_cast<uint32_t*>(dest);
+			for (int y = 0; y < size; ++y)
+			{
+				for (int x = 0; x < size / 2; ++x)
+				{
+					std::swap(texels[y * size + x], texels[y * size + size - x - 1]);
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,42 @@
+#include <vector>
+#include "check.h"
+#include "cube_face_reference.h"
+#include "CubeFaceRemap.h"
+
+// Texels per second when turning all six faces of a 256 cubemap and its mips,
+// through the old matrix path and through the remap kernels.
+namespace {
+	template <class Turn>
+	double Measure(Turn turn)
+	{
+		size_t texels = 0;
+		for (int size = 256; size >= 1; size /= 2)
+		{
+			texels += size_t(size) * size * 6;
+		}
+		const double seconds = test::BestOf(10, [&turn]()
+		{
+			for (int size = 256; size >= 1; size /= 2)
+			{
+				for (int face = 0; face < 6; ++face)
+				{
+					turn(face, size);
+				}
+			}
+		});
+		return texels / seconds / 1e6;
+	}
+}
+
+int main()
+{
+	std::vector<uint8_t> source(256 * 256 * 4, 0x5a);
+	std::vector<uint8_t> dest(source.size());
+	const double matrix = Measure([&](int face, int size) { test::RotateFaceWithMatrix(source.data(), dest.data(), face, size); });
+	const double remap = Measure([&](int face, int size) { cubeface::Remap(cubeface::GetUnityRotation(face), source.data(), dest.data(), uint32_t(size)); });
+	const double bottomUp = Measure([&](int face, int size) { cubeface::Remap(cubeface::GetUnityRotation(face), source.data(), dest.data(), uint32_t(size), true); });
+	std::printf("float matrix          %8.1f M texels/s\n", matrix);
+	std::printf("remap kernels         %8.1f M texels/s\n", remap);
+	std::printf("remap, bottom up      %8.1f M texels/s\n", bottomUp);
+	return 0;
+}
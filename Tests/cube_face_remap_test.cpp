@@ -0,0 +1,52 @@
+#include <cstring>
+#include <random>
+#include <vector>
+#include "check.h"
+#include "cube_face_reference.h"
+#include "CubeFaceRemap.h"
+
+namespace {
+	// Every face, both row orders, against the matrix path; the sizes that are
+	// not powers of two leave partial tiles at the right and bottom.
+	void TestSize(std::mt19937& random, int size)
+	{
+		const size_t bytes = size_t(size) * size * 4;
+		const size_t rowSize = size_t(size) * 4;
+		std::vector<uint8_t> source(bytes);
+		for (uint8_t& value : source)
+		{
+			value = uint8_t(random());
+		}
+		for (int face = 0; face < 6; ++face)
+		{
+			std::vector<uint8_t> expected(bytes);
+			test::RotateFaceWithMatrix(source.data(), expected.data(), face, size);
+
+			std::vector<uint8_t> remapped(bytes);
+			cubeface::Remap(cubeface::GetUnityRotation(face), source.data(), remapped.data(), uint32_t(size));
+			CHECK(remapped == expected);
+
+			std::vector<uint8_t> bottomUp(bytes);
+			cubeface::Remap(cubeface::GetUnityRotation(face), source.data(), bottomUp.data(), uint32_t(size), true);
+			for (int y = 0; y < size; ++y)
+			{
+				CHECK(std::memcmp(bottomUp.data() + (size - 1 - y) * rowSize, expected.data() + y * rowSize, rowSize) == 0);
+			}
+		}
+	}
+}
+
+int main()
+{
+	std::mt19937 random(1);
+	for (int size = 1; size <= 512; size *= 2)
+	{
+		TestSize(random, size);
+	}
+	for (int size : { 3, 33, 100 })
+	{
+		TestSize(random, size);
+	}
+	std::printf("cube_face_remap_test passed\n");
+	return 0;
+}
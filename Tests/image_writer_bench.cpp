@@ -0,0 +1,73 @@
+#include <cstring>
+#include <vector>
+#include "check.h"
+#include "ImageWriter.h"
+
+// A 2048 x 2048 BGRA8 TGA whose rows are held bottom up, written into memory
+// the way WriteLightMap used to (copy the rows in reverse, then write) and
+// through a bottom up view, which only sets the descriptor. Then a bottom up
+// 1024 x 1024 BC2 DDS, flipped the way CDDSImage::save used to (clone the
+// surface, flip it in place, write) and through the staging block row.
+int main()
+{
+	const uint32_t size = 2048;
+	const size_t rowSize = size * 4;
+	const std::vector<uint8_t> pixels(rowSize * size, 0x5a);
+	std::vector<uint8_t> file;
+
+	const double copied = test::BestOf(10, [&]()
+	{
+		file.clear();
+		std::vector<uint8_t> reversed;
+		reversed.reserve(pixels.size());
+		for (uint32_t y = 0; y < size; ++y)
+		{
+			const uint8_t* row = &pixels[(size - 1 - y) * rowSize];
+			reversed.insert(reversed.end(), row, row + rowSize);
+		}
+		image::VectorSink sink(file);
+		image::WriteTGA(sink, image::MakeView(reversed.data(), size, size, image::Format::BGRA8));
+	});
+	const double view = test::BestOf(10, [&]()
+	{
+		file.clear();
+		image::VectorSink sink(file);
+		image::WriteTGA(sink, image::MakeView(pixels.data(), size, size, image::Format::BGRA8, image::BottomUp));
+	});
+	std::printf("TGA copy and reverse  %8.2f ms\n", copied * 1e3);
+	std::printf("TGA bottom up view    %8.2f ms\n", view * 1e3);
+
+	const uint32_t blockSize = 1024;
+	const image::View layout = image::MakeView(nullptr, blockSize, blockSize, image::Format::BC2);
+	const size_t blockRowSize = layout.GetRowSize();
+	const uint32_t blockRows = layout.GetRowCount();
+	const std::vector<uint8_t> blocks(blockRowSize * blockRows, 0x3c);
+	const double cloned = test::BestOf(10, [&]()
+	{
+		file.clear();
+		std::vector<uint8_t> clone(blocks);
+		std::vector<uint8_t> swap(blockRowSize);
+		for (uint32_t row = 0; row < blockRows / 2; ++row)
+		{
+			uint8_t* top = &clone[row * blockRowSize];
+			uint8_t* bottom = &clone[(blockRows - 1 - row) * blockRowSize];
+			std::memcpy(swap.data(), top, blockRowSize);
+			std::memcpy(top, bottom, blockRowSize);
+			std::memcpy(bottom, swap.data(), blockRowSize);
+		}
+		image::detail::FlipBlocks(image::Format::BC2, clone.data(), clone.size() / 16, 4);
+		image::VectorSink sink(file);
+		const image::View surface = image::MakeView(clone.data(), blockSize, blockSize, image::Format::BC2);
+		image::WriteDDS(sink, &surface, 1, 1);
+	});
+	const double staged = test::BestOf(10, [&]()
+	{
+		file.clear();
+		image::VectorSink sink(file);
+		const image::View surface = image::MakeView(blocks.data(), blockSize, blockSize, image::Format::BC2, image::BottomUp);
+		image::WriteDDS(sink, &surface, 1, 1);
+	});
+	std::printf("BC2 clone and flip    %8.2f ms\n", cloned * 1e3);
+	std::printf("BC2 staged flip       %8.2f ms\n", staged * 1e3);
+	return 0;
+}
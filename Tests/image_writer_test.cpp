@@ -0,0 +1,475 @@
+#include <cstring>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "check.h"
+#include "block_compress_reference.h"
+#include "ImageWriter.h"
+
+namespace {
+	const uint32_t Orientations[] = { image::TopDown, image::BottomUp, image::MirrorX, image::BottomUp | image::MirrorX };
+
+	/// <summary>Pixels as they appear on screen, top row first, leftmost pixel first.</summary>
+	struct screen_image
+	{
+		uint32_t width = 0;
+		uint32_t height = 0;
+		uint32_t elementSize = 0;
+		std::vector<uint8_t> pixels;
+
+		bool operator == (const screen_image& other) const
+		{
+			return width == other.width && height == other.height && elementSize == other.elementSize && pixels == other.pixels;
+		}
+	};
+
+	// Records what a writer announces and what it writes, and can fail after
+	// a number of writes.
+	class test_sink : public image::Sink
+	{
+	public:
+		std::vector<uint8_t> output;
+		size_t reserved = 0;
+		int writesLeft = -1;
+
+		bool Write(const void* data, size_t size) override
+		{
+			if (writesLeft == 0)
+			{
+				return false;
+			}
+			--writesLeft;
+			const uint8_t* bytes = static_cast<const uint8_t*>(data);
+			output.insert(output.end(), bytes, bytes + size);
+			return true;
+		}
+
+		void Reserve(size_t size) override
+		{
+			reserved = size;
+		}
+	};
+
+	std::vector<uint8_t> MakeBytes(size_t size, uint32_t seed)
+	{
+		std::vector<uint8_t> bytes(size);
+		std::mt19937 random(seed);
+		for (uint8_t& value : bytes)
+		{
+			value = uint8_t(random());
+		}
+		return bytes;
+	}
+
+	/// <summary>Where every pixel of an uncompressed view lands, going by its orientation flags.</summary>
+	screen_image ToScreen(const image::View& view)
+	{
+		screen_image screen;
+		screen.width = view.width;
+		screen.height = view.height;
+		screen.elementSize = image::GetElementSize(view.format);
+		screen.pixels.resize(size_t(view.width) * view.height * screen.elementSize);
+		for (uint32_t y = 0; y < view.height; ++y)
+		{
+			const uint32_t sourceY = (view.orientation & image::BottomUp) ? view.height - 1 - y : y;
+			for (uint32_t x = 0; x < view.width; ++x)
+			{
+				const uint32_t sourceX = (view.orientation & image::MirrorX) ? view.width - 1 - x : x;
+				std::memcpy(&screen.pixels[(size_t(y) * view.width + x) * screen.elementSize], view.GetRow(sourceY) + size_t(sourceX) * screen.elementSize, screen.elementSize);
+			}
+		}
+		return screen;
+	}
+
+	uint32_t ReadU32(const std::vector<uint8_t>& file, size_t offset)
+	{
+		uint32_t value;
+		std::memcpy(&value, &file[offset], sizeof(value));
+		return value;
+	}
+
+	// TGA as a reader that honours the top-left bit of the descriptor and
+	// ignores the right-to-left one, as many do.
+	screen_image ReadTGA(const std::vector<uint8_t>& file, uint8_t imageType, uint8_t alphaBits)
+	{
+		CHECK(file.size() >= 18);
+		CHECK(file[0] == 0 && file[1] == 0 && file[2] == imageType);
+		const uint8_t descriptor = file[17];
+		CHECK((descriptor & 0x10) == 0);
+		CHECK((descriptor & 0x0f) == alphaBits);
+		screen_image screen;
+		screen.width = file[12] | (file[13] << 8);
+		screen.height = file[14] | (file[15] << 8);
+		screen.elementSize = file[16] / 8;
+		const size_t rowSize = size_t(screen.width) * screen.elementSize;
+		CHECK(file.size() == 18 + rowSize * screen.height);
+		screen.pixels.resize(rowSize * screen.height);
+		for (uint32_t y = 0; y < screen.height; ++y)
+		{
+			const uint32_t fileY = (descriptor & 0x20) ? y : screen.height - 1 - y;
+			std::memcpy(&screen.pixels[y * rowSize], &file[18 + fileY * rowSize], rowSize);
+		}
+		return screen;
+	}
+
+	// TGA from R8, BGR8 and BGRA8 views in every orientation, packed and with
+	// a padded pitch; the descriptor carries the row order, the pixels the mirror.
+	// With bottomLeft every file has the bottom-left origin and still shows the same image.
+	void TestTGA()
+	{
+		const image::Format formats[] = { image::Format::R8, image::Format::BGR8, image::Format::BGRA8 };
+		for (image::Format format : formats)
+		{
+			const uint32_t elementSize = image::GetElementSize(format);
+			for (uint32_t orientation : Orientations)
+			{
+				for (size_t padding : { size_t(0), size_t(7) })
+				{
+					const uint32_t width = 13;
+					const uint32_t height = 5;
+					const size_t pitch = width * elementSize + padding;
+					const std::vector<uint8_t> pixels = MakeBytes(pitch * height, width + orientation);
+					const image::View view = image::MakeView(pixels.data(), width, height, format, orientation, pitch);
+
+					for (bool bottomLeft : { false, true })
+					{
+						test_sink sink;
+						CHECK(image::WriteTGA(sink, view, bottomLeft));
+						CHECK(sink.reserved == sink.output.size());
+						CHECK(bool(sink.output[17] & 0x20) == (!bottomLeft && !(orientation & image::BottomUp)));
+						const screen_image screen = ReadTGA(sink.output, format == image::Format::R8 ? 3 : 2, format == image::Format::BGRA8 ? 8 : 0);
+						CHECK(screen == ToScreen(view));
+					}
+				}
+			}
+		}
+
+		std::vector<uint8_t> pixels(16 * 8);
+		test_sink sink;
+		CHECK(!image::WriteTGA(sink, image::MakeView(pixels.data(), 4, 4, image::Format::RGBA16F)));
+		CHECK(!image::WriteTGA(sink, image::MakeView(pixels.data(), 0x10000, 1, image::Format::R8)));
+		sink.writesLeft = 1;
+		CHECK(!image::WriteTGA(sink, image::MakeView(pixels.data(), 4, 4, image::Format::BGRA8, image::MirrorX)));
+	}
+
+	// Size of mip level mip of a dimension, as DDS and PVR count them.
+	uint32_t MipSize(uint32_t size, uint32_t mip)
+	{
+		return (size >> mip) ? (size >> mip) : 1;
+	}
+
+	// Uncompressed DDS: the header fields readers depend on, then every face
+	// and mip top down whatever the orientation of its view.
+	void TestDDS()
+	{
+		for (uint32_t faceCount : { 1u, 6u })
+		{
+			for (uint32_t orientation : Orientations)
+			{
+				const uint32_t width = 16;
+				const uint32_t height = 8;
+				const uint32_t mipCount = 5;
+				std::vector<std::vector<uint8_t>> storage;
+				std::vector<image::View> views;
+				for (uint32_t face = 0; face < faceCount; ++face)
+				{
+					for (uint32_t mip = 0; mip < mipCount; ++mip)
+					{
+						const uint32_t mipWidth = MipSize(width, mip);
+						const uint32_t mipHeight = MipSize(height, mip);
+						const size_t pitch = mipWidth * 4 + (mip % 2) * 12;
+						storage.push_back(MakeBytes(pitch * mipHeight, face * 16 + mip));
+						views.push_back(image::MakeView(storage.back().data(), mipWidth, mipHeight, image::Format::BGRA8, orientation, pitch));
+					}
+				}
+
+				test_sink sink;
+				CHECK(image::WriteDDS(sink, views.data(), faceCount, mipCount));
+				CHECK(sink.reserved == sink.output.size());
+				const std::vector<uint8_t>& file = sink.output;
+				CHECK(std::memcmp(file.data(), "DDS ", 4) == 0);
+				CHECK(ReadU32(file, 4) == 124);
+				CHECK(ReadU32(file, 12) == height && ReadU32(file, 16) == width);
+				CHECK(ReadU32(file, 20) == width * 4);
+				CHECK(ReadU32(file, 28) == mipCount);
+				CHECK(ReadU32(file, 76) == 32 && ReadU32(file, 80) == 0x41);
+				CHECK(ReadU32(file, 88) == 32);
+				CHECK(ReadU32(file, 92) == 0x00ff0000 && ReadU32(file, 96) == 0x0000ff00 && ReadU32(file, 100) == 0x000000ff && ReadU32(file, 104) == 0xff000000);
+				CHECK((ReadU32(file, 108) & 0x8) != 0);
+				CHECK(ReadU32(file, 112) == (faceCount == 6 ? 0xfe00u : 0u));
+
+				size_t offset = 128;
+				for (const image::View& view : views)
+				{
+					const screen_image expected = ToScreen(view);
+					CHECK(std::memcmp(&file[offset], expected.pixels.data(), expected.pixels.size()) == 0);
+					offset += expected.pixels.size();
+				}
+				CHECK(offset == file.size());
+			}
+		}
+
+		std::vector<uint8_t> blocks(64 * 16);
+		test_sink sink;
+		const image::View bc7 = image::MakeView(blocks.data(), 8, 8, image::Format::BC7);
+		CHECK(image::WriteDDS(sink, &bc7, 1, 1));
+		CHECK(sink.output.size() == 148 + 4 * 16);
+		CHECK(std::memcmp(&sink.output[84], "DX10", 4) == 0);
+		CHECK(ReadU32(sink.output, 20) == 4 * 16);
+		CHECK(ReadU32(sink.output, 128) == 98 && ReadU32(sink.output, 132) == 3 && ReadU32(sink.output, 140) == 1);
+
+		const image::View rejected[] = {
+			image::MakeView(blocks.data(), 8, 8, image::Format::BC7, image::BottomUp),
+			image::MakeView(blocks.data(), 8, 8, image::Format::BC1, image::MirrorX),
+			image::MakeView(blocks.data(), 8, 6, image::Format::BC3, image::BottomUp),
+			image::MakeView(blocks.data(), 8, 8, image::Format::RGBA16F),
+		};
+		for (const image::View& view : rejected)
+		{
+			CHECK(!image::WriteDDS(sink, &view, 1, 1));
+		}
+		CHECK(!image::WriteDDS(sink, &bc7, 2, 1));
+		const image::View mixed[] = { bc7, image::MakeView(blocks.data(), 4, 4, image::Format::BC3) };
+		CHECK(!image::WriteDDS(sink, mixed, 1, 2));
+	}
+
+	// Pixels of a BC1, BC2 or BC3 surface, blocks decoded and cropped to the image.
+	std::vector<uint8_t> DecodeSurface(image::Format format, const uint8_t* blocks, uint32_t width, uint32_t height)
+	{
+		const uint32_t columns = (width + 3) / 4;
+		const uint32_t blockSize = image::GetElementSize(format);
+		std::vector<uint8_t> rgba(size_t(width) * height * 4);
+		for (uint32_t y = 0; y < height; ++y)
+		{
+			for (uint32_t x = 0; x < width; ++x)
+			{
+				const uint8_t* block = blocks + (size_t(y / 4) * columns + x / 4) * blockSize;
+				uint8_t decoded[16][4];
+				switch (format)
+				{
+				case image::Format::BC1: test::DecodeBC1Reference(block, decoded); break;
+				case image::Format::BC2: test::DecodeBC2Reference(block, decoded); break;
+				default: test::DecodeBC3Reference(block, decoded); break;
+				}
+				std::memcpy(&rgba[(size_t(y) * width + x) * 4], decoded[(y % 4) * 4 + x % 4], 4);
+			}
+		}
+		return rgba;
+	}
+
+	// Bottom up BC1 to BC3 surfaces of random blocks go out flipped: the file
+	// decodes to the vertical mirror of the view, for images shorter than a
+	// block too, and the view itself is left alone.
+	void TestFlippedBlocks()
+	{
+		for (image::Format format : { image::Format::BC1, image::Format::BC2, image::Format::BC3 })
+		{
+			for (uint32_t height : { 1u, 2u, 3u, 4u, 8u, 12u })
+			{
+				const uint32_t width = 12;
+				const image::View layout = image::MakeView(nullptr, width, height, format);
+				const size_t pitch = layout.GetRowSize() + (height > 4 ? 16 : 0);
+				const std::vector<uint8_t> blocks = MakeBytes(pitch * layout.GetRowCount(), height);
+				const std::vector<uint8_t> original = blocks;
+				const image::View view = image::MakeView(blocks.data(), width, height, format, image::BottomUp, pitch);
+
+				test_sink sink;
+				CHECK(image::WriteDDS(sink, &view, 1, 1));
+				CHECK(blocks == original);
+				CHECK(sink.output.size() == 128 + layout.GetRowSize() * layout.GetRowCount());
+
+				std::vector<uint8_t> packed;
+				for (uint32_t row = 0; row < view.GetRowCount(); ++row)
+				{
+					packed.insert(packed.end(), view.GetRow(row), view.GetRow(row) + view.GetRowSize());
+				}
+				const std::vector<uint8_t> source = DecodeSurface(format, packed.data(), width, height);
+				const std::vector<uint8_t> written = DecodeSurface(format, &sink.output[128], width, height);
+				for (uint32_t y = 0; y < height; ++y)
+				{
+					CHECK(std::memcmp(&written[size_t(y) * width * 4], &source[size_t(height - 1 - y) * width * 4], width * 4) == 0);
+				}
+			}
+		}
+	}
+
+	// Radiance HDR: the resolution string for the orientation, then run length
+	// encoded scan lines that decode back to the RGBE8 pixels given.
+	void TestHDR()
+	{
+		for (uint32_t orientation : Orientations)
+		{
+			const uint32_t width = 300;
+			const uint32_t height = 4;
+			// noise, long runs and runs too short to encode, split over the 128 byte packets
+			std::vector<uint8_t> pixels = MakeBytes(size_t(width) * height * 4, orientation);
+			for (uint32_t x = 40; x < 200; ++x)
+			{
+				std::memset(&pixels[(width + x) * 4], 0x80, 4);
+			}
+			for (uint32_t x = 0; x < width; ++x)
+			{
+				pixels[(2 * width + x) * 4 + 3] = uint8_t(x / 3);
+			}
+			const image::View view = image::MakeView(pixels.data(), width, height, image::Format::RGBE8, orientation);
+
+			test_sink sink;
+			CHECK(image::WriteHDR(sink, view));
+			const std::string text(sink.output.begin(), sink.output.end());
+			const std::string resolution = std::string((orientation & image::BottomUp) ? "+Y" : "-Y") + " 4 " + ((orientation & image::MirrorX) ? "-X" : "+X") + " 300\n";
+			const std::string header = "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n" + resolution;
+			CHECK(text.compare(0, header.size(), header) == 0);
+
+			size_t offset = header.size();
+			std::vector<uint8_t> decoded(pixels.size());
+			for (uint32_t y = 0; y < height; ++y)
+			{
+				const uint8_t* line = &sink.output[offset];
+				CHECK(line[0] == 2 && line[1] == 2 && uint32_t((line[2] << 8) | line[3]) == width);
+				offset += 4;
+				for (uint32_t channel = 0; channel < 4; ++channel)
+				{
+					uint32_t x = 0;
+					while (x < width)
+					{
+						const uint8_t count = sink.output[offset++];
+						CHECK(count != 0);
+						const uint32_t length = count > 128 ? count - 128u : count;
+						CHECK(x + length <= width);
+						for (uint32_t i = 0; i < length; ++i, ++x)
+						{
+							decoded[(size_t(y) * width + x) * 4 + channel] = sink.output[count > 128 ? offset : offset + i];
+						}
+						offset += count > 128 ? 1 : length;
+					}
+				}
+			}
+			CHECK(offset == sink.output.size());
+			CHECK(decoded == pixels);
+		}
+
+		std::vector<uint8_t> pixels(16);
+		test_sink sink;
+		CHECK(!image::WriteHDR(sink, image::MakeView(pixels.data(), 4, 4, image::Format::R8)));
+	}
+
+	// PVR version 3: the header, orientation metadata only when there is
+	// something to say, then every face of a mip before the next mip.
+	void TestPVR()
+	{
+		for (uint32_t orientation : Orientations)
+		{
+			const uint32_t faceCount = 6;
+			const uint32_t mipCount = 3;
+			std::vector<std::vector<uint8_t>> storage;
+			std::vector<image::View> views;
+			for (uint32_t face = 0; face < faceCount; ++face)
+			{
+				for (uint32_t mip = 0; mip < mipCount; ++mip)
+				{
+					const uint32_t size = MipSize(8, mip);
+					storage.push_back(MakeBytes(size_t(size) * size * 8, face * 16 + mip));
+					views.push_back(image::MakeView(storage.back().data(), size, size, image::Format::RGBA16F, orientation));
+				}
+			}
+
+			test_sink sink;
+			CHECK(image::WritePVR(sink, views.data(), faceCount, mipCount, true));
+			CHECK(sink.reserved == sink.output.size());
+			const std::vector<uint8_t>& file = sink.output;
+			CHECK(ReadU32(file, 0) == 0x03525650);
+			CHECK(ReadU32(file, 8) == 0x61626772u && ReadU32(file, 12) == 0x10101010u);
+			CHECK(ReadU32(file, 16) == 1 && ReadU32(file, 20) == 12);
+			CHECK(ReadU32(file, 24) == 8 && ReadU32(file, 28) == 8 && ReadU32(file, 32) == 1 && ReadU32(file, 36) == 1);
+			CHECK(ReadU32(file, 40) == faceCount && ReadU32(file, 44) == mipCount);
+			size_t offset = 52 + ReadU32(file, 48);
+			if (orientation == image::TopDown)
+			{
+				CHECK(ReadU32(file, 48) == 0);
+			}
+			else
+			{
+				CHECK(ReadU32(file, 48) == 15);
+				CHECK(ReadU32(file, 52) == 0x03525650 && ReadU32(file, 56) == 3 && ReadU32(file, 60) == 3);
+				CHECK(file[64] == ((orientation & image::MirrorX) ? 1 : 0));
+				CHECK(file[65] == ((orientation & image::BottomUp) ? 1 : 0));
+				CHECK(file[66] == 0);
+			}
+			for (uint32_t mip = 0; mip < mipCount; ++mip)
+			{
+				for (uint32_t face = 0; face < faceCount; ++face)
+				{
+					const std::vector<uint8_t>& expected = storage[face * mipCount + mip];
+					CHECK(std::memcmp(&file[offset], expected.data(), expected.size()) == 0);
+					offset += expected.size();
+				}
+			}
+			CHECK(offset == file.size());
+		}
+	}
+
+	// ASTC: the PVR pixel format of the footprint, partial blocks rounded up,
+	// and no DDS.
+	void TestAstcPVR()
+	{
+		const image::Format formats[] = { image::Format::ASTC_4x4, image::Format::ASTC_5x4, image::Format::ASTC_5x5, image::Format::ASTC_6x5,
+			image::Format::ASTC_6x6, image::Format::ASTC_8x5, image::Format::ASTC_8x6, image::Format::ASTC_8x8 };
+		for (uint32_t i = 0; i < 8; ++i)
+		{
+			const uint32_t width = 13;
+			const uint32_t height = 11;
+			const image::View layout = image::MakeView(nullptr, width, height, formats[i]);
+			const uint32_t blocksX = (width + image::GetBlockWidth(formats[i]) - 1) / image::GetBlockWidth(formats[i]);
+			const uint32_t blocksY = (height + image::GetBlockHeight(formats[i]) - 1) / image::GetBlockHeight(formats[i]);
+			CHECK(layout.GetRowSize() == blocksX * 16 && layout.GetRowCount() == blocksY);
+			const std::vector<uint8_t> blocks = MakeBytes(layout.GetRowSize() * layout.GetRowCount(), i);
+			const image::View view = image::MakeView(blocks.data(), width, height, formats[i]);
+
+			test_sink sink;
+			CHECK(image::WritePVR(sink, &view, 1, 1, true));
+			const std::vector<uint8_t>& file = sink.output;
+			CHECK(ReadU32(file, 8) == 27 + i && ReadU32(file, 12) == 0 && ReadU32(file, 16) == 1);
+			CHECK(ReadU32(file, 24) == height && ReadU32(file, 28) == width && ReadU32(file, 48) == 0);
+			CHECK(file.size() == 52 + blocks.size() && std::memcmp(&file[52], blocks.data(), blocks.size()) == 0);
+
+			test_sink dds;
+			CHECK(!image::WriteDDS(dds, &view, 1, 1));
+		}
+	}
+
+	// A stream gets the same bytes a vector does, and a failed stream fails
+	// the writer.
+	void TestStreamSink()
+	{
+		const std::vector<uint8_t> pixels = MakeBytes(8 * 8 * 4, 9);
+		const image::View view = image::MakeView(pixels.data(), 8, 8, image::Format::BGRA8, image::BottomUp);
+		std::vector<uint8_t> expected;
+		image::VectorSink vectorSink(expected);
+		CHECK(image::WriteDDS(vectorSink, &view, 1, 1));
+
+		std::ostringstream stream;
+		image::StreamSink streamSink(stream);
+		CHECK(image::WriteDDS(streamSink, &view, 1, 1));
+		const std::string written = stream.str();
+		CHECK(std::vector<uint8_t>(written.begin(), written.end()) == expected);
+
+		std::ostringstream failed;
+		failed.setstate(std::ios::badbit);
+		image::StreamSink failedSink(failed);
+		CHECK(!image::WriteDDS(failedSink, &view, 1, 1));
+	}
+}
+
+int main()
+{
+	TestTGA();
+	TestDDS();
+	TestFlippedBlocks();
+	TestHDR();
+	TestPVR();
+	TestAstcPVR();
+	TestStreamSink();
+	std::printf("image_writer_test passed\n");
+	return 0;
+}
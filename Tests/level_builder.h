@@ -0,0 +1,80 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "LevelFormat.h"
+
+// Builds a chunked .level in memory with the layout WriteLevelChunks writes,
+// so the reader can be tested without the exporter.
+namespace test {
+	/// <summary>16 byte aligned bytes, as level::Reader::Attach requires.</summary>
+	struct alignas(16) Block
+	{
+		uint8_t bytes[16];
+	};
+
+	class level_builder
+	{
+	public:
+		level::StringPool strings;
+
+		template <class T>
+		void Add(uint32_t id, const std::vector<T>& records, uint32_t section = 0)
+		{
+			AddRaw(id, section, sizeof(T), uint32_t(records.size()), records.data(), records.size() * sizeof(T));
+		}
+
+		void AddRaw(uint32_t id, uint32_t section, uint32_t stride, uint32_t count, const void* data, size_t size)
+		{
+			level::ChunkEntry entry;
+			entry.id = id;
+			entry.section = section;
+			entry.stride = stride;
+			entry.count = count;
+			entry.size = size;
+			entry.hash = level::Hash64(data, size);
+			directory.push_back(entry);
+			const uint8_t* first = static_cast<const uint8_t*>(data);
+			payloads.emplace_back(first, first + size);
+		}
+
+		/// <summary>Lays out header, directory and chunks. The string pool goes first.</summary>
+		std::vector<Block> Build(uint32_t version = level::Version)
+		{
+			AddRaw(level::chunk::Strings, 0, 1, strings.GetCount(), strings.GetData().data(), strings.GetData().size());
+			std::rotate(directory.begin(), directory.end() - 1, directory.end());
+			std::rotate(payloads.begin(), payloads.end() - 1, payloads.end());
+
+			level::Header header;
+			header.version = version;
+			header.chunkCount = uint32_t(directory.size());
+			uint64_t offset = level::AlignUp(uint32_t(sizeof(header) + sizeof(level::ChunkEntry) * directory.size()));
+			for (level::ChunkEntry& entry : directory)
+			{
+				entry.offset = offset;
+				offset = level::AlignUp(uint32_t(offset + entry.size));
+			}
+			header.fileSize = offset;
+
+			std::vector<Block> file(size_t(offset / sizeof(Block)));
+			uint8_t* bytes = file.front().bytes;
+			std::memset(bytes, 0, size_t(offset));
+			std::memcpy(bytes, &header, sizeof(header));
+			std::memcpy(bytes + sizeof(header), directory.data(), sizeof(level::ChunkEntry) * directory.size());
+			for (size_t i = 0; i < directory.size(); ++i)
+			{
+				if (!payloads[i].empty())
+				{
+					std::memcpy(bytes + directory[i].offset, payloads[i].data(), payloads[i].size());
+				}
+			}
+			return file;
+		}
+
+	private:
+		std::vector<level::ChunkEntry> directory;
+		std::vector<std::vector<uint8_t>> payloads;
+	};
+}
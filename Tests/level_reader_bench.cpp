@@ -0,0 +1,244 @@
+#include <cstdio>
+#include <string>
+#include "check.h"
+#include "level_builder.h"
+#include "LevelReader.h"
+
+// Opens a chunked .level of 100k meshes and walks every mesh, material,
+// texture name and lightmap through level::Reader, against a sequential parse
+// of the same scene in the version 1 stream layout.
+namespace {
+	const uint32_t MeshCount = 100000;
+
+	class v1_stream
+	{
+	public:
+		std::string bytes;
+
+		void String(const std::string& value)
+		{
+			bytes += value;
+			bytes.push_back('\0');
+		}
+
+		template <class T>
+		void Scalar(T value)
+		{
+			bytes.append(reinterpret_cast<const char*>(&value), sizeof(value));
+		}
+	};
+
+	class v1_parser
+	{
+	public:
+		explicit v1_parser(const std::string& bytes)
+			: bytes(bytes)
+		{
+		}
+
+		std::string String()
+		{
+			std::string value(bytes.c_str() + position);
+			position += value.size() + 1;
+			return value;
+		}
+
+		uint32_t Uint()
+		{
+			uint32_t value;
+			std::memcpy(&value, bytes.data() + position, sizeof(value));
+			position += sizeof(value);
+			return value;
+		}
+
+		void Skip(size_t size)
+		{
+			position += size;
+		}
+
+	private:
+		const std::string& bytes;
+		size_t position = 0;
+	};
+
+	void MakeScene(test::level_builder& builder, v1_stream& v1)
+	{
+		std::vector<level::Mesh> meshes(MeshCount);
+		std::vector<level::Material> materials;
+		std::vector<uint32_t> textures;
+		std::vector<float> params;
+		std::vector<level::LightMap> lightMaps;
+		std::vector<level::ShadowMap> shadowMaps;
+		for (uint32_t i = 0; i < MeshCount; ++i)
+		{
+			level::Mesh& mesh = meshes[i];
+			const std::string name = "SM_Actor_" + std::to_string(i);
+			const std::string fbx = "SM_Mesh_" + std::to_string(i % 500);
+			mesh.name = builder.strings.Add(name);
+			mesh.fbx = builder.strings.Add(fbx);
+			v1.String(name);
+			v1.String(fbx);
+			for (int k = 0; k < 9; ++k)
+			{
+				v1.Scalar(float(k));
+			}
+			mesh.firstMaterial = uint32_t(materials.size());
+			mesh.materialCount = 2;
+			v1.Scalar(mesh.materialCount);
+			for (uint32_t j = 0; j < mesh.materialCount; ++j)
+			{
+				level::Material material;
+				const std::string materialName = "M_" + std::to_string((i + j) % 300);
+				material.name = builder.strings.Add(materialName);
+				material.index = j;
+				material.firstTexture = uint32_t(textures.size());
+				material.textureCount = 3;
+				material.firstParam = uint32_t(params.size());
+				material.paramCount = 1;
+				v1.String(materialName);
+				v1.Scalar(material.index);
+				v1.Scalar(material.type);
+				v1.Scalar(material.textureCount);
+				for (uint32_t t = 0; t < material.textureCount; ++t)
+				{
+					const std::string texture = "T_" + std::to_string((i + t) % 800);
+					textures.push_back(builder.strings.Add(texture));
+					v1.String(texture);
+				}
+				params.push_back(1.0f);
+				v1.Scalar(material.paramCount);
+				v1.Scalar(1.0f);
+				materials.push_back(material);
+			}
+			mesh.lightMap = int32_t(lightMaps.size());
+			level::LightMap lightMap;
+			const std::string lightMapName = "LM_" + std::to_string(i % 64);
+			lightMap.texture = builder.strings.Add(lightMapName);
+			lightMaps.push_back(lightMap);
+			v1.Scalar(1u);
+			v1.String(lightMapName);
+			for (int k = 0; k < 20; ++k)
+			{
+				v1.Scalar(float(k));
+			}
+			mesh.shadowMap = int32_t(shadowMaps.size());
+			shadowMaps.push_back(level::ShadowMap());
+			v1.Scalar(1u);
+			for (int k = 0; k < 4; ++k)
+			{
+				v1.Scalar(float(k));
+			}
+		}
+		builder.Add(level::chunk::Meshes, meshes);
+		builder.Add(level::chunk::Materials, materials);
+		builder.Add(level::chunk::TextureRefs, textures);
+		builder.Add(level::chunk::Params, params);
+		builder.Add(level::chunk::LightMaps, lightMaps);
+		builder.Add(level::chunk::ShadowMaps, shadowMaps);
+	}
+
+	bool WriteFile(const char* path, const void* data, size_t size)
+	{
+		std::FILE* file = std::fopen(path, "wb");
+		const bool written = file && std::fwrite(data, 1, size, file) == size;
+		if (file)
+		{
+			std::fclose(file);
+		}
+		return written;
+	}
+
+	std::string ReadFile(const char* path)
+	{
+		std::string bytes;
+		std::FILE* file = std::fopen(path, "rb");
+		char chunk[65536];
+		size_t read;
+		while (file && (read = std::fread(chunk, 1, sizeof(chunk), file)) > 0)
+		{
+			bytes.append(chunk, read);
+		}
+		if (file)
+		{
+			std::fclose(file);
+		}
+		return bytes;
+	}
+}
+
+int main()
+{
+	test::level_builder builder;
+	v1_stream v1;
+	MakeScene(builder, v1);
+	const std::vector<test::Block> file = builder.Build();
+	const size_t size = file.size() * sizeof(test::Block);
+	const char* path = "level_reader_bench.level";
+	const char* v1Path = "level_reader_bench_v1.level";
+	CHECK(WriteFile(path, file.data(), size));
+	CHECK(WriteFile(v1Path, v1.bytes.data(), v1.bytes.size()));
+
+	size_t mappedSink = 0;
+	const double mapped = test::BestOf(5, [path, &mappedSink]()
+	{
+		level::Reader reader;
+		CHECK(reader.Open(path));
+		for (const level::Mesh& mesh : reader.GetMeshes())
+		{
+			mappedSink += reader.GetString(mesh.name)[0];
+			for (const level::Material& material : reader.GetMaterials(mesh))
+			{
+				for (uint32_t texture : reader.GetTextures(material))
+				{
+					mappedSink += reader.GetString(texture)[0];
+				}
+			}
+			if (const level::LightMap* lightMap = reader.GetLightMap(mesh))
+			{
+				mappedSink += reader.GetString(lightMap->texture)[0];
+			}
+		}
+	});
+
+	size_t parsedSink = 0;
+	const double parsed = test::BestOf(5, [v1Path, &parsedSink]()
+	{
+		const std::string bytes = ReadFile(v1Path);
+		v1_parser parser(bytes);
+		for (uint32_t i = 0; i < MeshCount; ++i)
+		{
+			parsedSink += parser.String()[0];
+			parser.String();
+			parser.Skip(9 * sizeof(float));
+			const uint32_t materials = parser.Uint();
+			for (uint32_t j = 0; j < materials; ++j)
+			{
+				parser.String();
+				parser.Skip(2 * sizeof(uint32_t));
+				const uint32_t textures = parser.Uint();
+				for (uint32_t t = 0; t < textures; ++t)
+				{
+					parsedSink += parser.String()[0];
+				}
+				parser.Skip(parser.Uint() * sizeof(float));
+			}
+			if (parser.Uint())
+			{
+				parsedSink += parser.String()[0];
+				parser.Skip(20 * sizeof(float));
+			}
+			if (parser.Uint())
+			{
+				parser.Skip(4 * sizeof(float));
+			}
+		}
+	});
+	std::remove(path);
+	std::remove(v1Path);
+	CHECK(mappedSink == parsedSink);
+
+	std::printf("%u meshes, %.1f MB chunked, %.1f MB version 1\n", MeshCount, size / 1e6, v1.bytes.size() / 1e6);
+	std::printf("level::Reader open and walk  %8.2f ms\n", mapped * 1000.0);
+	std::printf("version 1 sequential parse   %8.2f ms\n", parsed * 1000.0);
+	return 0;
+}
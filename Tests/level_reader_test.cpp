@@ -0,0 +1,178 @@
+#include <cstdio>
+#include <string>
+#include "check.h"
+#include "level_builder.h"
+#include "LevelReader.h"
+
+namespace {
+	// Two sections: the persistent level with two meshes, a sublevel with
+	// one. Mesh 1 has no lightmap and points at a shadowmap that is missing.
+	test::level_builder MakeLevel()
+	{
+		test::level_builder builder;
+		level::Probe probe;
+		probe.name = builder.strings.Add("Probe_0");
+		probe.brightness = 2.0f;
+		builder.Add(level::chunk::Probes, std::vector<level::Probe>{ probe });
+
+		level::Alias alias;
+		alias.name = builder.strings.Add("/Game/T_Copy.T_Copy");
+		alias.target = builder.strings.Add("T_Wall");
+		builder.Add(level::chunk::Aliases, std::vector<level::Alias>{ alias });
+
+		for (uint32_t section = 0; section < 2; ++section)
+		{
+			const std::string prefix = section ? "Sub_" : "Main_";
+			std::vector<level::Mesh> meshes(section ? 1 : 2);
+			std::vector<level::Material> materials;
+			std::vector<uint32_t> textures;
+			std::vector<float> params;
+			std::vector<level::LightMap> lightMaps;
+			for (size_t i = 0; i < meshes.size(); ++i)
+			{
+				level::Mesh& mesh = meshes[i];
+				mesh.name = builder.strings.Add(prefix + std::to_string(i));
+				mesh.fbx = builder.strings.Add("SM_Wall");
+				mesh.position[0] = float(i);
+				mesh.firstMaterial = uint32_t(materials.size());
+				mesh.materialCount = 1;
+
+				level::Material material;
+				material.name = builder.strings.Add("M_Wall");
+				material.firstTexture = uint32_t(textures.size());
+				material.textureCount = 2;
+				material.firstParam = uint32_t(params.size());
+				material.paramCount = 1;
+				materials.push_back(material);
+				textures.push_back(builder.strings.Add("T_Wall"));
+				textures.push_back(builder.strings.Add(prefix + "Normal"));
+				params.push_back(0.25f * (i + 1));
+
+				if (i == 0)
+				{
+					mesh.lightMap = int32_t(lightMaps.size());
+					level::LightMap lightMap;
+					lightMap.texture = builder.strings.Add(prefix + "LightMap");
+					lightMaps.push_back(lightMap);
+				}
+				else
+				{
+					mesh.shadowMap = 5;
+				}
+			}
+			builder.Add(level::chunk::Meshes, meshes, section);
+			builder.Add(level::chunk::Materials, materials, section);
+			builder.Add(level::chunk::TextureRefs, textures, section);
+			builder.Add(level::chunk::Params, params, section);
+			builder.Add(level::chunk::LightMaps, lightMaps, section);
+			builder.Add(level::chunk::ShadowMaps, std::vector<level::ShadowMap>(), section);
+		}
+		return builder;
+	}
+
+	void CheckLevel(const level::Reader& reader)
+	{
+		CHECK(reader.IsValid());
+		for (const level::ChunkEntry& entry : reader.GetDirectory())
+		{
+			CHECK(reader.Verify(entry));
+		}
+		CHECK(reader.GetSectionCount() == 2);
+		CHECK(reader.GetProbes().size() == 1);
+		CHECK(std::string(reader.GetString(reader.GetProbes()[0].name)) == "Probe_0");
+		CHECK(reader.GetAliases().size() == 1);
+		CHECK(std::string(reader.GetString(reader.GetAliases()[0].target)) == "T_Wall");
+		CHECK(reader.GetEnvironment() == nullptr);
+
+		level::View<level::Mesh> meshes = reader.GetMeshes();
+		CHECK(meshes.size() == 2);
+		CHECK(std::string(reader.GetString(meshes[1].name)) == "Main_1");
+		CHECK(meshes[1].position[0] == 1.0f);
+		level::View<level::Material> materials = reader.GetMaterials(meshes[1]);
+		CHECK(materials.size() == 1);
+		CHECK(std::string(reader.GetString(materials[0].name)) == "M_Wall");
+		level::View<uint32_t> textures = reader.GetTextures(materials[0]);
+		CHECK(textures.size() == 2);
+		CHECK(std::string(reader.GetString(textures[1])) == "Main_Normal");
+		CHECK(reader.GetParams(materials[0]).size() == 1 && reader.GetParams(materials[0])[0] == 0.5f);
+		CHECK(reader.GetLightMap(meshes[0]) != nullptr);
+		CHECK(std::string(reader.GetString(reader.GetLightMap(meshes[0])->texture)) == "Main_LightMap");
+		CHECK(reader.GetLightMap(meshes[1]) == nullptr);
+		CHECK(reader.GetShadowMap(meshes[1]) == nullptr);
+
+		// Indices in a record refer to the arrays of its own section.
+		level::View<level::Mesh> sub = reader.GetMeshes(1);
+		CHECK(sub.size() == 1);
+		CHECK(std::string(reader.GetString(sub[0].name)) == "Sub_0");
+		const level::LightMap* lightMap = reader.GetLightMap(sub[0], 1);
+		CHECK(lightMap && std::string(reader.GetString(lightMap->texture)) == "Sub_LightMap");
+		CHECK(std::string(reader.GetString(reader.GetTextures(reader.GetMaterials(sub[0], 1)[0], 1)[1])) == "Sub_Normal");
+		CHECK(reader.GetMeshes(2).empty());
+		CHECK(std::string(reader.GetString(0xFFFFFFFFu)).empty());
+	}
+
+	void TestRead()
+	{
+		std::vector<test::Block> file = MakeLevel().Build();
+		const size_t size = file.size() * sizeof(test::Block);
+
+		level::Reader attached;
+		CHECK(attached.Attach(file.data(), size));
+		CheckLevel(attached);
+
+		const char* path = "level_reader_test.level";
+		std::FILE* out = std::fopen(path, "wb");
+		CHECK(out && std::fwrite(file.data(), 1, size, out) == size);
+		std::fclose(out);
+		level::Reader mapped;
+		CHECK(mapped.Open(path));
+		CheckLevel(mapped);
+		mapped.Close();
+		std::remove(path);
+		CHECK(!mapped.IsValid());
+		CHECK(!mapped.Open("level_reader_test.missing"));
+	}
+
+	void TestReject()
+	{
+		level::Reader reader;
+		std::vector<test::Block> file = MakeLevel().Build();
+		const size_t size = file.size() * sizeof(test::Block);
+		uint8_t* bytes = file.front().bytes;
+
+		CHECK(!reader.Attach(bytes, sizeof(level::Header) - 1));
+		CHECK(!reader.Attach(bytes, size - 16));
+		CHECK(!reader.Attach(MakeLevel().Build(level::Version - 1).data(), size));
+
+		// A buffer that is not 16 byte aligned.
+		std::vector<test::Block> shifted(file.size() + 1);
+		std::memcpy(shifted.front().bytes + 4, bytes, size);
+		CHECK(!reader.Attach(shifted.front().bytes + 4, size));
+
+		level::ChunkEntry* directory = reinterpret_cast<level::ChunkEntry*>(bytes + sizeof(level::Header));
+		const level::ChunkEntry saved = directory[1];
+		directory[1].offset += 8;
+		CHECK(!reader.Attach(bytes, size));
+		directory[1] = saved;
+		directory[1].size = size;
+		CHECK(!reader.Attach(bytes, size));
+		directory[1] = saved;
+		directory[1].count += 1;
+		CHECK(!reader.Attach(bytes, size));
+		directory[1] = saved;
+		CHECK(reader.Attach(bytes, size));
+
+		// A record stride that does not match is read as a missing chunk.
+		directory[1].stride -= 4;
+		CHECK(reader.Attach(bytes, size));
+		CHECK(reader.GetProbes().empty());
+	}
+}
+
+int main()
+{
+	TestRead();
+	TestReject();
+	std::printf("level_reader_test passed\n");
+	return 0;
+}
@@ -0,0 +1,181 @@
+#include <cstring>
+#include <string>
+#include <vector>
+#include "check.h"
+
+// Writes the stream of a version 1 .level for 20k meshes twice: once with a
+// write per scalar and per string character, as ExportSceneStructure used to
+// call IFileHandle::Write, and once through a buffer flushed in 1 MiB blocks
+// like CLevelArchive. Both files have to come out the same.
+namespace {
+	const int MeshCount = 20000;
+
+	// An unbuffered stdio stream, so every Write is a call into the OS.
+	class direct_file
+	{
+	public:
+		explicit direct_file(const char* path)
+			: file(std::fopen(path, "wb"))
+		{
+			std::setvbuf(file, nullptr, _IONBF, 0);
+		}
+
+		~direct_file()
+		{
+			std::fclose(file);
+		}
+
+		void Write(const void* data, size_t size)
+		{
+			std::fwrite(data, 1, size, file);
+		}
+
+		void WriteString(const std::string& value)
+		{
+			for (char c : value)
+			{
+				Write(&c, 1);
+			}
+			const char terminator = 0;
+			Write(&terminator, 1);
+		}
+
+	private:
+		std::FILE* file;
+	};
+
+	class buffered_file
+	{
+	public:
+		static const size_t FlushSize = 1024 * 1024;
+
+		explicit buffered_file(const char* path)
+			: file(std::fopen(path, "wb"))
+		{
+			std::setvbuf(file, nullptr, _IONBF, 0);
+			buffer.reserve(FlushSize);
+		}
+
+		~buffered_file()
+		{
+			Flush();
+			std::fclose(file);
+		}
+
+		void Write(const void* data, size_t size)
+		{
+			const size_t offset = buffer.size();
+			buffer.resize(offset + size);
+			std::memcpy(buffer.data() + offset, data, size);
+			if (buffer.size() >= FlushSize)
+			{
+				Flush();
+			}
+		}
+
+		void WriteString(const std::string& value)
+		{
+			Write(value.c_str(), value.size() + 1);
+		}
+
+		void Flush()
+		{
+			if (!buffer.empty())
+			{
+				std::fwrite(buffer.data(), 1, buffer.size(), file);
+				buffer.clear();
+			}
+		}
+
+	private:
+		std::FILE* file;
+		std::vector<char> buffer;
+	};
+
+	template <class File>
+	void WriteScalars(File& file, uint32_t count, float first)
+	{
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			const float value = first + i;
+			file.Write(&value, sizeof(value));
+		}
+	}
+
+	// Mesh records as WriteLevelV1 lays them out: name, FBX, transform,
+	// materials with their texture names and params, then the lightmap.
+	template <class File>
+	void WriteLevel(File& file)
+	{
+		const std::string mesh = "SM_Building_Wall_0123";
+		const std::string texture = "T_Building_Wall_BaseColor";
+		const uint32_t materials = 2;
+		const uint32_t textures = 3;
+		const uint32_t params = 4;
+		for (int m = 0; m < MeshCount; ++m)
+		{
+			file.WriteString(mesh);
+			file.WriteString(mesh + ".fbx");
+			WriteScalars(file, 10, float(m));
+			file.Write(&materials, sizeof(materials));
+			for (uint32_t i = 0; i < materials; ++i)
+			{
+				file.WriteString("M_Building");
+				file.Write(&i, sizeof(i));
+				file.Write(&textures, sizeof(textures));
+				for (uint32_t t = 0; t < textures; ++t)
+				{
+					file.WriteString(texture);
+				}
+				file.Write(&params, sizeof(params));
+				WriteScalars(file, params, 0.5f);
+			}
+			file.WriteString("LightMap_0");
+			WriteScalars(file, 20, 1.0f);
+		}
+	}
+
+	std::vector<char> ReadAll(const char* path)
+	{
+		std::vector<char> bytes;
+		std::FILE* file = std::fopen(path, "rb");
+		char chunk[65536];
+		size_t read;
+		while (file && (read = std::fread(chunk, 1, sizeof(chunk), file)) > 0)
+		{
+			bytes.insert(bytes.end(), chunk, chunk + read);
+		}
+		if (file)
+		{
+			std::fclose(file);
+		}
+		return bytes;
+	}
+}
+
+int main()
+{
+	const char* directPath = "level_write_bench_direct.level";
+	const char* bufferedPath = "level_write_bench_buffered.level";
+	const double direct = test::BestOf(1, [directPath]()
+	{
+		direct_file file(directPath);
+		WriteLevel(file);
+	});
+	const double buffered = test::BestOf(3, [bufferedPath]()
+	{
+		buffered_file file(bufferedPath);
+		WriteLevel(file);
+	});
+
+	const std::vector<char> directBytes = ReadAll(directPath);
+	const std::vector<char> bufferedBytes = ReadAll(bufferedPath);
+	std::remove(directPath);
+	std::remove(bufferedPath);
+	CHECK(!directBytes.empty() && directBytes == bufferedBytes);
+
+	std::printf("%d meshes, %.1f MB\n", MeshCount, directBytes.size() / 1e6);
+	std::printf("write per value   %8.1f ms\n", direct * 1000.0);
+	std::printf("1 MiB blocks      %8.1f ms\n", buffered * 1000.0);
+	return 0;
+}
@@ -0,0 +1,208 @@
+#include <string>
+#include <vector>
+#include "check.h"
+#include "PackFormat.h"
+
+namespace {
+	struct alignas(16) Block
+	{
+		uint8_t bytes[16];
+	};
+
+	// A pack with an uncompressed blob, a blob of three blocks flagged as
+	// zlib (the blocks are stored as they are, which the format allows for
+	// blocks that do not shrink) and a second name for the first blob.
+	class pack_file
+	{
+	public:
+		std::vector<uint8_t> bytes;
+		std::vector<pack::Entry> entries;
+		std::string strings = std::string(1, '\0');
+
+		pack_file()
+		{
+			bytes.resize(sizeof(pack::Header));
+			std::vector<uint8_t> loose(1000);
+			for (size_t i = 0; i < loose.size(); ++i)
+			{
+				loose[i] = uint8_t(i * 7);
+			}
+			const pack::Entry first = Add("Textures/T_Wall.tga", loose, 0);
+			pack::Entry alias = first;
+			alias.name = Name("Textures/T_Copy.tga");
+			alias.nameHash = pack::HashName("Textures/T_Copy.tga");
+			entries.push_back(alias);
+
+			std::vector<uint8_t> blob(pack::BlockSize * 2 + 100);
+			for (size_t i = 0; i < blob.size(); ++i)
+			{
+				blob[i] = uint8_t(i >> 8);
+			}
+			const uint32_t ends[3] = { pack::BlockSize, pack::BlockSize * 2, pack::BlockSize * 2 + 100 };
+			std::vector<uint8_t> stored(reinterpret_cast<const uint8_t*>(ends), reinterpret_cast<const uint8_t*>(ends + 3));
+			stored.insert(stored.end(), blob.begin(), blob.end());
+			pack::Entry& compressed = Add("LightMaps/LM_0.tga", stored, pack::flag::Zlib);
+			compressed.size = blob.size();
+			compressed.hash = level::Hash64(blob.data(), blob.size());
+
+			std::sort(entries.begin(), entries.end(), [](const pack::Entry& a, const pack::Entry& b) { return a.nameHash < b.nameHash; });
+			pack::Header header;
+			header.magic = pack::Magic;
+			header.entryCount = uint32_t(entries.size());
+			header.tocOffset = Align();
+			header.stringsOffset = header.tocOffset + sizeof(pack::Entry) * entries.size();
+			header.stringsSize = strings.size();
+			header.fileSize = header.stringsOffset + header.stringsSize;
+			Append(entries.data(), sizeof(pack::Entry) * entries.size());
+			Append(strings.data(), strings.size());
+			std::memcpy(bytes.data(), &header, sizeof(header));
+		}
+
+		pack::Entry* Entry(const char* name)
+		{
+			const uint64_t hash = pack::HashName(name);
+			for (size_t i = 0; i < entries.size(); ++i)
+			{
+				if (entries[i].nameHash == hash)
+				{
+					const pack::Header* header = reinterpret_cast<const pack::Header*>(bytes.data());
+					return reinterpret_cast<pack::Entry*>(bytes.data() + header->tocOffset) + i;
+				}
+			}
+			return nullptr;
+		}
+
+		std::vector<Block> Aligned() const
+		{
+			std::vector<Block> copy((bytes.size() + sizeof(Block) - 1) / sizeof(Block));
+			std::memcpy(copy.data(), bytes.data(), bytes.size());
+			return copy;
+		}
+
+	private:
+		uint32_t Name(const std::string& name)
+		{
+			const uint32_t offset = uint32_t(strings.size());
+			strings += name;
+			strings.push_back('\0');
+			return offset;
+		}
+
+		uint64_t Align()
+		{
+			bytes.resize(level::AlignUp(uint32_t(bytes.size()), pack::Alignment));
+			return bytes.size();
+		}
+
+		void Append(const void* data, size_t size)
+		{
+			const uint8_t* first = static_cast<const uint8_t*>(data);
+			bytes.insert(bytes.end(), first, first + size);
+		}
+
+		pack::Entry& Add(const char* name, const std::vector<uint8_t>& stored, uint32_t flags)
+		{
+			pack::Entry entry;
+			entry.nameHash = pack::HashName(name);
+			entry.name = Name(name);
+			entry.flags = flags;
+			entry.offset = Align();
+			entry.size = stored.size();
+			entry.storedSize = stored.size();
+			entry.hash = level::Hash64(stored.data(), stored.size());
+			Append(stored.data(), stored.size());
+			entries.push_back(entry);
+			return entries.back();
+		}
+	};
+
+	void TestRead()
+	{
+		pack_file file;
+		std::vector<Block> aligned = file.Aligned();
+		pack::Index index;
+		CHECK(index.Bind(aligned.data(), file.bytes.size()));
+		CHECK(index.GetCount() == 3);
+		CHECK(index.Find("Textures/T_Missing.tga") == nullptr);
+
+		const pack::Entry* loose = index.Find("Textures/T_Wall.tga");
+		const pack::Entry* alias = index.Find("Textures/T_Copy.tga");
+		CHECK(loose && alias && loose->offset == alias->offset);
+		CHECK(std::string(index.GetName(*alias)) == "Textures/T_Copy.tga");
+		CHECK(!index.IsCompressed(*loose));
+		CHECK(index.Verify(*loose));
+		CHECK(index.GetData(*loose)[7] == 49);
+
+		const pack::Entry* compressed = index.Find("LightMaps/LM_0.tga");
+		CHECK(compressed && index.IsCompressed(*compressed));
+		CHECK(index.GetBlockCount(*compressed) == 3);
+		CHECK(index.GetBlockSize(*compressed, 2) == 100);
+		std::vector<uint8_t> blob;
+		for (uint32_t block = 0; block < index.GetBlockCount(*compressed); ++block)
+		{
+			uint32_t storedSize = 0;
+			const uint8_t* stored = index.GetBlock(*compressed, block, storedSize);
+			CHECK(storedSize == index.GetBlockSize(*compressed, block));
+			blob.insert(blob.end(), stored, stored + storedSize);
+		}
+		CHECK(level::Hash64(blob.data(), blob.size()) == compressed->hash);
+	}
+
+	// Bind() rejects every block table that would let GetBlock read outside
+	// its entry.
+	void TestReject()
+	{
+		pack::Index index;
+		{
+			pack_file file;
+			pack::Header* header = reinterpret_cast<pack::Header*>(file.bytes.data());
+			header->magic = 0;
+			CHECK(!index.Bind(file.Aligned().data(), file.bytes.size()));
+		}
+		{
+			pack_file file;
+			CHECK(!index.Bind(file.Aligned().data(), file.bytes.size() - 1));
+		}
+		{
+			pack_file file;
+			file.Entry("Textures/T_Wall.tga")->storedSize -= 1;
+			CHECK(!index.Bind(file.Aligned().data(), file.bytes.size()));
+		}
+
+		const uint32_t tables[][3] = {
+			// decreasing
+			{ pack::BlockSize, pack::BlockSize - 1, pack::BlockSize * 2 + 100 },
+			// a block larger than its uncompressed size
+			{ pack::BlockSize + 1, pack::BlockSize * 2, pack::BlockSize * 2 + 100 },
+			// past the stored bytes
+			{ pack::BlockSize, pack::BlockSize * 2, pack::BlockSize * 2 + 101 },
+		};
+		for (const auto& table : tables)
+		{
+			pack_file file;
+			pack::Entry* entry = file.Entry("LightMaps/LM_0.tga");
+			std::memcpy(file.bytes.data() + entry->offset, table, sizeof(table));
+			CHECK(!index.Bind(file.Aligned().data(), file.bytes.size()));
+		}
+		{
+			// Too short to hold its own block table.
+			pack_file file;
+			file.Entry("LightMaps/LM_0.tga")->storedSize = 8;
+			CHECK(!index.Bind(file.Aligned().data(), file.bytes.size()));
+		}
+		{
+			// More blocks than a uint32_t counts.
+			pack_file file;
+			file.Entry("LightMaps/LM_0.tga")->size = uint64_t(pack::BlockSize) << 33;
+			CHECK(!index.Bind(file.Aligned().data(), file.bytes.size()));
+		}
+	}
+}
+
+int main()
+{
+	TestRead();
+	TestReject();
+	std::printf("pack_test passed\n");
+	return 0;
+}
@@ -0,0 +1,33 @@
+#include <random>
+#include <vector>
+#include "check.h"
+#include "rgbm_reference.h"
+
+// Texels per second encoded by each path the CPU supports, on the faces of a
+// 256 cubemap, against the per-texel engine function.
+int main()
+{
+	const size_t count = 256 * 256 * 6;
+	std::vector<uint16_t> halves(count * 4);
+	std::mt19937 random(1);
+	std::uniform_int_distribution<int> range(0x0000, 0x5bff);
+	for (uint16_t& half : halves)
+	{
+		half = uint16_t(range(random));
+	}
+	std::vector<uint8_t> out(count * 4);
+
+	const char* const names[] = { "scalar", "SSE4.1", "AVX2" };
+	for (rgbm::Path path : { rgbm::Path::Scalar, rgbm::Path::SSE4, rgbm::Path::AVX2 })
+	{
+		if (int(path) > int(rgbm::GetBestPath()))
+		{
+			continue;
+		}
+		const double seconds = test::BestOf(10, [&]() { rgbm::EncodeSpan(halves.data(), out.data(), count, path); });
+		std::printf("%-22s %8.1f M texels/s\n", names[int(path)], count / seconds / 1e6);
+	}
+	const double seconds = test::BestOf(5, [&]() { test::RgbmReferenceSpan(halves.data(), out.data(), count); });
+	std::printf("%-22s %8.1f M texels/s\n", "RGBMEncode per texel", count / seconds / 1e6);
+	return 0;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cmath>
+#include "RgbmEncode.h"
+
+// The engine's RGBMEncode transcribed line by line, with FLinearColor as four
+// floats and FMath::RoundToInt / CeilToInt as the generic platform defines
+// them. rgbm::EncodeSpan has to give the same bytes on every path.
+namespace test {
+	inline void RgbmReference(float r, float g, float b, uint8_t* out)
+	{
+		struct
+		{
+			float R, G, B, A;
+		} color = { r, g, b, 0.0f };
+
+		color.R = std::sqrt(color.R);
+		color.G = std::sqrt(color.G);
+		color.B = std::sqrt(color.B);
+
+		const float inverse = 1.0f / 16.0f;
+		color.R *= inverse;
+		color.G *= inverse;
+		color.B *= inverse;
+
+		auto Max = [](float a, float b) { return a >= b ? a : b; };
+		float maxValue = Max(Max(color.R, color.G), Max(color.B, 0.00001f));
+		if (maxValue > 0.75f)
+		{
+			float tonemapped = (maxValue - 0.75 * 0.75) / (maxValue - 0.5);
+			const float scale = tonemapped / maxValue;
+			color.R *= scale;
+			color.G *= scale;
+			color.B *= scale;
+			maxValue = tonemapped;
+		}
+
+		auto RoundToInt = [](float value) { return rgbm::detail::TruncateToInt(std::floor(value + 0.5f)); };
+		auto CeilToInt = [](float value) { return rgbm::detail::TruncateToInt(std::ceil(value)); };
+		const int32_t alpha = CeilToInt(maxValue * 255.0f);
+		const uint8_t a = uint8_t(alpha < 255 ? alpha : 255);
+		out[3] = a;
+		out[2] = uint8_t(RoundToInt((color.R * 255.0f / a) * 255.0f));
+		out[1] = uint8_t(RoundToInt((color.G * 255.0f / a) * 255.0f));
+		out[0] = uint8_t(RoundToInt((color.B * 255.0f / a) * 255.0f));
+	}
+
+	inline void RgbmReferenceSpan(const uint16_t* halves, uint8_t* out, size_t count)
+	{
+		for (size_t i = 0; i < count; ++i, halves += 4, out += 4)
+		{
+			RgbmReference(rgbm::detail::HalfToFloat(halves[0]), rgbm::detail::HalfToFloat(halves[1]), rgbm::detail::HalfToFloat(halves[2]), out);
+		}
+	}
+}
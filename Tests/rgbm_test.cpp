@@ -0,0 +1,80 @@
+#include <cstring>
+#include <random>
+#include <vector>
+#include "check.h"
+#include "rgbm_reference.h"
+
+namespace {
+	const char* const PathNames[] = { "scalar", "SSE4.1", "AVX2" };
+
+	// Every half value in every channel, with random halves in the others,
+	// then random texels in the range probes actually hold.
+	std::vector<uint16_t> MakeTexels()
+	{
+		std::vector<uint16_t> halves;
+		std::mt19937 random(1);
+		for (uint32_t value = 0; value < 65536; ++value)
+		{
+			for (int channel = 0; channel < 3; ++channel)
+			{
+				uint16_t texel[4] = { uint16_t(random()), uint16_t(random()), uint16_t(random()), 0 };
+				texel[channel] = uint16_t(value);
+				halves.insert(halves.end(), texel, texel + 4);
+			}
+		}
+		std::uniform_int_distribution<int> range(0x0000, 0x5bff);
+		for (int i = 0; i < 1000000; ++i)
+		{
+			for (int channel = 0; channel < 3; ++channel)
+			{
+				halves.push_back(uint16_t(range(random)));
+			}
+			halves.push_back(0x3c00);
+		}
+		return halves;
+	}
+}
+
+int main()
+{
+	const std::vector<uint16_t> halves = MakeTexels();
+	const size_t count = halves.size() / 4;
+	std::vector<uint8_t> expected(count * 4);
+	test::RgbmReferenceSpan(halves.data(), expected.data(), count);
+
+	// Paths the CPU lacks are skipped; the vector paths also run on odd
+	// counts so their scalar tails are covered.
+	const rgbm::Path best = rgbm::GetBestPath();
+	for (rgbm::Path path : { rgbm::Path::Scalar, rgbm::Path::SSE4, rgbm::Path::AVX2 })
+	{
+		if (int(path) > int(best))
+		{
+			std::printf("%s path not supported here, skipped\n", PathNames[int(path)]);
+			continue;
+		}
+		std::vector<uint8_t> encoded(count * 4);
+		rgbm::EncodeSpan(halves.data(), encoded.data(), count, path);
+		size_t mismatches = 0;
+		for (size_t i = 0; i < count; ++i)
+		{
+			if (std::memcmp(&encoded[i * 4], &expected[i * 4], 4) != 0 && mismatches++ < 3)
+			{
+				std::fprintf(stderr, "%s: texel %zu (%04x %04x %04x) is %u %u %u %u, expected %u %u %u %u\n", PathNames[int(path)], i,
+					halves[i * 4], halves[i * 4 + 1], halves[i * 4 + 2], encoded[i * 4], encoded[i * 4 + 1], encoded[i * 4 + 2], encoded[i * 4 + 3],
+					expected[i * 4], expected[i * 4 + 1], expected[i * 4 + 2], expected[i * 4 + 3]);
+			}
+		}
+		CHECK(mismatches == 0);
+
+		for (size_t tail = 1; tail < 16; ++tail)
+		{
+			std::vector<uint8_t> shortSpan(tail * 4 + 4, 0xcd);
+			rgbm::EncodeSpan(halves.data(), shortSpan.data(), tail, path);
+			CHECK(std::memcmp(shortSpan.data(), expected.data(), tail * 4) == 0);
+			CHECK(shortSpan[tail * 4] == 0xcd);
+		}
+		std::printf("%s: %zu texels match\n", PathNames[int(path)], count);
+	}
+	std::printf("rgbm_test passed\n");
+	return 0;
+}
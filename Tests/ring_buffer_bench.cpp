@@ -0,0 +1,92 @@
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "check.h"
+#include "ring_buffer.h"
+
+// Values per second through each queue with the same number of producer and
+// consumer threads. The mutex-guarded deque is what the queues replaced.
+namespace {
+	class locked_deque
+	{
+	public:
+		void push_blocking(uint64_t value)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			values.push_back(value);
+		}
+
+		bool try_pop(uint64_t& value)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (values.empty()) return false;
+			value = values.front();
+			values.pop_front();
+			return true;
+		}
+
+	private:
+		std::mutex mutex;
+		std::deque<uint64_t> values;
+	};
+
+	template <class Queue>
+	double Run(int threads, uint64_t perProducer)
+	{
+		std::unique_ptr<Queue> queue(new Queue());
+		const uint64_t total = threads * perProducer;
+		const double seconds = test::BestOf(3, [&]()
+		{
+			std::atomic<uint64_t> popped(0);
+			std::vector<std::thread> workers;
+			for (int p = 0; p < threads; ++p)
+			{
+				workers.emplace_back([&queue, perProducer]()
+				{
+					for (uint64_t i = 0; i < perProducer; ++i)
+					{
+						queue->push_blocking(i);
+					}
+				});
+			}
+			for (int c = 0; c < threads; ++c)
+			{
+				workers.emplace_back([&queue, &popped, total]()
+				{
+					uint64_t value;
+					while (popped.load(std::memory_order_relaxed) < total)
+					{
+						if (queue->try_pop(value))
+						{
+							popped.fetch_add(1, std::memory_order_relaxed);
+						}
+						else
+						{
+							std::this_thread::yield();
+						}
+					}
+				});
+			}
+			for (auto& worker : workers)
+			{
+				worker.join();
+			}
+		});
+		return total / seconds / 1e6;
+	}
+}
+
+int main()
+{
+	const uint64_t perProducer = 1000000;
+	for (int threads : { 1, 2, 4 })
+	{
+		std::printf("%d producer(s), %d consumer(s):\n", threads, threads);
+		std::printf("  ring_buffer       %8.2f M values/s\n", Run<vtd::ring_buffer<uint64_t>>(threads, perProducer));
+		std::printf("  segmented_buffer  %8.2f M values/s\n", Run<vtd::segmented_buffer<uint64_t>>(threads, perProducer));
+		std::printf("  mutex + deque     %8.2f M values/s\n", Run<locked_deque>(threads, perProducer));
+	}
+	return 0;
+}
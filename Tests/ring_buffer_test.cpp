@@ -0,0 +1,167 @@
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "check.h"
+#include "ring_buffer.h"
+
+namespace {
+	// Every value pushed is popped exactly once, by any of the consumers.
+	template <class Queue>
+	void Stress(Queue& queue, int producers, int consumers, uint64_t perProducer)
+	{
+		const uint64_t total = producers * perProducer;
+		std::vector<std::atomic<uint8_t>> seen(total);
+		for (auto& flag : seen)
+		{
+			flag.store(0);
+		}
+		std::atomic<uint64_t> popped(0);
+		std::atomic<uint64_t> sum(0);
+
+		std::vector<std::thread> threads;
+		for (int p = 0; p < producers; ++p)
+		{
+			threads.emplace_back([&queue, p, perProducer]()
+			{
+				for (uint64_t i = 0; i < perProducer; ++i)
+				{
+					queue.push_blocking(p * perProducer + i);
+				}
+			});
+		}
+		for (int c = 0; c < consumers; ++c)
+		{
+			threads.emplace_back([&]()
+			{
+				uint64_t value = 0;
+				uint64_t localSum = 0;
+				while (popped.load(std::memory_order_relaxed) < total)
+				{
+					if (queue.try_pop(value))
+					{
+						CHECK(value < total);
+						CHECK(seen[value].fetch_add(1) == 0);
+						localSum += value;
+						popped.fetch_add(1, std::memory_order_relaxed);
+					}
+					else
+					{
+						std::this_thread::yield();
+					}
+				}
+				sum.fetch_add(localSum);
+			});
+		}
+		for (auto& thread : threads)
+		{
+			thread.join();
+		}
+		CHECK(popped.load() == total);
+		CHECK(sum.load() == total * (total - 1) / 2);
+		uint64_t value = 0;
+		CHECK(!queue.try_pop(value));
+		CHECK(queue.size() == 0);
+	}
+
+	void TestRingBufferBounds()
+	{
+		vtd::ring_buffer<int, 7> queue;
+		CHECK(queue.capacity() == 8);
+		for (int i = 0; i < 8; ++i)
+		{
+			int value = i;
+			CHECK(queue.try_push(value));
+		}
+		int extra = 8;
+		CHECK(!queue.try_push(extra));
+		CHECK(extra == 8);
+		CHECK(queue.size() == 8);
+		for (int i = 0; i < 8; ++i)
+		{
+			int value = -1;
+			CHECK(queue.try_pop(value));
+			CHECK(value == i);
+		}
+		int value = -1;
+		CHECK(!queue.try_pop(value));
+	}
+
+	// Counts default constructions, which a segmented_buffer does once per
+	// cell of every segment it allocates.
+	struct Counted
+	{
+		static std::atomic<uint64_t> constructed;
+
+		Counted()
+		{
+			constructed.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		Counted(int value)
+			: value(value)
+		{
+		}
+
+		int value = 0;
+	};
+
+	std::atomic<uint64_t> Counted::constructed(0);
+
+	void TestSegmentedBufferOrder()
+	{
+		vtd::segmented_buffer<int, 15> queue;
+		for (int i = 0; i < 1000; ++i)
+		{
+			queue.push(i);
+		}
+		CHECK(queue.size() == 1000);
+		for (int i = 0; i < 1000; ++i)
+		{
+			int value = -1;
+			CHECK(queue.try_pop(value));
+			CHECK(value == i);
+		}
+		int value = -1;
+		CHECK(!queue.try_pop(value));
+	}
+
+	// Consumed segments are recycled, so a queue that never holds more than
+	// one segment's worth of values stops allocating.
+	void TestSegmentedBufferReuse()
+	{
+		vtd::segmented_buffer<Counted, 15> queue;
+		Counted value;
+		for (int i = 0; i < 64; ++i)
+		{
+			queue.push(Counted(i));
+			CHECK(queue.try_pop(value));
+		}
+		const uint64_t before = Counted::constructed.load();
+		for (int i = 0; i < 1000000; ++i)
+		{
+			queue.push(Counted(i));
+			CHECK(queue.try_pop(value));
+			CHECK(value.value == i);
+		}
+		CHECK(Counted::constructed.load() == before);
+	}
+}
+
+int main()
+{
+	TestRingBufferBounds();
+	TestSegmentedBufferOrder();
+	TestSegmentedBufferReuse();
+	{
+		// Small enough that producers keep running into a full queue.
+		std::unique_ptr<vtd::ring_buffer<uint64_t, 63>> queue(new vtd::ring_buffer<uint64_t, 63>());
+		Stress(*queue, 3, 3, 200000);
+	}
+	{
+		std::unique_ptr<vtd::segmented_buffer<uint64_t, 63>> queue(new vtd::segmented_buffer<uint64_t, 63>());
+		Stress(*queue, 3, 3, 200000);
+	}
+	std::printf("ring_buffer_test passed\n");
+	return 0;
+}
@@ -0,0 +1,64 @@
+#include <functional>
+#include <memory>
+#include "check.h"
+#include "ring_buffer.h"
+#include "task.h"
+
+// Tasks per second pushed, popped and run through a ring_buffer on one
+// thread: heap-allocated std::function, as the queues used to hold, against
+// vtd::task with a capture that fits inline and one that needs a pooled block.
+namespace {
+	const int Batch = 1024;
+	const int Rounds = 2000;
+
+	struct Payload
+	{
+		uint64_t values[vtd::task::inline_size / sizeof(uint64_t) + 2];
+	};
+
+	template <class Queue, class Make, class Run>
+	double Measure(Queue& queue, Make make, Run run)
+	{
+		const double seconds = test::BestOf(5, [&]()
+		{
+			for (int round = 0; round < Rounds; ++round)
+			{
+				for (int i = 0; i < Batch; ++i)
+				{
+					queue.push(make(i));
+				}
+				typename Queue::value_type value;
+				while (queue.try_pop(value))
+				{
+					run(value);
+				}
+			}
+		});
+		return double(Batch) * Rounds / seconds / 1e6;
+	}
+}
+
+int main()
+{
+	uint64_t sink = 0;
+
+	std::unique_ptr<vtd::ring_buffer<std::function<void()>*>> functions(new vtd::ring_buffer<std::function<void()>*>());
+	const double function = Measure(*functions,
+		[&sink](int i) { return new std::function<void()>([&sink, i]() { sink += i; }); },
+		[](std::function<void()>* func) { (*func)(); delete func; });
+
+	std::unique_ptr<vtd::ring_buffer<vtd::task>> tasks(new vtd::ring_buffer<vtd::task>());
+	const double inlined = Measure(*tasks,
+		[&sink](int i) { return vtd::task([&sink, i]() { sink += i; }); },
+		[](vtd::task& work) { work(); work.reset(); });
+
+	Payload payload = {};
+	const double pooled = Measure(*tasks,
+		[&sink, payload](int i) { return vtd::task([&sink, payload, i]() { sink += payload.values[0] + i; }); },
+		[](vtd::task& work) { work(); work.reset(); });
+
+	std::printf("std::function*     %8.2f M tasks/s\n", function);
+	std::printf("vtd::task inline   %8.2f M tasks/s\n", inlined);
+	std::printf("vtd::task pooled   %8.2f M tasks/s\n", pooled);
+	return sink == 0 ? 1 : 0;
+}
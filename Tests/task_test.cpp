@@ -0,0 +1,278 @@
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "check.h"
+#include "ring_buffer.h"
+#include "task.h"
+#include "task_graph.h"
+#include "task_pool.h"
+
+namespace {
+	// Counts live copies, so the tests can see that a task destroys what it
+	// captured exactly once.
+	struct Tracked
+	{
+		static int live;
+
+		Tracked() { ++live; }
+		Tracked(const Tracked&) { ++live; }
+		Tracked(Tracked&&) noexcept { ++live; }
+		~Tracked() { --live; }
+	};
+
+	int Tracked::live = 0;
+
+	void TestTask()
+	{
+		int calls = 0;
+		{
+			Tracked tracked;
+			vtd::task small([&calls, tracked]() { ++calls; });
+			CHECK(bool(small));
+			CHECK(Tracked::live == 2);
+			vtd::task moved(std::move(small));
+			CHECK(!small);
+			moved();
+			CHECK(calls == 1);
+			moved.reset();
+			CHECK(!moved);
+			CHECK(Tracked::live == 1);
+		}
+		CHECK(Tracked::live == 0);
+
+		// Larger than the inline storage, so it lives in a pooled block.
+		{
+			char payload[vtd::task::inline_size * 2] = { 7 };
+			Tracked tracked;
+			vtd::task large([&calls, payload, tracked]() { calls += payload[0]; });
+			vtd::task assigned;
+			assigned = std::move(large);
+			CHECK(!large);
+			assigned();
+			CHECK(calls == 8);
+		}
+		CHECK(Tracked::live == 0);
+
+		// Tasks travel through the queues by value.
+		{
+			std::unique_ptr<vtd::ring_buffer<vtd::task, 15>> queue(new vtd::ring_buffer<vtd::task, 15>());
+			for (int i = 0; i < 10; ++i)
+			{
+				queue->push(vtd::task([&calls]() { ++calls; }));
+			}
+			vtd::task next;
+			while (queue->try_pop(next))
+			{
+				next();
+			}
+			CHECK(calls == 18);
+		}
+	}
+
+	void TestTaskPool()
+	{
+		vtd::task_pool pool(3);
+		CHECK(pool.worker_count() == 3);
+
+		std::atomic<int> sum(0);
+		pool.parallel_for(1000, [&sum](size_t i) { sum.fetch_add(int(i)); });
+		CHECK(sum.load() == 999 * 1000 / 2);
+
+		// Waiting from inside a task helps with the queued work instead of
+		// blocking a worker.
+		std::atomic<int> inner(0);
+		vtd::task_group outer;
+		for (int i = 0; i < 8; ++i)
+		{
+			pool.submit(outer, vtd::task([&pool, &inner]()
+			{
+				vtd::task_group group;
+				for (int j = 0; j < 50; ++j)
+				{
+					pool.submit(group, vtd::task([&inner]() { inner.fetch_add(1); }));
+				}
+				pool.wait(group);
+			}));
+		}
+		pool.wait(outer);
+		CHECK(inner.load() == 400);
+
+		// More tasks than the worker rings hold; the overflow runs on the
+		// submitting thread.
+		std::atomic<int> flood(0);
+		vtd::task_group group;
+		for (int i = 0; i < VTD_WORKER_QUEUE_SIZE * 8; ++i)
+		{
+			pool.submit(group, vtd::task([&flood]() { flood.fetch_add(1); }));
+		}
+		pool.wait(group);
+		CHECK(flood.load() == VTD_WORKER_QUEUE_SIZE * 8);
+	}
+
+	// With one worker, a task waiting for a condition only a queued task meets
+	// finishes because the wait runs that task.
+	void TestTaskPoolWaitUntil()
+	{
+		vtd::task_pool pool(1);
+		std::atomic<bool> ready(false);
+		vtd::task_group group;
+		pool.submit(group, vtd::task([&pool, &ready]()
+		{
+			pool.submit(vtd::task([&ready]() { ready.store(true); }));
+			pool.wait_until([&ready]() { return ready.load(); });
+		}));
+		pool.wait(group);
+		CHECK(ready.load());
+	}
+
+	// join() runs what is still queued, including tasks submitted by tasks.
+	void TestTaskPoolJoin()
+	{
+		std::atomic<int> ran(0);
+		vtd::task_pool pool(2);
+		for (int i = 0; i < 100; ++i)
+		{
+			pool.submit(vtd::task([&pool, &ran]()
+			{
+				ran.fetch_add(1);
+				pool.submit(vtd::task([&ran]() { ran.fetch_add(1); }));
+			}));
+		}
+		pool.join();
+		CHECK(ran.load() == 200);
+	}
+
+	enum
+	{
+		LANE_MAIN,
+		LANE_WORKERS,
+	};
+
+	// Main lane nodes queue up for the thread that calls Pump(), like the
+	// exporter's game thread lane; worker lane nodes go to the pool.
+	class executor : public vtd::task_executor
+	{
+	public:
+		explicit executor(vtd::task_pool& pool)
+			: pool(pool)
+		{
+		}
+
+		void execute(int lane, vtd::task&& work) override
+		{
+			if (lane == LANE_WORKERS)
+			{
+				pool.submit(std::move(work));
+			}
+			else
+			{
+				main.push(std::move(work));
+			}
+		}
+
+		bool RunOne()
+		{
+			vtd::task work;
+			if (!main.try_pop(work)) return false;
+			work();
+			return true;
+		}
+
+		void Pump(const vtd::task_graph& graph)
+		{
+			while (!graph.done())
+			{
+				if (!RunOne())
+				{
+					std::this_thread::yield();
+				}
+			}
+		}
+
+	private:
+		vtd::task_pool& pool;
+		vtd::segmented_buffer<vtd::task, 63> main;
+	};
+
+	void TestTaskGraph()
+	{
+		vtd::task_pool pool(2);
+		executor lanes(pool);
+		vtd::task_graph graph;
+
+		// a -> b, c -> d, with b and c on the workers.
+		std::atomic<int> order(0);
+		int a = -1;
+		int d = -1;
+		std::atomic<int> b(-1);
+		std::atomic<int> c(-1);
+		vtd::task_graph::node_id nodeA = graph.add(vtd::task([&]() { a = order.fetch_add(1); }), LANE_MAIN);
+		vtd::task_graph::node_id nodeB = graph.add(vtd::task([&]() { b = order.fetch_add(1); }), LANE_WORKERS);
+		vtd::task_graph::node_id nodeC = graph.add(vtd::task([&]() { c = order.fetch_add(1); }), LANE_WORKERS);
+		vtd::task_graph::node_id nodeD = graph.add(vtd::task([&]() { d = order.fetch_add(1); }), LANE_MAIN);
+		graph.depend(nodeB, nodeA);
+		graph.depend(nodeC, nodeA);
+		graph.depend(nodeD, nodeB);
+		graph.depend(nodeD, nodeC);
+
+		// A node that yields is run again later, with its own cursor.
+		int slices = 0;
+		graph.add(vtd::task([&slices]()
+		{
+			if (++slices < 5)
+			{
+				vtd::task_graph::yield();
+			}
+		}), LANE_MAIN);
+
+		bool finished = false;
+		graph.launch(lanes, vtd::task([&finished]() { finished = true; }));
+		lanes.Pump(graph);
+		pool.join();
+		CHECK(finished);
+		CHECK(a == 0);
+		CHECK(b.load() >= 1 && b.load() <= 2);
+		CHECK(c.load() >= 1 && c.load() <= 2);
+		CHECK(d == 3);
+		CHECK(slices == 5);
+	}
+
+	// A node that yields and then runs another node on the same thread, the
+	// way a node waiting on the pool does, still gets run again.
+	void TestNestedYield()
+	{
+		vtd::task_pool pool(1);
+		executor lanes(pool);
+		vtd::task_graph graph;
+		int runs = 0;
+		bool other = false;
+		graph.add(vtd::task([&]()
+		{
+			if (++runs == 1)
+			{
+				vtd::task_graph::yield();
+				while (!other && lanes.RunOne())
+				{
+				}
+			}
+		}), LANE_MAIN);
+		graph.add(vtd::task([&other]() { other = true; }), LANE_MAIN);
+		graph.launch(lanes, vtd::task());
+		lanes.Pump(graph);
+		pool.join();
+		CHECK(other);
+		CHECK(runs == 2);
+	}
+}
+
+int main()
+{
+	TestTask();
+	TestTaskPool();
+	TestTaskPoolWaitUntil();
+	TestTaskPoolJoin();
+	TestTaskGraph();
+	TestNestedYield();
+	std::printf("task_test passed\n");
+	return 0;
+}